@@ -32,7 +32,11 @@ void benchmark_mm::setup(int64_t block_size, int64_t length) {
 }
 
 void benchmark_mm::proc() {
+    scheduler.reset_operand_reads();
     scheduler.sgemm(scylla_blas::NoTrans, scylla_blas::NoTrans, 1.0, *left_matrix, *right_matrix, 0.0, *result_matrix);
+
+    auto reads = scheduler.get_operand_reads();
+    LogInfo("\tWorkers read {} blocks of the operands, {} bytes", reads.blocks, reads.bytes);
 }
 
 void benchmark_mm::teardown() {
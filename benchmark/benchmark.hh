@@ -61,7 +61,10 @@ protected:
     scylla_blas::routine_scheduler scheduler;
     double matrix_load;
 public:
-    explicit base_benchmark(const std::shared_ptr<scmd::session> &session) : session(session), scheduler(session) {}
+    /* Benchmarks measure the workers, even on small sizes */
+    explicit base_benchmark(const std::shared_ptr<scmd::session> &session) : session(session), scheduler(session) {
+        scheduler.set_local_execution_threshold(0);
+    }
     virtual void init() = 0;
     virtual void setup(int64_t block_size, int64_t length) = 0;
     virtual void proc() = 0;
@@ -42,19 +42,37 @@ void jacobi_solver::build_matrices() {
 
 /* We use a simple convergence rule and check whether ||b - Ax||_inf < threshold.
  * A more sophisticated stopping rule might be better for practical applications */
-bool jacobi_solver::check_convergence(scylla_blas::vector<double> &x, scylla_blas::vector<double> &b, double threshold) {
-    _scheduler->dcopy(b, *_aux_vector);
-    _scheduler->dgemv(scylla_blas::NoTrans, -1, *_mat_A, x, 1, *_aux_vector);
+bool jacobi_solver::check_convergence(double threshold) {
+    for (auto &future : _scheduler->run_graph(*_residual_graph)) {
+        future.wait();
+    }
     scylla_blas::index_t id_max = _scheduler->idamax(*_aux_vector);
     double val = _aux_vector->get_value(id_max);
     std::cerr << "Error of current solution: " << val << std::endl;
     return std::abs(val) < threshold;
 }
 
-void jacobi_solver::jacobi_iteration(scylla_blas::vector<double> &x, scylla_blas::vector<double> &b) {
-    _scheduler->dcopy(b, *_aux_vector);
-    _scheduler->dgemv(scylla_blas::NoTrans, -1, *_mat_L_plus_U, x, 1, *_aux_vector);
-    _scheduler->dgemv(scylla_blas::NoTrans, 1, *_mat_D_inverted, *_aux_vector, 0, x);
+/* The routines of an iteration and of the convergence check are the same every time,
+ * so they are recorded once per solve, and only started again by each iteration.
+ * Segments of aux are copied from b and then updated by the same subtasks downstream,
+ * the last product of an iteration waits for the whole of aux. */
+void jacobi_solver::plan_routines(scylla_blas::vector<double> &x, scylla_blas::vector<double> &b) {
+    _iteration_graph = _scheduler->record_graph([&] {
+        _scheduler->dcopy_async(b, *_aux_vector);
+        _scheduler->dgemv_async(scylla_blas::NoTrans, -1, *_mat_L_plus_U, x, 1, *_aux_vector);
+        _scheduler->dgemv_async(scylla_blas::NoTrans, 1, *_mat_D_inverted, *_aux_vector, 0, x);
+    });
+
+    _residual_graph = _scheduler->record_graph([&] {
+        _scheduler->dcopy_async(b, *_aux_vector);
+        _scheduler->dgemv_async(scylla_blas::NoTrans, -1, *_mat_A, x, 1, *_aux_vector);
+    });
+}
+
+void jacobi_solver::jacobi_iteration() {
+    for (auto &future : _scheduler->run_graph(*_iteration_graph)) {
+        future.wait();
+    }
 }
 
 jacobi_solver::jacobi_solver(const std::shared_ptr<scmd::session> &session, scylla_blas::matrix<double> &A, scylla_blas::index_t initial_id) :
@@ -89,10 +107,12 @@ void jacobi_solver::solve(scylla_blas::vector<double> &x, scylla_blas::vector<do
                                              b.get_id(), b.get_length()));
     }
 
+    plan_routines(x, b);
+
     for (size_t i = 1; i <= num_of_iterations; i++) {
         std::cerr << std::endl << "Begin iteration " << i << std::endl;
-        jacobi_iteration(x, b);
-        if (check_convergence(x, b, threshold)) {
+        jacobi_iteration();
+        if (check_convergence(threshold)) {
             return;
         }
     }
@@ -22,12 +22,15 @@ private:
     std::shared_ptr<scylla_blas::matrix<double>> _mat_L_plus_U;
     std::shared_ptr<scylla_blas::vector<double>> _aux_vector;
     scylla_blas::index_t _dimensions;
+    std::unique_ptr<scylla_blas::routine_scheduler::task_graph> _iteration_graph;
+    std::unique_ptr<scylla_blas::routine_scheduler::task_graph> _residual_graph;
 
     void init_auxiliaries(scylla_blas::index_t initial_id);
     void build_matrices();
 
-    bool check_convergence(scylla_blas::vector<double> &x, scylla_blas::vector<double> &b, double threshold);
-    void jacobi_iteration(scylla_blas::vector<double> &x, scylla_blas::vector<double> &b);
+    void plan_routines(scylla_blas::vector<double> &x, scylla_blas::vector<double> &b);
+    bool check_convergence(double threshold);
+    void jacobi_iteration();
 
 public:
     /* Initializes solver used for solving systems of linear equations with matrix A.
@@ -5,14 +5,79 @@
 constexpr scylla_blas::index_t DEFAULT_BLOCK_SIZE = (1 << 2);
 constexpr int64_t DEFAULT_WORKER_COUNT = 4;
 constexpr int64_t DEFAULT_SCHEDULER_SLEEP_TIME_MICROSECONDS = 20000;
+constexpr int64_t DEFAULT_SCHEDULER_MIN_SLEEP_TIME_MICROSECONDS = 50;
+constexpr bool DEFAULT_WORK_STEALING = false;
+constexpr bool DEFAULT_RANGE_SCHEDULING = true;
+constexpr bool DEFAULT_COST_BASED_ASSIGNMENT = true;
+constexpr int64_t DEFAULT_LOCAL_EXECUTION_THRESHOLD = (1 << 16);
+constexpr bool DEFAULT_SPECULATIVE_SWEEPS = true;
+constexpr int64_t DEFAULT_CONVERGENCE_CHECK_INTERVAL = 1;
 
 constexpr int64_t DEFAULT_WORKER_SLEEP_TIME_MICROSECONDS = 20000;
+constexpr int64_t DEFAULT_WORKER_THREADS = 1;
+constexpr int64_t DEFAULT_LOCAL_WORKER_SLEEP_TIME_MICROSECONDS = 100;
 constexpr int64_t DEFAULT_MAX_WORKER_RETRIES = 5;
+constexpr int64_t DEFAULT_SUBTASK_BATCH_SIZE = 4;
+constexpr int64_t DEFAULT_SUBTASK_PREFETCH_DEPTH = 2;
+constexpr int64_t DEFAULT_OPERAND_CACHE_BYTES = (1 << 28);
+constexpr int64_t DEFAULT_READ_WINDOW = 32;
+constexpr bool DEFAULT_SPECULATIVE_EXECUTION = false;
+constexpr int64_t DEFAULT_TASK_LEASE_TIME_MICROSECONDS = 5000000;
+constexpr int64_t DEFAULT_QUEUE_METRICS_INTERVAL_MICROSECONDS = 0;
+
+constexpr int64_t DEFAULT_SUPERVISOR_MIN_WORKERS = 1;
+constexpr int64_t DEFAULT_SUPERVISOR_MAX_WORKERS = 8;
+constexpr int64_t DEFAULT_SUPERVISOR_INTERVAL_MICROSECONDS = 1000000;
+constexpr int64_t DEFAULT_SUPERVISOR_IDLE_INTERVALS = 10;
+/* The supervisor starts another worker while more subtasks than this per live worker wait in subtask queues */
+constexpr int64_t SUPERVISOR_SUBTASKS_PER_WORKER = 32;
 
 constexpr uint16_t SCYLLA_DEFAULT_PORT = 9042;
 constexpr id_t HELPER_FLOAT_VECTOR_ID = 0;
 constexpr id_t HELPER_DOUBLE_VECTOR_ID = 1;
 constexpr id_t DEFAULT_WORKER_QUEUE_ID = 0;
+constexpr int64_t DEFAULT_WORKER_QUEUE_BUCKET_COUNT = 1;
+/* Workers pick main tasks of the interactive, normal and batch priority classes in this proportion, when all have some */
+constexpr int64_t DEFAULT_INTERACTIVE_WEIGHT = 16;
+constexpr int64_t DEFAULT_NORMAL_WEIGHT = 4;
+constexpr int64_t DEFAULT_BATCH_WEIGHT = 1;
+
+/* Queue tasks are stored in partitions of this many ids, released ones are dropped a partition at a time */
+constexpr int64_t QUEUE_PAGE_SIZE = 1024;
+/* Local (in-process) queues keep at most this many pages of unreleased tasks */
+constexpr int64_t LOCAL_QUEUE_MAX_CHUNKS = 1024;
+/* Queue metrics remember claim times of this many most recent claims, to measure time to finish */
+constexpr int64_t QUEUE_METRICS_TRACKED_CLAIMS = 1024;
+/* A guided claim from a task range takes 1 / (GUIDED_CHUNK_DIVISOR * consumers) of the tasks left in it */
+constexpr int64_t GUIDED_CHUNK_DIVISOR = 2;
+/* ...but no more than this many, so that a worker doesn't hold a large part of the range at once */
+constexpr int64_t GUIDED_MAX_CHUNK = 1024;
+/* Two-dimensional task ranges are enumerated in square tiles of at most this side, see task_range::task_of */
+constexpr int64_t BLOCK_TILE_MAX_SIDE = 8;
+/* A gemm main task keeps this many most recently read block rows of A, and as many block columns of B */
+constexpr int64_t GEMM_CACHED_LINES = 2 * BLOCK_TILE_MAX_SIDE;
+/* Main queues of the schedulers (see queue_backend::list_main_queues) are looked up by workers this often */
+constexpr int64_t MAIN_QUEUE_REFRESH_MICROSECONDS = 1000000;
+/* Workers renew their registration (see queue_backend::count_live_workers) this often... */
+constexpr int64_t WORKER_HEARTBEAT_MICROSECONDS = 1000000;
+/* ...and are not counted as live once they haven't done it for this long */
+constexpr int64_t WORKER_HEARTBEAT_TTL_MICROSECONDS = 5000000;
+/* Schedulers renew the registration of their main queues (see queue_backend::register_main_queue) this often... */
+constexpr int64_t MAIN_QUEUE_HEARTBEAT_MICROSECONDS = 5000000;
+/* ...and workers stop looking at a queue whose scheduler hasn't done it for this long, e.g. because it died */
+constexpr int64_t MAIN_QUEUE_TTL_MICROSECONDS = 30000000;
+/* Schedulers look up the number of live workers, which they split routines between, at most this often */
+constexpr int64_t WORKER_COUNT_REFRESH_MICROSECONDS = 1000000;
+/* Workers check whether the subtasks they perform were cancelled (see task_queue::cancel) before each one,
+ * but no more often than this
+ */
+constexpr int64_t CANCELLATION_CHECK_MICROSECONDS = 100000;
+/* Costs of subtasks are not estimated for routines with more subtasks than this */
+constexpr int64_t COST_MODEL_MAX_SUBTASKS = (1 << 20);
+/* Blocks without a kept non-zero count are counted when costs are estimated, as long as there are at most this many */
+constexpr int64_t COST_MODEL_MAX_COUNTED_BLOCKS = 4096;
+/* Subtasks are assigned by cost only if the heaviest one is worth more than this many average ones */
+constexpr int64_t COST_SKEW_RATIO = 2;
 
 constexpr int64_t MATRIX_MAX_BATCH_SIZE = 512;
 
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <queue>
+#include <vector>
+
+#include "config.hh"
+#include "matrix.hh"
+
+namespace scylla_blas {
+
+/* Estimates of the work of subtasks, based on the non-zero counts of the blocks of the matrices
+ * they read (see basic_matrix::get_block_nnz). Costs are listed in the order
+ * in which the scheduler produces the subtasks: by segment, or by block, row by row. Every
+ * subtask also costs block_size, for the segment or block it writes, so that empty ones are not free.
+ * An empty result means that there is no estimate – all subtasks should be treated alike.
+ */
+
+/* Segments of Y in Y = alpha * op(A) * X + beta * Y: segment i reads block row i of op(A) */
+inline std::vector<int64_t> segment_costs(const basic_matrix &A, TRANSPOSE TransA) {
+    if (A.get_blocks_height(TransA) > COST_MODEL_MAX_SUBTASKS) return {};
+
+    auto costs = A.get_block_row_nnz(TransA);
+    for (auto &cost : costs) {
+        cost += A.get_block_size();
+    }
+    return costs;
+}
+
+/* Blocks of C in C = alpha * op(A) * op(B) + beta * C: block (i, j) reads block row i of op(A)
+ * and block column j of op(B)
+ */
+inline std::vector<int64_t> product_block_costs(const basic_matrix &A, TRANSPOSE TransA,
+                                                const basic_matrix &B, TRANSPOSE TransB) {
+    index_t height = A.get_blocks_height(TransA);
+    index_t width = B.get_blocks_width(TransB);
+    if (height * width > COST_MODEL_MAX_SUBTASKS) return {};
+
+    auto row_nnz = A.get_block_row_nnz(TransA);
+    auto column_nnz = B.get_block_column_nnz(TransB);
+    if (row_nnz.empty() || column_nnz.empty()) return {};
+
+    std::vector<int64_t> costs;
+    costs.reserve(height * width);
+    for (index_t i = 0; i < height; i++) {
+        for (index_t j = 0; j < width; j++) {
+            costs.push_back(row_nnz[i] + column_nnz[j] + A.get_block_size());
+        }
+    }
+    return costs;
+}
+
+/* Blocks of A updated in place, e.g. in A = alpha * X * Y^T + A: block (i, j) reads itself */
+inline std::vector<int64_t> update_block_costs(const basic_matrix &A) {
+    auto costs = A.get_block_nnz();
+    for (auto &cost : costs) {
+        cost += A.get_block_size();
+    }
+    return costs;
+}
+
+/* Whether the heaviest subtask is worth more than COST_SKEW_RATIO average ones */
+inline bool is_skewed(const std::vector<int64_t> &costs) {
+    if (costs.empty()) return false;
+
+    int64_t total = std::accumulate(costs.begin(), costs.end(), int64_t(0));
+    int64_t max = *std::max_element(costs.begin(), costs.end());
+    return max * (int64_t)costs.size() > COST_SKEW_RATIO * total;
+}
+
+/* Indices of the subtasks, heaviest first */
+inline std::vector<size_t> order_by_cost(const std::vector<int64_t> &costs) {
+    std::vector<size_t> order(costs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&costs](size_t a, size_t b) { return costs[a] > costs[b]; });
+    return order;
+}
+
+/* Longest processing time first: subtasks, heaviest first, go to the least loaded of `bins` queues.
+ * The heaviest queue gets at most 4/3 of the optimal load. Returns the queue of each subtask.
+ */
+inline std::vector<size_t> assign_longest_first(const std::vector<int64_t> &costs, size_t bins) {
+    using load = std::pair<int64_t, size_t>;
+    std::priority_queue<load, std::vector<load>, std::greater<>> loads;
+    for (size_t bin = 0; bin < bins; bin++) {
+        loads.emplace(0, bin);
+    }
+
+    std::vector<size_t> assignment(costs.size());
+    for (size_t i : order_by_cost(costs)) {
+        auto [current, bin] = loads.top();
+        loads.pop();
+        assignment[i] = bin;
+        loads.emplace(current + costs[i], bin);
+    }
+    return assignment;
+}
+
+}
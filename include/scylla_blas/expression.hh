@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.hh"
+#include "routines.hh"
+#include "vector.hh"
+
+namespace scylla_blas {
+
+/* Terms of lazy expressions, built with the operators below, e.g. `alpha * A * X + beta * Y`.
+ * They only point to the structures they name, which have to outlive them.
+ */
+template<class T>
+struct lazy_term {
+    T coef;
+    const vector<T> *X;
+};
+
+template<class T>
+struct lazy_matrix {
+    T coef;
+    const matrix<T> *A;
+    TRANSPOSE TransA;
+};
+
+template<class T>
+struct lazy_product {
+    T coef;
+    const matrix<T> *A;
+    TRANSPOSE TransA;
+    const vector<T> *X;
+};
+
+/* A linear combination of vectors, and of at most one matrix-vector product */
+template<class T>
+struct lazy_sum {
+    std::vector<lazy_term<T>> terms;
+    std::optional<lazy_product<T>> product;
+
+    lazy_sum(const lazy_term<T> &term) : terms{ term }, product() {}
+    lazy_sum(const lazy_product<T> &p) : terms(), product(p) {}
+};
+
+template<class T>
+lazy_term<T> operator*(std::type_identity_t<T> coef, const vector<T> &X) { return { coef, &X }; }
+
+template<class T>
+lazy_term<T> operator*(std::type_identity_t<T> coef, const lazy_term<T> &t) { return { coef * t.coef, t.X }; }
+
+template<class T>
+lazy_matrix<T> operator*(std::type_identity_t<T> coef, const matrix<T> &A) { return { coef, &A, NoTrans }; }
+
+template<class T>
+lazy_matrix<T> transposed(const matrix<T> &A) { return { 1, &A, Trans }; }
+
+template<class T>
+lazy_matrix<T> operator*(std::type_identity_t<T> coef, const lazy_matrix<T> &A) { return { coef * A.coef, A.A, A.TransA }; }
+
+template<class T>
+lazy_product<T> operator*(const lazy_matrix<T> &A, const vector<T> &X) { return { A.coef, A.A, A.TransA, &X }; }
+
+template<class T>
+lazy_product<T> operator*(const matrix<T> &A, const vector<T> &X) { return { 1, &A, NoTrans, &X }; }
+
+template<class T>
+lazy_product<T> operator*(std::type_identity_t<T> coef, const lazy_product<T> &p) { return { coef * p.coef, p.A, p.TransA, p.X }; }
+
+template<class T>
+lazy_sum<T> operator+(lazy_sum<T> a, const lazy_sum<T> &b) {
+    if (a.product.has_value() && b.product.has_value()) {
+        throw std::runtime_error("Lazy expressions support at most one matrix-vector product per assignment");
+    }
+    a.terms.insert(a.terms.end(), b.terms.begin(), b.terms.end());
+    if (b.product.has_value()) a.product = b.product;
+    return a;
+}
+
+template<class T>
+lazy_sum<T> operator+(lazy_sum<T> a, const lazy_term<T> &b) { return std::move(a) + lazy_sum<T>(b); }
+
+template<class T>
+lazy_sum<T> operator+(lazy_sum<T> a, const lazy_product<T> &b) { return std::move(a) + lazy_sum<T>(b); }
+
+template<class T>
+lazy_sum<T> operator+(const lazy_term<T> &a, const lazy_term<T> &b) { return lazy_sum<T>(a) + lazy_sum<T>(b); }
+
+template<class T>
+lazy_sum<T> operator+(const lazy_term<T> &a, const lazy_product<T> &b) { return lazy_sum<T>(a) + lazy_sum<T>(b); }
+
+template<class T>
+lazy_sum<T> operator+(const lazy_product<T> &a, const lazy_term<T> &b) { return lazy_sum<T>(a) + lazy_sum<T>(b); }
+
+/* A scalar computed by a lazy expression, known once the expression is evaluated */
+template<class T>
+class lazy_value {
+    template<class U> friend class expression;
+
+    std::shared_ptr<std::optional<T>> _value;
+
+public:
+    lazy_value() : _value(std::make_shared<std::optional<T>>()) {}
+
+    bool ready() const { return _value->has_value(); }
+
+    T get() const {
+        if (!ready()) {
+            throw std::runtime_error("Lazy value read before its expression was evaluated");
+        }
+        return **_value;
+    }
+};
+
+/* Records level 1 and level 2 statements without running them, e.g.
+ *
+ *     expression<double> e(scheduler);
+ *     e.assign(Y, alpha * A * X + beta * Y);
+ *     auto r = e.dot(Y, Z);
+ *     e.evaluate();
+ *     r.get();
+ *
+ * Statements are compiled into as few passes over the vectors as possible: consecutive statements that
+ * go segment by segment are fused into one routine (see routine_scheduler::dfused_vector_async),
+ * and a dot product of a vector just computed by gemv is taken while the result is written
+ * (see routine_scheduler::dgemv_dot_async). Operands shared by fused statements are read once,
+ * and a vector written by several of them – once. Statements that don't fit a pass start the next one.
+ */
+template<class T>
+class expression {
+    static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>);
+
+    struct pass {
+        bool is_gemv = false;
+        int64_t ops = 0;
+        T scale = 1;
+        T alpha = 0;
+        T beta = 0;
+        const matrix<T> *A = nullptr;
+        TRANSPOSE TransA = NoTrans;
+        const vector<T> *X = nullptr;
+        vector<T> *scaled = nullptr; /* X, if the pass writes it */
+        vector<T> *Y = nullptr;
+        const vector<T> *Z = nullptr;
+        std::shared_ptr<std::optional<T>> result;
+    };
+
+    routine_scheduler &_scheduler;
+    std::vector<pass> _passes;
+
+    static bool same(const vector<T> *a, const vector<T> *b) { return a != nullptr && b != nullptr && *a == *b; }
+
+    /* The last pass, if more vector steps may still be fused into it */
+    pass *open_vector_pass() {
+        if (_passes.empty()) return nullptr;
+        pass &last = _passes.back();
+        return (last.is_gemv || (last.ops & proto::FUSED_DOT)) ? nullptr : &last;
+    }
+
+    /* X = s * X */
+    void scale(T s, vector<T> &X) {
+        pass *p = open_vector_pass();
+        if (p != nullptr && p->ops == proto::FUSED_SCALE && same(p->X, &X)) {
+            p->scale *= s;
+        } else if (p != nullptr && (p->ops & proto::FUSED_UPDATE) && same(p->Y, &X)) {
+            p->alpha *= s;
+            p->beta *= s;
+        } else {
+            _passes.push_back({ .ops = proto::FUSED_SCALE, .scale = s, .X = &X, .scaled = &X, .result = nullptr });
+        }
+    }
+
+    /* Y = a * X + b * Y, X is not Y */
+    void update(T a, const vector<T> &X, T b, vector<T> &Y) {
+        pass *p = open_vector_pass();
+        if (p != nullptr && p->ops == proto::FUSED_SCALE && same(p->X, &X)) {
+            p->ops |= proto::FUSED_UPDATE;
+            p->alpha = a;
+            p->beta = b;
+            p->Y = &Y;
+        } else if (p != nullptr && p->ops == proto::FUSED_SCALE && same(p->X, &Y)) {
+            /* Y was only scaled – the scale goes to beta */
+            *p = { .ops = proto::FUSED_UPDATE, .alpha = a, .beta = b * p->scale, .X = &X, .Y = &Y, .result = nullptr };
+        } else {
+            _passes.push_back({ .ops = proto::FUSED_UPDATE, .alpha = a, .beta = b, .X = &X, .Y = &Y, .result = nullptr });
+        }
+    }
+
+    /* Y = a * op(A) * X + b * Y */
+    void multiply(T a, const matrix<T> &A, TRANSPOSE TransA, const vector<T> &X, T b, vector<T> &Y) {
+        if (same(&X, &Y)) {
+            throw std::runtime_error("Unsupported lazy expression: the vector multiplied by a matrix is assigned to");
+        }
+
+        pass *p = open_vector_pass();
+        if (p != nullptr && p->ops == proto::FUSED_SCALE && same(p->X, &Y)) {
+            b *= p->scale;
+            _passes.pop_back();
+        }
+        _passes.push_back({ .is_gemv = true, .alpha = a, .beta = b, .A = &A, .TransA = TransA, .X = &X, .Y = &Y,
+                            .result = nullptr });
+    }
+
+    T run(const pass &p) {
+        if (p.is_gemv) {
+            if (p.Z == nullptr) {
+                if constexpr (std::is_same_v<T, float>) {
+                    _scheduler.sgemv_async(p.TransA, p.alpha, *p.A, *p.X, p.beta, *p.Y).wait();
+                } else {
+                    _scheduler.dgemv_async(p.TransA, p.alpha, *p.A, *p.X, p.beta, *p.Y).wait();
+                }
+                return 0;
+            }
+            if constexpr (std::is_same_v<T, float>) {
+                return _scheduler.sgemv_dot_async(p.TransA, p.alpha, *p.A, *p.X, p.beta, *p.Y, *p.Z).get();
+            } else {
+                return _scheduler.dgemv_dot_async(p.TransA, p.alpha, *p.A, *p.X, p.beta, *p.Y, *p.Z).get();
+            }
+        }
+
+        // X of a pass without FUSED_SCALE is only read.
+        vector<T> &X = p.scaled != nullptr ? *p.scaled : const_cast<vector<T>&>(*p.X);
+        vector<T> &Y = p.Y != nullptr ? *p.Y : X;
+        const vector<T> &Z = p.Z != nullptr ? *p.Z : X;
+        if constexpr (std::is_same_v<T, float>) {
+            return _scheduler.sfused_vector_async(p.ops, p.scale, X, p.alpha, p.beta, Y, Z).get();
+        } else {
+            return _scheduler.dfused_vector_async(p.ops, p.scale, X, p.alpha, p.beta, Y, Z).get();
+        }
+    }
+
+public:
+    explicit expression(routine_scheduler &scheduler) : _scheduler(scheduler), _passes() {}
+
+    expression(const expression &other) = delete;
+    expression& operator=(const expression &other) = delete;
+
+    /* Y = value, where the value may read Y. Vectors named more than once have their coefficients added. */
+    void assign(vector<T> &Y, const lazy_sum<T> &value) {
+        T own = 0;
+        std::vector<lazy_term<T>> others;
+        for (auto &term : value.terms) {
+            if (same(term.X, &Y)) {
+                own += term.coef;
+                continue;
+            }
+            auto it = std::find_if(others.begin(), others.end(), [&term] (auto &t) { return same(t.X, term.X); });
+            if (it != others.end()) {
+                it->coef += term.coef;
+            } else {
+                others.push_back(term);
+            }
+        }
+
+        if (value.product.has_value() && others.empty()) {
+            auto &p = *value.product;
+            multiply(p.coef, *p.A, p.TransA, *p.X, own, Y);
+            return;
+        }
+
+        if (others.empty()) {
+            if (own != 1) scale(own, Y);
+        } else {
+            update(others.front().coef, *others.front().X, own, Y);
+            for (size_t i = 1; i < others.size(); i++) {
+                update(others[i].coef, *others[i].X, 1, Y);
+            }
+        }
+
+        if (value.product.has_value()) {
+            auto &p = *value.product;
+            multiply(p.coef, *p.A, p.TransA, *p.X, 1, Y);
+        }
+    }
+
+    /* Counterparts of the BLAS routines */
+    void scal(T alpha, vector<T> &X) { assign(X, alpha * X); }
+    void copy(const vector<T> &X, vector<T> &Y) { assign(Y, T(1) * X); }
+    void axpy(T alpha, const vector<T> &X, vector<T> &Y) { assign(Y, alpha * X + T(1) * Y); }
+
+    void gemv(TRANSPOSE TransA, T alpha, const matrix<T> &A, const vector<T> &X, T beta, vector<T> &Y) {
+        assign(Y, lazy_sum<T>(lazy_product<T>{ alpha, &A, TransA, &X }) + beta * Y);
+    }
+
+    /* Taken over the vectors as they are after the statements recorded so far */
+    lazy_value<T> dot(const vector<T> &X, const vector<T> &Y) {
+        lazy_value<T> ret;
+
+        if (!_passes.empty() && _passes.back().Z == nullptr && !(_passes.back().ops & proto::FUSED_DOT)) {
+            pass &last = _passes.back();
+            const vector<T> *written = last.is_gemv || (last.ops & proto::FUSED_UPDATE) ? last.Y : last.scaled;
+            const vector<T> *other = same(written, &X) ? &Y : (same(written, &Y) ? &X : nullptr);
+            if (other != nullptr) {
+                if (!last.is_gemv) last.ops |= proto::FUSED_DOT;
+                last.Z = other;
+                last.result = ret._value;
+                return ret;
+            }
+        }
+
+        _passes.push_back({ .ops = proto::FUSED_DOT, .X = &X, .Z = &Y, .result = ret._value });
+        return ret;
+    }
+
+    /* Passes the statements recorded since the last evaluation are compiled to */
+    size_t get_pass_count() const { return _passes.size(); }
+
+    /* Runs the passes one after another, and forgets the statements */
+    void evaluate() {
+        auto passes = std::move(_passes);
+        _passes.clear();
+
+        LogDebug("Evaluating a lazy expression in {} passes", passes.size());
+        for (auto &p : passes) {
+            T result = run(p);
+            if (p.result) *p.result = result;
+        }
+    }
+};
+
+}
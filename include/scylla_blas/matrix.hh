@@ -3,7 +3,10 @@
 #include <cstddef>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <optional>
+#include <set>
 #include <utility>
 
 #include <fmt/format.h>
@@ -26,6 +29,13 @@ class basic_matrix {
 protected:
     std::shared_ptr<scmd::session> _session;
 
+    /* Initialized before the prepared queries below, which are formatted with the id */
+    id_t id;
+    index_t row_count;
+    index_t column_count;
+    index_t block_size;
+    int64_t version;
+
     scmd::prepared_query _get_meta_prepared;
     scmd::prepared_query _get_value_prepared;
     scmd::prepared_query _get_row_prepared;
@@ -35,11 +45,8 @@ protected:
     scmd::prepared_query _clear_block_row_prepared;
     scmd::prepared_query _resize_prepared;
     scmd::prepared_query _set_block_size_prepared;
-
-    id_t id;
-    index_t row_count;
-    index_t column_count;
-    index_t block_size;
+    scmd::prepared_query _get_version_prepared;
+    scmd::prepared_query _bump_version_prepared;
 
     inline static constexpr index_t ceil_div (index_t a, index_t b) { return 1 + (a - 1) / b; }
 
@@ -48,6 +55,42 @@ protected:
 
     void update_meta();
 
+    /* Queries of the non-zero counts of blocks, prepared on first use. Matrices initialized before
+     * the counts were kept have no table for them, so their counts are neither kept nor estimated.
+     */
+    struct nnz_queries {
+        scmd::prepared_query get_all;
+        scmd::prepared_query count_block;
+        scmd::prepared_query set;
+        scmd::prepared_query forget;
+        scmd::prepared_query forget_block_row;
+    };
+    mutable bool _nnz_prepared = false;
+    mutable std::optional<nnz_queries> _nnz;
+
+    /* Null if the matrix has no table of non-zero counts */
+    const nnz_queries *get_nnz_queries() const;
+
+    static void create_nnz_table(const std::shared_ptr<scmd::session> &session, id_t id);
+
+    /* Sums of the non-zero counts of blocks (see get_block_nnz) over block rows (axis 0) or block columns (axis 1) */
+    std::vector<int64_t> sum_nnz(index_t axis) const;
+
+    /* Marks the values of the matrix as changed (see get_version), once a write has completed.
+     * Deferred within a version_bump_scope.
+     */
+    void bump_version();
+    static void bump_version(const std::shared_ptr<scmd::session> &session, id_t id);
+
+    /* Writes keep the non-zero count of a block only if they know all of its values, i.e. write it whole.
+     * Other writes to a block drop its count, in the same round trip as the values.
+     */
+    void set_nnz(index_t block_x, index_t block_y, int64_t nnz, std::vector<scmd::future> &futures);
+    void forget_nnz(index_t block_x, index_t block_y, std::vector<scmd::future> &futures);
+
+    /* Waits for the writes of the matrix to complete and bumps its version */
+    void finish_writes(std::vector<scmd::future> &futures);
+
 public:
     /* Removes all values inserted into the matrix up to the point of execution.
      * Doesn't remove the matrix itself or modify its metadata, so it doesn't need
@@ -96,6 +139,14 @@ public:
         return this->block_size;
     }
 
+    /* Grows with every write to the matrix (once per main task for the writes of workers),
+     * as seen when the handle was created. Equal versions mean equal values, so blocks read
+     * from the matrix may be cached under it.
+     */
+    int64_t get_version() const {
+        return this->version;
+    }
+
     index_t get_column_count(TRANSPOSE trans = NoTrans) const {
         if (trans != NoTrans) return get_row_count();
         return column_count;
@@ -141,6 +192,25 @@ public:
         return {start, end};
     }
 
+    /* Number of non-zero values in each block of the matrix, block (i, j) at index (i - 1) * width + j - 1.
+     * Blocks last written whole (see matrix::insert_whole_block) have their counts kept, the values
+     * of the others are counted now, if there are at most COST_MODEL_MAX_COUNTED_BLOCKS of them.
+     * Empty if there is no estimate.
+     */
+    std::vector<int64_t> get_block_nnz() const;
+
+    /* Number of non-zero values in each block row of the matrix (or of its transposition),
+     * the value for block row i at index i - 1, see get_block_nnz
+     */
+    std::vector<int64_t> get_block_row_nnz(TRANSPOSE trans = NoTrans) const {
+        return sum_nnz(trans != NoTrans ? 1 : 0);
+    }
+
+    /* Same as get_block_row_nnz, for block columns */
+    std::vector<int64_t> get_block_column_nnz(TRANSPOSE trans = NoTrans) const {
+        return sum_nnz(trans != NoTrans ? 0 : 1);
+    }
+
     void clear_row(index_t x);
     void clear_all();
     void resize(index_t new_row_count, index_t new_column_count);
@@ -149,10 +219,7 @@ public:
 
 template<class T>
 class matrix : public basic_matrix {
-    template<class... Args>
-    std::vector<matrix_value<T>> get_vals_for_query(const scmd::prepared_query &query, Args... args) const {
-        scmd::query_result result = _session->execute(query, args...);
-
+    static std::vector<matrix_value<T>> get_vals_of_result(scmd::query_result &result) {
         std::vector<matrix_value<T>> result_vector;
         result_vector.reserve(result.row_count());
         while (result.next_row()) {
@@ -166,8 +233,41 @@ class matrix : public basic_matrix {
         return result_vector;
     }
 
-    void insert_values(const std::vector<matrix_value<T>> &values) {
-        std::vector<scmd::future> futures;
+    template<class... Args>
+    std::vector<matrix_value<T>> get_vals_for_query(const scmd::prepared_query &query, Args... args) const {
+        scmd::query_result result = _session->execute(query, args...);
+        return get_vals_of_result(result);
+    }
+
+    /* Block (x, y) of the matrix stored in Scylla, (y, x) for trans != NoTrans */
+    static matrix_block<T> make_block(std::vector<matrix_value<T>> &&block_values, index_t x, index_t y,
+                                      index_t block_size, TRANSPOSE trans) {
+        /* Move by offset – a block is an independent unit.
+         * E.g. if we have a block sized 2x2, then for such a matrix:
+         * ---------
+         * |1 0 0 0|
+         * |1 1 0 0|
+         * |0 0 1 0|
+         * |0 0 1 1|
+         * ---------
+         * both blocks (1, 1) and (2, 2) will have identical sets of coordinates for all values.
+         * This should make further operations on abstract blocks easier by a bit.
+         */
+        index_t offset_x = (x - 1) * block_size;
+        index_t offset_y = (y - 1) * block_size;
+
+        for (auto &val : block_values) {
+            val.row_index -= offset_x;
+            val.col_index -= offset_y;
+        }
+
+        return scylla_blas::matrix_block(block_values, x, y, trans);
+    }
+
+    /* Issues the writes of `values`, returns the blocks written to and how many values each got */
+    std::map<std::pair<index_t, index_t>, int64_t> issue_values(const std::vector<matrix_value<T>> &values,
+                                                                std::vector<scmd::future> &futures) {
+        std::map<std::pair<index_t, index_t>, int64_t> blocks;
         size_t idx = 0;
         scylla_blas::index_t prev_block = -1;
         while(idx < values.size()) {
@@ -188,12 +288,48 @@ class matrix : public basic_matrix {
                 batch.add_statement(stmt);
                 current_batch_size++;
                 prev_block = get_block_col(val.col_index);
+                blocks[{get_block_row(val.row_index), get_block_col(val.col_index)}]++;
             }
             futures.push_back(_session->execute_async(batch));
         }
-        for (auto &future : futures) {
-            future.wait();
+        return blocks;
+    }
+
+    void insert_values(const std::vector<matrix_value<T>> &values) {
+        std::vector<scmd::future> futures;
+        for (auto &[block, count] : issue_values(values, futures)) {
+            forget_nnz(block.first, block.second, futures);
         }
+        finish_writes(futures);
+    }
+
+    /* Values of `block` placed as block (row, column) of the matrix */
+    std::vector<matrix_value<T>> values_of_block(index_t row, index_t column, const matrix_block<T> &block) const {
+        std::vector<matrix_value<T>> values = block.get_values_raw();
+        index_t offset_row = (row - 1) * block_size;
+        index_t offset_column = (column - 1) * block_size;
+
+        for (auto &val : values) {
+            val.row_index += offset_row;
+            val.col_index += offset_column;
+
+            /* Truncate those values that cannot be inserted */
+            bool ignore = false;
+
+            if (val.row_index > row_count)
+                ignore = true;
+
+            if (val.col_index > column_count)
+                ignore = true;
+
+            if (ignore) {
+                val.value = 0;
+                LogDebug("Matrix of size {}x{} too small for insertion at ({}, {}). Ignoring the insertion.",
+                         row_count, column_count, val.row_index, val.col_index);
+            }
+        }
+
+        return values;
     }
 public:
     /* We don't want to implicitly initialize a handle (somewhat costly) if it is discarded by the user.
@@ -217,6 +353,8 @@ public:
 
         session->execute(create_table.set_timeout(0));
 
+        create_nnz_table(session, id);
+
         if (force_new) {
             clear(session, id);
         }
@@ -264,43 +402,46 @@ public:
         return answer;
     }
 
-    matrix_block<T> get_block(index_t x, index_t y, TRANSPOSE trans = NoTrans) const {
-        if (trans != NoTrans) std::swap(x, y);
-
-        auto block_values = get_vals_for_query(_get_block_prepared, x, y);
+    /* A block read issued with get_block_async, get() waits for its values */
+    class pending_block {
+        scmd::future _future;
+        index_t _x, _y, _block_size;
+        TRANSPOSE _trans;
 
-        /* Move by offset – a block is an independent unit.
-         * E.g. if we have a block sized 2x2, then for such a matrix:
-         * ---------
-         * |1 0 0 0|
-         * |1 1 0 0|
-         * |0 0 1 0|
-         * |0 0 1 1|
-         * ---------
-         * both blocks (1, 1) and (2, 2) will have identical sets of coordinates for all values.
-         * This should make further operations on abstract blocks easier by a bit.
-         */
-        index_t offset_x = (x - 1) * block_size;
-        index_t offset_y = (y - 1) * block_size;
+    public:
+        pending_block(scmd::future &&future, index_t x, index_t y, index_t block_size, TRANSPOSE trans) :
+            _future(std::move(future)), _x(x), _y(y), _block_size(block_size), _trans(trans) {}
 
-        for (auto &val : block_values) {
-            val.row_index -= offset_x;
-            val.col_index -= offset_y;
+        matrix_block<T> get() {
+            scmd::query_result result = _future.get_result();
+            return make_block(get_vals_of_result(result), _x, _y, _block_size, _trans);
         }
+    };
 
-        return scylla_blas::matrix_block(block_values, x, y, trans);
+    /* Same as get_block, but returns once the read is issued, so that many reads may be in flight at once */
+    pending_block get_block_async(index_t x, index_t y, TRANSPOSE trans = NoTrans) const {
+        if (trans != NoTrans) std::swap(x, y);
+
+        return pending_block(_session->execute_async(_get_block_prepared, x, y), x, y, block_size, trans);
+    }
+
+    matrix_block<T> get_block(index_t x, index_t y, TRANSPOSE trans = NoTrans) const {
+        return get_block_async(x, y, trans).get();
     }
 
     void insert_value(index_t x, index_t y, T value) {
         if (std::abs(value) < EPSILON) return;
 
-        _session->execute(_insert_value_prepared, get_block_row(x), get_block_col(y), x, y, value);
+        insert_value(get_block_row(x), get_block_col(y), x, y, value);
     }
 
     void insert_value(index_t block_x, index_t block_y, index_t x, index_t y, T value) {
         if (std::abs(value) < EPSILON) return;
 
-        _session->execute(_insert_value_prepared, block_x, block_y, x, y, value);
+        std::vector<scmd::future> futures;
+        futures.push_back(_session->execute_async(_insert_value_prepared, block_x, block_y, x, y, value));
+        forget_nnz(block_x, block_y, futures);
+        finish_writes(futures);
     }
 
     /* Inserts a given block into the matrix. Old values will not be modified or deleted */
@@ -321,31 +462,18 @@ public:
     /* Inserts a given block into the matrix. Old values will not be modified or deleted */
     /* TODO: investigate */
     void insert_block(index_t row, index_t column, const matrix_block<T> &block) {
-        std::vector<matrix_value<T>> values = block.get_values_raw();
-        index_t offset_row = (row - 1) * block_size;
-        index_t offset_column = (column - 1) * block_size;
-
-        for (auto &val : values) {
-            val.row_index += offset_row;
-            val.col_index += offset_column;
-
-            /* Truncate those values that cannot be inserted */
-            bool ignore = false;
-
-            if (val.row_index > row_count)
-                ignore = true;
-
-            if (val.col_index > column_count)
-                ignore = true;
-
-            if (ignore) {
-                val.value = 0;
-                LogDebug("Matrix of size {}x{} too small for insertion at ({}, {}). Ignoring the insertion.",
-                         row_count, column_count, val.row_index, val.col_index);
-            }
-        }
+        insert_values(values_of_block(row, column, block));
+    }
 
-        insert_values(values);
+    /* Same as insert_block, for a block holding all the non-zero values of block (row, column) once written,
+     * e.g. one computed from the block read before. Its non-zero count is kept, see get_block_nnz.
+     */
+    void insert_whole_block(index_t row, index_t column, const matrix_block<T> &block) {
+        std::vector<scmd::future> futures;
+        auto blocks = issue_values(values_of_block(row, column, block), futures);
+        auto written = blocks.find({row, column});
+        set_nnz(row, column, written != blocks.end() ? written->second : 0, futures);
+        finish_writes(futures);
     }
 
     void print_octave(std::ostream &os) {
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "proto.hh"
+
+/* Serialization of tasks and responses stored in queues.
+ *
+ * Version 1 (compact) record:
+ *   WIRE_MARKER, version byte, varint type tag, then the fields used by that type:
+ *   integers as (zigzag) varints, floating point values as little-endian IEEE 754.
+ *   Responses carry the fields of the union member named by their type.
+ *   Untyped (R_SOME) payloads, written before responses were typed, are only read back.
+ * Version 0 (legacy) record is the raw memory image of proto::task / proto::response.
+ *
+ * Both versions are always decoded. The version that is written can be lowered to 0
+ * for as long as workers from before version 1 are still running.
+ */
+namespace scylla_blas::proto {
+
+/* The first byte of a legacy record is the low byte of its (little-endian) type, which is never 0xFF */
+constexpr uint8_t WIRE_MARKER = 0xFF;
+constexpr int64_t WIRE_VERSION_LEGACY = 0;
+constexpr int64_t WIRE_VERSION_COMPACT = 1;
+constexpr int64_t WIRE_VERSION_LATEST = WIRE_VERSION_COMPACT;
+
+void set_wire_version(int64_t version);
+
+int64_t get_wire_version();
+
+std::vector<uint8_t> encode(const task &t);
+
+std::vector<uint8_t> encode(const response &r);
+
+task decode_task(const uint8_t *data, size_t size);
+
+response decode_response(const uint8_t *data, size_t size);
+
+/* Id of the subtask queue a main task takes its subtasks from, none for subtasks */
+std::optional<int64_t> subtask_queue_of(const task &t);
+
+}
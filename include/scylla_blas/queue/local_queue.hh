@@ -0,0 +1,214 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "queue_metrics.hh"
+#include "task_queue.hh"
+#include "scylla_blas/config.hh"
+
+namespace scylla_blas {
+
+/* In-process queue, for a scheduler and workers running as threads of a single process.
+ *
+ * Follows the design of scylla_queue: producers reserve consecutive ids by advancing cnt_new,
+ * consumers claim them by advancing cnt_used – each with a single atomic operation instead of
+ * a transaction. Tasks are stored in chunks of QUEUE_PAGE_SIZE slots, looked up in a ring of
+ * chunk pointers. Released chunks are unlinked from the ring, and freed by the first release()
+ * that finds no operation in progress which could still hold them. The memory used is thus
+ * proportional to the number of tasks that were not released yet (at most LOCAL_QUEUE_MAX_CHUNKS
+ * chunks), plus the chunks released while the queue was busy.
+ *
+ * All operations are lock-free, except that a consumer has to wait for a claimed task
+ * whose producer has not finished writing it yet – same as scylla_queue does.
+ * Multi producer/consumer flags are not needed, every local queue handles both.
+ * Tasks of a task range have no slots, except for the ones that were reported as finished.
+ * reset() must not run concurrently with other operations.
+ */
+class local_queue : public task_queue {
+    enum slot_state : int {
+        EMPTY = 0,
+        READY,
+        FINISHING,
+        FINISHED
+    };
+
+    struct slot {
+        task value;
+        response result;
+        std::atomic<int> state;
+        std::atomic<int64_t> lease;
+    };
+
+    struct chunk {
+        int64_t page;
+        std::array<slot, QUEUE_PAGE_SIZE> slots;
+
+        explicit chunk(int64_t page) : page(page), slots() {}
+    };
+
+    // Held for the duration of every operation that looks up chunks.
+    class reader_guard {
+        std::atomic<int64_t> &_readers;
+
+    public:
+        explicit reader_guard(std::atomic<int64_t> &readers) : _readers(readers) {
+            _readers.fetch_add(1);
+            // Chunks are looked up only after the increment is visible to release().
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        ~reader_guard() { _readers.fetch_sub(1, std::memory_order_release); }
+    };
+
+    int64_t queue_id;
+    std::shared_ptr<queue_metrics> _metrics;
+    std::atomic<int64_t> cnt_new;
+    std::atomic<int64_t> cnt_used;
+    std::atomic<int64_t> cnt_released;
+    std::array<std::atomic<chunk *>, LOCAL_QUEUE_MAX_CHUNKS> chunks;
+
+    // Operations in progress that may hold chunks, and chunks unlinked by release() but not freed yet.
+    std::atomic<int64_t> _readers;
+    std::mutex _retired_mutex;
+    std::vector<chunk *> _retired;
+
+    std::atomic<int64_t> sibling_first_id;
+    std::atomic<int64_t> sibling_count;
+
+    // Descriptor of the last task range, written before cnt_new is advanced past it.
+    std::atomic<int64_t> range_first;
+    std::atomic<int64_t> range_end;
+    std::atomic<int64_t> range_columns;
+    std::atomic<int64_t> range_consumers;
+
+    std::mutex _dependencies_mutex;
+    std::vector<queue_dependency> _upstream;
+    std::atomic<bool> _track_finished;
+
+    // Tasks below cancelled_below are cancelled, and all of them once the wall clock passes the deadline (if not 0).
+    std::atomic<int64_t> cancelled_below;
+    std::atomic<int64_t> deadline;
+
+    static int64_t page_of(int64_t task_id) { return task_id / QUEUE_PAGE_SIZE; }
+
+    chunk *find_chunk(int64_t page) const;
+
+    chunk *get_or_create_chunk(int64_t page);
+
+    slot &get_slot(int64_t id) const;
+
+    const task &wait_for_task(int64_t id) const;
+
+    void free_chunks();
+
+    std::vector<std::pair<int64_t, task>> claim(int64_t n, bool guided);
+
+public:
+    explicit local_queue(int64_t id);
+
+    local_queue(const local_queue &other) = delete;
+    local_queue& operator=(const local_queue &other) = delete;
+
+    ~local_queue() override;
+
+    int64_t get_id() const override { return queue_id; }
+
+    int64_t produce(const task &task) override;
+
+    int64_t produce(const std::vector<task> &tasks) override;
+
+    // Throws if another producer reserves ids at the same time.
+    int64_t produce_range(int64_t count, int64_t columns, int64_t consumers) override;
+
+    std::optional<std::pair<int64_t, task>> consume() override;
+
+    std::vector<std::pair<int64_t, task>> consume(int64_t n) override;
+
+    std::vector<std::pair<int64_t, task>> consume_guided(int64_t min_chunk) override;
+
+    void mark_as_finished(int64_t id) override;
+
+    // Only the first report is stored, later ones are ignored.
+    void mark_as_finished(int64_t id, const response &response) override;
+
+    void mark_as_finished(const std::vector<int64_t> &ids) override;
+
+    bool is_finished(int64_t id) override;
+
+    std::optional<response> get_response(int64_t id) override;
+
+    std::vector<std::pair<int64_t, std::optional<response>>> get_finished(int64_t first_id, int64_t count) override;
+
+    int64_t get_pending_count() override;
+
+    int64_t get_produced_count() const override { return cnt_new.load(); }
+
+    void renew_lease(int64_t id) override;
+
+    std::optional<std::pair<int64_t, task>> claim_stale(int64_t lease_time,
+                                                        const std::function<bool(const task&)> &eligible) override;
+
+    std::vector<std::pair<int64_t, task>> get_unfinished() override;
+
+    void cancel() override;
+
+    void set_deadline(int64_t new_deadline) override { deadline.store(new_deadline); }
+
+    bool is_cancelled(int64_t id) override;
+
+    void set_siblings(int64_t first_id, int64_t count) override;
+
+    std::pair<int64_t, int64_t> get_siblings() const override { return { sibling_first_id.load(), sibling_count.load() }; }
+
+    task_range get_range() const override;
+
+    void set_dependencies(const std::vector<queue_dependency> &upstream, bool track_finished) override;
+
+    std::vector<queue_dependency> get_upstream() override;
+
+    bool tracks_finished() const override { return _track_finished.load(); }
+
+    void release(int64_t watermark) override;
+
+    void reset() override;
+};
+
+/* Queues living in the memory of this process */
+class local_backend : public queue_backend {
+    std::mutex _mutex;
+    std::unordered_map<int64_t, std::shared_ptr<local_queue>> _queues;
+    /* Registered main queues, and when their registration expires (wall time, in microseconds, 0 if never) */
+    std::map<std::pair<priority_class, int64_t>, int64_t> _main_queues;
+    /* Registered workers, and when their registration expires (wall time, in microseconds) */
+    std::unordered_map<int64_t, int64_t> _worker_expiry;
+
+public:
+    void create_queue(int64_t id, bool multi_producer = false, bool multi_consumer = true,
+                      int64_t bucket_count = 1) override;
+
+    void delete_queue(int64_t id) override;
+
+    bool queue_exists(int64_t id) override;
+
+    std::shared_ptr<task_queue> open_queue(int64_t id) override;
+
+    void register_main_queue(int64_t id, priority_class priority, int64_t ttl = 0) override;
+
+    void unregister_main_queue(int64_t id, priority_class priority) override;
+
+    std::vector<std::pair<priority_class, int64_t>> list_main_queues() override;
+
+    void heartbeat_worker(int64_t worker_id, int64_t ttl) override;
+
+    void unregister_worker(int64_t worker_id) override;
+
+    int64_t count_live_workers() override;
+};
+
+}
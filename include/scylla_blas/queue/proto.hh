@@ -182,12 +182,29 @@ enum task_type {
     DRVGEN,
     SRMGEN,
     DRMGEN,
+
+    /* FUSED – passes compiled from lazy expressions, see expression.hh */
+    SFUSED_VECTOR,
+    DFUSED_VECTOR,
+    SGEMV_DOT,
+    DGEMV_DOT,
+};
+
+/* Steps of a fused vector pass (see fused_vector_task_*), performed in this order on each segment */
+enum fused_op : int64_t {
+    /* X = scale * X */
+    FUSED_SCALE = 1,
+    /* Y = alpha * X + beta * Y */
+    FUSED_UPDATE = 2,
+    /* dot product of the last vector written (Y, or else X) with Z */
+    FUSED_DOT = 4
 };
 
 /* This is the struct that will be sent trough the queue.
  * We can freely modify it, to add different kinds of tasks.
- * Instance of this struct will be cast to char array,
- * stored as binary blob in the database, then "de-serialized" at the other end.
+ * Instances of this struct are serialized by codec.hh, stored as binary blob
+ * in the database, then de-serialized at the other end – new fields have to be
+ * added to the encoding of the task types that use them.
  * This means it probably should not contain data pertaining to local memory,
  * as there is little point in storing such data.
  */
@@ -244,6 +261,8 @@ struct task {
             id_t Y_id;
         } mixed_task_float;
 
+        /* Uplo and Diag fill the padding after TransA, so the layout of the older fields stays
+         * the one of memcpy images written by the legacy codec */
         struct {
             id_t task_queue_id;
 
@@ -251,6 +270,8 @@ struct task {
 
             id_t A_id;
             TRANSPOSE TransA;
+            UPLO Uplo : 16;
+            DIAG Diag : 16;
             double alpha;
 
             id_t X_id;
@@ -293,14 +314,83 @@ struct task {
             id_t structure_id;
             double alpha;
         } generation_task;
+
+        struct {
+            id_t task_queue_id;
+            int64_t ops;
+
+            float scale;
+            float alpha;
+            float beta;
+
+            id_t X_id;
+            id_t Y_id;
+            id_t Z_id;
+        } fused_vector_task_float;
+
+        struct {
+            id_t task_queue_id;
+            int64_t ops;
+
+            double scale;
+            double alpha;
+            double beta;
+
+            id_t X_id;
+            id_t Y_id;
+            id_t Z_id;
+        } fused_vector_task_double;
+
+        /* Y = alpha * op(A) * X + beta * Y, followed by the dot product of Y with Z */
+        struct {
+            id_t task_queue_id;
+
+            id_t A_id;
+            TRANSPOSE TransA;
+            float alpha;
+
+            id_t X_id;
+            float beta;
+
+            id_t Y_id;
+            id_t Z_id;
+        } gemv_dot_task_float;
+
+        struct {
+            id_t task_queue_id;
+
+            id_t A_id;
+            TRANSPOSE TransA;
+            double alpha;
+
+            id_t X_id;
+            double beta;
+
+            id_t Y_id;
+            id_t Z_id;
+        } gemv_dot_task_double;
     };
 
 };
 
+/* Legacy records are memcpy images of the struct, their size must not change */
+static_assert(sizeof(task) == 80, "proto::task no longer matches legacy queue records");
+
 enum response_type {
     R_NONE,
+    /* A partial result of a worker from before typed responses, its variant is known only to the routine */
     R_SOME,
-    R_INT64
+    R_INT64,
+    /* The routine of the task was cancelled before all its subtasks were done, see task_queue::cancel */
+    R_CANCELLED,
+    /* Partial results, named after the member of the union they carry */
+    R_FLOAT,
+    R_DOUBLE,
+    R_FLOAT_PAIR,
+    R_DOUBLE_PAIR,
+    R_FLOAT_INDEX_VALUE,
+    R_DOUBLE_INDEX_VALUE,
+    R_READS
 };
 
 struct response {
@@ -333,6 +423,12 @@ struct response {
         struct {
             int64_t response;
         } simple;
+
+        /* Operands read from Scylla by a main task, so far reported by gemm */
+        struct {
+            int64_t blocks;
+            int64_t bytes;
+        } result_reads;
     };
 };
 
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "proto.hh"
+#include "scylla_blas/config.hh"
+
+namespace scylla_blas {
+
+/* Lock-free histogram of non-negative values. Bucket 0 counts values below 1,
+ * bucket i > 0 counts values in [2^(i-1), 2^i), the last bucket also counts everything above.
+ */
+class log2_histogram {
+public:
+    static constexpr size_t BUCKETS = 48;
+
+    struct snapshot {
+        int64_t count = 0;
+        int64_t sum = 0;
+        int64_t max = 0;
+        std::array<int64_t, BUCKETS> buckets = {};
+
+        double mean() const { return count > 0 ? (double)sum / count : 0; }
+
+        // Upper bound of the bucket holding the given quantile (0 < q <= 1).
+        int64_t quantile(double q) const;
+    };
+
+    void record(int64_t value);
+
+    snapshot get() const;
+
+    void reset();
+
+private:
+    std::atomic<int64_t> _count {0};
+    std::atomic<int64_t> _sum {0};
+    std::atomic<int64_t> _max {0};
+    std::array<std::atomic<int64_t>, BUCKETS> _buckets {};
+};
+
+struct queue_metrics_snapshot {
+    // Id of the queue, or -1 for the totals of the process.
+    int64_t queue_id;
+
+    int64_t produce_calls;
+    int64_t produced_tasks;
+    // Transactions on the producer counter that were not applied, and had to be retried.
+    int64_t produce_conflicts;
+
+    int64_t claim_calls;
+    int64_t claimed_tasks;
+    // Claims that found the queue empty.
+    int64_t empty_claims;
+    // Transactions on a consumer counter (or on a lease) that were not applied, and had to be retried.
+    int64_t claim_conflicts;
+    int64_t stale_claims;
+    // Queries for payloads of claimed tasks that were not written by their producers yet.
+    int64_t payload_misses;
+
+    int64_t finished_tasks;
+
+    // Number of produced, but not claimed tasks, as last seen by a client of the queue.
+    int64_t depth;
+    int64_t max_depth;
+
+    // Tasks per produce call.
+    log2_histogram::snapshot produce_batch;
+    // Duration of claims that returned some tasks, including retries and payload fetches, in microseconds.
+    log2_histogram::snapshot time_to_claim;
+    // Time from claiming a task to marking it as finished, by the same client, in microseconds.
+    log2_histogram::snapshot time_to_finish;
+
+    std::string to_string() const;
+};
+
+/* Counters and histograms of queue operations performed by this process.
+ *
+ * There is one instance per queue id, shared by all clients of that queue in the process,
+ * and one with the totals. The clients own the instance of their queue – it is dropped with
+ * the last of them, and only the totals keep what it recorded. Recording is lock-free and
+ * cheap enough to be always on.
+ * Everything is counted as seen by this process – other clients of a scylla_queue
+ * keep their own metrics.
+ */
+class queue_metrics {
+    // Claim times of the most recent claims, indexed by id % QUEUE_METRICS_TRACKED_CLAIMS.
+    struct claim_record {
+        std::atomic<int64_t> id {-1};
+        std::atomic<int64_t> time {0};
+    };
+
+    int64_t _queue_id;
+    queue_metrics *_total;
+
+    std::atomic<int64_t> _produce_calls {0};
+    std::atomic<int64_t> _produced_tasks {0};
+    std::atomic<int64_t> _produce_conflicts {0};
+    std::atomic<int64_t> _claim_calls {0};
+    std::atomic<int64_t> _claimed_tasks {0};
+    std::atomic<int64_t> _empty_claims {0};
+    std::atomic<int64_t> _claim_conflicts {0};
+    std::atomic<int64_t> _stale_claims {0};
+    std::atomic<int64_t> _payload_misses {0};
+    std::atomic<int64_t> _finished_tasks {0};
+    std::atomic<int64_t> _depth {0};
+    std::atomic<int64_t> _max_depth {0};
+
+    log2_histogram _produce_batch;
+    log2_histogram _time_to_claim;
+    log2_histogram _time_to_finish;
+
+    std::array<claim_record, QUEUE_METRICS_TRACKED_CLAIMS> _claims;
+
+    void record_claimed(int64_t id, int64_t now);
+
+public:
+    queue_metrics(int64_t queue_id, queue_metrics *total) : _queue_id(queue_id), _total(total) {}
+
+    queue_metrics(const queue_metrics &other) = delete;
+    queue_metrics& operator=(const queue_metrics &other) = delete;
+
+    // Metrics of the queue with given id, created unless some client of the queue already holds them.
+    static std::shared_ptr<queue_metrics> of(int64_t queue_id);
+
+    // Totals of all queues.
+    static queue_metrics &total();
+
+    // Totals first, then queues by id.
+    static std::vector<queue_metrics_snapshot> snapshot_all();
+
+    // Writes one log line for the totals and one for each queue that has clients.
+    static void log_all();
+
+    static void reset_all();
+
+    void record_produce(int64_t count);
+
+    void record_produce_conflict();
+
+    // Result of a claim that started at start_time (see now()). An empty result counts as an empty claim.
+    void record_claim(const std::vector<std::pair<int64_t, proto::task>> &claimed, int64_t start_time);
+
+    void record_claim_conflict();
+
+    void record_stale_claim(int64_t id);
+
+    void record_payload_miss();
+
+    void record_finished(int64_t id);
+
+    void record_depth(int64_t depth);
+
+    queue_metrics_snapshot get() const;
+
+    void reset();
+
+    // Monotonic time in microseconds, used for all durations above.
+    static int64_t now();
+};
+
+}
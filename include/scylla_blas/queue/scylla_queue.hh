@@ -2,13 +2,18 @@
 
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <fmt/format.h>
 #include <scmd.hh>
 
 #include "proto.hh"
+#include "queue_metrics.hh"
+#include "task_queue.hh"
+#include "scylla_blas/config.hh"
 #include "scylla_blas/utils/scylla_types.hh"
 #include "scylla_blas/utils/utils.hh"
 
@@ -18,34 +23,77 @@ public:
     using std::runtime_error::runtime_error;
 };
 
-class scylla_queue {
+class scylla_queue : public task_queue {
 public:
     using shared_prepared = std::shared_ptr<scmd::prepared_query>;
 private:
+    // Clients sharing a session share its prepared statements. Worker threads of a process
+    // (see worker::local_worker_pool) open and close clients of the same session concurrently.
     static std::unordered_map<scmd::session *, std::unordered_set<scylla_queue *>> session_map;
+    static std::mutex session_map_mutex;
 
     int64_t queue_id;
     std::shared_ptr<scmd::session> _session;
+    std::shared_ptr<queue_metrics> _metrics;
     bool multi_producer;
     bool multi_consumer;
     int64_t cnt_new;
     int64_t cnt_used;
+    // All tasks below this id were released and their pages dropped. Always a multiple of QUEUE_PAGE_SIZE.
+    int64_t cnt_released;
+
+    // Bucketed layout: task with id t lives in partition (queue_id, t % bucket_count),
+    // and each bucket has its own consumer counter in blas.queue_bucket.
+    // With bucket_count == 1 the queue keeps using cnt_used from blas.queue_meta.
+    int64_t bucket_count;
+    int64_t home_bucket;
+    std::vector<int64_t> bucket_used;
+
+    // Queues with ids [sibling_first_id, sibling_first_id + sibling_count) form a group,
+    // whose consumers may help each other (see set_siblings). Empty (0, 0) by default.
+    int64_t sibling_first_id;
+    int64_t sibling_count;
+
+    // The last task range produced to the queue, as last seen by update_counters. Empty if there was none.
+    task_range range;
+
+    // Dependencies between queues, see set_dependencies. Upstream queues are listed in blas.queue_upstream.
+    bool track_finished;
+    int64_t upstream_count;
+
+    // Deadline of the queue as last set by this client, see set_deadline.
+    int64_t deadline;
 
     shared_prepared fetch_counters_stmt;
 
     shared_prepared update_new_counter_prepared;
+    shared_prepared produce_range_prepared;
     shared_prepared update_new_counter_trans_prepared;
 
     shared_prepared update_used_counter_prepared;
     shared_prepared update_used_counter_trans_prepared;
 
+    shared_prepared fetch_bucket_counter_prepared;
+    shared_prepared update_bucket_counter_prepared;
+    shared_prepared update_bucket_counter_trans_prepared;
+
+    shared_prepared update_released_counter_prepared;
+
     shared_prepared fetch_task_by_id_prepared;
+    shared_prepared fetch_task_range_prepared;
     shared_prepared insert_task_prepared;
 
     shared_prepared mark_task_finished_prepared;
     shared_prepared check_task_finished_prepared;
+    shared_prepared check_task_range_finished_prepared;
     shared_prepared get_task_response;
 
+    shared_prepared mark_task_done_prepared;
+    shared_prepared renew_lease_prepared;
+    shared_prepared take_over_lease_prepared;
+    shared_prepared fetch_task_range_state_prepared;
+    shared_prepared fetch_cancellation_prepared;
+
 public:
     using task = proto::task;
     using response = proto::response;
@@ -63,10 +111,31 @@ public:
     // and the method (produce/consume) is called at least once on each of them.
     // If you know there are no multi (producers/consumers) you should set relevant parameter to false,
     // as this will improve performance.
-    static void create_queue(const std::shared_ptr<scmd::session> &session, int64_t id, bool multi_producer = false, bool multi_consumer = true);
+    // bucket_count - number of partitions the queue is spread over. Tasks are assigned to buckets
+    // by task_id % bucket_count, and each bucket is claimed from separately, so consumers
+    // of a bucketed queue don't contend on a single row. Task order is kept only within a bucket.
+    static void create_queue(const std::shared_ptr<scmd::session> &session, int64_t id, bool multi_producer = false,
+                             bool multi_consumer = true, int64_t bucket_count = 1);
 
     static void delete_queue(const std::shared_ptr<scmd::session> &session, int64_t id);
 
+    // Registry of main queues (see queue_backend::list_main_queues), kept in blas.main_queues.
+    // Registrations with a ttl expire with the TTL of their rows.
+    static void register_main_queue(const std::shared_ptr<scmd::session> &session, int64_t id, priority_class priority,
+                                    int64_t ttl = 0);
+
+    static void unregister_main_queue(const std::shared_ptr<scmd::session> &session, int64_t id, priority_class priority);
+
+    static std::vector<std::pair<priority_class, int64_t>> list_main_queues(const std::shared_ptr<scmd::session> &session);
+
+    // Registry of workers (see queue_backend::count_live_workers), kept in blas.workers.
+    // Registrations expire with the TTL of their rows.
+    static void heartbeat_worker(const std::shared_ptr<scmd::session> &session, int64_t worker_id, int64_t ttl);
+
+    static void unregister_worker(const std::shared_ptr<scmd::session> &session, int64_t worker_id);
+
+    static int64_t count_live_workers(const std::shared_ptr<scmd::session> &session);
+
     // Creates new queue client, and connects to queue with given id.
     // Queue with given id must be created before constructing this object, \
     // using "create_queue" method.
@@ -83,13 +152,17 @@ public:
     // Shouldn't throw exceptions until something is broken, e.g. queue was deleted.
     // It can throw std::runtime_error or scmd::exception in those cases.
     // After successful execution returns id of the inserted task.
-    int64_t produce(const task &task);
+    int64_t produce(const task &task) override;
 
     // Version of produce that pushes multiple tasks to queue.
     // It should be more performant than calling normal version of produce multiple times.
     // Returns task_id, where { task_id, task_id + 1, ..., task_id + tasks.size() - 1 }
     // are the ids of corresponding tasks.
-    int64_t produce(const std::vector<task> &tasks);
+    int64_t produce(const std::vector<task> &tasks) override;
+
+    // Stores the range descriptor together with the producer counter, with a single write.
+    // Only supported by unbucketed, single producer queues.
+    int64_t produce_range(int64_t count, int64_t columns, int64_t consumers) override;
 
     // Tries to fetch first item from queue, deserializes and returns it.
     // Returns std:nullopt if queue is empty.
@@ -97,23 +170,97 @@ public:
     // Returns id of fetched task (the same that produce returned for this task),
     // and deserialized task struct.
     // Returned id can be used to mark the task as finished.
-    std::optional<std::pair<int64_t, task>> consume();
+    std::optional<std::pair<int64_t, task>> consume() override;
+
+    // Version of consume that claims up to n tasks at once.
+    // Claimed tasks have consecutive ids. The whole range is claimed with a single
+    // counter update, and payloads are fetched with a single range query.
+    // Returns an empty vector if queue is empty.
+    std::vector<std::pair<int64_t, task>> consume(int64_t n) override;
+
+    // Version of consume(n) that claims chunks of guided size from a task range.
+    // Claimed tasks of the range are derived from their ids, without fetching any payloads.
+    std::vector<std::pair<int64_t, task>> consume_guided(int64_t min_chunk) override;
 
     // Marks given task as finished, with empty reponse
-    void mark_as_finished(int64_t id);
+    void mark_as_finished(int64_t id) override;
 
     // Marks given task as finished, with given reponse
-    void mark_as_finished(int64_t id, const response& response);
+    void mark_as_finished(int64_t id, const response& response) override;
 
-    bool is_finished(int64_t id);
+    // Marks given tasks as finished, with one unlogged batch per partition
+    void mark_as_finished(const std::vector<int64_t> &ids) override;
 
-    std::optional<response> get_response(int64_t id);
+    bool is_finished(int64_t id) override;
+
+    std::optional<response> get_response(int64_t id) override;
+
+    // Checks all tasks with ids in range [first_id, first_id + count) with a single query.
+    // Returns ids of those that are finished, together with their responses.
+    // Tasks that are not finished yet are omitted.
+    std::vector<std::pair<int64_t, std::optional<response>>> get_finished(int64_t first_id, int64_t count) override;
+
+    // Declares that all tasks with ids below watermark are finished and their responses were collected.
+    // Pages (QUEUE_PAGE_SIZE consecutive ids) that lie entirely below watermark are dropped
+    // as whole partitions, so a long-lived queue doesn't accumulate rows and tombstones.
+    // Released tasks can't be queried anymore. Should be called by the single client that collects responses.
+    // A no-op on DEFAULT_WORKER_QUEUE_ID, whose tasks may belong to several clients.
+    void release(int64_t watermark) override;
 
     // Reset internal counters to 0. Deletes task data from database.
     // Effectively resets queue to initial state.
-    void reset();
+    void reset() override;
+
+    int64_t get_id() const override { return queue_id; }
+
+    int64_t get_bucket_count() const { return bucket_count; }
+
+    // Number of tasks that were produced, but not claimed yet.
+    // Queries the counters, so the result is up to date, but may change right after the call.
+    int64_t get_pending_count() override;
+
+    // Sets the lease of the task to the current (wall clock) time.
+    void renew_lease(int64_t id) override;
+
+    // Scans unreleased tasks, and takes over the first stale one with a transaction on its lease.
+    // Tasks that were never leased are not considered claimed.
+    std::optional<std::pair<int64_t, task>> claim_stale(int64_t lease_time,
+                                                        const std::function<bool(const task&)> &eligible) override;
+
+    std::vector<std::pair<int64_t, task>> get_unfinished() override;
+
+    // Stores cnt_new as cancelled_below in blas.queue_meta – tasks with lower ids are cancelled.
+    // Should be called by the single producer of the queue.
+    void cancel() override;
+
+    // The deadline is stored in blas.queue_meta, unless it didn't change since this client last set it.
+    void set_deadline(int64_t deadline) override;
+
+    // Reads cancelled_below and the deadline with a single query. Deadlines are compared with
+    // the wall clock of this client, so clock skew between machines shifts them.
+    bool is_cancelled(int64_t id) override;
+
+    // Makes this queue a member of the group of queues with ids [first_id, first_id + count).
+    // A consumer that drained its own queue of the group may continue with the other ones,
+    // so all queues of the group should be created as multi_consumer.
+    void set_siblings(int64_t first_id, int64_t count) override;
+
+    std::pair<int64_t, int64_t> get_siblings() const override { return { sibling_first_id, sibling_count }; }
+
+    task_range get_range() const override { return range; }
+
+    // Replaces the rows of this queue in blas.queue_upstream, then updates its meta.
+    // Should be called while no subtasks of the queue or of its upstream queues are in progress.
+    void set_dependencies(const std::vector<queue_dependency> &upstream, bool track_finished) override;
 
-    int64_t get_id() const { return queue_id; }
+    // Queries blas.queue_upstream, unless the queue had no upstream queues when this client connected.
+    std::vector<queue_dependency> get_upstream() override;
+
+    bool tracks_finished() const override { return track_finished; }
+
+    // Number of tasks in the queue, as last seen by this client.
+    // Exact if this client is the only producer.
+    int64_t get_produced_count() const override { return cnt_new; }
 
 private:
     void prepare_statements();
@@ -122,9 +269,41 @@ private:
 
     void update_counters();
 
+    static task_range range_from_row(scmd::query_result &result);
+
+    // Number of tasks to claim, out of available ones starting at cnt_used.
+    int64_t claim_size(int64_t n, bool guided, int64_t available) const {
+        return std::min(available, guided && range.contains(cnt_used) ? range.guided_chunk(cnt_used, n) : n);
+    }
+
+    int64_t bucket_of(int64_t task_id) const { return task_id % bucket_count; }
+
+    static int64_t page_of(int64_t task_id) { return task_id / QUEUE_PAGE_SIZE; }
+
+    // Number of tasks that were assigned to given bucket, out of first cnt_new tasks.
+    int64_t bucket_size(int64_t bucket) const { return cnt_new > bucket ? (cnt_new - bucket - 1) / bucket_count + 1 : 0; }
+
+    void update_bucket_counter(int64_t bucket);
+
+    // Number of tasks that were produced, but not claimed, according to the last seen bucket counters.
+    int64_t bucket_pending_count() const {
+        int64_t pending = 0;
+        for (int64_t bucket = 0; bucket < bucket_count; bucket++) {
+            pending += std::max(bucket_size(bucket) - bucket_used[bucket], int64_t(0));
+        }
+        return pending;
+    }
+
+    // Calls visit for each partition holding unreleased tasks, with the result of
+    // fetch_task_range_state_prepared for it. Uses counters as last seen by update_counters.
+    void scan_unreleased(const std::function<void(scmd::query_result &)> &visit);
+
+    static std::vector<scmd::future> delete_pages(const std::shared_ptr<scmd::session> &session, int64_t id,
+                                                  int64_t bucket_count, int64_t first_page, int64_t end_page);
+
     scmd::statement prepare_insert_query(int64_t task_id, const task &task);
 
-    scmd::batch_query prepare_batch_insert_query(int64_t base_id, const std::vector<task> &tasks);
+    std::vector<scmd::future> insert_tasks(int64_t base_id, const std::vector<task> &tasks);
 
     scmd::future insert_task(int64_t task_id, const task &task);
 
@@ -142,8 +321,74 @@ private:
 
     task fetch_task_loop(int64_t task_id);
 
+    std::vector<std::pair<int64_t, task>> fetch_task_range_loop(int64_t first_id, int64_t count);
+
+    // Claimed task of an unbucketed queue, derived from its id if it belongs to the task range.
+    task task_at(int64_t task_id);
+
+    // Tasks [first_id, first_id + count) of an unbucketed queue. Those of the task range are derived
+    // from their ids, the rest is fetched.
+    std::vector<std::pair<int64_t, task>> claimed_tasks(int64_t first_id, int64_t count);
+
     std::optional<std::pair<int64_t, task>> consume_simple();
 
     std::optional<std::pair<int64_t, task>> consume_multi();
+
+    std::vector<std::pair<int64_t, task>> consume_many_simple(int64_t n, bool guided);
+
+    std::vector<std::pair<int64_t, task>> consume_many_multi(int64_t n, bool guided);
+
+    std::vector<std::pair<int64_t, task>> consume_bucketed(int64_t n);
+
+    std::vector<std::pair<int64_t, task>> consume_from_bucket(int64_t bucket, int64_t n);
+};
+
+/* Queues stored in Scylla, shared by all processes connected to the cluster */
+class scylla_backend : public queue_backend {
+    std::shared_ptr<scmd::session> _session;
+
+public:
+    explicit scylla_backend(const std::shared_ptr<scmd::session> &session) : _session(session) {}
+
+    void create_queue(int64_t id, bool multi_producer = false, bool multi_consumer = true,
+                      int64_t bucket_count = 1) override {
+        scylla_queue::create_queue(_session, id, multi_producer, multi_consumer, bucket_count);
+    }
+
+    void delete_queue(int64_t id) override {
+        scylla_queue::delete_queue(_session, id);
+    }
+
+    bool queue_exists(int64_t id) override {
+        return scylla_queue::queue_exists(_session, id);
+    }
+
+    void register_main_queue(int64_t id, priority_class priority, int64_t ttl = 0) override {
+        scylla_queue::register_main_queue(_session, id, priority, ttl);
+    }
+
+    void unregister_main_queue(int64_t id, priority_class priority) override {
+        scylla_queue::unregister_main_queue(_session, id, priority);
+    }
+
+    std::vector<std::pair<priority_class, int64_t>> list_main_queues() override {
+        return scylla_queue::list_main_queues(_session);
+    }
+
+    void heartbeat_worker(int64_t worker_id, int64_t ttl) override {
+        scylla_queue::heartbeat_worker(_session, worker_id, ttl);
+    }
+
+    void unregister_worker(int64_t worker_id) override {
+        scylla_queue::unregister_worker(_session, worker_id);
+    }
+
+    int64_t count_live_workers() override {
+        return scylla_queue::count_live_workers(_session);
+    }
+
+    std::shared_ptr<task_queue> open_queue(int64_t id) override {
+        return std::make_shared<scylla_queue>(_session, id);
+    }
 };
 }
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "proto.hh"
+#include "scylla_blas/config.hh"
+
+namespace scylla_blas {
+
+/* Descriptor of tasks [first_id, end_id) that were produced with produce_range.
+ * None of them is stored – each one is derived from its id when claimed.
+ */
+struct task_range {
+    int64_t first_id = 0;
+    int64_t end_id = 0;
+    // Width of the two-dimensional index space, 0 if it is one-dimensional.
+    int64_t columns = 0;
+    // Number of consumers expected to share the range, used to size guided claims.
+    int64_t consumers = 1;
+
+    bool contains(int64_t id) const { return first_id <= id && id < end_id; }
+
+    // Side of the square tiles a two-dimensional range is enumerated in. A tile holds about as many tasks
+    // as the first guided claim, so that a claim spans few rows and columns of the grid.
+    int64_t tile_side() const {
+        int64_t share = (end_id - first_id + GUIDED_CHUNK_DIVISOR * consumers - 1) / (GUIDED_CHUNK_DIVISOR * consumers);
+        int64_t side = 1;
+        while (side < BLOCK_TILE_MAX_SIDE && (side + 1) * (side + 1) <= share) {
+            side++;
+        }
+        return std::min(side, columns);
+    }
+
+    // Task i of the range (counting from 0) has index i + 1. With columns > 0, the range is a grid
+    // of (end_id - first_id) / columns rows, and task i has coordinates (row, column), counting from 1.
+    // The grid is enumerated tile by tile (see tile_side) – bands of tile rows top to bottom, tiles
+    // of a band left to right, tasks of a tile row by row – so consecutive tasks share rows and columns.
+    proto::task task_of(int64_t id) const {
+        int64_t i = id - first_id;
+        if (columns > 0) {
+            int64_t rows = (end_id - first_id) / columns;
+            int64_t tile = tile_side();
+            int64_t top = i / (tile * columns) * tile;
+            int64_t height = std::min(tile, rows - top);
+            int64_t offset = i - top * columns;
+            int64_t left = offset / (height * tile) * tile;
+            int64_t width = std::min(tile, columns - left);
+            int64_t in_tile = offset - left * height;
+            return { .type = proto::NONE, .coord { .block_row = top + in_tile / width + 1,
+                                                   .block_column = left + in_tile % width + 1 } };
+        }
+        return { .type = proto::NONE, .index = i + 1 };
+    }
+
+    // Inverse of task_of: id of the task with given index, or coordinates.
+    int64_t id_of(const proto::task &subtask) const {
+        if (columns > 0) {
+            int64_t rows = (end_id - first_id) / columns;
+            int64_t tile = tile_side();
+            int64_t row = subtask.coord.block_row - 1;
+            int64_t column = subtask.coord.block_column - 1;
+            int64_t top = row / tile * tile;
+            int64_t height = std::min(tile, rows - top);
+            int64_t left = column / tile * tile;
+            int64_t width = std::min(tile, columns - left);
+            return first_id + top * columns + left * height + (row - top) * width + (column - left);
+        }
+        return first_id + subtask.index - 1;
+    }
+
+    // Guided self-scheduling: claims are large while there is plenty of work left,
+    // and shrink towards min_chunk as the range drains, so that the tail is balanced.
+    int64_t guided_chunk(int64_t next_id, int64_t min_chunk) const {
+        int64_t left = end_id - next_id;
+        int64_t share = (left + GUIDED_CHUNK_DIVISOR * consumers - 1) / (GUIDED_CHUNK_DIVISOR * consumers);
+        return std::min(left, std::max(min_chunk, std::min(share, GUIDED_MAX_CHUNK)));
+    }
+};
+
+/* How the subtasks of a queue depend on the subtasks of an upstream queue (see task_queue::set_dependencies) */
+enum class dependency_kind : int64_t {
+    // Each subtask waits for the upstream subtask with the same index, or coordinates.
+    SAME_SUBTASK = 1,
+    // Each subtask waits for all subtasks of the upstream range.
+    ALL = 2
+};
+
+struct queue_dependency {
+    int64_t queue_id;
+    dependency_kind kind;
+};
+
+/* Interface of a task queue, used by the scheduler and the workers.
+ * See scylla_queue for the detailed semantics of each method –
+ * every implementation has to follow them.
+ */
+class task_queue {
+public:
+    using task = proto::task;
+    using response = proto::response;
+
+    virtual ~task_queue() = default;
+
+    virtual int64_t get_id() const = 0;
+
+    // Pushes task to the queue and returns its id.
+    virtual int64_t produce(const task &task) = 0;
+
+    // Pushes tasks to the queue, they get consecutive ids. Returns the id of the first one.
+    virtual int64_t produce(const std::vector<task> &tasks) = 0;
+
+    // Publishes count tasks with consecutive ids as a single task_range, in time independent of count.
+    // All tasks produced before have to be claimed already. Returns the id of the first one.
+    virtual int64_t produce_range(int64_t count, int64_t columns, int64_t consumers) = 0;
+
+    // Claims the first task in the queue, or returns std::nullopt if there is none.
+    virtual std::optional<std::pair<int64_t, task>> consume() = 0;
+
+    // Claims up to n tasks at once. Returns an empty vector if the queue is empty.
+    virtual std::vector<std::pair<int64_t, task>> consume(int64_t n) = 0;
+
+    // Claims a chunk of a task range, sized with task_range::guided_chunk. Same as consume(min_chunk)
+    // for tasks that were not produced as a range.
+    virtual std::vector<std::pair<int64_t, task>> consume_guided(int64_t min_chunk) = 0;
+
+    virtual void mark_as_finished(int64_t id) = 0;
+
+    virtual void mark_as_finished(int64_t id, const response &response) = 0;
+
+    // Marks several tasks as finished, without responses, in as few writes as possible.
+    virtual void mark_as_finished(const std::vector<int64_t> &ids) = 0;
+
+    virtual bool is_finished(int64_t id) = 0;
+
+    virtual std::optional<response> get_response(int64_t id) = 0;
+
+    // Returns finished tasks among [first_id, first_id + count), ordered by id.
+    virtual std::vector<std::pair<int64_t, std::optional<response>>> get_finished(int64_t first_id, int64_t count) = 0;
+
+    // Number of tasks that were produced, but not claimed yet.
+    virtual int64_t get_pending_count() = 0;
+
+    // Number of tasks in the queue, as last seen by this client.
+    virtual int64_t get_produced_count() const = 0;
+
+    // Declares that the claimed task is still being worked on, for another lease period.
+    virtual void renew_lease(int64_t id) = 0;
+
+    // Takes over a claimed, unfinished task accepted by `eligible`, whose lease was last renewed
+    // more than lease_time microseconds ago, and renews the lease. Only one client takes over
+    // a given lease. Returns std::nullopt if there is no such task.
+    virtual std::optional<std::pair<int64_t, task>> claim_stale(int64_t lease_time,
+                                                                const std::function<bool(const task&)> &eligible) = 0;
+
+    // Returns all tasks that are neither finished nor released, claimed or not, ordered by id.
+    virtual std::vector<std::pair<int64_t, task>> get_unfinished() = 0;
+
+    // Cancels all tasks produced so far, whether claimed or not. Tasks produced later are not affected.
+    virtual void cancel() = 0;
+
+    // Sets the wall clock time (in microseconds, 0 for none) after which all tasks of the queue are cancelled.
+    virtual void set_deadline(int64_t deadline) = 0;
+
+    // Whether the task was cancelled, or the deadline of the queue has passed. Always queries the queue.
+    virtual bool is_cancelled(int64_t id) = 0;
+
+    virtual void set_siblings(int64_t first_id, int64_t count) = 0;
+
+    virtual std::pair<int64_t, int64_t> get_siblings() const = 0;
+
+    // The last task range produced to the queue, as last seen by this client. Empty if there was none.
+    virtual task_range get_range() const = 0;
+
+    // Declares that subtasks of this queue have to wait for the current task ranges of `upstream` queues
+    // before they run, and whether finished subtasks of this queue are to be marked as finished,
+    // for the queues that depend on it. An empty `upstream` and false clear both.
+    virtual void set_dependencies(const std::vector<queue_dependency> &upstream, bool track_finished) = 0;
+
+    virtual std::vector<queue_dependency> get_upstream() = 0;
+
+    virtual bool tracks_finished() const = 0;
+
+    // Drops tasks below watermark, which are all finished and collected.
+    virtual void release(int64_t watermark) = 0;
+
+    virtual void reset() = 0;
+};
+
+/* Main queues are grouped in priority classes. Workers take main tasks of all classes
+ * in proportion to their weights (see worker::set_priority_weights), most from INTERACTIVE.
+ */
+enum priority_class : int64_t {
+    INTERACTIVE = 0,
+    NORMAL = 1,
+    BATCH = 2
+};
+
+constexpr int64_t PRIORITY_CLASS_COUNT = 3;
+
+/* Creates, opens and deletes queues of one kind.
+ * Queues with the same id opened from the same backend are the same queue.
+ */
+class queue_backend {
+public:
+    virtual ~queue_backend() = default;
+
+    // Lists the queue as a main queue of given priority class, to be consumed by workers.
+    // With a ttl (in microseconds), the registration lapses unless renewed by calling this again in time.
+    virtual void register_main_queue(int64_t id, priority_class priority, int64_t ttl = 0) = 0;
+
+    virtual void unregister_main_queue(int64_t id, priority_class priority) = 0;
+
+    // Registered main queues, as (priority class, id) pairs, ordered by class.
+    virtual std::vector<std::pair<priority_class, int64_t>> list_main_queues() = 0;
+
+    // Registers a worker consuming the main queues, or renews its registration, for `ttl` microseconds.
+    virtual void heartbeat_worker(int64_t worker_id, int64_t ttl) = 0;
+
+    virtual void unregister_worker(int64_t worker_id) = 0;
+
+    // Workers whose registration hasn't expired yet.
+    virtual int64_t count_live_workers() = 0;
+
+    // bucket_count is a hint, see scylla_queue::create_queue.
+    virtual void create_queue(int64_t id, bool multi_producer = false, bool multi_consumer = true,
+                              int64_t bucket_count = 1) = 0;
+
+    virtual void delete_queue(int64_t id) = 0;
+
+    virtual bool queue_exists(int64_t id) = 0;
+
+    virtual std::shared_ptr<task_queue> open_queue(int64_t id) = 0;
+};
+
+}
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+#include <thread>
 #include <vector>
 
 #include <scmd.hh>
 
 #include "proto.hh"
+#include "task_queue.hh"
 #include "scylla_queue.hh"
 
 #include "scylla_blas/matrix.hh"
@@ -15,13 +20,62 @@ namespace scylla_blas::worker {
 
 void set_worker_retries(int64_t retries);
 
+/* How many subtasks are claimed from a subtask queue at once.
+ * Claims from a task range start larger, and shrink down to this size as the range drains.
+ */
+void set_subtask_batch_size(int64_t batch_size);
+
+/* How many subtasks ahead of the current one may have their operands fetched,
+ * while the current one is computed. 0 performs subtasks strictly one after another.
+ */
+void set_prefetch_depth(int64_t depth);
+
+/* Blocks and segments of operands that a routine only reads (e.g. A and B of gemm) are kept by the process,
+ * up to this many bytes, and reused by later subtasks and routines until the matrix or vector is written to.
+ * 0 disables the cache.
+ */
+void set_operand_cache_size(int64_t bytes);
+
+/* Reads of the operand blocks and segments of a subtask are issued at once, with at most this many in flight,
+ * and computed on as they arrive, so that a subtask takes about one round trip instead of one per block.
+ */
+void set_read_window(int64_t window);
+
+/* With speculative execution enabled, a worker leases the main tasks it runs, and renews
+ * the lease whenever it makes progress. Once the main queue is empty, idle workers take over
+ * tasks whose lease is older than lease_time microseconds, and run them again.
+ * Only tasks that are safe to run twice (see is_speculation_safe) are leased.
+ * Should be enabled on all workers or none, as only leasing workers track finished subtasks.
+ */
+void set_speculative_execution(bool enabled);
+void set_task_lease_time(int64_t lease_time);
+
+/* Every interval microseconds one of the workers of the process logs queue_metrics::log_all(). 0 disables it. */
+void set_metrics_interval(int64_t interval);
+
+/* Weights of the priority classes: when all of them have tasks pending, a worker takes main tasks of each class
+ * in proportion to its weight. A class with weight 0 is not served at all, e.g. workers dedicated to INTERACTIVE
+ * routines keep latency bounded while the others are busy with BATCH ones.
+ */
+void set_priority_weights(const std::array<int64_t, PRIORITY_CLASS_COUNT> &weights);
+
 class subtask_failed_exception : public std::runtime_error {
 
 public:
     subtask_failed_exception(): std::runtime_error("") {};
 };
 
-using procedure_t = std::optional<proto::response>(const std::shared_ptr<scmd::session>&, const proto::task&);
+/* Thrown when the subtasks being consumed turn out to be cancelled (see task_queue::cancel).
+ * The main task is then reported as finished with an R_CANCELLED response.
+ */
+class task_cancelled_exception : public std::runtime_error {
+
+public:
+    task_cancelled_exception(): std::runtime_error("") {};
+};
+
+/* Subtask queues named in the task are opened from the given backend */
+using procedure_t = std::optional<proto::response>(const std::shared_ptr<scmd::session>&, queue_backend&, const proto::task&);
 
 /* LEVEL 1 */
 procedure_t sswap, sscal, scopy, saxpy, sdot, sdsdot, snrm2, sasum, isamax;
@@ -39,7 +93,11 @@ procedure_t dgemm, dsyrk, dsyr2k;
 procedure_t srvgen, srmgen;
 procedure_t drvgen, drmgen;
 
-constexpr std::array<std::pair<proto::task_type, const procedure_t &>, 38> task_to_procedure =
+/* FUSED */
+procedure_t sfused_vector, sgemv_dot;
+procedure_t dfused_vector, dgemv_dot;
+
+constexpr std::array<std::pair<proto::task_type, const procedure_t &>, 42> task_to_procedure =
 {{
          {proto::SSWAP, sswap},
          {proto::SSCAL, sscal},
@@ -82,7 +140,12 @@ constexpr std::array<std::pair<proto::task_type, const procedure_t &>, 38> task_
          {proto::SRVGEN, srvgen},
          {proto::DRVGEN, drvgen},
          {proto::SRMGEN, srmgen},
-         {proto::DRMGEN, drmgen}
+         {proto::DRMGEN, drmgen},
+
+         {proto::SFUSED_VECTOR, sfused_vector},
+         {proto::DFUSED_VECTOR, dfused_vector},
+         {proto::SGEMV_DOT, sgemv_dot},
+         {proto::DGEMV_DOT, dgemv_dot}
  }};
 
 inline procedure_t& get_procedure_for_task(const proto::task &t) {
@@ -97,4 +160,102 @@ inline procedure_t& get_procedure_for_task(const proto::task &t) {
     return it->second;
 }
 
+/* Tasks whose procedures only overwrite their outputs with values computed from their inputs,
+ * so a task that runs twice, even concurrently, gives the same result as a single run.
+ * Note that a stale worker may still write its results after the task was re-executed.
+ */
+inline bool is_speculation_safe(const proto::task &t) {
+    switch (t.type) {
+        case proto::SCOPY:
+            return t.vector_task_float.X_id != t.vector_task_float.Y_id;
+        case proto::DCOPY:
+            return t.vector_task_double.X_id != t.vector_task_double.Y_id;
+        case proto::SGEMV:
+        case proto::SGBMV:
+            return t.mixed_task_float.beta == 0 && t.mixed_task_float.X_id != t.mixed_task_float.Y_id;
+        case proto::DGEMV:
+        case proto::DGBMV:
+            return t.mixed_task_double.beta == 0 && t.mixed_task_double.X_id != t.mixed_task_double.Y_id;
+        case proto::SGEMM:
+            return t.matrix_task_float.beta == 0 && t.matrix_task_float.C_id != t.matrix_task_float.A_id
+                   && t.matrix_task_float.C_id != t.matrix_task_float.B_id;
+        case proto::DGEMM:
+            return t.matrix_task_double.beta == 0 && t.matrix_task_double.C_id != t.matrix_task_double.A_id
+                   && t.matrix_task_double.C_id != t.matrix_task_double.B_id;
+        default:
+            return false;
+    }
+}
+
+/* The worker loop: takes main tasks from the main queues registered in the backend (see set_priority_weights),
+ * and performs them. Sleeps for sleep_time microseconds whenever they are all empty. Returns once `stop` is set.
+ */
+void run_worker(const std::shared_ptr<scmd::session> &session, queue_backend &backend,
+                int64_t sleep_time, const std::atomic<bool> &stop);
+
+/* Runs workers as threads of this process, until destroyed.
+ * Together with a local_backend, lets a scheduler in the same process
+ * hand tasks over to its workers without any queue round trips.
+ * With a scylla_backend, the threads share a single session (and its prepared statements)
+ * instead of running a process each. Every thread registers as a worker of its own.
+ * With pin_threads, thread i only runs on CPU i (modulo the number of CPUs).
+ */
+class local_worker_pool {
+    std::shared_ptr<queue_backend> _backend;
+    std::atomic<bool> _stop;
+    std::vector<std::thread> _threads;
+
+public:
+    local_worker_pool(const std::shared_ptr<scmd::session> &session, const std::shared_ptr<queue_backend> &backend,
+                      int64_t worker_count, int64_t sleep_time = DEFAULT_LOCAL_WORKER_SLEEP_TIME_MICROSECONDS,
+                      bool pin_threads = false);
+
+    local_worker_pool(const local_worker_pool &other) = delete;
+    local_worker_pool& operator=(const local_worker_pool &other) = delete;
+
+    ~local_worker_pool();
+
+    int64_t get_worker_count() const { return _threads.size(); }
+};
+
+/* Tasks waiting to be claimed: main tasks of the registered main queues, and subtasks in the subtask
+ * queues of their main tasks. Schedulers split a routine into one main task per live worker,
+ * so main tasks are claimed at once – a backlog of work waits in the subtask queues.
+ */
+struct queue_load {
+    int64_t main_tasks = 0;
+    int64_t subtasks = 0;
+};
+
+/* Measures the queue_load of a backend, keeping the main queues open between measurements */
+class queue_load_monitor {
+    queue_backend &_backend;
+    std::map<int64_t, std::shared_ptr<task_queue>> _main_queues;
+
+public:
+    explicit queue_load_monitor(queue_backend &backend) : _backend(backend), _main_queues() {}
+
+    queue_load measure();
+};
+
+/* Number of worker processes kept by the supervisor, between min_workers and max_workers. A worker is added
+ * per check while main tasks wait, or more than SUPERVISOR_SUBTASKS_PER_WORKER subtasks per live worker.
+ * Once nothing has waited for idle_intervals checks in a row, a worker is removed.
+ */
+class worker_scaler {
+    int64_t _min_workers;
+    int64_t _max_workers;
+    int64_t _idle_intervals;
+    int64_t _target;
+    int64_t _idle_for;
+
+public:
+    worker_scaler(int64_t min_workers, int64_t max_workers, int64_t idle_intervals);
+
+    /* Called once per check, returns the new number of workers. `live_workers` – see queue_backend::count_live_workers */
+    int64_t update(const queue_load &load, int64_t live_workers);
+
+    int64_t get_target() const { return _target; }
+};
+
 }
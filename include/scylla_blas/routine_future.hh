@@ -0,0 +1,239 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "logging/logging.hh"
+#include "queue/task_queue.hh"
+#include "utils/scylla_types.hh"
+#include "utils/utils.hh"
+
+namespace scylla_blas {
+
+/* Thrown by routine_future::get when workers abandoned some of the subtasks of the routine */
+class routine_cancelled_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/* Stops the routines it is attached to (see routine_scheduler::set_cancellation_token) when cancelled,
+ * or once the wall clock passes its deadline. Copies share their state, so one of them may be cancelled
+ * from another thread than the one waiting for the routines. The deadline reaches the workers with
+ * the subtask queues – it stops the routines even if the client that started them is gone.
+ */
+class cancellation_token {
+    struct state {
+        std::atomic<bool> cancelled;
+        int64_t deadline; /* Wall clock time in microseconds, 0 if there is none */
+
+        explicit state(int64_t deadline) : cancelled(false), deadline(deadline) {}
+    };
+
+    std::shared_ptr<state> _state;
+
+public:
+    explicit cancellation_token(int64_t deadline = 0) : _state(std::make_shared<state>(deadline)) {}
+
+    /* A token whose deadline is `timeout` microseconds from now */
+    static cancellation_token with_timeout(int64_t timeout) {
+        return cancellation_token(get_wall_time_microseconds() + timeout);
+    }
+
+    /* Thread safe */
+    void cancel() { _state->cancelled.store(true); }
+
+    int64_t get_deadline() const { return _state->deadline; }
+
+    bool is_cancelled() const {
+        return _state->cancelled.load() || (_state->deadline > 0 && get_wall_time_microseconds() >= _state->deadline);
+    }
+};
+
+/* Main tasks of a routine that were produced with consecutive ids [first_id, first_id + count).
+ * Completion reports are collected with a single range query per poll, and each response
+ * is passed to `on_response`. Once all of them are collected, `on_finish` is called (once).
+ */
+class pending_routine {
+    std::shared_ptr<task_queue> _queue;
+    id_t _first_id;
+    id_t _end_id;
+    id_t _first_pending;
+    std::vector<bool> _is_done;
+    std::function<void(const proto::response&)> _on_response;
+    std::function<void()> _on_finish;
+    backoff _poll_backoff;
+    bool _finished;
+    /* Checked on every poll – once cancelled, `_on_cancel` is called (once) */
+    std::optional<cancellation_token> _token;
+    std::function<void()> _on_cancel;
+    bool _cancelled;
+    /* Called on every poll, see set_heartbeat */
+    std::function<void()> _on_poll;
+
+    /* Returns whether any new task was found finished */
+    bool collect() {
+        bool progress = false;
+        for (auto &[id, response] : _queue->get_finished(_first_pending, _end_id - _first_pending)) {
+            if (_is_done[id - _first_id]) continue;
+            _is_done[id - _first_id] = true;
+            progress = true;
+
+            if (response.has_value() && response.value().type == proto::R_CANCELLED) {
+                _cancelled = true;
+                continue;
+            }
+            if (!response.has_value() || response.value().type == proto::R_NONE) continue;
+
+            try {
+                _on_response(response.value());
+            } catch(std::exception &e) {
+                LogError("Result update failed: {}", e.what());
+            }
+        }
+
+        while (_first_pending < _end_id && _is_done[_first_pending - _first_id]) {
+            _first_pending++;
+        }
+
+        return progress;
+    }
+
+    void check_cancellation() {
+        if (!_token.has_value() || !_token->is_cancelled()) return;
+
+        _token.reset();
+        try {
+            _on_cancel();
+        } catch (std::exception &e) {
+            LogError("Cancelling the routine failed: {}", e.what());
+        }
+    }
+
+public:
+    /* Polls are spaced with an exponential backoff from min_sleep up to max_sleep microseconds */
+    pending_routine(const std::shared_ptr<task_queue> &queue, id_t first_id, id_t count,
+                    std::function<void(const proto::response&)> on_response, std::function<void()> on_finish,
+                    int64_t min_sleep, int64_t max_sleep) :
+        _queue(queue),
+        _first_id(first_id),
+        _end_id(first_id + count),
+        _first_pending(first_id),
+        _is_done(count, false),
+        _on_response(std::move(on_response)),
+        _on_finish(std::move(on_finish)),
+        _poll_backoff(min_sleep, max_sleep),
+        _finished(false),
+        _token(),
+        _on_cancel(),
+        _cancelled(false),
+        _on_poll() {}
+
+    pending_routine(const pending_routine &other) = delete;
+    pending_routine& operator=(const pending_routine &other) = delete;
+
+    id_t get_first_id() const { return _first_id; }
+
+    id_t get_end_id() const { return _end_id; }
+
+    bool is_finished() const { return _finished; }
+
+    /* Whether any main task reported that its subtasks were cancelled, as last polled */
+    bool is_cancelled() const { return _cancelled; }
+
+    /* Once `token` is cancelled, the next poll calls `on_cancel` to stop the workers */
+    void set_cancellation(const cancellation_token &token, std::function<void()> on_cancel) {
+        _token = token;
+        _on_cancel = std::move(on_cancel);
+    }
+
+    /* `on_poll` is called on every poll, e.g. to keep the registrations of the client alive while it waits */
+    void set_heartbeat(std::function<void()> on_poll) {
+        _on_poll = std::move(on_poll);
+    }
+
+    /* Checks for completion reports once, without waiting. Returns whether the routine has finished. */
+    bool poll() {
+        if (_finished) return true;
+
+        if (_on_poll) _on_poll();
+        check_cancellation();
+        collect();
+        return _first_pending >= _end_id && finish();
+    }
+
+    void wait() {
+        while (!_finished) {
+            if (_on_poll) _on_poll();
+            check_cancellation();
+            bool progress = collect();
+            if (_first_pending >= _end_id) {
+                finish();
+                return;
+            }
+
+            if (progress) _poll_backoff.reset();
+            _poll_backoff.wait();
+        }
+    }
+
+private:
+    bool finish() {
+        _finished = true;
+        // on_finish may drop the last reference to this object – it is not accessed afterwards.
+        auto on_finish = std::move(_on_finish);
+        if (on_finish) on_finish();
+        return true;
+    }
+};
+
+/* Handle to the result of a routine started with one of routine_scheduler::*_async methods.
+ * Should not outlive the scheduler, and – same as the scheduler – is not thread safe.
+ */
+template<class T>
+class routine_future {
+    std::shared_ptr<pending_routine> _pending;
+    std::function<T()> _result;
+
+public:
+    /* Without pending tasks, the future is ready from the start */
+    routine_future(const std::shared_ptr<pending_routine> &pending, std::function<T()> result) :
+        _pending(pending), _result(std::move(result)) {}
+
+    /* A future of a routine that had nothing to do */
+    static routine_future completed(std::function<T()> result = [] {}) {
+        return routine_future(nullptr, std::move(result));
+    }
+
+    /* Whether all tasks of the routine are finished. Polls the queue, but doesn't wait. */
+    bool ready() { return !_pending || _pending->poll(); }
+
+    /* Waits until all tasks of the routine are finished */
+    void wait() {
+        if (_pending) _pending->wait();
+    }
+
+    /* Waits for the routine and returns its result. Throws routine_cancelled_error
+     * if the routine was cancelled before all of its subtasks were done.
+     */
+    T get() {
+        wait();
+        if (_pending && _pending->is_cancelled()) {
+            throw routine_cancelled_error("Routine was cancelled before it finished");
+        }
+        return _result();
+    }
+
+    /* A future of the same routine, whose result is passed through `f` */
+    template<class F>
+    auto then(F f) -> routine_future<decltype(f(std::declval<T>()))> {
+        using U = decltype(f(std::declval<T>()));
+        return routine_future<U>(_pending, [result = _result, f]() -> U { return f(result()); });
+    }
+};
+
+}
@@ -2,11 +2,24 @@
 
 /* BASED ON cblas.h */
 
+#include <array>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+
 #include <scmd.hh>
 
+#include "queue/local_queue.hh"
 #include "queue/scylla_queue.hh"
+#include "queue/task_queue.hh"
+#include "queue/worker_proc.hh"
 #include "utils/scylla_types.hh"
+#include "utils/version_bumps.hh"
+#include "cost_model.hh"
 #include "matrix.hh"
+#include "routine_future.hh"
+#include "task_graph.hh"
 #include "vector.hh"
 
 namespace scylla_blas {
@@ -26,96 +39,440 @@ class routine_scheduler {
 
     std::shared_ptr <scmd::session> _session;
 
-    std::vector<scylla_queue> _subtask_queues;
-    scylla_queue _main_worker_queue;
+    /* Routines are identified by their priority class and the id of their first main task in its main queue */
+    using routine_id = std::pair<priority_class, id_t>;
+
+    /* Subtask queues of a single routine. Queue i has id base + i, so that with work stealing
+     * enabled a worker can find all the sibling queues of the one it was given.
+     * With range scheduling, there is a single queue shared by all workers.
+     */
+    struct queue_set {
+        id_t base;
+        std::vector<std::shared_ptr<task_queue>> queues;
+        bool planned = false; /* Owned by a task_plan, never returned to the pool */
+        bool tracked = false; /* Finished subtasks are read by routines of a task_graph, released by the next run */
+    };
+
+public:
+    /* Subtasks and main tasks of a routine, recorded once with record_plan and started again with run_plan,
+     * e.g. by every sweep of an iterative method. The plan owns a subtask queue, and its subtasks are
+     * a task range, so starting it takes a single produce_range and one batch of main tasks (one per worker),
+     * whatever the size of the routine. Operands are fixed when the plan is recorded.
+     * Should not outlive the scheduler.
+     */
+    class task_plan {
+        friend class routine_scheduler;
+
+        std::shared_ptr<queue_set> _set;
+        int64_t _count = 0;
+        int64_t _columns = 0;
+        int64_t _consumers = 1;
+        std::vector<proto::task> _main_tasks;
+        std::optional<routine_id> _last_run;
+        std::function<void()> _on_release;
+
+    public:
+        task_plan() = default;
+        task_plan(const task_plan &other) = delete;
+        task_plan& operator=(const task_plan &other) = delete;
+
+        ~task_plan() {
+            if (_on_release) _on_release();
+        }
+
+        int64_t get_subtask_count() const { return _count; }
+    };
+
+    /* Routines recorded together with record_graph, and started together with run_graph. Each one is a task_plan.
+     * A routine that touches structures written by an earlier one (or writes ones it reads) depends on it:
+     * if both touch them segment by segment (or block by block) over the same grid, each subtask waits only
+     * for its counterpart upstream – otherwise for all upstream subtasks. Workers start downstream subtasks
+     * as soon as their upstream ones are done, without waiting for whole routines.
+     * Should not outlive the scheduler.
+     */
+    class task_graph {
+        friend class routine_scheduler;
 
+        std::vector<std::unique_ptr<task_plan>> _nodes;
+        int64_t _dependency_count = 0;
+
+    public:
+        task_graph() = default;
+        task_graph(const task_graph &other) = delete;
+        task_graph& operator=(const task_graph &other) = delete;
+
+        size_t get_routine_count() const { return _nodes.size(); }
+
+        int64_t get_dependency_count() const { return _dependency_count; }
+    };
+
+private:
+
+    /* Where the queues live: Scylla by default, or the memory of this process for local workers */
+    std::shared_ptr<queue_backend> _backend;
+
+    /* Queues of this scheduler have ids starting at _namespace: main queues first, one per priority class
+     * (created on first use), then subtask queues. Other schedulers never touch them.
+     */
+    id_t _namespace;
+    std::array<std::shared_ptr<task_queue>, PRIORITY_CLASS_COUNT> _main_queues;
+    int64_t _main_queue_bucket_count;
+    /* Registrations of the main queues lapse unless renewed, so that workers forget the queues of dead schedulers */
+    int64_t _main_queues_renewed_at;
+    priority_class _priority;
+    /* Routines started while it is set can be stopped with it, see set_cancellation_token */
+    std::optional<cancellation_token> _cancellation;
+
+    /* Every routine in progress has a queue set of its own. Sets of finished routines are reused. */
+    std::vector<std::shared_ptr<queue_set>> _queue_sets;
+    std::vector<std::shared_ptr<queue_set>> _idle_queue_sets;
+    /* Sets of task plans, which have a single queue whatever the scheduling mode */
+    std::vector<std::shared_ptr<queue_set>> _plan_sets;
+    std::vector<std::shared_ptr<queue_set>> _idle_plan_sets;
+    /* The plan being recorded – routines started meanwhile only describe their tasks to it */
+    task_plan *_recording;
+    /* The graph being recorded, which gets a new plan for every routine */
+    task_graph *_recording_graph;
+    /* The set of the routine whose tasks are being produced, taken over by produce_async */
+    std::shared_ptr<queue_set> _current_queue_set;
+    id_t _next_queue_id;
+
+    /* Routines that were started, but not collected yet */
+    std::map<routine_id, std::shared_ptr<pending_routine>> _outstanding;
+    std::array<id_t, PRIORITY_CLASS_COUNT> _main_end_ids;
+    routine_id _last_started;
+
+    /* Workers the routines are split between: the live ones, up to _max_used_workers (if set) */
     int64_t _current_worker_count;
+    std::optional<int64_t> _max_used_workers;
+    int64_t _worker_count_refreshed_at;
     int64_t _scheduler_sleep_time;
+    int64_t _scheduler_min_sleep_time;
+    bool _work_stealing;
+    bool _range_scheduling;
+    bool _cost_based_assignment;
+
+    /* Small routines run in this process (see set_local_execution_threshold), with subtasks in a local queue */
+    int64_t _local_execution_threshold;
+    std::optional<bool> _run_locally; /* Decided when the subtasks of a routine are added */
+    std::shared_ptr<local_backend> _local_backend;
+    std::vector<std::shared_ptr<task_queue>> _local_queues;
+
+    /* Iterative solvers, see run_sweeps */
+    bool _speculative_sweeps;
+    int64_t _convergence_check_interval;
 
-    /* Produces `cnt` copies of `task`, waits until all of them are completed.
+public:
+    /* Operands read from Scylla by workers, as reported in their responses */
+    struct operand_reads {
+        int64_t blocks = 0;
+        int64_t bytes = 0;
+    };
+
+private:
+    operand_reads _operand_reads;
+
+    void record_reads(const proto::response &r) {
+        _operand_reads.blocks += r.result_reads.blocks;
+        _operand_reads.bytes += r.result_reads.bytes;
+    }
+
+    /* Produces `tasks` and returns a future of the routine they make up.
      * Partial results from completion reports are accumulated in `acc`
-     * with `update`, and returned in the end.
+     * with `update`, which becomes the result of the future.
      *
      * If there is no result to be accumulated, `update` can be a pointer to null.
      * Otherwise, accumulation errors will be reported if `update` is not a valid function.
+     *
+     * The subtask queues filled for this routine stay assigned to it until it finishes.
+     * Completion of all outstanding tasks is checked with a single range query per poll.
+     * Polls are spaced with an exponential backoff, starting at `_scheduler_min_sleep_time`
+     * and growing up to `_scheduler_sleep_time` microseconds.
+     * Once everything is collected, finished pages of the queues are released.
      */
     template<class T>
-    T produce_and_wait(const std::vector<proto::task> &tasks, T acc, updater<T> update) {
-        id_t task_id = _main_worker_queue.produce(tasks);
-        LogInfo("Scheduled tasks {}-{} to queue {}", task_id, task_id + tasks.size() - 1, _main_worker_queue.get_id());
-        for (id_t id = task_id; id < task_id + tasks.size(); id++) {
-            while (!_main_worker_queue.is_finished(id)) {
-                scylla_blas::wait_microseconds(_scheduler_sleep_time);
+    routine_future<T> produce_async(const std::vector<proto::task> &tasks, T acc, updater<T> update) {
+        bool local = _run_locally.value_or(false);
+        _run_locally.reset();
+        if (local) {
+            return run_locally(tasks, acc, update);
+        }
+
+        auto set = std::move(_current_queue_set);
+        _current_queue_set.reset();
+
+        if (_recording) {
+            _recording->_set = set;
+            _recording->_main_tasks = tasks;
+            if (_recording_graph) {
+                _recording_graph->_nodes.push_back(std::make_unique<task_plan>());
+                _recording = _recording_graph->_nodes.back().get();
+            }
+            return routine_future<T>::completed([acc] { return acc; });
+        }
+
+        /* The deadline has to reach the subtask queues before any worker gets to them */
+        if (set) {
+            int64_t deadline = _cancellation.has_value() ? _cancellation->get_deadline() : 0;
+            for (auto &q : set->queues) {
+                q->set_deadline(deadline);
             }
+        }
+
+        auto &main_queue = get_main_queue(_priority);
+        id_t task_id = main_queue->produce(tasks);
+        id_t end_id = task_id + tasks.size();
+        _main_end_ids[_priority] = std::max(_main_end_ids[_priority], end_id);
+        LogInfo("Scheduled tasks {}-{} to queue {}", task_id, end_id - 1, main_queue->get_id());
+
+        routine_id routine { _priority, task_id };
+        auto result = std::make_shared<T>(acc);
+        auto on_response = [result, update] (const proto::response &r) { update(*result, r); };
+        auto on_finish = [this, routine, set] () { finish_routine(routine, set); };
+
+        auto pending = std::make_shared<pending_routine>(main_queue, task_id, tasks.size(), on_response, on_finish,
+                                                         _scheduler_min_sleep_time, _scheduler_sleep_time);
+        pending->set_heartbeat([this] { renew_main_queues(); });
+        if (_cancellation.has_value() && set) {
+            pending->set_cancellation(*_cancellation, [set] {
+                for (auto &q : set->queues) {
+                    q->cancel();
+                }
+            });
+        }
+        _outstanding.emplace(routine, pending);
+        _last_started = routine;
 
-            auto response = _main_worker_queue.get_response(id);
+        return routine_future<T>(pending, [result] () { return *result; });
+    }
+
+    /* Performs the main tasks in this thread, the same way a worker would, and returns a ready future */
+    template<class T>
+    routine_future<T> run_locally(const std::vector<proto::task> &tasks, T acc, updater<T> update) {
+        auto &queue = _local_queues.front();
+        version_bump_scope bumps;
+        try {
+            for (auto &task : tasks) {
+                auto response = worker::get_procedure_for_task(task)(_session, *_local_backend, task);
+                if (response.has_value() && update) {
+                    update(acc, response.value());
+                }
+            }
+            bumps.flush();
+        } catch (...) {
+            queue->reset();
+            throw;
+        }
+        queue->release(queue->get_produced_count());
 
-            if (response.value().type == proto::R_NONE) continue;
+        return routine_future<T>::completed([acc] { return acc; });
+    }
 
-            try {
-                update(acc, response.value());
-            } catch(std::exception &e) {
-                LogError("Result update failed: {}", e.what());
+    /* All responses below the first main task of the oldest outstanding routine of a main queue are collected,
+     * and all subtasks of a finished routine were consumed – let the queues drop their old pages.
+     */
+    void finish_routine(const routine_id &routine, const std::shared_ptr<queue_set> &set) {
+        auto priority = routine.first;
+        auto it = _outstanding.find(routine);
+        bool cancelled = it != _outstanding.end() && it->second->is_cancelled();
+        _outstanding.erase(routine);
+        auto oldest = _outstanding.lower_bound({ priority, 0 });
+        id_t watermark = (oldest != _outstanding.end() && oldest->first.first == priority)
+                         ? oldest->first.second : _main_end_ids[priority];
+
+        try {
+            _main_queues[priority]->release(watermark);
+            if (set && cancelled) {
+                /* Workers of a cancelled routine left some subtasks unclaimed – the next routine must not get them */
+                drain_queues(*set);
             }
+            if (set && !set->tracked) {
+                for (auto &q : set->queues) {
+                    q->release(q->get_produced_count());
+                }
+            }
+        } catch (const std::exception &e) {
+            /* Not critical – the pages will be dropped by a later call */
+            LogWarn("Failed to release finished queue pages: {}", e.what());
         }
 
-        return acc;
+        if (set && !set->planned) {
+            _idle_queue_sets.push_back(set);
+        }
     }
 
-    /* Produces a number of vector-only primary tasks for workers, waits
-     * until they are reported to be complete, accumulating result using
+    /* Produces a number of vector-only primary tasks for workers
+     * and returns a future of their completion, accumulating result using
      * the 'update' function, provided that there is any.
      */
     template<class T>
-    T produce_vector_tasks(const proto::task_type type, const T alpha,
+    routine_future<T> produce_vector_tasks(const proto::task_type type, const T alpha,
                            const id_t X_id, const id_t Y_id,
                            T acc = 0, updater<T> update = nullptr);
 
-    /* Produces a number of matrix-to-wektor primary tasks for workers, waits
-     * until they are reported to be complete, accumulating result using
+    /* Produces a number of matrix-to-wektor primary tasks for workers
+     * and returns a future of their completion, accumulating result using
      * the 'update' function, provided that there is any.
      */
     template<class T>
-    T produce_mixed_tasks(const proto::task_type type,
+    routine_future<T> produce_mixed_tasks(const proto::task_type type,
                           const index_t KL, const index_t KU,
                           const UPLO Uplo, const DIAG Diag,
                           const id_t A_id, const TRANSPOSE TransA, const T alpha,
                           const id_t X_id, const T beta,
                           const id_t Y_id, T acc = 0, updater<T> update = nullptr);
 
-    /* Produces a number of matrix-only primary tasks for workers, waits
-     * until they are reported to be complete, accumulating result using
+    /* Produces a number of matrix-only primary tasks for workers
+     * and returns a future of their completion, accumulating result using
      * the 'update' function, provided that there is any.
      */
     template<class T>
-    T produce_matrix_tasks(const proto::task_type type,
+    routine_future<T> produce_matrix_tasks(const proto::task_type type,
                            const id_t A_id, const enum TRANSPOSE TransA, const T alpha,
                            const id_t B_id, const enum TRANSPOSE TransB, const T beta,
                            const id_t C_id, T acc = 0, updater<T> update = nullptr);
 
+    /* Produces the primary tasks of passes compiled from lazy expressions, see expression.hh */
     template<class T>
-    T produce_generation_tasks(const proto::task_type type,
+    routine_future<T> produce_fused_vector_tasks(const int64_t ops, const T scale, const T alpha, const T beta,
+                                                 const id_t X_id, const id_t Y_id, const id_t Z_id);
+
+    template<class T>
+    routine_future<T> produce_gemv_dot_tasks(const id_t A_id, const TRANSPOSE TransA, const T alpha,
+                                             const id_t X_id, const T beta, const id_t Y_id, const id_t Z_id);
+
+    template<class T>
+    routine_future<T> produce_generation_tasks(const proto::task_type type,
                                const id_t structure_id, const double alpha,
                                T acc = 0, updater<T> update = nullptr);
 
-    void produce_tasks_in_queues(std::vector<scylla_queue::task> &tasks) {
+    /* Without cost estimates, tasks are dealt to the queues in turn – or, if `contiguous`,
+     * each queue gets a contiguous part of them, in order. With cost estimates, heavy tasks
+     * are spread first (see assign_longest_first), each queue getting its share heaviest first.
+     * A single queue shared by all workers gets all tasks, heaviest first, which balances them
+     * the same way as they are claimed.
+     */
+    void produce_tasks_in_queues(std::vector<task_queue::task> &tasks, const std::vector<int64_t> &costs = {},
+                                 bool contiguous = false) {
         /* TODO: consider limiting the number of queues used
          * to such a value @q that q^2 <= tasks.size(),
          * or 10 * q <= tasks.size() or any other value
          * that would make the level of distribution sensible.
          */
-        std::vector<std::vector<scylla_queue::task>> split(_current_worker_count);
+        auto &queues = current_queues();
+        std::vector<std::vector<task_queue::task>> split(queues.size());
+
+        if (costs.size() == tasks.size()) {
+            auto assignment = assign_longest_first(costs, queues.size());
+            std::vector<int64_t> loads(queues.size(), 0);
+            for (size_t i : order_by_cost(costs)) {
+                split[assignment[i]].emplace_back(tasks[i]);
+                loads[assignment[i]] += costs[i];
+            }
+            LogInfo("Assigned {} subtasks by estimated cost, the heaviest queue got {} of {}", tasks.size(),
+                    *std::max_element(loads.begin(), loads.end()), std::accumulate(loads.begin(), loads.end(), int64_t(0)));
+        } else if (contiguous) {
+            for (size_t i = 0; i < tasks.size(); i++)
+                split[i * queues.size() / tasks.size()].emplace_back(tasks[i]);
+        } else {
+            for (size_t i = 0; i < tasks.size(); i++)
+                split[i % queues.size()].emplace_back(tasks[i]);
+        }
 
-        for (size_t i = 0; i < tasks.size(); i++)
-            split[i % _current_worker_count].emplace_back(tasks[i]);
+        for (size_t i = 0; i < queues.size(); i++)
+            queues[i]->produce(split[i]);
+    }
 
-        for (size_t i = 0; i < _current_worker_count; i++)
-            _subtask_queues[i].produce(split[i]);
+    /* Runs `estimate` (see cost_model.hh) only if cost based assignment is enabled */
+    template<class F>
+    std::vector<int64_t> estimated_costs(F estimate) {
+        try {
+            return _cost_based_assignment && !_recording && !_run_locally.value_or(false) ? estimate() : std::vector<int64_t>();
+        } catch (...) {
+            forget_execution();
+            throw;
+        }
     }
 
+    /* Dense size of a matrix (rows × columns, not its nnz), as passed to choose_execution */
+    static int64_t entries_of(const basic_matrix &A) {
+        return A.get_row_count() * A.get_column_count();
+    }
+
+    /* Called when a routine fails after choose_execution, but before produce_async takes the decision over –
+     * the next routine has to make its own. Subtasks added to the local queue are dropped.
+     */
+    void forget_execution() {
+        if (_run_locally.value_or(false)) {
+            _local_queues.front()->reset();
+        }
+        _run_locally.reset();
+    }
+
+    /* Decides whether the routine being started, which touches `entries` entries of its structures, runs in this process.
+     * Routines that only pass their output structure to add_*_as_queue_tasks get it decided there.
+     */
+    void choose_execution(int64_t entries) {
+        _run_locally = !_recording && _local_execution_threshold > 0 && entries <= _local_execution_threshold;
+        if (*_run_locally && !_local_backend) {
+            _local_backend = std::make_shared<local_backend>();
+            _local_backend->create_queue(0, false, false);
+            _local_queues.push_back(_local_backend->open_queue(0));
+        }
+    }
+
+    /* Cost estimates are only used if they are skewed – otherwise subtasks are scheduled as usual.
+     * Planned routines always schedule their subtasks as a task range.
+     */
+    bool use_costs(const std::vector<int64_t> &costs, int64_t task_count) {
+        return _cost_based_assignment && !_recording && (int64_t)costs.size() == task_count && is_skewed(costs);
+    }
+
+    /* Publishes subtasks [1, count] – or, with columns > 0, a count / columns high grid of them –
+     * as a single task range, which workers claim in chunks of guided size.
+     */
+    void produce_range_in_queue(int64_t count, int64_t columns) {
+        if (_recording) {
+            current_queues();
+            _recording->_count = count;
+            _recording->_columns = columns;
+            _recording->_consumers = _current_worker_count;
+            return;
+        }
+
+        if (_run_locally.value_or(false)) {
+            current_queues().front()->produce_range(count, columns, 1);
+            return;
+        }
+
+        LogInfo("Scheduling {} subtasks as a task range", count);
+        current_queues().front()->produce_range(count, columns, _current_worker_count);
+    }
+
+    /* `costs` – estimated cost of each segment, see cost_model.hh */
     template<class T>
-    void add_segments_as_queue_tasks(const vector<T> &X) {
-        std::vector<scylla_queue::task> tasks;
+    void add_segments_as_queue_tasks(const vector<T> &X, const std::vector<int64_t> &costs = {}) {
+        try {
+            produce_segment_tasks(X, costs);
+        } catch (...) {
+            forget_execution();
+            throw;
+        }
+    }
+
+    template<class T>
+    void produce_segment_tasks(const vector<T> &X, const std::vector<int64_t> &costs) {
+        if (!_run_locally.has_value()) {
+            choose_execution(X.get_length());
+        }
+
+        bool by_cost = use_costs(costs, X.get_segment_count());
+        if ((_range_scheduling || _recording || *_run_locally) && !by_cost) {
+            produce_range_in_queue(X.get_segment_count(), 0);
+            return;
+        }
+
+        std::vector<task_queue::task> tasks;
         tasks.reserve(X.get_segment_count());
         for (scylla_blas::index_t i = 1; i <= X.get_segment_count(); i++) {
             tasks.push_back({
@@ -124,68 +481,583 @@ class routine_scheduler {
             });
         }
         LogInfo("Scheduling {} subtasks (vector segments)", tasks.size());
-        produce_tasks_in_queues(tasks);
+        produce_tasks_in_queues(tasks, by_cost ? costs : std::vector<int64_t>());
     }
 
+    /* Blocks are placed tile by tile (see task_range::task_of), so that a worker gets blocks
+     * sharing rows and columns, whose operands it can reuse. `costs` – estimated cost of each block,
+     * row by row, see cost_model.hh. Costs that are used override the placement.
+     */
     template<class T>
-    void add_blocks_as_queue_tasks(const matrix<T> &C) {
+    void add_blocks_as_queue_tasks(const matrix<T> &C, const std::vector<int64_t> &costs = {}) {
+        try {
+            produce_block_tasks(C, costs);
+        } catch (...) {
+            forget_execution();
+            throw;
+        }
+    }
+
+    template<class T>
+    void produce_block_tasks(const matrix<T> &C, const std::vector<int64_t> &costs) {
+        if (!_run_locally.has_value()) {
+            choose_execution(C.get_row_count() * C.get_column_count());
+        }
+
+        int64_t count = C.get_blocks_height() * C.get_blocks_width();
+        bool by_cost = use_costs(costs, count);
+        if ((_range_scheduling || _recording || *_run_locally) && !by_cost) {
+            produce_range_in_queue(count, C.get_blocks_width());
+            return;
+        }
+
         LogDebug("Creating block-based subtasks");
-        std::vector<scylla_blas::scylla_queue::task> tasks;
-        tasks.reserve(C.get_blocks_height() * C.get_blocks_width());
-        for (scylla_blas::index_t i = 1; i <= C.get_blocks_height(); i++) {
-            for (scylla_blas::index_t j = 1; j <= C.get_blocks_width(); j++) {
-                tasks.push_back({
-                    .type = scylla_blas::proto::NONE,
-                    .coord {
-                            .block_row = i,
-                            .block_column = j
-                    }});
+        std::vector<scylla_blas::task_queue::task> tasks;
+        tasks.reserve(count);
+        if (by_cost) {
+            for (scylla_blas::index_t i = 1; i <= C.get_blocks_height(); i++) {
+                for (scylla_blas::index_t j = 1; j <= C.get_blocks_width(); j++) {
+                    tasks.push_back({
+                        .type = scylla_blas::proto::NONE,
+                        .coord {
+                                .block_row = i,
+                                .block_column = j
+                        }});
+                }
             }
+            produce_tasks_in_queues(tasks, costs);
+            return;
+        }
+
+        /* Each queue gets a contiguous run of tiles */
+        task_range grid { .first_id = 0, .end_id = count, .columns = C.get_blocks_width(), .consumers = _current_worker_count };
+        for (int64_t i = 0; i < count; i++) {
+            tasks.push_back(grid.task_of(i));
         }
-        produce_tasks_in_queues(tasks);
+        produce_tasks_in_queues(tasks, {}, true);
     }
 
-    void prepare_queues(size_t queue_count) {
-        if (_subtask_queues.size() > queue_count) {
-            for (size_t i = queue_count; i < _subtask_queues.size(); i++) {
-                scylla_queue::delete_queue(_session, _subtask_queues[i].get_id());
+    /* A planned set has a single queue, shared by all workers, same as sets used with range scheduling */
+    std::shared_ptr<queue_set> create_queue_set(bool planned = false) {
+        auto set = std::make_shared<queue_set>(queue_set{ _next_queue_id, {}, planned });
+        _next_queue_id += _current_worker_count;
+
+        if (planned) {
+            _backend->create_queue(set->base, false, true);
+            set->queues.push_back(_backend->open_queue(set->base));
+            _plan_sets.push_back(set);
+            return set;
+        }
+
+        if (_range_scheduling) {
+            _backend->create_queue(set->base, false, true);
+            set->queues.push_back(_backend->open_queue(set->base));
+            _queue_sets.push_back(set);
+            return set;
+        }
+
+        for (int64_t i = 0; i < _current_worker_count; i++) {
+            _backend->create_queue(set->base + i, false, _work_stealing);
+            set->queues.push_back(_backend->open_queue(set->base + i));
+        }
+
+        if (_work_stealing) {
+            for (auto &q : set->queues) {
+                q->set_siblings(set->base, set->queues.size());
             }
-            _subtask_queues.erase(_subtask_queues.begin() + queue_count, _subtask_queues.end());
+        }
+
+        _queue_sets.push_back(set);
+        return set;
+    }
+
+    /* Routines are split between the workers registered in the backend (see queue_backend::count_live_workers).
+     * If none are – e.g. they are older builds, which don't register – DEFAULT_WORKER_COUNT is used instead.
+     */
+    void refresh_worker_count() {
+        int64_t now = get_wall_time_microseconds();
+        if (now - _worker_count_refreshed_at < WORKER_COUNT_REFRESH_MICROSECONDS) return;
+        _worker_count_refreshed_at = now;
+
+        int64_t live;
+        try {
+            live = _backend->count_live_workers();
+        } catch (const std::exception &e) {
+            LogWarn("Failed to count live workers: {}", e.what());
             return;
         }
 
-        while (_subtask_queues.size() < queue_count) {
-            id_t queue_id = get_timestamp();
-            scylla_queue::create_queue(_session, queue_id, false, false);
-            _subtask_queues.emplace_back(_session, queue_id);
+        int64_t count = live > 0 ? live : DEFAULT_WORKER_COUNT;
+        count = std::max(std::min(count, _max_used_workers.value_or(count)), int64_t(1));
+        if (count != _current_worker_count) {
+            LogInfo("Splitting routines between {} workers ({} live)", count, live);
+            _current_worker_count = count;
         }
     }
+
+    /* Queues in a set made for the current worker count and scheduling mode */
+    size_t queue_set_size() const {
+        return _range_scheduling ? 1 : _current_worker_count;
+    }
+
+    /* Subtask queues of the routine being produced. The first call of a routine assigns it a set.
+     * Idle sets made for another worker count are deleted on the way.
+     */
+    const std::vector<std::shared_ptr<task_queue>> &current_queues() {
+        if (_run_locally.value_or(false)) {
+            return _local_queues;
+        }
+        if (!_current_queue_set) {
+            refresh_worker_count();
+        }
+        if (!_current_queue_set && _recording) {
+            if (_idle_plan_sets.empty()) {
+                _current_queue_set = create_queue_set(true);
+            } else {
+                _current_queue_set = _idle_plan_sets.back();
+                _idle_plan_sets.pop_back();
+            }
+        }
+        while (!_current_queue_set && !_idle_queue_sets.empty()) {
+            auto set = std::move(_idle_queue_sets.back());
+            _idle_queue_sets.pop_back();
+            if (set->queues.size() == queue_set_size()) {
+                _current_queue_set = std::move(set);
+            } else {
+                delete_queue_set(set);
+            }
+        }
+        if (!_current_queue_set) {
+            _current_queue_set = create_queue_set();
+        }
+        return _current_queue_set->queues;
+    }
+
+    /* Subtask queue of each main task of the routine being produced, one main task per worker */
+    std::vector<id_t> subtask_queue_ids() {
+        auto &queues = current_queues();
+        if (_run_locally.value_or(false)) {
+            return { queues.front()->get_id() };
+        }
+
+        std::vector<id_t> ids;
+        for (int64_t i = 0; i < _current_worker_count; i++) {
+            ids.push_back(queues[i % queues.size()]->get_id());
+        }
+        return ids;
+    }
+
+    void delete_queue_set(const std::shared_ptr<queue_set> &set) {
+        for (auto &q : set->queues) {
+            _backend->delete_queue(q->get_id());
+        }
+        std::erase(_queue_sets, set);
+    }
+
+    /* Queue sets are recreated lazily, with the current worker count and work stealing setting */
+    void delete_queues() {
+        wait_all();
+        for (auto &set : _queue_sets) {
+            for (auto &q : set->queues) {
+                _backend->delete_queue(q->get_id());
+            }
+        }
+        _queue_sets.clear();
+        _idle_queue_sets.clear();
+        _current_queue_set.reset();
+    }
+    void abort_recording() {
+        _recording = nullptr;
+        _recording_graph = nullptr;
+        if (_current_queue_set) {
+            _idle_plan_sets.push_back(std::move(_current_queue_set));
+        }
+    }
+
+    void wait_for_last_run(task_plan &plan) {
+        if (!plan._last_run.has_value()) return;
+
+        auto it = _outstanding.find(*plan._last_run);
+        if (it != _outstanding.end()) {
+            auto pending = it->second;
+            pending->wait();
+        }
+    }
+
+    /* Produces the main tasks of the plan, whose subtask range is already published */
+    template<class T>
+    routine_future<T> start_plan(task_plan &plan, T acc, updater<T> update) {
+        _current_queue_set = plan._set;
+        auto future = produce_async(plan._main_tasks, acc, update);
+        plan._last_run = _last_started;
+        return future;
+    }
+
+    /* Claims all subtasks left in the queues of the set, without performing them */
+    static void drain_queues(queue_set &set) {
+        for (auto &q : set.queues) {
+            while (!q->consume_guided(GUIDED_MAX_CHUNK).empty());
+        }
+    }
+
+    /* Drops the subtasks of the run of the plan in progress that no worker has taken yet,
+     * then waits for the workers to abandon the ones already taken
+     */
+    void cancel_plan(task_plan &plan) {
+        for (auto &q : plan._set->queues) {
+            q->cancel();
+        }
+        drain_queues(*plan._set);
+        wait_for_last_run(plan);
+    }
+
+    /* Runs sweeps of an iterative solver, produced by `produce_sweep`, until the error they report
+     * relative to the norm of the result drops below EPSILON. Every sweep has the same tasks – they are
+     * planned once, and only started again later. With speculative sweeps two plans take turns: the next
+     * sweep is started before the previous one is checked, and is cancelled if the result has converged.
+     * A sweep that ran alongside the next one may report the error of a result that was changing under it,
+     * so its convergence is only accepted once a sweep started with nothing else in flight confirms it.
+     */
+    template<class T>
+    void run_sweeps(const std::function<void()> &produce_sweep) {
+        struct sweep {
+            task_plan *plan;
+            std::shared_ptr<T> sum;
+            routine_future<T> error;
+        };
+
+        int64_t depth = _speculative_sweeps ? 2 : 1;
+        std::vector<std::unique_ptr<task_plan>> plans;
+        for (int64_t i = 0; i < depth; i++) {
+            plans.push_back(record_plan(produce_sweep));
+        }
+
+        std::deque<sweep> in_flight;
+        int64_t started = 0;
+        auto start = [&] {
+            task_plan &plan = *plans[started++ % depth];
+            auto sum = std::make_shared<T>(0);
+            auto error = run_plan<T>(plan, 0, [sum](T &result, const proto::response &r) {
+                if constexpr (std::is_same_v<T, float>) {
+                    result += r.result_float_pair.first;
+                    *sum += r.result_float_pair.second;
+                } else {
+                    result += r.result_double_pair.first;
+                    *sum += r.result_double_pair.second;
+                }
+            });
+            in_flight.push_back({ &plan, sum, std::move(error) });
+        };
+
+        bool confirming = false;
+        while (started < depth) start();
+        for (int64_t finished = 1; ; finished++) {
+            sweep current = std::move(in_flight.front());
+            in_flight.pop_front();
+            T error = current.error.get();
+            bool converged = !(error / *current.sum > EPSILON);
+
+            if (confirming) {
+                if (converged) {
+                    LogDebug("Converged after {} sweeps", finished);
+                    break;
+                }
+                confirming = false;
+            } else if (finished % _convergence_check_interval == 0 && converged) {
+                if (in_flight.empty()) {
+                    LogDebug("Converged after {} sweeps", finished);
+                    break;
+                }
+                LogDebug("Sweep {} converged alongside {} more, confirming it alone", finished, in_flight.size());
+                for (auto &s : in_flight) {
+                    cancel_plan(*s.plan);
+                }
+                in_flight.clear();
+                confirming = true;
+                start();
+                continue;
+            }
+            while ((int64_t)in_flight.size() < depth) start();
+        }
+
+        for (auto &s : in_flight) {
+            cancel_plan(*s.plan);
+        }
+    }
+
+    /* Main queues are registered for the workers when first used */
+    const std::shared_ptr<task_queue> &get_main_queue(priority_class priority) {
+        auto &queue = _main_queues[priority];
+        if (!queue) {
+            id_t id = _namespace + priority;
+            _backend->create_queue(id, false, true, _main_queue_bucket_count);
+            queue = _backend->open_queue(id);
+            _backend->register_main_queue(id, priority, MAIN_QUEUE_TTL_MICROSECONDS);
+        } else {
+            renew_main_queues();
+        }
+        return queue;
+    }
+
+    /* Called whenever the scheduler produces or waits, renews the registrations once they are due */
+    void renew_main_queues() {
+        int64_t now = get_wall_time_microseconds();
+        if (now - _main_queues_renewed_at < MAIN_QUEUE_HEARTBEAT_MICROSECONDS) return;
+
+        _main_queues_renewed_at = now;
+        try {
+            for (int64_t priority = 0; priority < PRIORITY_CLASS_COUNT; priority++) {
+                if (!_main_queues[priority]) continue;
+                _backend->register_main_queue(_namespace + priority, (priority_class)priority, MAIN_QUEUE_TTL_MICROSECONDS);
+            }
+        } catch (const std::exception &e) {
+            /* Retried on the next heartbeat, well before the registrations lapse */
+            LogWarn("Failed to renew the registrations of main queues: {}", e.what());
+        }
+    }
+
 public:
     /* The queue used for subroutines requested in methods */
     routine_scheduler(const std::shared_ptr <scmd::session> &session) :
+        routine_scheduler(session, std::make_shared<scylla_backend>(session)) {}
+
+    /* Queues are created in `backend`, workers have to consume them from the same backend */
+    routine_scheduler(const std::shared_ptr <scmd::session> &session, const std::shared_ptr<queue_backend> &backend) :
         _session(session),
-        _subtask_queues(),
-        _main_worker_queue(_session, DEFAULT_WORKER_QUEUE_ID),
+        _backend(backend),
+        _namespace(get_timestamp()),
+        _main_queues(),
+        _main_queue_bucket_count(DEFAULT_WORKER_QUEUE_BUCKET_COUNT),
+        _main_queues_renewed_at(get_wall_time_microseconds()),
+        _priority(NORMAL),
+        _cancellation(),
+        _queue_sets(),
+        _idle_queue_sets(),
+        _plan_sets(),
+        _idle_plan_sets(),
+        _recording(nullptr),
+        _recording_graph(nullptr),
+        _current_queue_set(),
+        _next_queue_id(_namespace + PRIORITY_CLASS_COUNT),
+        _outstanding(),
+        _main_end_ids(),
+        _last_started(),
         _current_worker_count(DEFAULT_WORKER_COUNT),
-        _scheduler_sleep_time(DEFAULT_SCHEDULER_SLEEP_TIME_MICROSECONDS)
-    {
-        prepare_queues(_current_worker_count);
+        _max_used_workers(),
+        _worker_count_refreshed_at(0),
+        _scheduler_sleep_time(DEFAULT_SCHEDULER_SLEEP_TIME_MICROSECONDS),
+        _scheduler_min_sleep_time(DEFAULT_SCHEDULER_MIN_SLEEP_TIME_MICROSECONDS),
+        _work_stealing(DEFAULT_WORK_STEALING),
+        _range_scheduling(DEFAULT_RANGE_SCHEDULING),
+        _cost_based_assignment(DEFAULT_COST_BASED_ASSIGNMENT),
+        _local_execution_threshold(DEFAULT_LOCAL_EXECUTION_THRESHOLD),
+        _run_locally(),
+        _local_backend(),
+        _local_queues(),
+        _speculative_sweeps(DEFAULT_SPECULATIVE_SWEEPS),
+        _convergence_check_interval(DEFAULT_CONVERGENCE_CHECK_INTERVAL),
+        _operand_reads() {}
+
+    /* Waits for the routines that are still in progress, then deletes the queues of this scheduler */
+    ~routine_scheduler() {
+        try {
+            delete_queues();
+            for (auto &set : _plan_sets) {
+                _backend->delete_queue(set->base);
+            }
+            for (int64_t priority = 0; priority < PRIORITY_CLASS_COUNT; priority++) {
+                if (!_main_queues[priority]) continue;
+                _backend->unregister_main_queue(_namespace + priority, (priority_class)priority);
+                _backend->delete_queue(_namespace + priority);
+            }
+        } catch (const std::exception &e) {
+            LogError("Failed to delete queues of the scheduler: {}", e.what());
+        }
     }
 
-    ~routine_scheduler() {
-        for (auto & _subtask_queue : _subtask_queues) {
-            scylla_queue::delete_queue(_session, _subtask_queue.get_id());
+    /* Waits until all routines started with *_async methods are finished, even if their futures were dropped */
+    void wait_all() {
+        while (!_outstanding.empty()) {
+            auto pending = _outstanding.begin()->second;
+            pending->wait();
+        }
+    }
+
+    /* Records the tasks of the routine started by `start_routine` (one of the *_async methods, called
+     * on this scheduler) without producing them, e.g.
+     *     auto plan = scheduler.record_plan([&] { scheduler.dgemv_async(NoTrans, 1, A, X, 0, Y); });
+     * The future returned by the routine meanwhile is ready at once, and should be ignored.
+     * Routines that need more than one round of tasks, like the blocking ones, can't be planned.
+     */
+    template<class F>
+    std::unique_ptr<task_plan> record_plan(F start_routine) {
+        auto plan = std::make_unique<task_plan>();
+        _recording = plan.get();
+        try {
+            start_routine();
+        } catch (...) {
+            abort_recording();
+            throw;
+        }
+        _recording = nullptr;
+
+        if (!plan->_set) {
+            throw std::runtime_error("No routine was started while recording a task plan");
         }
-        _main_worker_queue.reset();
+        plan->_on_release = [this, set = plan->_set] () { _idle_plan_sets.push_back(set); };
+
+        LogInfo("Recorded a plan of {} main tasks and {} subtasks", plan->_main_tasks.size(), plan->_count);
+        return plan;
+    }
+
+    /* Starts the routine of the plan again, accumulating results like produce_async does.
+     * A plan runs once at a time – starting it again first waits for the previous run.
+     */
+    template<class T = float>
+    routine_future<T> run_plan(task_plan &plan, T acc = 0, updater<T> update = nullptr) {
+        wait_for_last_run(plan);
+        plan._set->queues.front()->produce_range(plan._count, plan._columns, plan._consumers);
+        return start_plan(plan, acc, update);
+    }
+
+    /* Records the routines started by `start_routines` (*_async methods, called on this scheduler) as a graph, e.g.
+     *     auto graph = scheduler.record_graph([&] {
+     *         scheduler.dcopy_async(b, Y);
+     *         scheduler.dgemv_async(NoTrans, -1, A, X, 1, Y);
+     *     });
+     * Dependencies between the routines follow from the structures they touch, in the order they were started.
+     * Same as with record_plan, the futures returned meanwhile should be ignored.
+     */
+    template<class F>
+    std::unique_ptr<task_graph> record_graph(F start_routines) {
+        auto graph = std::make_unique<task_graph>();
+        graph->_nodes.push_back(std::make_unique<task_plan>());
+        _recording = graph->_nodes.back().get();
+        _recording_graph = graph.get();
+        try {
+            start_routines();
+        } catch (...) {
+            abort_recording();
+            graph->_nodes.pop_back();
+            for (auto &node : graph->_nodes) {
+                node->_on_release = [this, set = node->_set] () { _idle_plan_sets.push_back(set); };
+            }
+            throw;
+        }
+        _recording = nullptr;
+        _recording_graph = nullptr;
+        /* The plan prepared for a routine that was never started */
+        graph->_nodes.pop_back();
+
+        if (graph->_nodes.empty()) {
+            throw std::runtime_error("No routine was started while recording a task graph");
+        }
+
+        auto &nodes = graph->_nodes;
+        std::vector<std::vector<queue_dependency>> upstream(nodes.size());
+        std::vector<bool> tracked(nodes.size(), false);
+        for (size_t j = 0; j < nodes.size(); j++) {
+            routine_subtasks downstream { nodes[j]->_main_tasks, nodes[j]->_count, nodes[j]->_columns };
+            for (size_t i = 0; i < j; i++) {
+                auto kind = dependency_between({ nodes[i]->_main_tasks, nodes[i]->_count, nodes[i]->_columns }, downstream);
+                if (kind.has_value()) {
+                    upstream[j].push_back({ nodes[i]->_set->base, *kind });
+                    tracked[i] = true;
+                }
+            }
+            graph->_dependency_count += upstream[j].size();
+        }
+
+        for (size_t i = 0; i < nodes.size(); i++) {
+            auto set = nodes[i]->_set;
+            set->queues.front()->set_dependencies(upstream[i], tracked[i]);
+            set->tracked = tracked[i];
+            nodes[i]->_on_release = [this, set] () {
+                try {
+                    set->queues.front()->set_dependencies({}, false);
+                } catch (const std::exception &e) {
+                    LogWarn("Failed to clear dependencies of queue {}: {}", set->base, e.what());
+                }
+                set->tracked = false;
+                _idle_plan_sets.push_back(set);
+            };
+        }
+
+        LogInfo("Recorded a graph of {} routines with {} dependencies", nodes.size(), graph->_dependency_count);
+        return graph;
+    }
+
+    /* Starts all routines of the graph, in the order they were recorded, and returns their futures in that order.
+     * Results of the routines are not accumulated – routines whose result is needed should be run as plans.
+     * A graph runs once at a time – starting it again first waits for the previous run.
+     */
+    std::vector<routine_future<void>> run_graph(task_graph &graph) {
+        for (auto &node : graph._nodes) {
+            wait_for_last_run(*node);
+        }
+
+        /* All ranges are published before any main task, so that a downstream worker never sees a stale upstream range */
+        for (auto &node : graph._nodes) {
+            auto &queue = node->_set->queues.front();
+            if (node->_set->tracked) {
+                queue->release(queue->get_produced_count());
+            }
+            queue->produce_range(node->_count, node->_columns, node->_consumers);
+        }
+
+        std::vector<routine_future<void>> futures;
+        for (auto &node : graph._nodes) {
+            updater<float> ignore = [] (float &, const proto::response &) {};
+            futures.push_back(start_plan<float>(*node, 0, ignore).then([](float) {}));
+        }
+        return futures;
+    }
+
+    /* First id of the queues of this scheduler */
+    id_t get_namespace() const {
+        return _namespace;
+    }
+
+    priority_class get_priority() const {
+        return _priority;
+    }
+
+    /* Routines started afterwards go to the main queue of given priority class. Short, latency sensitive
+     * routines should be INTERACTIVE, long ones that may wait BATCH – workers favor the former.
+     */
+    void set_priority(priority_class priority) {
+        _priority = priority;
+    }
+
+    /* Routines started afterwards (until clear_cancellation_token) are stopped once `token` is cancelled,
+     * or its deadline passes: workers abandon their subtasks, and routine_future::get throws routine_cancelled_error.
+     * Cancellation is noticed while the routine is polled – the deadline also without polls.
+     */
+    void set_cancellation_token(const cancellation_token &token) {
+        _cancellation = token;
+    }
+
+    void clear_cancellation_token() {
+        _cancellation.reset();
+    }
+
+    /* Number of routines started with *_async methods that are not finished yet, as last polled */
+    size_t get_outstanding_count() const {
+        return _outstanding.size();
     }
 
+    /* Number of workers the next routine will be split between */
     int64_t get_max_used_workers() {
+        refresh_worker_count();
         return this->_current_worker_count;
     }
 
+    /* Routines are split between the live workers, but no more than this many. Routines in progress
+     * keep the queues they were given, recorded plans and graphs keep the worker count they were recorded with.
+     */
     void set_max_used_workers(int64_t new_max_used_workers) {
-        this->_current_worker_count = new_max_used_workers;
-        prepare_queues(new_max_used_workers);
+        this->_max_used_workers = new_max_used_workers;
+        this->_worker_count_refreshed_at = 0;
     }
 
     int64_t get_scheduler_sleep_time() {
@@ -196,6 +1068,117 @@ public:
         this->_scheduler_sleep_time = new_scheduler_sleep_time;
     }
 
+    int64_t get_scheduler_min_sleep_time() {
+        return this->_scheduler_min_sleep_time;
+    }
+
+    /* Sets the first (shortest) sleep between completion polls.
+     * Consecutive polls without progress double it, up to the scheduler sleep time.
+     */
+    void set_scheduler_min_sleep_time(int64_t new_scheduler_min_sleep_time) {
+        this->_scheduler_min_sleep_time = new_scheduler_min_sleep_time;
+    }
+
+    bool get_work_stealing() {
+        return this->_work_stealing;
+    }
+
+    /* With work stealing enabled, a worker that drained its subtask queue
+     * keeps taking subtasks from the other queues of the same routine,
+     * so a single slow worker or an unlucky split doesn't hold up the whole routine.
+     * Subtask queues become multi-consumer, so each claim is a bit more expensive.
+     */
+    void set_work_stealing(bool new_work_stealing) {
+        if (this->_work_stealing == new_work_stealing) return;
+
+        delete_queues();
+        this->_work_stealing = new_work_stealing;
+    }
+
+    bool get_range_scheduling() {
+        return this->_range_scheduling;
+    }
+
+    /* With range scheduling enabled, subtasks of a routine are not written to the queues one by one.
+     * A single descriptor of the whole index space is published instead, whatever its size,
+     * and workers claim chunks of it that shrink as it drains (guided self-scheduling).
+     * All workers share one subtask queue, so work stealing makes no difference.
+     */
+    void set_range_scheduling(bool new_range_scheduling) {
+        if (this->_range_scheduling == new_range_scheduling) return;
+
+        delete_queues();
+        this->_range_scheduling = new_range_scheduling;
+    }
+
+    bool get_cost_based_assignment() {
+        return this->_cost_based_assignment;
+    }
+
+    /* With cost based assignment enabled, gemv, gemm and ger estimate the cost of their subtasks
+     * from non-zero counts of the matrices. If a few subtasks outweigh the rest, they are assigned
+     * heaviest first, instead of as a task range or in turn. Reading the counts costs a query or two per routine.
+     */
+    void set_cost_based_assignment(bool new_cost_based_assignment) {
+        this->_cost_based_assignment = new_cost_based_assignment;
+    }
+
+    int64_t get_local_execution_threshold() {
+        return this->_local_execution_threshold;
+    }
+
+    /* Routines that touch at most this many entries of their structures (as told by their sizes) are run
+     * in this process, with the same procedures the workers use – there is no queue round trip to wait for.
+     * Such routines are finished once their *_async method returns, in whatever order they were started
+     * relative to routines still in progress on workers. Routines of plans and graphs always go to workers. 0 disables it.
+     */
+    void set_local_execution_threshold(int64_t new_local_execution_threshold) {
+        this->_local_execution_threshold = new_local_execution_threshold;
+    }
+
+    int64_t get_main_queue_bucket_count() {
+        return this->_main_queue_bucket_count;
+    }
+
+    /* Main queues of this scheduler are spread over this many buckets (see scylla_queue::create_queue), so that
+     * many workers claiming main tasks don't contend on one row. Only affects queues not created yet.
+     */
+    void set_main_queue_bucket_count(int64_t new_main_queue_bucket_count) {
+        this->_main_queue_bucket_count = std::max(new_main_queue_bucket_count, int64_t(1));
+    }
+
+    bool get_speculative_sweeps() {
+        return this->_speculative_sweeps;
+    }
+
+    /* Iterative solvers (trsv, tbsv) start each sweep before knowing whether the previous one has converged,
+     * so that workers don't wait for the check. A sweep started after the result converged is cancelled.
+     */
+    void set_speculative_sweeps(bool new_speculative_sweeps) {
+        this->_speculative_sweeps = new_speculative_sweeps;
+    }
+
+    int64_t get_convergence_check_interval() {
+        return this->_convergence_check_interval;
+    }
+
+    /* Iterative solvers check whether the result has converged once every this many sweeps */
+    void set_convergence_check_interval(int64_t new_convergence_check_interval) {
+        this->_convergence_check_interval = std::max(new_convergence_check_interval, int64_t(1));
+    }
+
+    /* Blocks (and their bytes) of operands read by workers in routines collected so far.
+     * Only gemm reports them for now – with its rows and columns reused within tiles of C,
+     * it is the measure of how well the placement of subtasks works.
+     */
+    operand_reads get_operand_reads() const {
+        return this->_operand_reads;
+    }
+
+    void reset_operand_reads() {
+        this->_operand_reads = {};
+    }
+
 /*
 * ===========================================================================
 * Prototypes for level 1 BLAS functions
@@ -392,6 +1375,116 @@ public:
                           const enum TRANSPOSE TransA, const enum DIAG Diag,
                           const double alpha, const matrix<double> &A, matrix<double> &B);
 
+/*
+* ===========================================================================
+* Asynchronous versions of routines
+* ===========================================================================
+*
+* Each *_async method produces the tasks of its routine and returns without waiting for them.
+* Routines started this way are performed concurrently, each one with subtask queues of its own.
+* It is up to the caller not to start a routine that depends on the result of an unfinished one.
+* Structures passed by reference have to outlive the returned future.
+*/
+    routine_future<float> sdsdot_async(const float alpha, const vector<float> &X, const vector<float> &Y);
+    routine_future<double> dsdot_async(const vector<float> &X, const vector<float> &Y);
+    routine_future<float> sdot_async(const vector<float> &X, const vector<float> &Y);
+    routine_future<double> ddot_async(const vector<double> &X, const vector<double> &Y);
+
+    routine_future<float> snrm2_async(const vector<float> &X);
+    routine_future<float> sasum_async(const vector<float> &X);
+
+    routine_future<double> dnrm2_async(const vector<double> &X);
+    routine_future<double> dasum_async(const vector<double> &X);
+
+    routine_future<index_t> isamax_async(const vector<float> &X);
+    routine_future<index_t> idamax_async(const vector<double> &X);
+
+    routine_future<void> sswap_async(vector<float> &X, vector<float> &Y);
+    routine_future<void> scopy_async(const vector<float> &X, vector<float> &Y);
+    routine_future<void> saxpy_async(const float alpha, const vector<float> &X, vector<float> &Y);
+
+    routine_future<void> dswap_async(vector<double> &X, vector<double> &Y);
+    routine_future<void> dcopy_async(const vector<double> &X, vector<double> &Y);
+    routine_future<void> daxpy_async(const double alpha, const vector<double> &X, vector<double> &Y);
+
+    routine_future<void> sscal_async(const float alpha, vector<float> &X);
+    routine_future<void> dscal_async(const double alpha, vector<double> &X);
+
+    routine_future<vector<float>&> sgemv_async(const enum TRANSPOSE TransA,
+                                               const float alpha, const matrix<float> &A,
+                                               const vector<float> &X, const float beta, vector<float> &Y);
+
+    routine_future<vector<float>&> sgbmv_async(const enum TRANSPOSE TransA,
+                                               const int KL, const int KU,
+                                               const float alpha, const matrix<float> &A,
+                                               const vector<float> &X, const float beta, vector<float> &Y);
+
+    routine_future<vector<double>&> dgemv_async(const enum TRANSPOSE TransA,
+                                                const double alpha, const matrix<double> &A,
+                                                const vector<double> &X, const double beta, vector<double> &Y);
+
+    routine_future<vector<double>&> dgbmv_async(const enum TRANSPOSE TransA,
+                                                const int KL, const int KU,
+                                                const double alpha, const matrix<double> &A,
+                                                const vector<double> &X, const double beta, vector<double> &Y);
+
+    routine_future<matrix<float>&> sger_async(const float alpha,
+                                              const vector<float> &X, const vector<float> &Y, matrix<float> &A);
+
+    routine_future<matrix<double>&> dger_async(const double alpha,
+                                               const vector<double> &X, const vector<double> &Y, matrix<double> &A);
+
+    routine_future<matrix<float>&> sgemm_async(const enum TRANSPOSE TransA, const enum TRANSPOSE TransB,
+                                               const float alpha, const matrix<float> &A,
+                                               const matrix<float> &B,
+                                               const float beta, matrix<float> &C);
+
+    routine_future<matrix<float>&> ssyrk_async(__attribute__((unused)) const enum UPLO Uplo, const enum TRANSPOSE Trans,
+                                               const float alpha, const matrix<float> &A,
+                                               const float beta, matrix<float> &C);
+
+    routine_future<matrix<float>&> ssyr2k_async(__attribute__((unused)) const enum UPLO Uplo, const enum TRANSPOSE Trans,
+                                                const float alpha, const matrix<float> &A,
+                                                const float beta, const matrix<float> &B, matrix<float> &C);
+
+    routine_future<matrix<double>&> dgemm_async(const enum TRANSPOSE TransA, const enum TRANSPOSE TransB,
+                                                const double alpha, const matrix<double> &A,
+                                                const matrix<double> &B,
+                                                const double beta, matrix<double> &C);
+
+    routine_future<matrix<double>&> dsyrk_async(__attribute__((unused)) const enum UPLO Uplo, const enum TRANSPOSE Trans,
+                                                const double alpha, const matrix<double> &A,
+                                                const double beta, matrix<double> &C);
+
+    routine_future<matrix<double>&> dsyr2k_async(__attribute__((unused)) const enum UPLO Uplo, const enum TRANSPOSE Trans,
+                                                 const double alpha, const matrix<double> &A,
+                                                 const double beta, const matrix<double> &B, matrix<double> &C);
+
+    /* Fused passes, compiled from lazy expressions (see expression.hh). The result is the dot product they compute, if any.
+     *
+     * A fused vector pass performs the steps of `ops` (see proto::fused_op) on each segment in turn:
+     * X = scale * X, then Y = alpha * X + beta * Y, then the dot product of the last vector written with Z.
+     * Y and Z are only used if a step needs them.
+     */
+    routine_future<float> sfused_vector_async(const int64_t ops, const float scale, vector<float> &X,
+                                              const float alpha, const float beta, vector<float> &Y,
+                                              const vector<float> &Z);
+
+    routine_future<double> dfused_vector_async(const int64_t ops, const double scale, vector<double> &X,
+                                               const double alpha, const double beta, vector<double> &Y,
+                                               const vector<double> &Z);
+
+    /* Y = alpha * op(A) * X + beta * Y, followed by the dot product of Y with Z */
+    routine_future<float> sgemv_dot_async(const enum TRANSPOSE TransA,
+                                          const float alpha, const matrix<float> &A,
+                                          const vector<float> &X, const float beta, vector<float> &Y,
+                                          const vector<float> &Z);
+
+    routine_future<double> dgemv_dot_async(const enum TRANSPOSE TransA,
+                                           const double alpha, const matrix<double> &A,
+                                           const vector<double> &X, const double beta, vector<double> &Y,
+                                           const vector<double> &Z);
+
     /* MISC */
 
     /* Generate dense vectors */
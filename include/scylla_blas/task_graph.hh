@@ -0,0 +1,201 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include "queue/proto.hh"
+#include "queue/task_queue.hh"
+
+namespace scylla_blas {
+
+/* Structures read and written by the subtasks of a routine, derived from one of its main tasks.
+ * Used by routine_scheduler::record_graph to find out how the routines of a graph depend on each other.
+ */
+struct structure_access {
+    bool is_matrix;
+    id_t id;
+    bool write;
+    /* Subtask i only touches segment (or block) i of the structure, with the index (or coordinates) of the subtask.
+     * Otherwise any subtask may touch any part of it.
+     */
+    bool per_subtask;
+};
+
+/* Subtasks of routines that are not described here (e.g. the blocking ones) are assumed to touch
+ * everything – std::nullopt makes the routines that follow them wait for all of their subtasks.
+ */
+inline std::optional<std::vector<structure_access>> accesses_of(const proto::task &main_task) {
+    using namespace proto;
+
+    /* Ids of operands a routine doesn't have are not set – they are not listed */
+    auto single_vector_routine = [] (id_t X_id, bool writes_X) {
+        return std::vector<structure_access>{
+            { .is_matrix = false, .id = X_id, .write = writes_X, .per_subtask = true }
+        };
+    };
+
+    auto vector_routine = [] (id_t X_id, id_t Y_id, bool writes_X, bool writes_Y) {
+        return std::vector<structure_access>{
+            { .is_matrix = false, .id = X_id, .write = writes_X, .per_subtask = true },
+            { .is_matrix = false, .id = Y_id, .write = writes_Y, .per_subtask = true }
+        };
+    };
+
+    /* Y = alpha * op(A) * X + beta * Y: segment i of Y reads block row i of op(A), and all of X */
+    auto mixed_routine = [] (const auto &t) {
+        return std::vector<structure_access>{
+            { .is_matrix = true, .id = t.A_id, .write = false, .per_subtask = false },
+            { .is_matrix = false, .id = t.X_id, .write = false, .per_subtask = false },
+            { .is_matrix = false, .id = t.Y_id, .write = true, .per_subtask = true }
+        };
+    };
+
+    /* A = alpha * X * Y^T + A: block (i, j) of A reads segment i of X and segment j of Y */
+    auto update_routine = [] (const auto &t) {
+        return std::vector<structure_access>{
+            { .is_matrix = false, .id = t.X_id, .write = false, .per_subtask = false },
+            { .is_matrix = false, .id = t.Y_id, .write = false, .per_subtask = false },
+            { .is_matrix = true, .id = t.A_id, .write = true, .per_subtask = true }
+        };
+    };
+
+    /* C = alpha * op(A) * op(B) + beta * C: block (i, j) of C reads a block row of op(A) and a block column of op(B) */
+    auto matrix_routine = [] (const auto &t) {
+        return std::vector<structure_access>{
+            { .is_matrix = true, .id = t.A_id, .write = false, .per_subtask = false },
+            { .is_matrix = true, .id = t.B_id, .write = false, .per_subtask = false },
+            { .is_matrix = true, .id = t.C_id, .write = true, .per_subtask = true }
+        };
+    };
+
+    /* Only the vectors used by the steps of the pass are listed */
+    auto fused_vector_routine = [] (const auto &t) {
+        std::vector<structure_access> ret{
+            { .is_matrix = false, .id = t.X_id, .write = bool(t.ops & FUSED_SCALE), .per_subtask = true }
+        };
+        if (t.ops & FUSED_UPDATE) {
+            ret.push_back({ .is_matrix = false, .id = t.Y_id, .write = true, .per_subtask = true });
+        }
+        if (t.ops & FUSED_DOT) {
+            ret.push_back({ .is_matrix = false, .id = t.Z_id, .write = false, .per_subtask = true });
+        }
+        return ret;
+    };
+
+    /* gemv, whose segment i of Y is multiplied by segment i of Z */
+    auto gemv_dot_routine = [&mixed_routine] (const auto &t) {
+        auto ret = mixed_routine(t);
+        ret.push_back({ .is_matrix = false, .id = t.Z_id, .write = false, .per_subtask = true });
+        return ret;
+    };
+
+    switch (main_task.type) {
+        case SSWAP:
+            return vector_routine(main_task.vector_task_float.X_id, main_task.vector_task_float.Y_id, true, true);
+        case DSWAP:
+            return vector_routine(main_task.vector_task_double.X_id, main_task.vector_task_double.Y_id, true, true);
+        case SSCAL:
+            return single_vector_routine(main_task.vector_task_float.X_id, true);
+        case DSCAL:
+            return single_vector_routine(main_task.vector_task_double.X_id, true);
+        case SCOPY:
+        case SAXPY:
+            return vector_routine(main_task.vector_task_float.X_id, main_task.vector_task_float.Y_id, false, true);
+        case DCOPY:
+        case DAXPY:
+            return vector_routine(main_task.vector_task_double.X_id, main_task.vector_task_double.Y_id, false, true);
+        case SDOT:
+        case SDSDOT:
+            return vector_routine(main_task.vector_task_float.X_id, main_task.vector_task_float.Y_id, false, false);
+        case DDOT:
+        case DSDOT:
+            return vector_routine(main_task.vector_task_double.X_id, main_task.vector_task_double.Y_id, false, false);
+        case SNRM2:
+        case SASUM:
+        case ISAMAX:
+            return single_vector_routine(main_task.vector_task_float.X_id, false);
+        case DNRM2:
+        case DASUM:
+        case IDAMAX:
+            return single_vector_routine(main_task.vector_task_double.X_id, false);
+
+        case SGEMV:
+        case SGBMV:
+            return mixed_routine(main_task.mixed_task_float);
+        case DGEMV:
+        case DGBMV:
+            return mixed_routine(main_task.mixed_task_double);
+        case SGER:
+            return update_routine(main_task.mixed_task_float);
+        case DGER:
+            return update_routine(main_task.mixed_task_double);
+
+        case SGEMM:
+            return matrix_routine(main_task.matrix_task_float);
+        case DGEMM:
+            return matrix_routine(main_task.matrix_task_double);
+
+        case SRVGEN:
+        case DRVGEN:
+            return std::vector<structure_access>{
+                { .is_matrix = false, .id = main_task.generation_task.structure_id, .write = true, .per_subtask = true } };
+        case SRMGEN:
+        case DRMGEN:
+            return std::vector<structure_access>{
+                { .is_matrix = true, .id = main_task.generation_task.structure_id, .write = true, .per_subtask = true } };
+
+        case SFUSED_VECTOR:
+            return fused_vector_routine(main_task.fused_vector_task_float);
+        case DFUSED_VECTOR:
+            return fused_vector_routine(main_task.fused_vector_task_double);
+        case SGEMV_DOT:
+            return gemv_dot_routine(main_task.gemv_dot_task_float);
+        case DGEMV_DOT:
+            return gemv_dot_routine(main_task.gemv_dot_task_double);
+
+        default:
+            return std::nullopt;
+    }
+}
+
+/* Subtasks of a routine, as recorded in a task plan: main tasks, and the grid of their task range */
+struct routine_subtasks {
+    const std::vector<proto::task> &main_tasks;
+    int64_t count;
+    int64_t columns;
+};
+
+/* How the subtasks of `downstream` have to wait for those of `upstream`, started before it.
+ * Routines that don't share a structure written by either of them are independent. If every structure
+ * they share is touched per subtask, over the same grid, each subtask only waits for its counterpart.
+ */
+inline std::optional<dependency_kind> dependency_between(const routine_subtasks &upstream,
+                                                         const routine_subtasks &downstream) {
+    if (upstream.main_tasks.empty() || downstream.main_tasks.empty()) {
+        return std::nullopt;
+    }
+
+    /* Main tasks of a routine only differ in the subtask queue they name */
+    auto up = accesses_of(upstream.main_tasks.front());
+    auto down = accesses_of(downstream.main_tasks.front());
+    if (!up.has_value() || !down.has_value()) {
+        return dependency_kind::ALL;
+    }
+
+    bool same_grid = upstream.count == downstream.count && upstream.columns == downstream.columns;
+    std::optional<dependency_kind> kind;
+    for (auto &a : *up) {
+        for (auto &b : *down) {
+            if (a.is_matrix != b.is_matrix || a.id != b.id || !(a.write || b.write)) continue;
+
+            if (a.per_subtask && b.per_subtask && same_grid) {
+                kind = kind.value_or(dependency_kind::SAME_SUBTASK);
+            } else {
+                return dependency_kind::ALL;
+            }
+        }
+    }
+    return kind;
+}
+
+}
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <thread>
+#include <algorithm>
 #include <chrono>
+#include <thread>
 
 namespace scylla_blas {
 
@@ -11,8 +12,38 @@ inline int64_t get_timestamp() {
     return std::chrono::high_resolution_clock::now().time_since_epoch().count();
 }
 
+/* Wall clock time, comparable between machines (up to clock skew) */
+inline int64_t get_wall_time_microseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
 inline void wait_microseconds(int64_t count) {
     std::this_thread::sleep_for(std::chrono::microseconds(count));
 }
 
+/* Exponential backoff for polling loops. Consecutive waits start
+ * at `min_sleep` microseconds and double up to `max_sleep` microseconds.
+ * Call reset() whenever the awaited condition makes progress.
+ */
+class backoff {
+    int64_t _min_sleep;
+    int64_t _max_sleep;
+    int64_t _current_sleep;
+
+public:
+    backoff(int64_t min_sleep, int64_t max_sleep) :
+        _min_sleep(std::max(min_sleep, int64_t(1))),
+        _max_sleep(std::max(max_sleep, _min_sleep)),
+        _current_sleep(_min_sleep) {}
+
+    void wait() {
+        wait_microseconds(_current_sleep);
+        _current_sleep = std::min(_current_sleep * 2, _max_sleep);
+    }
+
+    void reset() {
+        _current_sleep = _min_sleep;
+    }
+};
+
 }
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <utility>
+
+#include "scylla_blas/utils/scylla_types.hh"
+
+namespace scylla_blas {
+
+/* While a scope exists, version bumps (see basic_matrix::get_version) made by its thread are deferred
+ * until flush(), and made once per structure. A worker performing the subtasks of a main task thus bumps
+ * the version of each structure it writes once, not once per subtask.
+ */
+class version_bump_scope {
+    inline static thread_local version_bump_scope *current = nullptr;
+
+    version_bump_scope *_outer;
+    std::map<std::pair<bool, id_t>, std::function<void()>> _pending; /* By (is a matrix, id) */
+
+public:
+    version_bump_scope() : _outer(current) { current = this; }
+    ~version_bump_scope() { current = _outer; }
+    version_bump_scope(const version_bump_scope&) = delete;
+    version_bump_scope& operator=(const version_bump_scope&) = delete;
+
+    /* Records the bump, unless the thread is not in a scope – it has to be made right away then */
+    static bool defer(bool is_matrix, id_t id, const std::function<void()> &bump) {
+        if (current == nullptr) return false;
+
+        current->_pending.try_emplace({is_matrix, id}, bump);
+        return true;
+    }
+
+    /* Has to be called before the writes are reported as done */
+    void flush() {
+        while (!_pending.empty()) {
+            _pending.begin()->second();
+            _pending.erase(_pending.begin());
+        }
+    }
+};
+
+}
@@ -22,6 +22,12 @@ class basic_vector {
 protected:
     std::shared_ptr<scmd::session> _session;
 
+    /* Initialized before the prepared queries below, which are formatted with the id */
+    id_t id;
+    index_t length;
+    index_t block_size;
+    int64_t version;
+
     scmd::prepared_query _get_meta_prepared;
     scmd::prepared_query _get_value_prepared;
     scmd::prepared_query _get_segment_prepared;
@@ -31,16 +37,20 @@ protected:
     scmd::prepared_query _clear_segment_prepared;
     scmd::prepared_query _resize_prepared;
     scmd::prepared_query _set_block_size_prepared;
-
-    id_t id;
-    index_t length;
-    index_t block_size;
+    scmd::prepared_query _get_version_prepared;
+    scmd::prepared_query _bump_version_prepared;
 
     inline static constexpr index_t ceil_div (index_t a, index_t b) { return 1 + (a - 1) / b; }
     index_t get_segment_index(index_t i) const { return ceil_div(i, block_size); }
 
     void get_meta_from_database();
 
+    /* Marks the values of the vector as changed (see get_version), once a write has completed.
+     * Deferred within a version_bump_scope.
+     */
+    void bump_version();
+    static void bump_version(const std::shared_ptr<scmd::session> &session, id_t id);
+
 public:
     static void clear(const std::shared_ptr<scmd::session> &session, id_t id);
     static void resize(const std::shared_ptr<scmd::session> &session,
@@ -72,6 +82,11 @@ public:
         return this->length;
     }
 
+    /* See basic_matrix::get_version */
+    int64_t get_version() const {
+        return this->version;
+    }
+
     /*
      * Length measured in segments is equal to the index of the last segment.
      */
@@ -144,20 +159,37 @@ public:
         }
     }
 
-    vector_segment<T> get_segment(index_t x) const {
-        std::vector<vector_value<T>> segment_values = get_vals_for_query(_get_segment_prepared, x);
+    /* A segment read issued with get_segment_async, get() waits for its values */
+    class pending_segment {
+        scmd::future _future;
+        index_t _offset;
 
-        /*
-         * Segments are moved by offset similarly to matrix blocks.
-         */
-        index_t offset = get_segment_offset(x);
+    public:
+        pending_segment(scmd::future &&future, index_t offset) : _future(std::move(future)), _offset(offset) {}
 
-        vector_segment<T> answer;
-        for (auto &val : segment_values) {
-            answer.emplace_back(val.index - offset, val.value);
+        vector_segment<T> get() {
+            scmd::query_result result = _future.get_result();
+            std::vector<vector_value<T>> segment_values = get_vals_of_result(result);
+
+            /*
+             * Segments are moved by offset similarly to matrix blocks.
+             */
+            vector_segment<T> answer;
+            for (auto &val : segment_values) {
+                answer.emplace_back(val.index - _offset, val.value);
+            }
+
+            return answer;
         }
+    };
 
-        return answer;
+    /* Same as get_segment, but returns once the read is issued, so that many reads may be in flight at once */
+    pending_segment get_segment_async(index_t x) const {
+        return pending_segment(_session->execute_async(_get_segment_prepared, x), get_segment_offset(x));
+    }
+
+    vector_segment<T> get_segment(index_t x) const {
+        return get_segment_async(x).get();
     }
 
     /* The vectors can be very large so we probably only want to use get_whole for visualization/testing purposes */
@@ -174,10 +206,12 @@ public:
 
     void clear_value(index_t x) {
         _session->execute(_clear_value_prepared, get_segment_index(x), x);
+        bump_version();
     }
 
     void clear_segment(index_t x) {
         _session->execute(_clear_segment_prepared, x);
+        bump_version();
     }
 
     /* Replaces the old value. With a new one
@@ -190,6 +224,7 @@ public:
         }
 
         _session->execute(_insert_value_prepared, get_segment_index(x), x, value);
+        bump_version();
     }
 
     /* Behaves exactly like update_value, but for multiple values.
@@ -218,6 +253,7 @@ public:
             }
             _session->execute(batch);
         }
+        bump_version();
     }
 
     /* Inserts values from @values into the vector, but only those that are >= EPSILON
@@ -238,6 +274,7 @@ public:
         }
 
         _session->execute(batch);
+        bump_version();
     }
 
     /* Clear the whole segment. Then inserts new values (but only those that are >= EPSILON).
@@ -268,10 +305,7 @@ public:
     }
 
 private:
-    template<class... Args>
-    std::vector<vector_value<T>> get_vals_for_query(const scmd::prepared_query &query, Args... args) const {
-        scmd::query_result result = _session->execute(query, args...);
-
+    static std::vector<vector_value<T>> get_vals_of_result(scmd::query_result &result) {
         std::vector<vector_value<T>> result_vector;
         result_vector.reserve(result.row_count());
         while (result.next_row()) {
@@ -283,6 +317,12 @@ private:
 
         return result_vector;
     }
+
+    template<class... Args>
+    std::vector<vector_value<T>> get_vals_for_query(const scmd::prepared_query &query, Args... args) const {
+        scmd::query_result result = _session->execute(query, args...);
+        return get_vals_of_result(result);
+    }
 };
 
 }
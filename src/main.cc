@@ -1,11 +1,21 @@
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <boost/program_options.hpp>
 
 #include <fmt/format.h>
 #include <scmd.hh>
 
+#include "scylla_blas/queue/codec.hh"
 #include "scylla_blas/queue/worker_proc.hh"
 #include "scylla_blas/queue/scylla_queue.hh"
 #include "scylla_blas/logging/logging.hh"
@@ -21,8 +31,26 @@ struct options {
     bool is_worker = false;
     bool is_deinit = false;
     bool is_init = false;
+    bool is_supervisor = false;
+    std::string program{};
     int64_t worker_sleep_time;
+    int64_t threads;
+    bool pin_threads = false;
     int64_t worker_retries;
+    int64_t subtask_batch_size;
+    int64_t queue_bucket_count;
+    int64_t wire_version;
+    bool speculate = false;
+    int64_t lease_time;
+    int64_t prefetch_depth;
+    int64_t operand_cache_size;
+    int64_t read_window;
+    int64_t metrics_interval;
+    std::string priority_weights;
+    int64_t min_workers;
+    int64_t max_workers;
+    int64_t supervisor_interval;
+    int64_t idle_intervals;
 };
 
 template<typename ...T>
@@ -38,19 +66,53 @@ void exactly_one_of(const boost::program_options::variables_map & vm,
 
 void parse_arguments(int argc, char *argv[], options &options) {
     namespace po = boost::program_options;
-    po::options_description desc(fmt::format("Usage: {} [--init/--worker] [options]", argv[0]));
+    po::options_description desc(fmt::format("Usage: {} [--init/--worker/--supervisor] [options]", argv[0]));
     po::options_description opt("Options");
     opt.add_options()
             ("help", "Show program help")
             ("init", "Initialize Scylla keyspace and tables")
             ("deinit", "Deinitialize Scylla keyspace and tables")
             ("worker", "Connect to Scylla and process incoming requests")
+            ("supervisor", "Run worker processes, as many as the main queues need")
             ("host,H", po::value<std::string>(&options.host)->required(), "Address on which Scylla can be reached")
             ("port,P", po::value<uint16_t>(&options.port)->default_value(SCYLLA_DEFAULT_PORT), "port number on which Scylla can be reached")
             ("sleep,s", po::value<int64_t>(&options.worker_sleep_time)->default_value(DEFAULT_WORKER_SLEEP_TIME_MICROSECONDS),
                     "Worker sleep time after queue is empty, in microseconds")
+            ("threads,t", po::value<int64_t>(&options.threads)->default_value(DEFAULT_WORKER_THREADS),
+                    "Number of worker threads of the process, sharing a single connection")
+            ("pin", po::bool_switch(&options.pin_threads)->default_value(false),
+                    "Pin each worker thread to a CPU of its own")
             ("retries,r", po::value<int64_t>(&options.worker_retries)->default_value(DEFAULT_MAX_WORKER_RETRIES),
-                    "How many time worker should attempt to do a task");
+                    "How many time worker should attempt to do a task")
+            ("batch,b", po::value<int64_t>(&options.subtask_batch_size)->default_value(DEFAULT_SUBTASK_BATCH_SIZE),
+                    "How many subtasks worker should claim at once")
+            ("buckets", po::value<int64_t>(&options.queue_bucket_count)->default_value(DEFAULT_WORKER_QUEUE_BUCKET_COUNT),
+                    "Number of partitions the main task queue is spread over (used with --init)")
+            ("speculate", po::bool_switch(&options.speculate)->default_value(DEFAULT_SPECULATIVE_EXECUTION),
+                    "Lease safe tasks, and re-execute stale ones when idle (enable on all workers)")
+            ("lease", po::value<int64_t>(&options.lease_time)->default_value(DEFAULT_TASK_LEASE_TIME_MICROSECONDS),
+                    "Time without progress after which a leased task is stale, in microseconds")
+            ("prefetch", po::value<int64_t>(&options.prefetch_depth)->default_value(DEFAULT_SUBTASK_PREFETCH_DEPTH),
+                    "Number of subtasks whose operands are fetched ahead of the one being computed")
+            ("cache", po::value<int64_t>(&options.operand_cache_size)->default_value(DEFAULT_OPERAND_CACHE_BYTES),
+                    "Bytes of read-only operand blocks and segments kept by the worker process, 0 to disable")
+            ("reads", po::value<int64_t>(&options.read_window)->default_value(DEFAULT_READ_WINDOW),
+                    "Number of operand reads of a subtask in flight at once")
+            ("metrics", po::value<int64_t>(&options.metrics_interval)->default_value(DEFAULT_QUEUE_METRICS_INTERVAL_MICROSECONDS),
+                    "Log queue metrics every this many microseconds, 0 to disable")
+            ("weights", po::value<std::string>(&options.priority_weights)->default_value(
+                    fmt::format("{},{},{}", DEFAULT_INTERACTIVE_WEIGHT, DEFAULT_NORMAL_WEIGHT, DEFAULT_BATCH_WEIGHT)),
+                    "Shares of interactive, normal and batch main tasks taken by the worker, 0 skips a class")
+            ("wire-version", po::value<int64_t>(&options.wire_version)->default_value(scylla_blas::proto::WIRE_VERSION_LATEST),
+                    "Format of the responses written by the worker, 0 while older schedulers are still running")
+            ("min-workers", po::value<int64_t>(&options.min_workers)->default_value(DEFAULT_SUPERVISOR_MIN_WORKERS),
+                    "Least number of worker processes run by the supervisor")
+            ("max-workers", po::value<int64_t>(&options.max_workers)->default_value(DEFAULT_SUPERVISOR_MAX_WORKERS),
+                    "Greatest number of worker processes run by the supervisor")
+            ("interval", po::value<int64_t>(&options.supervisor_interval)->default_value(DEFAULT_SUPERVISOR_INTERVAL_MICROSECONDS),
+                    "How often the supervisor checks the main queues, in microseconds")
+            ("idle-intervals", po::value<int64_t>(&options.idle_intervals)->default_value(DEFAULT_SUPERVISOR_IDLE_INTERVALS),
+                    "Number of checks in a row with the main queues empty, after which the supervisor stops a worker");
     desc.add(opt);
     try {
         auto parsed = po::command_line_parser(argc, argv)
@@ -63,10 +125,12 @@ void parse_arguments(int argc, char *argv[], options &options) {
             std::exit(0);
         }
 
-        exactly_one_of(vm, "init", "deinit","worker");
+        exactly_one_of(vm, "init", "deinit", "worker", "supervisor");
         if (vm.count("init")) options.is_init = true;
         if (vm.count("deinit")) options.is_deinit = true;
         if (vm.count("worker")) options.is_worker = true;
+        if (vm.count("supervisor")) options.is_supervisor = true;
+        options.program = argv[0];
 
         po::notify(vm);
     } catch (std::exception &e) {
@@ -100,8 +164,14 @@ void init(const struct options& op) {
     scylla_blas::vector<float>::init(session, HELPER_FLOAT_VECTOR_ID, 0);
     scylla_blas::vector<double>::init(session, HELPER_DOUBLE_VECTOR_ID, 0);
 
-    LogInfo("Creating main task queue...");
-    scylla_blas::scylla_queue::create_queue(session, DEFAULT_WORKER_QUEUE_ID, false, true);
+    /* Schedulers create main queues of their own, this one is left for clients that produce to it directly.
+     * Creating it again would reset the counters of a queue that may still hold tasks.
+     */
+    if (!scylla_blas::scylla_queue::queue_exists(session, DEFAULT_WORKER_QUEUE_ID)) {
+        LogInfo("Creating main task queue...");
+        scylla_blas::scylla_queue::create_queue(session, DEFAULT_WORKER_QUEUE_ID, false, true, op.queue_bucket_count);
+    }
+    scylla_blas::scylla_queue::register_main_queue(session, DEFAULT_WORKER_QUEUE_ID, scylla_blas::NORMAL);
 
     LogInfo("Database initialized succesfully!");
 }
@@ -118,64 +188,159 @@ void deinit(const struct options& op) {
     LogInfo("Database deinitialized succesfully!");
 }
 
+std::array<int64_t, scylla_blas::PRIORITY_CLASS_COUNT> parse_weights(const std::string &weights) {
+    std::array<int64_t, scylla_blas::PRIORITY_CLASS_COUNT> ret{};
+    std::stringstream stream(weights);
+    std::string weight;
+    for (auto &value : ret) {
+        if (!std::getline(stream, weight, ',')) {
+            throw std::runtime_error(fmt::format("Expected {} comma separated weights, got: {}",
+                                                 scylla_blas::PRIORITY_CLASS_COUNT, weights));
+        }
+        value = std::stoll(weight);
+    }
+    return ret;
+}
+
+/* Set on SIGTERM or SIGINT. A worker finishes its current task and unregisters, a second signal kills it. */
+std::atomic<bool> stop_requested(false);
+
+void request_stop(int signal) {
+    stop_requested.store(true);
+    std::signal(signal, SIG_DFL);
+}
+
+void handle_stop_signals() {
+    std::signal(SIGTERM, request_stop);
+    std::signal(SIGINT, request_stop);
+}
+
 void worker(const struct options& op) {
     scylla_blas::worker::set_worker_retries(op.worker_retries);
+    scylla_blas::worker::set_subtask_batch_size(op.subtask_batch_size);
+    scylla_blas::proto::set_wire_version(op.wire_version);
+    scylla_blas::worker::set_speculative_execution(op.speculate);
+    scylla_blas::worker::set_task_lease_time(op.lease_time);
+    scylla_blas::worker::set_prefetch_depth(op.prefetch_depth);
+    scylla_blas::worker::set_operand_cache_size(op.operand_cache_size);
+    scylla_blas::worker::set_read_window(op.read_window);
+    scylla_blas::worker::set_metrics_interval(op.metrics_interval);
+    scylla_blas::worker::set_priority_weights(parse_weights(op.priority_weights));
     LogInfo("Worker connecting to {}:{}...", op.host, op.port);
     auto session = std::make_shared<scmd::session>(op.host, std::to_string(op.port));
 
-    LogInfo("Accessing default task queue...");
-    auto base_queue = scylla_blas::scylla_queue(session, DEFAULT_WORKER_QUEUE_ID);
+    handle_stop_signals();
+    if (op.threads <= 1 && !op.pin_threads) {
+        scylla_blas::scylla_backend backend(session);
+        scylla_blas::worker::run_worker(session, backend, op.worker_sleep_time, stop_requested);
+    } else {
+        /* Each thread finishes its current task once the pool is destroyed */
+        LogInfo("Starting {} worker threads...", op.threads);
+        auto backend = std::make_shared<scylla_blas::scylla_backend>(session);
+        scylla_blas::worker::local_worker_pool pool(session, backend, std::max(op.threads, int64_t(1)),
+                                                   op.worker_sleep_time, op.pin_threads);
+        while (!stop_requested.load()) {
+            scylla_blas::wait_microseconds(op.worker_sleep_time);
+        }
+    }
+    LogInfo("Worker stopped");
+}
+
+/* Worker processes started by the supervisor get its worker options */
+std::vector<std::string> worker_arguments(const struct options& op) {
+    std::vector<std::string> args = {
+        op.program, "--worker", "-H", op.host, "-P", std::to_string(op.port),
+        "-s", std::to_string(op.worker_sleep_time), "-t", std::to_string(op.threads), "-r", std::to_string(op.worker_retries),
+        "-b", std::to_string(op.subtask_batch_size), "--lease", std::to_string(op.lease_time),
+        "--prefetch", std::to_string(op.prefetch_depth), "--cache", std::to_string(op.operand_cache_size),
+        "--reads", std::to_string(op.read_window), "--metrics", std::to_string(op.metrics_interval),
+        "--weights", op.priority_weights, "--wire-version", std::to_string(op.wire_version)
+    };
+    if (op.speculate) {
+        args.emplace_back("--speculate");
+    }
+    if (op.pin_threads) {
+        args.emplace_back("--pin");
+    }
+    return args;
+}
+
+pid_t start_worker_process(const std::vector<std::string> &args) {
+    /* The driver's I/O threads may hold the allocator's locks at fork(),
+     * so the child only calls async-signal-safe functions – argv is built beforehand. */
+    std::vector<char*> argv;
+    for (auto &arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error(fmt::format("Failed to start a worker process: {}", std::strerror(errno)));
+    }
+
+    if (pid == 0) {
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+/* Keeps between min_workers and max_workers worker processes running, as decided by worker_scaler.
+ * Schedulers split each routine into one main task per live worker, so the main tasks are claimed at once
+ * and a backlog waits in the subtask queues of the routines in progress – see queue_load_monitor.
+ * A stopped worker finishes its task first. Schedulers split their next routines between the live workers,
+ * so they follow the changes within a second or so.
+ */
+void supervisor(const struct options& op) {
+    scylla_blas::worker::worker_scaler scaler(op.min_workers, op.max_workers, op.idle_intervals);
+
+    LogInfo("Supervisor connecting to {}:{}...", op.host, op.port);
+    auto session = std::make_shared<scmd::session>(op.host, std::to_string(op.port));
+    scylla_blas::scylla_backend backend(session);
+    handle_stop_signals();
+
+    auto args = worker_arguments(op);
+    std::vector<pid_t> workers;
+    scylla_blas::worker::queue_load_monitor monitor(backend);
+    while (!stop_requested.load()) {
+        int status;
+        pid_t exited;
+        while ((exited = waitpid(-1, &status, WNOHANG)) > 0) {
+            auto it = std::find(workers.begin(), workers.end(), exited);
+            if (it != workers.end()) {
+                LogWarn("Worker process {} exited unexpectedly (status {}), replacing it", exited, status);
+                workers.erase(it);
+            }
+        }
 
-    LogInfo("Starting worker loop...");
-    for (;;) {
-        std::optional<std::pair<int64_t, scylla_blas::proto::task>> opt;
         try {
-            opt = base_queue.consume();
+            scaler.update(monitor.measure(), backend.count_live_workers());
         } catch (const std::exception &e) {
-            LogWarn("Exception while fetching main task: {}, retrying", e.what());
-            scylla_blas::wait_microseconds(op.worker_sleep_time);
-            continue;
+            LogWarn("Failed to check the queues: {}", e.what());
         }
-        if (!opt.has_value()) {
-            scylla_blas::wait_microseconds(op.worker_sleep_time);
-            continue;
+
+        int64_t target = scaler.get_target();
+
+        while ((int64_t)workers.size() < target) {
+            workers.push_back(start_worker_process(args));
+            LogInfo("Started worker process {}", workers.back());
         }
-        auto [task_id, task_data] = opt.value();
-        LogInfo("A new task received! task_id: {}", task_id);
-
-        int64_t attempts;
-        for (attempts = 0; attempts <= op.worker_retries; attempts++) {
-            scylla_blas::worker::procedure_t& proc = scylla_blas::worker::get_procedure_for_task(task_data);
-
-            /* Keep trying until the task is finished – otherwise it will be lost and never marked as finished */
-            /* TODO: scylla_queue.mark_as_failed()? */
-            try {
-                auto result = proc(session, task_data);
-
-                if (result.has_value()) {
-                    /* The procedure has generated a partial result to be returned */
-                    result.value().type = scylla_blas::proto::R_SOME; /* We don't really need result types beyond NONE and SOME */
-                    base_queue.mark_as_finished(task_id, result.value());
-                } else {
-                    base_queue.mark_as_finished(task_id);
-                }
-
-                break;
-            } catch (const scylla_blas::worker::subtask_failed_exception &e) {
-                LogError("Subtask of task {} failed. Abandoning task", task_id);
-                attempts = op.worker_retries + 1;
-                break;
-            } catch (const std::exception &e) {
-                LogWarn("Task {} failed. Reason: {}. Retrying...", task_id, e.what());
-            }
+        while ((int64_t)workers.size() > target) {
+            LogInfo("Stopping worker process {}", workers.back());
+            kill(workers.back(), SIGTERM);
+            workers.pop_back();
         }
 
-        if (attempts <= op.worker_retries) {
-            LogInfo("Task {} completed succesfully.", task_id);
-        } else {
-            LogError("Abandoned task {} due to too many failures.", task_id);
-        }
+        scylla_blas::wait_microseconds(op.supervisor_interval);
+    }
+
+    LogInfo("Stopping {} worker processes...", workers.size());
+    for (pid_t pid : workers) {
+        kill(pid, SIGTERM);
     }
+    while (wait(nullptr) > 0);
+    LogInfo("Supervisor stopped");
 }
 
 /* Use this program once to initialize the database */
@@ -188,6 +353,8 @@ int main(int argc, char **argv) {
         deinit(op);
     } else if (op.is_worker) {
         worker(op);
+    } else if (op.is_supervisor) {
+        supervisor(op);
     } else {
         // This code should be unreachable
         throw std::logic_error("How did we get here?");
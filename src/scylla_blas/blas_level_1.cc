@@ -21,18 +21,18 @@ void assert_length_equal(const scylla_blas::vector<T> &X,
 }
 
 template<>
-float scylla_blas::routine_scheduler::produce_vector_tasks(const proto::task_type type,
-                                                           const float alpha,
-                                                           const id_t X_id,
-                                                           const id_t Y_id,
-                                                           float acc, updater<float> update) {
+scylla_blas::routine_future<float> scylla_blas::routine_scheduler::produce_vector_tasks(const proto::task_type type,
+                                                                                        const float alpha,
+                                                                                        const id_t X_id,
+                                                                                        const id_t Y_id,
+                                                                                        float acc, updater<float> update) {
     std::vector<proto::task> tasks;
 
-    for (const auto &q : this->_subtask_queues) {
+    for (id_t queue_id : this->subtask_queue_ids()) {
         tasks.push_back({
            .type = type,
            .vector_task_float = {
-               .task_queue_id = q.get_id(),
+               .task_queue_id = queue_id,
                .alpha = alpha,
                .X_id = X_id,
                .Y_id = Y_id
@@ -40,22 +40,22 @@ float scylla_blas::routine_scheduler::produce_vector_tasks(const proto::task_typ
         });
     }
 
-    return produce_and_wait(tasks, acc, update);
+    return produce_async(tasks, acc, update);
 }
 
 template<>
-double scylla_blas::routine_scheduler::produce_vector_tasks(const proto::task_type type,
-                                                            const double alpha,
-                                                            const id_t X_id,
-                                                            const id_t Y_id,
-                                                            double acc, updater<double> update) {
+scylla_blas::routine_future<double> scylla_blas::routine_scheduler::produce_vector_tasks(const proto::task_type type,
+                                                                                         const double alpha,
+                                                                                         const id_t X_id,
+                                                                                         const id_t Y_id,
+                                                                                         double acc, updater<double> update) {
     std::vector<proto::task> tasks;
 
-    for (const auto &q : this->_subtask_queues) {
+    for (id_t queue_id : this->subtask_queue_ids()) {
         tasks.push_back({
             .type = type,
             .vector_task_double = {
-                .task_queue_id = q.get_id(),
+                .task_queue_id = queue_id,
                 .alpha = alpha,
                 .X_id = X_id,
                 .Y_id = Y_id
@@ -63,83 +63,175 @@ double scylla_blas::routine_scheduler::produce_vector_tasks(const proto::task_ty
         });
     }
 
-    return produce_and_wait(tasks, acc, update);
+    return produce_async(tasks, acc, update);
+}
+
+template<>
+scylla_blas::routine_future<float> scylla_blas::routine_scheduler::produce_fused_vector_tasks(const int64_t ops,
+                                                                                              const float scale,
+                                                                                              const float alpha,
+                                                                                              const float beta,
+                                                                                              const id_t X_id,
+                                                                                              const id_t Y_id,
+                                                                                              const id_t Z_id) {
+    std::vector<proto::task> tasks;
+
+    for (id_t queue_id : this->subtask_queue_ids()) {
+        tasks.push_back({
+            .type = proto::SFUSED_VECTOR,
+            .fused_vector_task_float = {
+                .task_queue_id = queue_id,
+                .ops = ops,
+                .scale = scale,
+                .alpha = alpha,
+                .beta = beta,
+                .X_id = X_id,
+                .Y_id = Y_id,
+                .Z_id = Z_id
+            }
+        });
+    }
+
+    return produce_async(tasks, float(0), updater<float>([](float &result, const proto::response& r) { result += r.result_float; }));
+}
+
+template<>
+scylla_blas::routine_future<double> scylla_blas::routine_scheduler::produce_fused_vector_tasks(const int64_t ops,
+                                                                                               const double scale,
+                                                                                               const double alpha,
+                                                                                               const double beta,
+                                                                                               const id_t X_id,
+                                                                                               const id_t Y_id,
+                                                                                               const id_t Z_id) {
+    std::vector<proto::task> tasks;
+
+    for (id_t queue_id : this->subtask_queue_ids()) {
+        tasks.push_back({
+            .type = proto::DFUSED_VECTOR,
+            .fused_vector_task_double = {
+                .task_queue_id = queue_id,
+                .ops = ops,
+                .scale = scale,
+                .alpha = alpha,
+                .beta = beta,
+                .X_id = X_id,
+                .Y_id = Y_id,
+                .Z_id = Z_id
+            }
+        });
+    }
+
+    return produce_async(tasks, double(0), updater<double>([](double &result, const proto::response& r) { result += r.result_double; }));
 }
 
 #define NONE 0
 
-void
-scylla_blas::routine_scheduler::sswap(vector<float> &X, vector<float> &Y) {
-    if (X == Y) return;
+scylla_blas::routine_future<void>
+scylla_blas::routine_scheduler::sswap_async(vector<float> &X, vector<float> &Y) {
+    if (X == Y) return routine_future<void>::completed();
     assert_length_equal(X, Y);
     add_segments_as_queue_tasks(X);
 
-    produce_vector_tasks<float>(proto::SSWAP, NONE, X.get_id(), Y.get_id());
+    return produce_vector_tasks<float>(proto::SSWAP, NONE, X.get_id(), Y.get_id()).then([](float) {});
 }
 
-void
-scylla_blas::routine_scheduler::dswap(vector<double> &X, vector<double> &Y) {
-    if (X == Y) return;
+scylla_blas::routine_future<void>
+scylla_blas::routine_scheduler::dswap_async(vector<double> &X, vector<double> &Y) {
+    if (X == Y) return routine_future<void>::completed();
     assert_length_equal(X, Y);
     add_segments_as_queue_tasks(X);
 
-    produce_vector_tasks<double>(proto::DSWAP, NONE, X.get_id(), Y.get_id());
+    return produce_vector_tasks<double>(proto::DSWAP, NONE, X.get_id(), Y.get_id()).then([](double) {});
 }
 
-void
-scylla_blas::routine_scheduler::sscal(const float alpha, vector<float> &X) {
+scylla_blas::routine_future<void>
+scylla_blas::routine_scheduler::sscal_async(const float alpha, vector<float> &X) {
     add_segments_as_queue_tasks(X);
 
-    produce_vector_tasks<float>(proto::SSCAL, alpha, X.get_id(), NONE);
+    return produce_vector_tasks<float>(proto::SSCAL, alpha, X.get_id(), NONE).then([](float) {});
 }
 
-void
-scylla_blas::routine_scheduler::dscal(const double alpha, vector<double> &X) {
+scylla_blas::routine_future<void>
+scylla_blas::routine_scheduler::dscal_async(const double alpha, vector<double> &X) {
     add_segments_as_queue_tasks(X);
 
-    produce_vector_tasks<double>(proto::DSCAL, alpha, X.get_id(), NONE);
+    return produce_vector_tasks<double>(proto::DSCAL, alpha, X.get_id(), NONE).then([](double) {});
 }
 
-void
-scylla_blas::routine_scheduler::scopy(const vector<float> &X, vector<float> &Y) {
-    if (X == Y) return;
+scylla_blas::routine_future<void>
+scylla_blas::routine_scheduler::scopy_async(const vector<float> &X, vector<float> &Y) {
+    if (X == Y) return routine_future<void>::completed();
     assert_length_equal(X, Y);
     add_segments_as_queue_tasks(X);
 
-    produce_vector_tasks<float>(proto::SCOPY, NONE, X.get_id(), Y.get_id());
+    return produce_vector_tasks<float>(proto::SCOPY, NONE, X.get_id(), Y.get_id()).then([](float) {});
 }
 
-void
-scylla_blas::routine_scheduler::dcopy(const vector<double> &X, vector<double> &Y) {
-    if (X == Y) return;
+scylla_blas::routine_future<void>
+scylla_blas::routine_scheduler::dcopy_async(const vector<double> &X, vector<double> &Y) {
+    if (X == Y) return routine_future<void>::completed();
     assert_length_equal(X, Y);
     add_segments_as_queue_tasks(X);
 
-    produce_vector_tasks<double>(proto::DCOPY, NONE, X.get_id(), Y.get_id());
+    return produce_vector_tasks<double>(proto::DCOPY, NONE, X.get_id(), Y.get_id()).then([](double) {});
 }
 
-void
-scylla_blas::routine_scheduler::saxpy(const float alpha, const vector<float> &X, vector<float> &Y) {
+scylla_blas::routine_future<void>
+scylla_blas::routine_scheduler::saxpy_async(const float alpha, const vector<float> &X, vector<float> &Y) {
     /* (X == Y) to be handled by a worker separately */
 
     assert_length_equal(X, Y);
     add_segments_as_queue_tasks(X);
 
-    produce_vector_tasks<float>(proto::SAXPY, alpha, X.get_id(), Y.get_id());
+    return produce_vector_tasks<float>(proto::SAXPY, alpha, X.get_id(), Y.get_id()).then([](float) {});
 }
 
-void
-scylla_blas::routine_scheduler::daxpy(const double alpha, const vector<double> &X, vector<double> &Y) {
+scylla_blas::routine_future<void>
+scylla_blas::routine_scheduler::daxpy_async(const double alpha, const vector<double> &X, vector<double> &Y) {
     /* (X == Y) to be handled by a worker separately */
 
     assert_length_equal(X, Y);
     add_segments_as_queue_tasks(X);
 
-    produce_vector_tasks<double>(proto::DAXPY, alpha, X.get_id(), Y.get_id());
+    return produce_vector_tasks<double>(proto::DAXPY, alpha, X.get_id(), Y.get_id()).then([](double) {});
 }
 
-float
-scylla_blas::routine_scheduler::sdot(const vector<float> &X, const vector<float> &Y) {
+scylla_blas::routine_future<float>
+scylla_blas::routine_scheduler::sfused_vector_async(const int64_t ops, const float scale, vector<float> &X,
+                                                    const float alpha, const float beta, vector<float> &Y,
+                                                    const vector<float> &Z) {
+    if (ops == 0) return routine_future<float>::completed([] { return float(0); });
+    if (ops & proto::FUSED_UPDATE) {
+        if (X == Y) {
+            throw std::runtime_error("Invalid operation: vector X passed equal to vector Y in a fused update");
+        }
+        assert_length_equal(X, Y);
+    }
+    if (ops & proto::FUSED_DOT) assert_length_equal(X, Z);
+    add_segments_as_queue_tasks(X);
+
+    return produce_fused_vector_tasks<float>(ops, scale, alpha, beta, X.get_id(), Y.get_id(), Z.get_id());
+}
+
+scylla_blas::routine_future<double>
+scylla_blas::routine_scheduler::dfused_vector_async(const int64_t ops, const double scale, vector<double> &X,
+                                                    const double alpha, const double beta, vector<double> &Y,
+                                                    const vector<double> &Z) {
+    if (ops == 0) return routine_future<double>::completed([] { return double(0); });
+    if (ops & proto::FUSED_UPDATE) {
+        if (X == Y) {
+            throw std::runtime_error("Invalid operation: vector X passed equal to vector Y in a fused update");
+        }
+        assert_length_equal(X, Y);
+    }
+    if (ops & proto::FUSED_DOT) assert_length_equal(X, Z);
+    add_segments_as_queue_tasks(X);
+
+    return produce_fused_vector_tasks<double>(ops, scale, alpha, beta, X.get_id(), Y.get_id(), Z.get_id());
+}
+
+scylla_blas::routine_future<float>
+scylla_blas::routine_scheduler::sdot_async(const vector<float> &X, const vector<float> &Y) {
     /* (X == Y) to be handled by a worker separately */
 
     assert_length_equal(X, Y);
@@ -149,8 +241,8 @@ scylla_blas::routine_scheduler::sdot(const vector<float> &X, const vector<float>
                                        [](float &result, const proto::response& r) { result += r.result_float; });
 }
 
-double
-scylla_blas::routine_scheduler::ddot(const vector<double> &X, const vector<double> &Y) {
+scylla_blas::routine_future<double>
+scylla_blas::routine_scheduler::ddot_async(const vector<double> &X, const vector<double> &Y) {
     /* (X == Y) to be handled by a worker separately */
 
     assert_length_equal(X, Y);
@@ -160,19 +252,20 @@ scylla_blas::routine_scheduler::ddot(const vector<double> &X, const vector<doubl
                                         [](double &result, const proto::response& r) { result += r.result_double; });
 }
 
-float
-scylla_blas::routine_scheduler::sdsdot(float B, const vector<float> &X, const vector<float> &Y) {
+scylla_blas::routine_future<float>
+scylla_blas::routine_scheduler::sdsdot_async(float B, const vector<float> &X, const vector<float> &Y) {
     /* (X == Y) to be handled by a worker separately */
 
     assert_length_equal(X, Y);
     add_segments_as_queue_tasks(X);
 
     return produce_vector_tasks<double>(proto::SDSDOT, NONE, X.get_id(), Y.get_id(), double(B),
-                                        [](double &result, const proto::response& r) { result += r.result_double; });
+                                        [](double &result, const proto::response& r) { result += r.result_double; })
+           .then([](double result) { return float(result); });
 }
 
-double
-scylla_blas::routine_scheduler::dsdot(const vector<float> &X, const vector<float> &Y) {
+scylla_blas::routine_future<double>
+scylla_blas::routine_scheduler::dsdot_async(const vector<float> &X, const vector<float> &Y) {
     /* (X == Y) to be handled by a worker separately */
 
     assert_length_equal(X, Y);
@@ -182,68 +275,163 @@ scylla_blas::routine_scheduler::dsdot(const vector<float> &X, const vector<float
                                         [](double &result, const proto::response& r) { result += r.result_double; });
 }
 
-float
-scylla_blas::routine_scheduler::snrm2(const vector<float> &X) {
+scylla_blas::routine_future<float>
+scylla_blas::routine_scheduler::snrm2_async(const vector<float> &X) {
     add_segments_as_queue_tasks(X);
 
-    return sqrtf(produce_vector_tasks<float>(proto::SNRM2, NONE, X.get_id(), NONE, float(0),
-                                             [](float &result, const proto::response& r) { result += r.result_float; }));
+    return produce_vector_tasks<float>(proto::SNRM2, NONE, X.get_id(), NONE, float(0),
+                                       [](float &result, const proto::response& r) { result += r.result_float; })
+           .then([](float result) { return sqrtf(result); });
 }
 
-double
-scylla_blas::routine_scheduler::dnrm2(const vector<double> &X) {
+scylla_blas::routine_future<double>
+scylla_blas::routine_scheduler::dnrm2_async(const vector<double> &X) {
     add_segments_as_queue_tasks(X);
 
-    return sqrt(produce_vector_tasks<double>(proto::DNRM2, NONE, X.get_id(), NONE, double(0),
-                                             [](double &result, const proto::response& r) { result += r.result_double; }));
+    return produce_vector_tasks<double>(proto::DNRM2, NONE, X.get_id(), NONE, double(0),
+                                        [](double &result, const proto::response& r) { result += r.result_double; })
+           .then([](double result) { return sqrt(result); });
 }
-float
 
-scylla_blas::routine_scheduler::sasum(const vector<float> &X) {
+scylla_blas::routine_future<float>
+scylla_blas::routine_scheduler::sasum_async(const vector<float> &X) {
     add_segments_as_queue_tasks(X);
 
     return produce_vector_tasks<float>(proto::SASUM, NONE, X.get_id(), NONE, float(0),
                                        [](float &result, const proto::response& r) { result += r.result_float; });
 }
 
-double
-scylla_blas::routine_scheduler::dasum(const vector<double> &X) {
+scylla_blas::routine_future<double>
+scylla_blas::routine_scheduler::dasum_async(const vector<double> &X) {
     add_segments_as_queue_tasks(X);
 
     return produce_vector_tasks<double>(proto::DASUM, NONE, X.get_id(), NONE, double(0),
                                         [](double &result, const proto::response& r) { result += r.result_double; });
 }
 
-scylla_blas::index_t
-scylla_blas::routine_scheduler::isamax(const vector<float> &X) {
+scylla_blas::routine_future<scylla_blas::index_t>
+scylla_blas::routine_scheduler::isamax_async(const vector<float> &X) {
     add_segments_as_queue_tasks(X);
 
-    index_t iamax = 0;
-    produce_vector_tasks<float>(proto::ISAMAX, NONE, X.get_id(), NONE, float(0),
-                                [&iamax](float &result, const proto::response& r) {
-                                    if (result < r.result_max_float_index.value) {
-                                        result = r.result_max_float_index.value;
-                                        iamax = r.result_max_float_index.index;
-                                    } else if (result == r.result_max_float_index.value) {
-                                        iamax = std::min(iamax, r.result_max_float_index.index);
-                                    }
-                                });
-    return iamax;
+    /* The index is kept along with the accumulated maximum, until the future is collected */
+    auto iamax = std::make_shared<index_t>(0);
+    return produce_vector_tasks<float>(proto::ISAMAX, NONE, X.get_id(), NONE, float(0),
+                                       [iamax](float &result, const proto::response& r) {
+                                           if (result < r.result_max_float_index.value) {
+                                               result = r.result_max_float_index.value;
+                                               *iamax = r.result_max_float_index.index;
+                                           } else if (result == r.result_max_float_index.value) {
+                                               *iamax = std::min(*iamax, r.result_max_float_index.index);
+                                           }
+                                       })
+           .then([iamax](float) { return *iamax; });
 }
 
-scylla_blas::index_t
-scylla_blas::routine_scheduler::idamax(const vector<double> &X) {
+scylla_blas::routine_future<scylla_blas::index_t>
+scylla_blas::routine_scheduler::idamax_async(const vector<double> &X) {
     add_segments_as_queue_tasks(X);
 
-    index_t iamax = 0;
-    produce_vector_tasks<double>(proto::IDAMAX, NONE, X.get_id(), NONE, double(0),
-                                 [&iamax](double &result, const proto::response& r) {
-                                    if (result < r.result_max_double_index.value) {
-                                        result = r.result_max_double_index.value;
-                                        iamax = r.result_max_double_index.index;
-                                    } else if (result == r.result_max_double_index.value) {
-                                        iamax = std::min(iamax, r.result_max_double_index.index);
-                                    }
-                                });
-    return iamax;
-}
\ No newline at end of file
+    auto iamax = std::make_shared<index_t>(0);
+    return produce_vector_tasks<double>(proto::IDAMAX, NONE, X.get_id(), NONE, double(0),
+                                        [iamax](double &result, const proto::response& r) {
+                                            if (result < r.result_max_double_index.value) {
+                                                result = r.result_max_double_index.value;
+                                                *iamax = r.result_max_double_index.index;
+                                            } else if (result == r.result_max_double_index.value) {
+                                                *iamax = std::min(*iamax, r.result_max_double_index.index);
+                                            }
+                                        })
+           .then([iamax](double) { return *iamax; });
+}
+
+/* Blocking versions */
+
+void
+scylla_blas::routine_scheduler::sswap(vector<float> &X, vector<float> &Y) {
+    sswap_async(X, Y).get();
+}
+
+void
+scylla_blas::routine_scheduler::dswap(vector<double> &X, vector<double> &Y) {
+    dswap_async(X, Y).get();
+}
+
+void
+scylla_blas::routine_scheduler::sscal(const float alpha, vector<float> &X) {
+    sscal_async(alpha, X).get();
+}
+
+void
+scylla_blas::routine_scheduler::dscal(const double alpha, vector<double> &X) {
+    dscal_async(alpha, X).get();
+}
+
+void
+scylla_blas::routine_scheduler::scopy(const vector<float> &X, vector<float> &Y) {
+    scopy_async(X, Y).get();
+}
+
+void
+scylla_blas::routine_scheduler::dcopy(const vector<double> &X, vector<double> &Y) {
+    dcopy_async(X, Y).get();
+}
+
+void
+scylla_blas::routine_scheduler::saxpy(const float alpha, const vector<float> &X, vector<float> &Y) {
+    saxpy_async(alpha, X, Y).get();
+}
+
+void
+scylla_blas::routine_scheduler::daxpy(const double alpha, const vector<double> &X, vector<double> &Y) {
+    daxpy_async(alpha, X, Y).get();
+}
+
+float
+scylla_blas::routine_scheduler::sdot(const vector<float> &X, const vector<float> &Y) {
+    return sdot_async(X, Y).get();
+}
+
+double
+scylla_blas::routine_scheduler::ddot(const vector<double> &X, const vector<double> &Y) {
+    return ddot_async(X, Y).get();
+}
+
+float
+scylla_blas::routine_scheduler::sdsdot(float B, const vector<float> &X, const vector<float> &Y) {
+    return sdsdot_async(B, X, Y).get();
+}
+
+double
+scylla_blas::routine_scheduler::dsdot(const vector<float> &X, const vector<float> &Y) {
+    return dsdot_async(X, Y).get();
+}
+
+float
+scylla_blas::routine_scheduler::snrm2(const vector<float> &X) {
+    return snrm2_async(X).get();
+}
+
+double
+scylla_blas::routine_scheduler::dnrm2(const vector<double> &X) {
+    return dnrm2_async(X).get();
+}
+
+float
+scylla_blas::routine_scheduler::sasum(const vector<float> &X) {
+    return sasum_async(X).get();
+}
+
+double
+scylla_blas::routine_scheduler::dasum(const vector<double> &X) {
+    return dasum_async(X).get();
+}
+
+scylla_blas::index_t
+scylla_blas::routine_scheduler::isamax(const vector<float> &X) {
+    return isamax_async(X).get();
+}
+
+scylla_blas::index_t
+scylla_blas::routine_scheduler::idamax(const vector<double> &X) {
+    return idamax_async(X).get();
+}
@@ -32,25 +32,27 @@ void assert_width_length_equal(const scylla_blas::matrix<T> &A,
 }
 
 template<>
-float scylla_blas::routine_scheduler::produce_mixed_tasks(const proto::task_type type,
-                                                          const index_t KL, const index_t KU,
-                                                          const UPLO Uplo, const DIAG Diag,
-                                                          const id_t A_id,
-                                                          const TRANSPOSE TransA,
-                                                          const float alpha,
-                                                          const id_t X_id,
-                                                          const float beta,
-                                                          const id_t Y_id,
-                                                          float acc, updater<float> update) {
+scylla_blas::routine_future<float> scylla_blas::routine_scheduler::produce_mixed_tasks(const proto::task_type type,
+                                                                                       const index_t KL, const index_t KU,
+                                                                                       const UPLO Uplo, const DIAG Diag,
+                                                                                       const id_t A_id,
+                                                                                       const TRANSPOSE TransA,
+                                                                                       const float alpha,
+                                                                                       const id_t X_id,
+                                                                                       const float beta,
+                                                                                       const id_t Y_id,
+                                                                                       float acc, updater<float> update) {
     std::vector<proto::task> tasks;
 
-    for (const auto &q : this->_subtask_queues) {
+    for (id_t queue_id : this->subtask_queue_ids()) {
         tasks.push_back({
             .type = type,
             .mixed_task_float = {
-                .task_queue_id = q.get_id(),
+                .task_queue_id = queue_id,
                 .KL = KL,
                 .KU = KU,
+                .Uplo = Uplo,
+                .Diag = Diag,
                 .A_id = A_id,
                 .TransA = TransA,
                 .alpha = alpha,
@@ -61,31 +63,33 @@ float scylla_blas::routine_scheduler::produce_mixed_tasks(const proto::task_type
         });
     }
 
-    return produce_and_wait(tasks, acc, update);
+    return produce_async(tasks, acc, update);
 }
 
 template<>
-double scylla_blas::routine_scheduler::produce_mixed_tasks(const proto::task_type type,
-                                                           const index_t KL, const index_t KU,
-                                                           const UPLO Uplo, const DIAG Diag,
-                                                           const id_t A_id,
-                                                           const TRANSPOSE TransA,
-                                                           const double alpha,
-                                                           const id_t X_id,
-                                                           const double beta,
-                                                           const id_t Y_id,
-                                                           double acc, updater<double> update) {
+scylla_blas::routine_future<double> scylla_blas::routine_scheduler::produce_mixed_tasks(const proto::task_type type,
+                                                                                        const index_t KL, const index_t KU,
+                                                                                        const UPLO Uplo, const DIAG Diag,
+                                                                                        const id_t A_id,
+                                                                                        const TRANSPOSE TransA,
+                                                                                        const double alpha,
+                                                                                        const id_t X_id,
+                                                                                        const double beta,
+                                                                                        const id_t Y_id,
+                                                                                        double acc, updater<double> update) {
     std::vector<proto::task> tasks;
 
-    for (const auto &q : this->_subtask_queues) {
+    for (id_t queue_id : this->subtask_queue_ids()) {
         tasks.push_back({
             .type = type,
             .mixed_task_double = {
-                .task_queue_id = q.get_id(),
+                .task_queue_id = queue_id,
                 .KL = KL,
                 .KU = KU,
                 .A_id = A_id,
                 .TransA = TransA,
+                .Uplo = Uplo,
+                .Diag = Diag,
                 .alpha = alpha,
                 .X_id = X_id,
                 .beta = beta,
@@ -94,104 +98,203 @@ double scylla_blas::routine_scheduler::produce_mixed_tasks(const proto::task_typ
         });
     }
 
-    return produce_and_wait(tasks, acc, update);
+    return produce_async(tasks, acc, update);
+}
+
+template<>
+scylla_blas::routine_future<float> scylla_blas::routine_scheduler::produce_gemv_dot_tasks(const id_t A_id,
+                                                                                          const TRANSPOSE TransA,
+                                                                                          const float alpha,
+                                                                                          const id_t X_id,
+                                                                                          const float beta,
+                                                                                          const id_t Y_id,
+                                                                                          const id_t Z_id) {
+    std::vector<proto::task> tasks;
+
+    for (id_t queue_id : this->subtask_queue_ids()) {
+        tasks.push_back({
+            .type = proto::SGEMV_DOT,
+            .gemv_dot_task_float = {
+                .task_queue_id = queue_id,
+                .A_id = A_id,
+                .TransA = TransA,
+                .alpha = alpha,
+                .X_id = X_id,
+                .beta = beta,
+                .Y_id = Y_id,
+                .Z_id = Z_id
+            }
+        });
+    }
+
+    return produce_async(tasks, float(0), updater<float>([](float &result, const proto::response& r) { result += r.result_float; }));
+}
+
+template<>
+scylla_blas::routine_future<double> scylla_blas::routine_scheduler::produce_gemv_dot_tasks(const id_t A_id,
+                                                                                           const TRANSPOSE TransA,
+                                                                                           const double alpha,
+                                                                                           const id_t X_id,
+                                                                                           const double beta,
+                                                                                           const id_t Y_id,
+                                                                                           const id_t Z_id) {
+    std::vector<proto::task> tasks;
+
+    for (id_t queue_id : this->subtask_queue_ids()) {
+        tasks.push_back({
+            .type = proto::DGEMV_DOT,
+            .gemv_dot_task_double = {
+                .task_queue_id = queue_id,
+                .A_id = A_id,
+                .TransA = TransA,
+                .alpha = alpha,
+                .X_id = X_id,
+                .beta = beta,
+                .Y_id = Y_id,
+                .Z_id = Z_id
+            }
+        });
+    }
+
+    return produce_async(tasks, double(0), updater<double>([](double &result, const proto::response& r) { result += r.result_double; }));
 }
 
 #define NONE 0
 
-scylla_blas::vector<float>&
-scylla_blas::routine_scheduler::sgemv(const enum TRANSPOSE TransA,
-                                     const float alpha, const matrix<float> &A,
-                                     const vector<float> &X, const float beta,
-                                     vector<float> &Y) {
+scylla_blas::routine_future<scylla_blas::vector<float>&>
+scylla_blas::routine_scheduler::sgemv_async(const enum TRANSPOSE TransA,
+                                            const float alpha, const matrix<float> &A,
+                                            const vector<float> &X, const float beta,
+                                            vector<float> &Y) {
     if (X == Y) {
         throw std::runtime_error("Invalid operation: const vector X passed equal to non-const vector Y in sgemv");
     }
 
     assert_width_length_equal(A, X, TransA);
     assert_height_length_equal(A, Y, TransA);
+    choose_execution(entries_of(A));
+    add_segments_as_queue_tasks(Y, estimated_costs([&A, TransA] { return segment_costs(A, TransA); }));
 
-    add_segments_as_queue_tasks(Y);
+    return produce_mixed_tasks<float>(proto::SGEMV, NONE, NONE, Upper, NonUnit, A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id())
+           .then([&Y](float) -> vector<float>& { return Y; });
+}
 
-    produce_mixed_tasks<float>(proto::SGEMV, NONE, NONE, Upper, NonUnit, A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id());
-    return Y;
+scylla_blas::routine_future<scylla_blas::vector<double>&>
+scylla_blas::routine_scheduler::dgemv_async(const enum TRANSPOSE TransA,
+                                            const double alpha, const matrix<double> &A,
+                                            const vector<double> &X, const double beta,
+                                            vector<double> &Y) {
+    if (X == Y) {
+        throw std::runtime_error("Invalid operation: const vector X passed equal to non-const vector Y in dgemv");
+    }
+
+    assert_width_length_equal(A, X, TransA);
+    assert_height_length_equal(A, Y, TransA);
+    choose_execution(entries_of(A));
+    add_segments_as_queue_tasks(Y, estimated_costs([&A, TransA] { return segment_costs(A, TransA); }));
+
+    return produce_mixed_tasks<double>(proto::DGEMV, NONE, NONE, Upper, NonUnit, A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id())
+           .then([&Y](double) -> vector<double>& { return Y; });
 }
 
-scylla_blas::vector<double>&
-scylla_blas::routine_scheduler::dgemv(const enum TRANSPOSE TransA,
-                                     const double alpha, const matrix<double> &A,
-                                     const vector<double> &X, const double beta,
-                                     vector<double> &Y) {
+scylla_blas::routine_future<float>
+scylla_blas::routine_scheduler::sgemv_dot_async(const enum TRANSPOSE TransA,
+                                                const float alpha, const matrix<float> &A,
+                                                const vector<float> &X, const float beta,
+                                                vector<float> &Y, const vector<float> &Z) {
+    if (X == Y) {
+        throw std::runtime_error("Invalid operation: const vector X passed equal to non-const vector Y in sgemv");
+    }
+
+    assert_width_length_equal(A, X, TransA);
+    assert_height_length_equal(A, Y, TransA);
+    assert_height_length_equal(A, Z, TransA);
+    choose_execution(entries_of(A));
+    add_segments_as_queue_tasks(Y, estimated_costs([&A, TransA] { return segment_costs(A, TransA); }));
+
+    return produce_gemv_dot_tasks<float>(A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id(), Z.get_id());
+}
+
+scylla_blas::routine_future<double>
+scylla_blas::routine_scheduler::dgemv_dot_async(const enum TRANSPOSE TransA,
+                                                const double alpha, const matrix<double> &A,
+                                                const vector<double> &X, const double beta,
+                                                vector<double> &Y, const vector<double> &Z) {
     if (X == Y) {
         throw std::runtime_error("Invalid operation: const vector X passed equal to non-const vector Y in dgemv");
     }
 
     assert_width_length_equal(A, X, TransA);
     assert_height_length_equal(A, Y, TransA);
-    add_segments_as_queue_tasks(Y);
+    assert_height_length_equal(A, Z, TransA);
+    choose_execution(entries_of(A));
+    add_segments_as_queue_tasks(Y, estimated_costs([&A, TransA] { return segment_costs(A, TransA); }));
 
-    produce_mixed_tasks<double>(proto::DGEMV, NONE, NONE, Upper, NonUnit, A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id());
-    return Y;
+    return produce_gemv_dot_tasks<double>(A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id(), Z.get_id());
 }
 
-scylla_blas::vector<float>&
-scylla_blas::routine_scheduler::sgbmv(const enum TRANSPOSE TransA,
-                                      const int KL, const int KU,
-                                      const float alpha, const matrix<float> &A,
-                                      const vector<float> &X, const float beta,
-                                      vector<float> &Y) {
+scylla_blas::routine_future<scylla_blas::vector<float>&>
+scylla_blas::routine_scheduler::sgbmv_async(const enum TRANSPOSE TransA,
+                                            const int KL, const int KU,
+                                            const float alpha, const matrix<float> &A,
+                                            const vector<float> &X, const float beta,
+                                            vector<float> &Y) {
     if (X == Y) {
         throw std::runtime_error("Invalid operation: const vector X passed equal to non-const vector Y in sgbmv");
     }
 
     assert_width_length_equal(A, X, TransA);
     assert_height_length_equal(A, Y, TransA);
+    choose_execution(entries_of(A));
     add_segments_as_queue_tasks(Y);
 
-    produce_mixed_tasks<float>(proto::SGBMV, KL, KU, Upper, NonUnit, A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id());
-    return Y;
+    return produce_mixed_tasks<float>(proto::SGBMV, KL, KU, Upper, NonUnit, A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id())
+           .then([&Y](float) -> vector<float>& { return Y; });
 }
 
-scylla_blas::vector<double>&
-scylla_blas::routine_scheduler::dgbmv(const enum TRANSPOSE TransA,
-                                      const int KL, const int KU,
-                                      const double alpha, const matrix<double> &A,
-                                      const vector<double> &X, const double beta,
-                                      vector<double> &Y) {
+scylla_blas::routine_future<scylla_blas::vector<double>&>
+scylla_blas::routine_scheduler::dgbmv_async(const enum TRANSPOSE TransA,
+                                            const int KL, const int KU,
+                                            const double alpha, const matrix<double> &A,
+                                            const vector<double> &X, const double beta,
+                                            vector<double> &Y) {
     if (X == Y) {
         throw std::runtime_error("Invalid operation: const vector X passed equal to non-const vector Y in dgbmv");
     }
 
     assert_width_length_equal(A, X, TransA);
     assert_height_length_equal(A, Y, TransA);
+    choose_execution(entries_of(A));
     add_segments_as_queue_tasks(Y);
 
-    produce_mixed_tasks<double>(proto::DGBMV, KL, KU, Upper, NonUnit, A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id());
-    return Y;
+    return produce_mixed_tasks<double>(proto::DGBMV, KL, KU, Upper, NonUnit, A.get_id(), TransA, alpha, X.get_id(), beta, Y.get_id())
+           .then([&Y](double) -> vector<double>& { return Y; });
 }
 
-scylla_blas::matrix<float>&
-scylla_blas::routine_scheduler::sger(const float alpha, const vector<float> &X,
-                                     const vector<float> &Y, matrix<float> &A) {
+scylla_blas::routine_future<scylla_blas::matrix<float>&>
+scylla_blas::routine_scheduler::sger_async(const float alpha, const vector<float> &X,
+                                           const vector<float> &Y, matrix<float> &A) {
     /* Leave handling X == Y to a worker */
     assert_height_length_equal(A, X);
     assert_width_length_equal(A, Y);
-    add_blocks_as_queue_tasks(A);
+    choose_execution(entries_of(A));
+    add_blocks_as_queue_tasks(A, estimated_costs([&A] { return update_block_costs(A); }));
 
-    produce_mixed_tasks<float>(proto::SGER, NONE, NONE, Upper, NonUnit, A.get_id(), NoTrans, alpha, X.get_id(), NONE, Y.get_id());
-    return A;
+    return produce_mixed_tasks<float>(proto::SGER, NONE, NONE, Upper, NonUnit, A.get_id(), NoTrans, alpha, X.get_id(), NONE, Y.get_id())
+           .then([&A](float) -> matrix<float>& { return A; });
 }
 
-scylla_blas::matrix<double>&
-scylla_blas::routine_scheduler::dger(const double alpha, const vector<double> &X,
-                                     const vector<double> &Y, matrix<double> &A) {
+scylla_blas::routine_future<scylla_blas::matrix<double>&>
+scylla_blas::routine_scheduler::dger_async(const double alpha, const vector<double> &X,
+                                           const vector<double> &Y, matrix<double> &A) {
     /* Leave handling X == Y to a worker */
     assert_height_length_equal(A, X);
     assert_width_length_equal(A, Y);
-    add_blocks_as_queue_tasks(A);
+    choose_execution(entries_of(A));
+    add_blocks_as_queue_tasks(A, estimated_costs([&A] { return update_block_costs(A); }));
 
-    produce_mixed_tasks<double>(proto::DGER, NONE, NONE, Upper, NonUnit, A.get_id(), NoTrans, alpha, X.get_id(), NONE, Y.get_id());
-    return A;
+    return produce_mixed_tasks<double>(proto::DGER, NONE, NONE, Upper, NonUnit, A.get_id(), NoTrans, alpha, X.get_id(), NONE, Y.get_id())
+           .then([&A](double) -> matrix<double>& { return A; });
 }
 
 scylla_blas::vector<float>&
@@ -203,19 +306,12 @@ scylla_blas::routine_scheduler::strsv(const enum UPLO Uplo, const enum TRANSPOSE
     scylla_blas::vector<float>::clear(this->_session, HELPER_FLOAT_VECTOR_ID);
 
     add_segments_as_queue_tasks(X);
-    produce_vector_tasks<float>(proto::SCOPY, 1, X.get_id(), HELPER_FLOAT_VECTOR_ID);
-
-    float error, sum;
-    do {
-        sum = 0;
+    produce_vector_tasks<float>(proto::SCOPY, 1, X.get_id(), HELPER_FLOAT_VECTOR_ID).get();
 
+    run_sweeps<float>([&] {
         add_segments_as_queue_tasks(X);
-        error = produce_mixed_tasks<float>(proto::STRSV, NONE, NONE, Uplo, Diag, A.get_id(), TransA, NONE, HELPER_FLOAT_VECTOR_ID, NONE, X.get_id(),
-                                           0, [&sum](float &result, const proto::response &r) {
-                                                result += r.result_float_pair.first;
-                                                sum += r.result_float_pair.second;
-                                            });
-    } while (error / sum > EPSILON);
+        produce_mixed_tasks<float>(proto::STRSV, NONE, NONE, Uplo, Diag, A.get_id(), TransA, NONE, HELPER_FLOAT_VECTOR_ID, NONE, X.get_id());
+    });
     return X;
 }
 
@@ -228,19 +324,12 @@ scylla_blas::routine_scheduler::dtrsv(const enum UPLO Uplo, const enum TRANSPOSE
     scylla_blas::vector<double>::clear(this->_session, HELPER_DOUBLE_VECTOR_ID);
 
     add_segments_as_queue_tasks(X);
-    produce_vector_tasks<float>(proto::DCOPY, 1, X.get_id(), HELPER_DOUBLE_VECTOR_ID);
-
-    double error, sum;
-    do {
-        sum = 0;
+    produce_vector_tasks<double>(proto::DCOPY, 1, X.get_id(), HELPER_DOUBLE_VECTOR_ID).get();
 
+    run_sweeps<double>([&] {
         add_segments_as_queue_tasks(X);
-        error = produce_mixed_tasks<double>(proto::DTRSV, NONE, NONE, Uplo, Diag, A.get_id(), TransA, NONE, HELPER_DOUBLE_VECTOR_ID, NONE, X.get_id(),
-                                           0, [&sum](double &result, const proto::response &r) {
-                                                result += r.result_double_pair.first;
-                                                sum += r.result_double_pair.second;
-                                            });
-    } while (error / sum > EPSILON);
+        produce_mixed_tasks<double>(proto::DTRSV, NONE, NONE, Uplo, Diag, A.get_id(), TransA, NONE, HELPER_DOUBLE_VECTOR_ID, NONE, X.get_id());
+    });
     return X;
 }
 
@@ -252,19 +341,12 @@ scylla_blas::routine_scheduler::stbsv(const enum UPLO Uplo, const enum TRANSPOSE
     scylla_blas::vector<float>::clear(this->_session, HELPER_FLOAT_VECTOR_ID);
 
     add_segments_as_queue_tasks(X);
-    produce_vector_tasks<float>(proto::SCOPY, 1, X.get_id(), HELPER_FLOAT_VECTOR_ID);
-
-    float error, sum;
-    do {
-        sum = 0;
+    produce_vector_tasks<float>(proto::SCOPY, 1, X.get_id(), HELPER_FLOAT_VECTOR_ID).get();
 
+    run_sweeps<float>([&] {
         add_segments_as_queue_tasks(X);
-        error = produce_mixed_tasks<float>(proto::STBSV, K, K, Uplo, Diag, A.get_id(), TransA, NONE, HELPER_FLOAT_VECTOR_ID, NONE, X.get_id(),
-                                           0, [&sum](float &result, const proto::response &r) {
-                                                result += r.result_float_pair.first;
-                                                sum += r.result_float_pair.second;
-                                            });
-    } while (error / sum > EPSILON);
+        produce_mixed_tasks<float>(proto::STBSV, K, K, Uplo, Diag, A.get_id(), TransA, NONE, HELPER_FLOAT_VECTOR_ID, NONE, X.get_id());
+    });
     return X;
 }
 
@@ -275,18 +357,58 @@ scylla_blas::routine_scheduler::dtbsv(const enum UPLO Uplo, const enum TRANSPOSE
     scylla_blas::vector<double>::clear(this->_session, HELPER_DOUBLE_VECTOR_ID);
 
     add_segments_as_queue_tasks(X);
-    produce_vector_tasks<float>(proto::DCOPY, 1, X.get_id(), HELPER_DOUBLE_VECTOR_ID);
-
-    double error, sum;
-    do {
-        sum = 0;
+    produce_vector_tasks<double>(proto::DCOPY, 1, X.get_id(), HELPER_DOUBLE_VECTOR_ID).get();
 
+    run_sweeps<double>([&] {
         add_segments_as_queue_tasks(X);
-        error = produce_mixed_tasks<double>(proto::DTBSV, K, K, Uplo, Diag, A.get_id(), TransA, NONE, HELPER_DOUBLE_VECTOR_ID, NONE, X.get_id(),
-                                           0, [&sum](double &result, const proto::response &r) {
-                                                result += r.result_double_pair.first;
-                                                sum += r.result_double_pair.second;
-                                            });
-    } while (error / sum > EPSILON);
+        produce_mixed_tasks<double>(proto::DTBSV, K, K, Uplo, Diag, A.get_id(), TransA, NONE, HELPER_DOUBLE_VECTOR_ID, NONE, X.get_id());
+    });
     return X;
-}
\ No newline at end of file
+}
+/* Blocking versions */
+
+scylla_blas::vector<float>&
+scylla_blas::routine_scheduler::sgemv(const enum TRANSPOSE TransA,
+                                     const float alpha, const matrix<float> &A,
+                                     const vector<float> &X, const float beta,
+                                     vector<float> &Y) {
+    return sgemv_async(TransA, alpha, A, X, beta, Y).get();
+}
+
+scylla_blas::vector<double>&
+scylla_blas::routine_scheduler::dgemv(const enum TRANSPOSE TransA,
+                                     const double alpha, const matrix<double> &A,
+                                     const vector<double> &X, const double beta,
+                                     vector<double> &Y) {
+    return dgemv_async(TransA, alpha, A, X, beta, Y).get();
+}
+
+scylla_blas::vector<float>&
+scylla_blas::routine_scheduler::sgbmv(const enum TRANSPOSE TransA,
+                                      const int KL, const int KU,
+                                      const float alpha, const matrix<float> &A,
+                                      const vector<float> &X, const float beta,
+                                      vector<float> &Y) {
+    return sgbmv_async(TransA, KL, KU, alpha, A, X, beta, Y).get();
+}
+
+scylla_blas::vector<double>&
+scylla_blas::routine_scheduler::dgbmv(const enum TRANSPOSE TransA,
+                                      const int KL, const int KU,
+                                      const double alpha, const matrix<double> &A,
+                                      const vector<double> &X, const double beta,
+                                      vector<double> &Y) {
+    return dgbmv_async(TransA, KL, KU, alpha, A, X, beta, Y).get();
+}
+
+scylla_blas::matrix<float>&
+scylla_blas::routine_scheduler::sger(const float alpha, const vector<float> &X,
+                                     const vector<float> &Y, matrix<float> &A) {
+    return sger_async(alpha, X, Y, A).get();
+}
+
+scylla_blas::matrix<double>&
+scylla_blas::routine_scheduler::dger(const double alpha, const vector<double> &X,
+                                     const vector<double> &Y, matrix<double> &A) {
+    return dger_async(alpha, X, Y, A).get();
+}
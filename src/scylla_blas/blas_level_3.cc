@@ -40,17 +40,17 @@ void assert_multiplication_compatible(const enum scylla_blas::TRANSPOSE TransA,
 }
 
 template<>
-float scylla_blas::routine_scheduler::produce_matrix_tasks(const proto::task_type type,
-                                                           const id_t A_id, const enum TRANSPOSE TransA, const float alpha,
-                                                           const id_t B_id, const enum TRANSPOSE TransB, const float beta,
-                                                           const id_t C_id, float acc, updater<float> update) {
+scylla_blas::routine_future<float> scylla_blas::routine_scheduler::produce_matrix_tasks(const proto::task_type type,
+                                                                                        const id_t A_id, const enum TRANSPOSE TransA, const float alpha,
+                                                                                        const id_t B_id, const enum TRANSPOSE TransB, const float beta,
+                                                                                        const id_t C_id, float acc, updater<float> update) {
     std::vector<proto::task> tasks;
 
-    for (const auto &q : this->_subtask_queues) {
+    for (id_t queue_id : this->subtask_queue_ids()) {
         tasks.push_back({
             .type = type,
             .matrix_task_float = {
-                .task_queue_id = q.get_id(),
+                .task_queue_id = queue_id,
 
                 .A_id = A_id,
                 .TransA = TransA,
@@ -65,21 +65,21 @@ float scylla_blas::routine_scheduler::produce_matrix_tasks(const proto::task_typ
         });
     }
 
-    return produce_and_wait(tasks, acc, update);
+    return produce_async(tasks, acc, update);
 }
 
 template<>
-double scylla_blas::routine_scheduler::produce_matrix_tasks(const proto::task_type type,
-                                                            const id_t A_id, const enum TRANSPOSE TransA, const double alpha,
-                                                            const id_t B_id, const enum TRANSPOSE TransB, const double beta,
-                                                            const id_t C_id, double acc, updater<double> update) {
+scylla_blas::routine_future<double> scylla_blas::routine_scheduler::produce_matrix_tasks(const proto::task_type type,
+                                                                                         const id_t A_id, const enum TRANSPOSE TransA, const double alpha,
+                                                                                         const id_t B_id, const enum TRANSPOSE TransB, const double beta,
+                                                                                         const id_t C_id, double acc, updater<double> update) {
     std::vector<proto::task> tasks;
 
-    for (const auto &q : this->_subtask_queues) {
+    for (id_t queue_id : this->subtask_queue_ids()) {
         tasks.push_back({
             .type = type,
             .matrix_task_double = {
-                .task_queue_id = q.get_id(),
+                .task_queue_id = queue_id,
 
                 .A_id = A_id,
                 .TransA = TransA,
@@ -94,82 +94,128 @@ double scylla_blas::routine_scheduler::produce_matrix_tasks(const proto::task_ty
         });
     }
 
-    return produce_and_wait(tasks, acc, update);
+    return produce_async(tasks, acc, update);
 }
 
 #define NONE 0
 
+scylla_blas::routine_future<scylla_blas::matrix<float>&>
+scylla_blas::routine_scheduler::sgemm_async(const enum TRANSPOSE TransA, const enum TRANSPOSE TransB,
+                                            const float alpha, const matrix<float> &A,
+                                            const matrix<float> &B,
+                                            const float beta, scylla_blas::matrix<float> &C) {
+    assert_multiplication_compatible(TransA, A, B, TransB, C);
+    choose_execution(entries_of(A) + entries_of(B) + entries_of(C));
+    add_blocks_as_queue_tasks(C, estimated_costs([&A, TransA, &B, TransB] {
+        return product_block_costs(A, TransA, B, TransB);
+    }));
+
+    return produce_matrix_tasks<float>(proto::SGEMM, A.get_id(), TransA, alpha, B.get_id(), TransB, beta, C.get_id(),
+                                       0, [this](float &, const proto::response &r) { record_reads(r); })
+           .then([&C](float) -> matrix<float>& { return C; });
+}
+
+scylla_blas::routine_future<scylla_blas::matrix<double>&>
+scylla_blas::routine_scheduler::dgemm_async(const enum TRANSPOSE TransA, const enum TRANSPOSE TransB,
+                                            const double alpha, const matrix<double> &A,
+                                            const matrix<double> &B, const double beta, scylla_blas::matrix<double> &C) {
+    assert_multiplication_compatible(TransA, A, B, TransB, C);
+    choose_execution(entries_of(A) + entries_of(B) + entries_of(C));
+    add_blocks_as_queue_tasks(C, estimated_costs([&A, TransA, &B, TransB] {
+        return product_block_costs(A, TransA, B, TransB);
+    }));
+
+    return produce_matrix_tasks<double>(proto::DGEMM, A.get_id(), TransA, alpha, B.get_id(), TransB, beta, C.get_id(),
+                                        0, [this](double &, const proto::response &r) { record_reads(r); })
+           .then([&C](double) -> matrix<double>& { return C; });
+}
+
+scylla_blas::routine_future<scylla_blas::matrix<float>&>
+scylla_blas::routine_scheduler::ssyrk_async(__attribute__((unused)) const enum UPLO Uplo,
+                                            const enum TRANSPOSE TransA, const float alpha, const matrix<float> &A,
+                                            const float beta, matrix<float> &C) {
+    assert_multiplication_compatible(TransA, A, A, anti_trans(TransA), C);
+    add_blocks_as_queue_tasks(C);
+
+    return produce_matrix_tasks<float>(proto::SSYRK, A.get_id(), TransA, alpha, NONE, NoTrans, beta, C.get_id())
+           .then([&C](float) -> matrix<float>& { return C; });
+}
+
+scylla_blas::routine_future<scylla_blas::matrix<double>&>
+scylla_blas::routine_scheduler::dsyrk_async(__attribute__((unused)) const enum UPLO Uplo,
+                                            const enum TRANSPOSE TransA, const double alpha, const matrix<double> &A,
+                                            const double beta, matrix<double> &C) {
+    assert_multiplication_compatible(TransA, A, A, anti_trans(TransA), C);
+    add_blocks_as_queue_tasks(C);
+
+    return produce_matrix_tasks<double>(proto::DSYRK, A.get_id(), TransA, alpha, NONE, NoTrans, beta, C.get_id())
+           .then([&C](double) -> matrix<double>& { return C; });
+}
+
+scylla_blas::routine_future<scylla_blas::matrix<float>&>
+scylla_blas::routine_scheduler::ssyr2k_async(__attribute__((unused)) const enum UPLO Uplo,
+                                             const enum TRANSPOSE Trans, const float alpha, const matrix<float> &A,
+                                             const float beta, const matrix<float> &B, matrix<float> &C) {
+    assert_multiplication_compatible(Trans, A, B, anti_trans(Trans), C);
+    assert_multiplication_compatible(anti_trans(Trans), A, B, Trans, C);
+    add_blocks_as_queue_tasks(C);
+
+    return produce_matrix_tasks<float>(proto::SSYR2K, A.get_id(), Trans, alpha, B.get_id(), NoTrans, beta, C.get_id())
+           .then([&C](float) -> matrix<float>& { return C; });
+}
+
+scylla_blas::routine_future<scylla_blas::matrix<double>&>
+scylla_blas::routine_scheduler::dsyr2k_async(__attribute__((unused)) const enum UPLO Uplo,
+                                             const enum TRANSPOSE TransA, const double alpha, const matrix<double> &A,
+                                             const double beta, const matrix<double> &B, matrix<double> &C) {
+    assert_multiplication_compatible(Trans, A, B, anti_trans(Trans), C);
+    assert_multiplication_compatible(anti_trans(Trans), A, B, Trans, C);
+    add_blocks_as_queue_tasks(C);
+
+    return produce_matrix_tasks<double>(proto::DSYR2K, A.get_id(), Trans, alpha, B.get_id(), NoTrans, beta, C.get_id())
+           .then([&C](double) -> matrix<double>& { return C; });
+}
+/* Blocking versions */
+
 scylla_blas::matrix<float>&
 scylla_blas::routine_scheduler::sgemm(const enum TRANSPOSE TransA, const enum TRANSPOSE TransB,
                                       const float alpha, const matrix<float> &A,
                                       const matrix<float> &B,
                                       const float beta, scylla_blas::matrix<float> &C) {
-    assert_multiplication_compatible(TransA, A, B, TransB, C);
-    add_blocks_as_queue_tasks(C);
-
-    produce_matrix_tasks<float>(proto::SGEMM, A.get_id(), TransA, alpha, B.get_id(), TransB, beta, C.get_id());
-
-    return C;
+    return sgemm_async(TransA, TransB, alpha, A, B, beta, C).get();
 }
 
 scylla_blas::matrix<double>&
 scylla_blas::routine_scheduler::dgemm(const enum TRANSPOSE TransA, const enum TRANSPOSE TransB,
                                       const double alpha, const matrix<double> &A,
                                       const matrix<double> &B, const double beta, scylla_blas::matrix<double> &C) {
-    assert_multiplication_compatible(TransA, A, B, TransB, C);
-    add_blocks_as_queue_tasks(C);
-
-    produce_matrix_tasks<double>(proto::DGEMM, A.get_id(), TransA, alpha, B.get_id(), TransB, beta, C.get_id());
-
-    return C;
+    return dgemm_async(TransA, TransB, alpha, A, B, beta, C).get();
 }
 
 scylla_blas::matrix<float>&
-scylla_blas::routine_scheduler::ssyrk(__attribute__((unused)) const enum UPLO Uplo,
+scylla_blas::routine_scheduler::ssyrk(const enum UPLO Uplo,
                                       const enum TRANSPOSE TransA, const float alpha, const matrix<float> &A,
                                       const float beta, matrix<float> &C) {
-    assert_multiplication_compatible(TransA, A, A, anti_trans(TransA), C);
-    add_blocks_as_queue_tasks(C);
-
-    produce_matrix_tasks<float>(proto::SSYRK, A.get_id(), TransA, alpha, NONE, NoTrans, beta, C.get_id());
-
-    return C;
+    return ssyrk_async(Uplo, TransA, alpha, A, beta, C).get();
 }
 
 scylla_blas::matrix<double>&
-scylla_blas::routine_scheduler::dsyrk(__attribute__((unused)) const enum UPLO Uplo,
+scylla_blas::routine_scheduler::dsyrk(const enum UPLO Uplo,
                                       const enum TRANSPOSE TransA, const double alpha, const matrix<double> &A,
                                       const double beta, matrix<double> &C) {
-    assert_multiplication_compatible(TransA, A, A, anti_trans(TransA), C);
-    add_blocks_as_queue_tasks(C);
-
-    produce_matrix_tasks<float>(proto::DSYRK, A.get_id(), TransA, alpha, NONE, NoTrans, beta, C.get_id());
-
-    return C;
+    return dsyrk_async(Uplo, TransA, alpha, A, beta, C).get();
 }
 
 scylla_blas::matrix<float>&
-scylla_blas::routine_scheduler::ssyr2k(__attribute__((unused)) const enum UPLO Uplo,
+scylla_blas::routine_scheduler::ssyr2k(const enum UPLO Uplo,
                                       const enum TRANSPOSE Trans, const float alpha, const matrix<float> &A,
                                       const float beta, const matrix<float> &B, matrix<float> &C) {
-    assert_multiplication_compatible(Trans, A, B, anti_trans(Trans), C);
-    assert_multiplication_compatible(anti_trans(Trans), A, B, Trans, C);
-    add_blocks_as_queue_tasks(C);
-
-    produce_matrix_tasks<float>(proto::SSYR2K, A.get_id(), Trans, alpha, B.get_id(), NoTrans, beta, C.get_id());
-
-    return C;
+    return ssyr2k_async(Uplo, Trans, alpha, A, beta, B, C).get();
 }
 
 scylla_blas::matrix<double>&
-scylla_blas::routine_scheduler::dsyr2k(__attribute__((unused)) const enum UPLO Uplo,
+scylla_blas::routine_scheduler::dsyr2k(const enum UPLO Uplo,
                                       const enum TRANSPOSE TransA, const double alpha, const matrix<double> &A,
                                       const double beta, const matrix<double> &B, matrix<double> &C) {
-    assert_multiplication_compatible(Trans, A, B, anti_trans(Trans), C);
-    assert_multiplication_compatible(anti_trans(Trans), A, B, Trans, C);
-    add_blocks_as_queue_tasks(C);
-
-    produce_matrix_tasks<float>(proto::DSYR2K, A.get_id(), Trans, alpha, B.get_id(), NoTrans, beta, C.get_id());
-
-    return C;
-}
\ No newline at end of file
+    return dsyr2k_async(Uplo, TransA, alpha, A, beta, B, C).get();
+}
@@ -1,23 +1,23 @@
 #include "scylla_blas/routines.hh"
 
 template<class T>
-T scylla_blas::routine_scheduler::produce_generation_tasks(const proto::task_type type,
-                                                           const id_t structure_id, const double alpha,
-                                                           T acc, updater<T> update) {
+scylla_blas::routine_future<T> scylla_blas::routine_scheduler::produce_generation_tasks(const proto::task_type type,
+                                                                                        const id_t structure_id, const double alpha,
+                                                                                        T acc, updater<T> update) {
     std::vector<proto::task> tasks;
 
-    for (const auto &q : this->_subtask_queues) {
+    for (id_t queue_id : this->subtask_queue_ids()) {
         tasks.push_back({
             .type = type,
             .generation_task = {
-                .task_queue_id = q.get_id(),
+                .task_queue_id = queue_id,
                 .structure_id = structure_id,
                 .alpha = alpha
             }
         });
     }
 
-    return produce_and_wait(tasks, acc, update);
+    return produce_async(tasks, acc, update);
 }
 
 #define NONE 0
@@ -27,7 +27,7 @@ scylla_blas::routine_scheduler::srvgen(scylla_blas::vector<float> &X) {
     add_segments_as_queue_tasks(X);
 
     /* TODO: is there a `none_type` that we could provide? */
-    produce_generation_tasks<float>(proto::SRVGEN, X.get_id(), NONE);
+    produce_generation_tasks<float>(proto::SRVGEN, X.get_id(), NONE).get();
     return X;
 }
 
@@ -36,7 +36,7 @@ scylla_blas::routine_scheduler::drvgen(scylla_blas::vector<double> &X) {
     add_segments_as_queue_tasks(X);
 
     /* TODO: is there a `none_type` that we could provide? */
-    produce_generation_tasks<double>(proto::DRVGEN, X.get_id(), NONE);
+    produce_generation_tasks<double>(proto::DRVGEN, X.get_id(), NONE).get();
     return X;
 }
 
@@ -45,7 +45,7 @@ scylla_blas::routine_scheduler::srmgen(double alpha, scylla_blas::matrix<float>
     add_blocks_as_queue_tasks(A);
 
     /* TODO: is there a `none_type` that we could provide? */
-    produce_generation_tasks<float>(proto::SRMGEN, A.get_id(), alpha);
+    produce_generation_tasks<float>(proto::SRMGEN, A.get_id(), alpha).get();
     return A;
 }
 
@@ -54,6 +54,6 @@ scylla_blas::routine_scheduler::drmgen(double alpha, scylla_blas::matrix<double>
     add_blocks_as_queue_tasks(A);
 
     /* TODO: is there a `none_type` that we could provide? */
-    produce_generation_tasks<double>(proto::DRMGEN, A.get_id(), alpha);
+    produce_generation_tasks<double>(proto::DRMGEN, A.get_id(), alpha).get();
     return A;
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "scylla_blas/matrix.hh"
+#include "scylla_blas/utils/version_bumps.hh"
 
 void scylla_blas::basic_matrix::update_meta() {
     scmd::query_result result = _session->execute(_get_meta_prepared, id);
@@ -9,11 +10,129 @@ void scylla_blas::basic_matrix::update_meta() {
     row_count = result.get_column<index_t>("row_count");
     column_count = result.get_column<index_t>("column_count");
     block_size = result.get_column<index_t>("block_size");
+
+    scmd::query_result version_result = _session->execute(_get_version_prepared, id);
+    version = version_result.next_row() ? version_result.get_column<int64_t>("version") : 0;
+}
+
+void scylla_blas::basic_matrix::bump_version() {
+    if (version_bump_scope::defer(true, id, [session = _session, id = id] { bump_version(session, id); })) return;
+
+    _session->execute(_bump_version_prepared, id);
+}
+
+void scylla_blas::basic_matrix::bump_version(const std::shared_ptr<scmd::session> &session, id_t id) {
+    session->execute("UPDATE blas.matrix_version SET version = version + 1 WHERE id = ?;", id);
+}
+
+const scylla_blas::basic_matrix::nnz_queries *scylla_blas::basic_matrix::get_nnz_queries() const {
+    if (!_nnz_prepared) {
+        _nnz_prepared = true;
+        try {
+#define PREPARE(args...) _session->prepare(fmt::format(args))
+            _nnz = nnz_queries {
+                .get_all = PREPARE("SELECT block_x, block_y, nnz FROM blas.matrix_{}_block_nnz;", id),
+                .count_block = PREPARE("SELECT COUNT(*) FROM blas.matrix_{} WHERE block_x = ? AND block_y = ?;", id),
+                .set = PREPARE("INSERT INTO blas.matrix_{}_block_nnz (block_x, block_y, nnz) VALUES (?, ?, ?);", id),
+                .forget = PREPARE("DELETE FROM blas.matrix_{}_block_nnz WHERE block_x = ? AND block_y = ?;", id),
+                .forget_block_row = PREPARE("DELETE FROM blas.matrix_{}_block_nnz WHERE block_x = ?;", id)
+            };
+#undef PREPARE
+        } catch (const std::exception &e) {
+            LogDebug("Matrix {} keeps no non-zero counts: {}", id, e.what());
+        }
+    }
+
+    return _nnz.has_value() ? &*_nnz : nullptr;
+}
+
+void scylla_blas::basic_matrix::create_nnz_table(const std::shared_ptr<scmd::session> &session, id_t id) {
+    scmd::statement create_nnz_table(fmt::format(R"(
+        CREATE TABLE IF NOT EXISTS blas.matrix_{0}_block_nnz (
+            block_x BIGINT,
+            block_y BIGINT,
+            nnz     BIGINT,
+            PRIMARY KEY (block_x, block_y));
+    )", id));
+    session->execute(create_nnz_table.set_timeout(0));
+}
+
+std::vector<int64_t> scylla_blas::basic_matrix::get_block_nnz() const {
+    index_t height = get_blocks_height();
+    index_t width = get_blocks_width();
+    auto queries = get_nnz_queries();
+    if (queries == nullptr || height * width > COST_MODEL_MAX_SUBTASKS) return {};
+
+    std::vector<int64_t> nnz(height * width, -1);
+    scmd::query_result result = _session->execute(queries->get_all);
+    while (result.next_row()) {
+        index_t x = result.get_column<index_t>("block_x");
+        index_t y = result.get_column<index_t>("block_y");
+        if (1 <= x && x <= height && 1 <= y && y <= width) {
+            nnz[(x - 1) * width + y - 1] = result.get_column<int64_t>("nnz");
+        }
+    }
+
+    /* Blocks written partially, or never, have no count – their values are counted in Scylla, all at once */
+    std::vector<size_t> uncounted;
+    for (size_t i = 0; i < nnz.size(); i++) {
+        if (nnz[i] < 0) uncounted.push_back(i);
+    }
+    if ((int64_t)uncounted.size() > COST_MODEL_MAX_COUNTED_BLOCKS) return {};
+
+    std::vector<scmd::future> counts;
+    for (size_t i : uncounted) {
+        counts.push_back(_session->execute_async(queries->count_block, index_t(i / width + 1), index_t(i % width + 1)));
+    }
+    for (size_t k = 0; k < uncounted.size(); k++) {
+        scmd::query_result count = counts[k].get_result();
+        nnz[uncounted[k]] = count.next_row() ? count.get_column<int64_t>("count") : 0;
+    }
+
+    return nnz;
+}
+
+std::vector<int64_t> scylla_blas::basic_matrix::sum_nnz(index_t axis) const {
+    auto nnz = get_block_nnz();
+    if (nnz.empty()) return {};
+
+    index_t width = get_blocks_width();
+    std::vector<int64_t> sums(axis == 0 ? get_blocks_height() : width, 0);
+    for (size_t i = 0; i < nnz.size(); i++) {
+        sums[axis == 0 ? i / width : i % width] += nnz[i];
+    }
+    return sums;
+}
+
+void scylla_blas::basic_matrix::set_nnz(index_t block_x, index_t block_y, int64_t nnz, std::vector<scmd::future> &futures) {
+    if (auto queries = get_nnz_queries()) {
+        futures.push_back(_session->execute_async(queries->set, block_x, block_y, nnz));
+    }
+}
+
+void scylla_blas::basic_matrix::forget_nnz(index_t block_x, index_t block_y, std::vector<scmd::future> &futures) {
+    if (auto queries = get_nnz_queries()) {
+        futures.push_back(_session->execute_async(queries->forget, block_x, block_y));
+    }
+}
+
+void scylla_blas::basic_matrix::finish_writes(std::vector<scmd::future> &futures) {
+    for (auto &future : futures) {
+        future.wait();
+    }
+    bump_version();
 }
 
 void scylla_blas::basic_matrix::clear(const std::shared_ptr<scmd::session> &session, int64_t id) {
     scmd::statement truncate(fmt::format("TRUNCATE blas.matrix_{};", id));
     session->execute(truncate.set_timeout(0));
+
+    /* Matrices initialized before the non-zero counts were kept get their table here */
+    create_nnz_table(session, id);
+    scmd::statement truncate_nnz(fmt::format("TRUNCATE blas.matrix_{}_block_nnz;", id));
+    session->execute(truncate_nnz.set_timeout(0));
+
+    bump_version(session, id);
 }
 
 void scylla_blas::basic_matrix::resize(const std::shared_ptr<scmd::session> &session,
@@ -24,6 +143,7 @@ void scylla_blas::basic_matrix::resize(const std::shared_ptr<scmd::session> &ses
                         column_count   = ?
                 WHERE   id             = ?;
         )", new_row_count, new_column_count, id);
+    bump_version(session, id);
 }
 
 void scylla_blas::basic_matrix::set_block_size(const std::shared_ptr<scmd::session> &session, int64_t id, int64_t new_block_size) {
@@ -32,10 +152,12 @@ void scylla_blas::basic_matrix::set_block_size(const std::shared_ptr<scmd::sessi
                 SET     block_size     = ?
                 WHERE   id             = ?;
         )", new_block_size, id);
+    bump_version(session, id);
 }
 
 void scylla_blas::basic_matrix::drop(const std::shared_ptr<scmd::session> &session, int64_t id) {
     session->execute(fmt::format(R"(DROP TABLE blas.matrix_{})", id));
+    session->execute(fmt::format(R"(DROP TABLE IF EXISTS blas.matrix_{}_block_nnz)", id));
     session->execute(R"(DELETE FROM blas.matrix_meta WHERE id = ?)", id);
 }
 
@@ -46,12 +168,20 @@ void scylla_blas::basic_matrix::init_meta(const std::shared_ptr<scmd::session> &
                                                 column_count BIGINT,
                                                 block_size   BIGINT);)");
     session->execute(init_meta.set_timeout(0));
+
+    /* Versions are counters, so that concurrent bumps always give a new one. They are kept
+     * in a table of their own, as counters can't share one with other columns.
+     */
+    scmd::statement init_version(R"(CREATE TABLE IF NOT EXISTS blas.matrix_version (
+                                                id           BIGINT PRIMARY KEY,
+                                                version      COUNTER);)");
+    session->execute(init_version.set_timeout(0));
 }
 
 scylla_blas::basic_matrix::basic_matrix(const std::shared_ptr<scmd::session> &session, int64_t id) :
         _session(session),
         id(id),
-        row_count(0), column_count(0), block_size(0), // Updated in constructor body in update_meta
+        row_count(0), column_count(0), block_size(0), version(0), // Updated in constructor body in update_meta
 #define PREPARE(x, args...) x(_session->prepare(fmt::format(args)))
         PREPARE(_get_meta_prepared,
                 "SELECT row_count, column_count, block_size FROM blas.matrix_meta WHERE id = ?;"),
@@ -70,7 +200,11 @@ scylla_blas::basic_matrix::basic_matrix(const std::shared_ptr<scmd::session> &se
         PREPARE(_resize_prepared,
                 "UPDATE blas.matrix_meta SET row_count = ?, column_count = ? WHERE id = ?;"),
         PREPARE(_set_block_size_prepared,
-                "UPDATE blas.matrix_meta SET block_size = ? WHERE id = ?;")
+                "UPDATE blas.matrix_meta SET block_size = ? WHERE id = ?;"),
+        PREPARE(_get_version_prepared,
+                "SELECT version FROM blas.matrix_version WHERE id = ?;"),
+        PREPARE(_bump_version_prepared,
+                "UPDATE blas.matrix_version SET version = version + 1 WHERE id = ?;")
 #undef PREPARE
 {
     update_meta();
@@ -78,6 +212,12 @@ scylla_blas::basic_matrix::basic_matrix(const std::shared_ptr<scmd::session> &se
 
 void scylla_blas::basic_matrix::clear_all() {
     _session->execute(_clear_all_prepared.get_statement());
+
+    if (get_nnz_queries() != nullptr) {
+        scmd::statement truncate_nnz(fmt::format("TRUNCATE blas.matrix_{}_block_nnz;", id));
+        _session->execute(truncate_nnz.set_timeout(0));
+    }
+    bump_version();
 }
 
 void scylla_blas::basic_matrix::clear_row(index_t row) {
@@ -87,18 +227,21 @@ void scylla_blas::basic_matrix::clear_row(index_t row) {
         auto stmt = _clear_block_row_prepared.get_statement();
         scheduled.push_back(_session->execute_async(stmt, get_block_row(row), block_idx, row));
     }
-    for (auto &future : scheduled) {
-        future.wait();
+    if (auto queries = get_nnz_queries()) {
+        scheduled.push_back(_session->execute_async(queries->forget_block_row, get_block_row(row)));
     }
+    finish_writes(scheduled);
 }
 
 void scylla_blas::basic_matrix::resize(int64_t new_row_count, int64_t new_column_count) {
     _session->execute(_resize_prepared, new_row_count, new_column_count, id);
+    bump_version();
     this->row_count = new_row_count;
     this->column_count = new_column_count;
 }
 
 void scylla_blas::basic_matrix::set_block_size(int64_t new_block_size) {
     _session->execute(_set_block_size_prepared, new_block_size, id);
+    bump_version();
     this->block_size = new_block_size;
 }
@@ -0,0 +1,575 @@
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <fmt/format.h>
+
+#include "scylla_blas/queue/codec.hh"
+
+namespace scylla_blas::proto {
+
+namespace {
+
+int64_t wire_version = WIRE_VERSION_LATEST;
+
+/* Fields of the task union used by a task type */
+enum task_layout {
+    L_SUBTASK,
+    L_VECTOR_FLOAT,
+    L_VECTOR_DOUBLE,
+    L_MIXED_FLOAT,
+    L_MIXED_DOUBLE,
+    L_MATRIX_FLOAT,
+    L_MATRIX_DOUBLE,
+    L_GENERATION,
+    L_FUSED_VECTOR_FLOAT,
+    L_FUSED_VECTOR_DOUBLE,
+    L_GEMV_DOT_FLOAT,
+    L_GEMV_DOT_DOUBLE,
+    L_UNSUPPORTED
+};
+
+task_layout layout_of(task_type type) {
+    if (type == NONE) return L_SUBTASK;
+    if (SROTG <= type && type <= ISAMAX) return L_VECTOR_FLOAT;
+    if (DROTG <= type && type <= IDAMAX) return L_VECTOR_DOUBLE;
+    if (SGEMV <= type && type <= SSPR2) return L_MIXED_FLOAT;
+    if (DGEMV <= type && type <= DSPR2) return L_MIXED_DOUBLE;
+    if (SGEMM <= type && type <= STRSM) return L_MATRIX_FLOAT;
+    if (DGEMM <= type && type <= DTRSM) return L_MATRIX_DOUBLE;
+    if (SRVGEN <= type && type <= DRMGEN) return L_GENERATION;
+    if (type == SFUSED_VECTOR) return L_FUSED_VECTOR_FLOAT;
+    if (type == DFUSED_VECTOR) return L_FUSED_VECTOR_DOUBLE;
+    if (type == SGEMV_DOT) return L_GEMV_DOT_FLOAT;
+    if (type == DGEMV_DOT) return L_GEMV_DOT_DOUBLE;
+    return L_UNSUPPORTED;
+}
+
+class writer {
+    std::vector<uint8_t> _out;
+
+    void put_fixed(uint64_t bits, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            _out.push_back(bits >> (8 * i));
+        }
+    }
+
+public:
+    void put_byte(uint8_t b) { _out.push_back(b); }
+
+    void put_varint(uint64_t v) {
+        while (v >= 0x80) {
+            _out.push_back(v | 0x80);
+            v >>= 7;
+        }
+        _out.push_back(v);
+    }
+
+    void put_int(int64_t v) { put_varint((uint64_t(v) << 1) ^ uint64_t(v >> 63)); }
+
+    void put_float(float v) {
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof bits);
+        put_fixed(bits, sizeof bits);
+    }
+
+    void put_double(double v) {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof bits);
+        put_fixed(bits, sizeof bits);
+    }
+
+    template<class T>
+    void put_scalar(T v) {
+        if constexpr (std::is_same_v<T, float>) {
+            put_float(v);
+        } else {
+            put_double(v);
+        }
+    }
+
+    std::vector<uint8_t> finish() { return std::move(_out); }
+};
+
+class reader {
+    const uint8_t *_data;
+    size_t _size;
+    size_t _pos;
+
+    void require(size_t bytes) {
+        if (_size - _pos < bytes) {
+            throw std::runtime_error("Truncated data in queue");
+        }
+    }
+
+    uint64_t get_fixed(int bytes) {
+        require(bytes);
+        uint64_t bits = 0;
+        for (int i = 0; i < bytes; i++) {
+            bits |= uint64_t(_data[_pos++]) << (8 * i);
+        }
+        return bits;
+    }
+
+public:
+    reader(const uint8_t *data, size_t size) : _data(data), _size(size), _pos(0) {}
+
+    uint8_t get_byte() {
+        require(1);
+        return _data[_pos++];
+    }
+
+    uint64_t get_varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = get_byte();
+            v |= uint64_t(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return v;
+            }
+        }
+        throw std::runtime_error("Malformed varint in queue data");
+    }
+
+    int64_t get_int() {
+        uint64_t v = get_varint();
+        return int64_t(v >> 1) ^ -int64_t(v & 1);
+    }
+
+    float get_float() {
+        uint32_t bits = get_fixed(sizeof bits);
+        float v;
+        memcpy(&v, &bits, sizeof v);
+        return v;
+    }
+
+    double get_double() {
+        uint64_t bits = get_fixed(sizeof bits);
+        double v;
+        memcpy(&v, &bits, sizeof v);
+        return v;
+    }
+
+    template<class T>
+    T get_scalar() {
+        if constexpr (std::is_same_v<T, float>) {
+            return get_float();
+        } else {
+            return get_double();
+        }
+    }
+
+    /* Copies a length-prefixed payload into out, which is zero-padded up to capacity */
+    void get_bytes(void *out, size_t capacity) {
+        size_t size = get_varint();
+        if (size > capacity) {
+            throw std::runtime_error("Oversized payload in queue data");
+        }
+        require(size);
+        memcpy(out, _data + _pos, size);
+        _pos += size;
+    }
+
+    template<class E>
+    E get_enum() { return static_cast<E>(get_varint()); }
+};
+
+void write_header(writer &w, int64_t type) {
+    w.put_byte(WIRE_MARKER);
+    w.put_byte(WIRE_VERSION_COMPACT);
+    w.put_varint(type);
+}
+
+/* Returns the type tag of a compact record */
+int64_t read_header(reader &r) {
+    r.get_byte();
+    int64_t version = r.get_byte();
+    if (version != WIRE_VERSION_COMPACT) {
+        throw std::runtime_error(fmt::format("Unsupported queue data version {}", version));
+    }
+    return r.get_varint();
+}
+
+template<class T>
+T legacy_from_bytes(const uint8_t *data, size_t size, const char *what) {
+    if (size != sizeof(T)) {
+        throw std::runtime_error(fmt::format("Invalid {} in queue", what));
+    }
+    T ret{};
+    memcpy(&ret, data, size);
+    return ret;
+}
+
+template<class T>
+std::vector<uint8_t> legacy_to_bytes(const T &value) {
+    auto bytes = reinterpret_cast<const uint8_t *>(&value);
+    return std::vector<uint8_t>(bytes, bytes + sizeof value);
+}
+
+template<class Task>
+void put_mixed(writer &w, const Task &t) {
+    w.put_int(t.task_queue_id);
+    w.put_int(t.KL);
+    w.put_int(t.KU);
+    w.put_varint(t.Uplo);
+    w.put_varint(t.Diag);
+    w.put_int(t.A_id);
+    w.put_varint(t.TransA);
+    w.put_scalar(t.alpha);
+    w.put_int(t.X_id);
+    w.put_scalar(t.beta);
+    w.put_int(t.Y_id);
+}
+
+template<class Task>
+void get_mixed(reader &r, Task &t) {
+    t.task_queue_id = r.get_int();
+    t.KL = r.get_int();
+    t.KU = r.get_int();
+    t.Uplo = r.get_enum<UPLO>();
+    t.Diag = r.get_enum<DIAG>();
+    t.A_id = r.get_int();
+    t.TransA = r.get_enum<TRANSPOSE>();
+    t.alpha = r.get_scalar<decltype(t.alpha)>();
+    t.X_id = r.get_int();
+    t.beta = r.get_scalar<decltype(t.beta)>();
+    t.Y_id = r.get_int();
+}
+
+template<class Task>
+void put_matrix(writer &w, const Task &t) {
+    w.put_int(t.task_queue_id);
+    w.put_int(t.A_id);
+    w.put_varint(t.TransA);
+    w.put_scalar(t.alpha);
+    w.put_int(t.B_id);
+    w.put_varint(t.TransB);
+    w.put_scalar(t.beta);
+    w.put_int(t.C_id);
+}
+
+template<class Task>
+void get_matrix(reader &r, Task &t) {
+    t.task_queue_id = r.get_int();
+    t.A_id = r.get_int();
+    t.TransA = r.get_enum<TRANSPOSE>();
+    t.alpha = r.get_scalar<decltype(t.alpha)>();
+    t.B_id = r.get_int();
+    t.TransB = r.get_enum<TRANSPOSE>();
+    t.beta = r.get_scalar<decltype(t.beta)>();
+    t.C_id = r.get_int();
+}
+
+template<class Task>
+void put_fused_vector(writer &w, const Task &t) {
+    w.put_int(t.task_queue_id);
+    w.put_varint(t.ops);
+    w.put_scalar(t.scale);
+    w.put_scalar(t.alpha);
+    w.put_scalar(t.beta);
+    w.put_int(t.X_id);
+    w.put_int(t.Y_id);
+    w.put_int(t.Z_id);
+}
+
+template<class Task>
+void get_fused_vector(reader &r, Task &t) {
+    t.task_queue_id = r.get_int();
+    t.ops = r.get_varint();
+    t.scale = r.get_scalar<decltype(t.scale)>();
+    t.alpha = r.get_scalar<decltype(t.alpha)>();
+    t.beta = r.get_scalar<decltype(t.beta)>();
+    t.X_id = r.get_int();
+    t.Y_id = r.get_int();
+    t.Z_id = r.get_int();
+}
+
+template<class Task>
+void put_gemv_dot(writer &w, const Task &t) {
+    w.put_int(t.task_queue_id);
+    w.put_int(t.A_id);
+    w.put_varint(t.TransA);
+    w.put_scalar(t.alpha);
+    w.put_int(t.X_id);
+    w.put_scalar(t.beta);
+    w.put_int(t.Y_id);
+    w.put_int(t.Z_id);
+}
+
+template<class Task>
+void get_gemv_dot(reader &r, Task &t) {
+    t.task_queue_id = r.get_int();
+    t.A_id = r.get_int();
+    t.TransA = r.get_enum<TRANSPOSE>();
+    t.alpha = r.get_scalar<decltype(t.alpha)>();
+    t.X_id = r.get_int();
+    t.beta = r.get_scalar<decltype(t.beta)>();
+    t.Y_id = r.get_int();
+    t.Z_id = r.get_int();
+}
+
+}
+
+void set_wire_version(int64_t version) {
+    if (version < WIRE_VERSION_LEGACY || version > WIRE_VERSION_LATEST) {
+        throw std::invalid_argument(fmt::format("Unsupported wire version {}", version));
+    }
+    wire_version = version;
+}
+
+int64_t get_wire_version() {
+    return wire_version;
+}
+
+std::vector<uint8_t> encode(const task &t) {
+    if (wire_version == WIRE_VERSION_LEGACY) {
+        return legacy_to_bytes(t);
+    }
+
+    writer w;
+    write_header(w, t.type);
+    switch (layout_of(t.type)) {
+        case L_SUBTASK:
+            /* Subtasks carry either an index or block coordinates, the index aliases block_row */
+            w.put_int(t.coord.block_row);
+            w.put_int(t.coord.block_column);
+            break;
+        case L_VECTOR_FLOAT:
+            w.put_int(t.vector_task_float.task_queue_id);
+            w.put_float(t.vector_task_float.alpha);
+            w.put_int(t.vector_task_float.X_id);
+            w.put_int(t.vector_task_float.Y_id);
+            break;
+        case L_VECTOR_DOUBLE:
+            w.put_int(t.vector_task_double.task_queue_id);
+            w.put_double(t.vector_task_double.alpha);
+            w.put_int(t.vector_task_double.X_id);
+            w.put_int(t.vector_task_double.Y_id);
+            break;
+        case L_MIXED_FLOAT:
+            put_mixed(w, t.mixed_task_float);
+            break;
+        case L_MIXED_DOUBLE:
+            put_mixed(w, t.mixed_task_double);
+            break;
+        case L_MATRIX_FLOAT:
+            put_matrix(w, t.matrix_task_float);
+            break;
+        case L_MATRIX_DOUBLE:
+            put_matrix(w, t.matrix_task_double);
+            break;
+        case L_GENERATION:
+            w.put_int(t.generation_task.task_queue_id);
+            w.put_int(t.generation_task.structure_id);
+            w.put_double(t.generation_task.alpha);
+            break;
+        case L_FUSED_VECTOR_FLOAT:
+            put_fused_vector(w, t.fused_vector_task_float);
+            break;
+        case L_FUSED_VECTOR_DOUBLE:
+            put_fused_vector(w, t.fused_vector_task_double);
+            break;
+        case L_GEMV_DOT_FLOAT:
+            put_gemv_dot(w, t.gemv_dot_task_float);
+            break;
+        case L_GEMV_DOT_DOUBLE:
+            put_gemv_dot(w, t.gemv_dot_task_double);
+            break;
+        case L_UNSUPPORTED:
+            throw std::runtime_error("Operation type " + std::to_string(t.type) + " cannot be serialized!");
+    }
+
+    return w.finish();
+}
+
+std::vector<uint8_t> encode(const response &r) {
+    if (wire_version == WIRE_VERSION_LEGACY) {
+        return legacy_to_bytes(r);
+    }
+
+    writer w;
+    write_header(w, r.type);
+    switch (r.type) {
+        case R_NONE:
+        case R_CANCELLED:
+            break;
+        case R_INT64:
+            w.put_int(r.simple.response);
+            break;
+        case R_FLOAT:
+            w.put_float(r.result_float);
+            break;
+        case R_DOUBLE:
+            w.put_double(r.result_double);
+            break;
+        case R_FLOAT_PAIR:
+            w.put_float(r.result_float_pair.first);
+            w.put_float(r.result_float_pair.second);
+            break;
+        case R_DOUBLE_PAIR:
+            w.put_double(r.result_double_pair.first);
+            w.put_double(r.result_double_pair.second);
+            break;
+        case R_FLOAT_INDEX_VALUE:
+            w.put_int(r.result_max_float_index.index);
+            w.put_float(r.result_max_float_index.value);
+            break;
+        case R_DOUBLE_INDEX_VALUE:
+            w.put_int(r.result_max_double_index.index);
+            w.put_double(r.result_max_double_index.value);
+            break;
+        case R_READS:
+            w.put_int(r.result_reads.blocks);
+            w.put_int(r.result_reads.bytes);
+            break;
+        default:
+            throw std::runtime_error("Response type " + std::to_string(r.type) + " cannot be serialized!");
+    }
+
+    return w.finish();
+}
+
+task decode_task(const uint8_t *data, size_t size) {
+    if (size == 0 || data[0] != WIRE_MARKER) {
+        return legacy_from_bytes<task>(data, size, "data");
+    }
+
+    reader r(data, size);
+    task t{};
+    t.type = static_cast<task_type>(read_header(r));
+    switch (layout_of(t.type)) {
+        case L_SUBTASK:
+            t.coord.block_row = r.get_int();
+            t.coord.block_column = r.get_int();
+            break;
+        case L_VECTOR_FLOAT:
+            t.vector_task_float.task_queue_id = r.get_int();
+            t.vector_task_float.alpha = r.get_float();
+            t.vector_task_float.X_id = r.get_int();
+            t.vector_task_float.Y_id = r.get_int();
+            break;
+        case L_VECTOR_DOUBLE:
+            t.vector_task_double.task_queue_id = r.get_int();
+            t.vector_task_double.alpha = r.get_double();
+            t.vector_task_double.X_id = r.get_int();
+            t.vector_task_double.Y_id = r.get_int();
+            break;
+        case L_MIXED_FLOAT:
+            get_mixed(r, t.mixed_task_float);
+            break;
+        case L_MIXED_DOUBLE:
+            get_mixed(r, t.mixed_task_double);
+            break;
+        case L_MATRIX_FLOAT:
+            get_matrix(r, t.matrix_task_float);
+            break;
+        case L_MATRIX_DOUBLE:
+            get_matrix(r, t.matrix_task_double);
+            break;
+        case L_GENERATION:
+            t.generation_task.task_queue_id = r.get_int();
+            t.generation_task.structure_id = r.get_int();
+            t.generation_task.alpha = r.get_double();
+            break;
+        case L_FUSED_VECTOR_FLOAT:
+            get_fused_vector(r, t.fused_vector_task_float);
+            break;
+        case L_FUSED_VECTOR_DOUBLE:
+            get_fused_vector(r, t.fused_vector_task_double);
+            break;
+        case L_GEMV_DOT_FLOAT:
+            get_gemv_dot(r, t.gemv_dot_task_float);
+            break;
+        case L_GEMV_DOT_DOUBLE:
+            get_gemv_dot(r, t.gemv_dot_task_double);
+            break;
+        case L_UNSUPPORTED:
+            throw std::runtime_error("Operation type " + std::to_string(t.type) + " cannot be deserialized!");
+    }
+
+    return t;
+}
+
+std::optional<int64_t> subtask_queue_of(const task &t) {
+    switch (layout_of(t.type)) {
+        case L_VECTOR_FLOAT:
+            return t.vector_task_float.task_queue_id;
+        case L_VECTOR_DOUBLE:
+            return t.vector_task_double.task_queue_id;
+        case L_MIXED_FLOAT:
+            return t.mixed_task_float.task_queue_id;
+        case L_MIXED_DOUBLE:
+            return t.mixed_task_double.task_queue_id;
+        case L_MATRIX_FLOAT:
+            return t.matrix_task_float.task_queue_id;
+        case L_MATRIX_DOUBLE:
+            return t.matrix_task_double.task_queue_id;
+        case L_GENERATION:
+            return t.generation_task.task_queue_id;
+        case L_FUSED_VECTOR_FLOAT:
+            return t.fused_vector_task_float.task_queue_id;
+        case L_FUSED_VECTOR_DOUBLE:
+            return t.fused_vector_task_double.task_queue_id;
+        case L_GEMV_DOT_FLOAT:
+            return t.gemv_dot_task_float.task_queue_id;
+        case L_GEMV_DOT_DOUBLE:
+            return t.gemv_dot_task_double.task_queue_id;
+        default:
+            return std::nullopt;
+    }
+}
+
+response decode_response(const uint8_t *data, size_t size) {
+    if (size == 0 || data[0] != WIRE_MARKER) {
+        return legacy_from_bytes<response>(data, size, "response data");
+    }
+
+    reader r(data, size);
+    response ret{};
+    ret.type = static_cast<response_type>(read_header(r));
+    switch (ret.type) {
+        case R_NONE:
+        case R_CANCELLED:
+            break;
+        case R_INT64:
+            ret.simple.response = r.get_int();
+            break;
+        case R_FLOAT:
+            ret.result_float = r.get_float();
+            break;
+        case R_DOUBLE:
+            ret.result_double = r.get_double();
+            break;
+        case R_FLOAT_PAIR:
+            ret.result_float_pair.first = r.get_float();
+            ret.result_float_pair.second = r.get_float();
+            break;
+        case R_DOUBLE_PAIR:
+            ret.result_double_pair.first = r.get_double();
+            ret.result_double_pair.second = r.get_double();
+            break;
+        case R_FLOAT_INDEX_VALUE:
+            ret.result_max_float_index.index = r.get_int();
+            ret.result_max_float_index.value = r.get_float();
+            break;
+        case R_DOUBLE_INDEX_VALUE:
+            ret.result_max_double_index.index = r.get_int();
+            ret.result_max_double_index.value = r.get_double();
+            break;
+        case R_READS:
+            ret.result_reads.blocks = r.get_int();
+            ret.result_reads.bytes = r.get_int();
+            break;
+        case R_SOME:
+            /* Memory image of the union, written by workers from before typed responses */
+            r.get_bytes(&ret.result_double_pair, sizeof ret.result_double_pair);
+            break;
+        default:
+            throw std::runtime_error("Response type " + std::to_string(ret.type) + " cannot be deserialized!");
+    }
+
+    return ret;
+}
+
+}
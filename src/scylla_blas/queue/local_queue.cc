@@ -0,0 +1,469 @@
+#include <thread>
+
+#include <fmt/format.h>
+
+#include <scylla_blas/logging/logging.hh>
+#include <scylla_blas/queue/local_queue.hh>
+#include <scylla_blas/utils/utils.hh>
+
+using task = scylla_blas::local_queue::task;
+using response = scylla_blas::local_queue::response;
+
+scylla_blas::local_queue::local_queue(int64_t id) :
+        queue_id(id),
+        _metrics(queue_metrics::of(id)),
+        cnt_new(0),
+        cnt_used(0),
+        cnt_released(0),
+        chunks(),
+        _readers(0),
+        _retired_mutex(),
+        _retired(),
+        sibling_first_id(0),
+        sibling_count(0),
+        range_first(0),
+        range_end(0),
+        range_columns(0),
+        range_consumers(1),
+        _dependencies_mutex(),
+        _upstream(),
+        _track_finished(false),
+        cancelled_below(0),
+        deadline(0)
+{
+    for (auto &entry : chunks) {
+        entry.store(nullptr);
+    }
+}
+
+scylla_blas::local_queue::~local_queue() {
+    free_chunks();
+}
+
+int64_t scylla_blas::local_queue::produce(const task &task) {
+    return produce(std::vector<scylla_blas::local_queue::task>{task});
+}
+
+int64_t scylla_blas::local_queue::produce(const std::vector<task> &tasks) {
+    reader_guard guard(_readers);
+    int64_t first_id = cnt_new.fetch_add(tasks.size());
+    for (size_t i = 0; i < tasks.size(); i++) {
+        int64_t id = first_id + i;
+        slot &s = get_or_create_chunk(page_of(id))->slots[id % QUEUE_PAGE_SIZE];
+        s.value = tasks[i];
+        s.state.store(READY, std::memory_order_release);
+    }
+
+    _metrics->record_produce(tasks.size());
+    return first_id;
+}
+
+int64_t scylla_blas::local_queue::produce_range(int64_t count, int64_t columns, int64_t consumers) {
+    // All earlier tasks are claimed, so no consumer looks at the old descriptor anymore.
+    int64_t first_id = cnt_new.load();
+    range_first.store(first_id);
+    range_end.store(first_id + count);
+    range_columns.store(columns);
+    range_consumers.store(std::max(consumers, int64_t(1)));
+    if (!cnt_new.compare_exchange_strong(first_id, first_id + count)) {
+        throw std::runtime_error(fmt::format("Task range produced to queue {} concurrently with other tasks", queue_id));
+    }
+
+    _metrics->record_produce(count);
+    return first_id;
+}
+
+std::optional<std::pair<int64_t, task>> scylla_blas::local_queue::consume() {
+    auto claimed = consume(1);
+    if (claimed.empty()) {
+        return std::nullopt;
+    }
+    return claimed.front();
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::local_queue::consume(int64_t n) {
+    return claim(n, false);
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::local_queue::consume_guided(int64_t min_chunk) {
+    return claim(min_chunk, true);
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::local_queue::claim(int64_t n, bool guided) {
+    if (n <= 0) {
+        return {};
+    }
+
+    int64_t start_time = queue_metrics::now();
+    int64_t first_id = cnt_used.load();
+    int64_t available;
+    int64_t count;
+    task_range current;
+    while (true) {
+        // Everything below cnt_new is reserved by some producer, so it can be claimed.
+        available = cnt_new.load() - first_id;
+        // Read after cnt_new, so it covers everything below it.
+        current = get_range();
+        count = guided && current.contains(first_id) ? std::min(available, current.guided_chunk(first_id, n))
+                                                     : std::min(n, available);
+        if (count <= 0) {
+            _metrics->record_depth(0);
+            _metrics->record_claim({}, start_time);
+            return {};
+        }
+        if (cnt_used.compare_exchange_weak(first_id, first_id + count)) {
+            break;
+        }
+        _metrics->record_claim_conflict();
+    }
+
+    reader_guard guard(_readers);
+    std::vector<std::pair<int64_t, task>> tasks;
+    tasks.reserve(count);
+    for (int64_t id = first_id; id < first_id + count; id++) {
+        tasks.emplace_back(id, current.contains(id) ? current.task_of(id) : wait_for_task(id));
+    }
+
+    _metrics->record_depth(available - count);
+    _metrics->record_claim(tasks, start_time);
+    return tasks;
+}
+
+void scylla_blas::local_queue::mark_as_finished(int64_t id) {
+    response r = { .type = proto::R_NONE, .simple { .response = 0 } };
+    mark_as_finished(id, r);
+}
+
+void scylla_blas::local_queue::mark_as_finished(int64_t id, const response &response) {
+    reader_guard guard(_readers);
+    if (id < cnt_released.load()) {
+        // Its chunk is gone, and must not be recreated.
+        LogDebug("Task {} of queue {} reported as finished after it was released", id, queue_id);
+        return;
+    }
+
+    // A task of the range gets its slot when it is first reported.
+    bool in_range = get_range().contains(id);
+    slot &s = in_range ? get_or_create_chunk(page_of(id))->slots[id % QUEUE_PAGE_SIZE] : get_slot(id);
+    int expected = in_range ? EMPTY : READY;
+    if (!s.state.compare_exchange_strong(expected, FINISHING)) {
+        // Expected when a stale task was re-executed, and both runs completed.
+        LogDebug("Task {} of queue {} reported as finished more than once", id, queue_id);
+        return;
+    }
+    s.result = response;
+    s.state.store(FINISHED, std::memory_order_release);
+    _metrics->record_finished(id);
+}
+
+void scylla_blas::local_queue::mark_as_finished(const std::vector<int64_t> &ids) {
+    for (int64_t id : ids) {
+        mark_as_finished(id);
+    }
+}
+
+bool scylla_blas::local_queue::is_finished(int64_t id) {
+    reader_guard guard(_readers);
+    if (get_range().contains(id) && find_chunk(page_of(id)) == nullptr) {
+        return false;
+    }
+    return get_slot(id).state.load(std::memory_order_acquire) == FINISHED;
+}
+
+std::optional<response> scylla_blas::local_queue::get_response(int64_t id) {
+    reader_guard guard(_readers);
+    slot &s = get_slot(id);
+    if (s.state.load(std::memory_order_acquire) != FINISHED) {
+        return std::nullopt;
+    }
+    return s.result;
+}
+
+std::vector<std::pair<int64_t, std::optional<response>>> scylla_blas::local_queue::get_finished(int64_t first_id, int64_t count) {
+    reader_guard guard(_readers);
+    std::vector<std::pair<int64_t, std::optional<response>>> finished;
+    for (int64_t id = first_id; id < first_id + count; id++) {
+        chunk *c = find_chunk(page_of(id));
+        if (c == nullptr) {
+            continue;
+        }
+
+        slot &s = c->slots[id % QUEUE_PAGE_SIZE];
+        if (s.state.load(std::memory_order_acquire) == FINISHED) {
+            finished.emplace_back(id, s.result);
+        }
+    }
+
+    return finished;
+}
+
+int64_t scylla_blas::local_queue::get_pending_count() {
+    return std::max(cnt_new.load() - cnt_used.load(), int64_t(0));
+}
+
+void scylla_blas::local_queue::renew_lease(int64_t id) {
+    reader_guard guard(_readers);
+    get_slot(id).lease.store(get_wall_time_microseconds());
+}
+
+std::optional<std::pair<int64_t, task>> scylla_blas::local_queue::claim_stale(int64_t lease_time,
+                                                                              const std::function<bool(const task&)> &eligible) {
+    reader_guard guard(_readers);
+    int64_t now = get_wall_time_microseconds();
+    int64_t end_id = cnt_used.load();
+    for (int64_t id = cnt_released.load(); id < end_id; id++) {
+        chunk *c = find_chunk(page_of(id));
+        if (c == nullptr) {
+            continue;
+        }
+
+        slot &s = c->slots[id % QUEUE_PAGE_SIZE];
+        int64_t lease = s.lease.load();
+        if (lease == 0 || lease + lease_time > now || s.state.load(std::memory_order_acquire) != READY) {
+            continue;
+        }
+        if (!eligible(s.value)) {
+            continue;
+        }
+        if (s.lease.compare_exchange_strong(lease, now)) {
+            _metrics->record_stale_claim(id);
+            return std::make_pair(id, s.value);
+        }
+        _metrics->record_claim_conflict();
+    }
+
+    return std::nullopt;
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::local_queue::get_unfinished() {
+    reader_guard guard(_readers);
+    std::vector<std::pair<int64_t, task>> unfinished;
+    int64_t end_id = cnt_new.load();
+    task_range current = get_range();
+    for (int64_t id = cnt_released.load(); id < end_id; id++) {
+        chunk *c = find_chunk(page_of(id));
+        if (current.contains(id)) {
+            if (c == nullptr || c->slots[id % QUEUE_PAGE_SIZE].state.load(std::memory_order_acquire) != FINISHED) {
+                unfinished.emplace_back(id, current.task_of(id));
+            }
+            continue;
+        }
+        if (c == nullptr) {
+            continue;
+        }
+
+        // Tasks that are still being written by their producers are skipped.
+        slot &s = c->slots[id % QUEUE_PAGE_SIZE];
+        if (s.state.load(std::memory_order_acquire) == READY) {
+            unfinished.emplace_back(id, s.value);
+        }
+    }
+
+    return unfinished;
+}
+
+void scylla_blas::local_queue::cancel() {
+    int64_t produced = cnt_new.load();
+    int64_t cancelled = cancelled_below.load();
+    while (cancelled < produced && !cancelled_below.compare_exchange_weak(cancelled, produced));
+}
+
+bool scylla_blas::local_queue::is_cancelled(int64_t id) {
+    int64_t current_deadline = deadline.load();
+    return id < cancelled_below.load() || (current_deadline > 0 && get_wall_time_microseconds() >= current_deadline);
+}
+
+void scylla_blas::local_queue::set_siblings(int64_t first_id, int64_t count) {
+    sibling_first_id.store(first_id);
+    sibling_count.store(count);
+}
+
+scylla_blas::task_range scylla_blas::local_queue::get_range() const {
+    return {
+        .first_id = range_first.load(),
+        .end_id = range_end.load(),
+        .columns = range_columns.load(),
+        .consumers = range_consumers.load()
+    };
+}
+
+void scylla_blas::local_queue::set_dependencies(const std::vector<queue_dependency> &upstream, bool track_finished) {
+    std::lock_guard lock(_dependencies_mutex);
+    _upstream = upstream;
+    _track_finished.store(track_finished);
+}
+
+std::vector<scylla_blas::queue_dependency> scylla_blas::local_queue::get_upstream() {
+    std::lock_guard lock(_dependencies_mutex);
+    return _upstream;
+}
+
+void scylla_blas::local_queue::release(int64_t watermark) {
+    // Pages that were not produced yet must not be released – their producers would recreate them.
+    int64_t end_page = page_of(std::min(watermark, cnt_new.load()));
+    std::lock_guard lock(_retired_mutex);
+    for (int64_t page = page_of(cnt_released.load()); page < end_page; page++) {
+        auto &entry = chunks[page % LOCAL_QUEUE_MAX_CHUNKS];
+        chunk *c = entry.load();
+        if (c != nullptr && c->page == page && entry.compare_exchange_strong(c, nullptr)) {
+            _retired.push_back(c);
+        }
+    }
+
+    int64_t released = cnt_released.load();
+    while (released < end_page * QUEUE_PAGE_SIZE
+           && !cnt_released.compare_exchange_weak(released, end_page * QUEUE_PAGE_SIZE));
+
+    // An operation that started after the chunks were unlinked can't find them. If none is in progress,
+    // no one holds them anymore – otherwise they wait for a later call.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_readers.load(std::memory_order_acquire) == 0) {
+        for (chunk *c : _retired) {
+            delete c;
+        }
+        _retired.clear();
+    }
+}
+
+void scylla_blas::local_queue::reset() {
+    free_chunks();
+    cnt_new.store(0);
+    cnt_used.store(0);
+    cnt_released.store(0);
+    range_first.store(0);
+    range_end.store(0);
+    cancelled_below.store(0);
+}
+
+// =========== PRIVATE METHODS ===========
+
+scylla_blas::local_queue::chunk *scylla_blas::local_queue::find_chunk(int64_t page) const {
+    chunk *c = chunks[page % LOCAL_QUEUE_MAX_CHUNKS].load(std::memory_order_acquire);
+    return (c != nullptr && c->page == page) ? c : nullptr;
+}
+
+scylla_blas::local_queue::chunk *scylla_blas::local_queue::get_or_create_chunk(int64_t page) {
+    auto &entry = chunks[page % LOCAL_QUEUE_MAX_CHUNKS];
+    chunk *c = entry.load(std::memory_order_acquire);
+    while (true) {
+        if (c != nullptr) {
+            if (c->page == page) {
+                return c;
+            }
+            throw std::runtime_error(fmt::format("Local queue {} is full: more than {} tasks were not released",
+                                                 queue_id, LOCAL_QUEUE_MAX_CHUNKS * QUEUE_PAGE_SIZE));
+        }
+
+        // Several producers may race to create the same chunk – only one of them wins.
+        auto *fresh = new chunk(page);
+        if (entry.compare_exchange_strong(c, fresh, std::memory_order_acq_rel)) {
+            return fresh;
+        }
+        delete fresh;
+    }
+}
+
+scylla_blas::local_queue::slot &scylla_blas::local_queue::get_slot(int64_t id) const {
+    chunk *c = find_chunk(page_of(id));
+    if (id < 0 || id >= cnt_new.load() || c == nullptr) {
+        throw std::runtime_error("No task with given id");
+    }
+    return c->slots[id % QUEUE_PAGE_SIZE];
+}
+
+const task &scylla_blas::local_queue::wait_for_task(int64_t id) const {
+    // The id is reserved, but its producer may not have written the task yet.
+    // It shouldn't happen too often, requires a race condition.
+    while (true) {
+        chunk *c = find_chunk(page_of(id));
+        if (c != nullptr) {
+            const slot &s = c->slots[id % QUEUE_PAGE_SIZE];
+            if (s.state.load(std::memory_order_acquire) != EMPTY) {
+                return s.value;
+            }
+        }
+        _metrics->record_payload_miss();
+        std::this_thread::yield();
+    }
+}
+
+void scylla_blas::local_queue::free_chunks() {
+    for (auto &entry : chunks) {
+        delete entry.exchange(nullptr);
+    }
+
+    std::lock_guard lock(_retired_mutex);
+    for (chunk *c : _retired) {
+        delete c;
+    }
+    _retired.clear();
+}
+
+// =========== BACKEND ===========
+
+void scylla_blas::local_backend::create_queue(int64_t id,
+                                              __attribute__((unused)) bool multi_producer,
+                                              __attribute__((unused)) bool multi_consumer,
+                                              __attribute__((unused)) int64_t bucket_count) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _queues[id] = std::make_shared<local_queue>(id);
+}
+
+void scylla_blas::local_backend::delete_queue(int64_t id) {
+    // Clients that still have the queue open keep it alive until they are done.
+    std::lock_guard<std::mutex> guard(_mutex);
+    _queues.erase(id);
+}
+
+bool scylla_blas::local_backend::queue_exists(int64_t id) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _queues.contains(id);
+}
+
+std::shared_ptr<scylla_blas::task_queue> scylla_blas::local_backend::open_queue(int64_t id) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    auto it = _queues.find(id);
+    if (it == _queues.end()) {
+        throw std::runtime_error(fmt::format("Tried to connect to non-existing queue {}", id));
+    }
+    return it->second;
+}
+
+void scylla_blas::local_backend::register_main_queue(int64_t id, priority_class priority, int64_t ttl) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _main_queues[{ priority, id }] = ttl > 0 ? get_wall_time_microseconds() + ttl : 0;
+}
+
+void scylla_blas::local_backend::unregister_main_queue(int64_t id, priority_class priority) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _main_queues.erase({ priority, id });
+}
+
+std::vector<std::pair<scylla_blas::priority_class, int64_t>> scylla_blas::local_backend::list_main_queues() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    int64_t now = get_wall_time_microseconds();
+    std::erase_if(_main_queues, [now] (const auto &entry) { return entry.second > 0 && entry.second <= now; });
+
+    std::vector<std::pair<priority_class, int64_t>> queues;
+    for (auto &[queue, expiry] : _main_queues) {
+        queues.push_back(queue);
+    }
+    return queues;
+}
+
+void scylla_blas::local_backend::heartbeat_worker(int64_t worker_id, int64_t ttl) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _worker_expiry[worker_id] = get_wall_time_microseconds() + ttl;
+}
+
+void scylla_blas::local_backend::unregister_worker(int64_t worker_id) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _worker_expiry.erase(worker_id);
+}
+
+int64_t scylla_blas::local_backend::count_live_workers() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    int64_t now = get_wall_time_microseconds();
+    std::erase_if(_worker_expiry, [now] (const auto &entry) { return entry.second <= now; });
+    return _worker_expiry.size();
+}
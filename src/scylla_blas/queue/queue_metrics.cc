@@ -0,0 +1,289 @@
+#include <bit>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+#include <fmt/format.h>
+
+#include "scylla_blas/logging/logging.hh"
+#include "scylla_blas/queue/queue_metrics.hh"
+
+namespace {
+
+void store_max(std::atomic<int64_t> &target, int64_t value) {
+    int64_t current = target.load(std::memory_order_relaxed);
+    while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+
+std::mutex registry_mutex;
+std::map<int64_t, std::weak_ptr<scylla_blas::queue_metrics>> registry;
+
+/* Entries of queues that lost their last client. Called with registry_mutex held. */
+void prune_registry() {
+    std::erase_if(registry, [] (const auto &entry) { return entry.second.expired(); });
+}
+
+std::string format_histogram(const scylla_blas::log2_histogram::snapshot &h) {
+    return fmt::format("{{n={} avg={:.1f} p50<={} p99<={} max={}}}",
+                       h.count, h.mean(), h.quantile(0.5), h.quantile(0.99), h.max);
+}
+
+}
+
+void scylla_blas::log2_histogram::record(int64_t value) {
+    value = std::max(value, int64_t(0));
+    size_t bucket = std::min((size_t)std::bit_width((uint64_t)value), BUCKETS - 1);
+
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    store_max(_max, value);
+}
+
+scylla_blas::log2_histogram::snapshot scylla_blas::log2_histogram::get() const {
+    snapshot ret;
+    ret.count = _count.load(std::memory_order_relaxed);
+    ret.sum = _sum.load(std::memory_order_relaxed);
+    ret.max = _max.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < BUCKETS; i++) {
+        ret.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+void scylla_blas::log2_histogram::reset() {
+    for (auto &bucket : _buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+int64_t scylla_blas::log2_histogram::snapshot::quantile(double q) const {
+    // Buckets are read one by one while they may change, so they don't have to add up to count.
+    int64_t total = 0;
+    for (auto bucket : buckets) {
+        total += bucket;
+    }
+
+    int64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > 0 && seen >= q * total) {
+            return std::min(i == 0 ? int64_t(0) : (int64_t(1) << i) - 1, max);
+        }
+    }
+    return max;
+}
+
+std::string scylla_blas::queue_metrics_snapshot::to_string() const {
+    return fmt::format("{}: depth={} (max {}), produced={} in {} calls, produce conflicts={}, batch={}, "
+                       "claimed={} in {} calls, empty claims={}, claim conflicts={}, stale claims={}, "
+                       "payload misses={}, finished={}, time to claim={}us, time to finish={}us",
+                       queue_id < 0 ? std::string("all queues") : fmt::format("queue {}", queue_id),
+                       depth, max_depth, produced_tasks, produce_calls, produce_conflicts,
+                       format_histogram(produce_batch),
+                       claimed_tasks, claim_calls, empty_claims, claim_conflicts, stale_claims,
+                       payload_misses, finished_tasks,
+                       format_histogram(time_to_claim), format_histogram(time_to_finish));
+}
+
+scylla_blas::queue_metrics &scylla_blas::queue_metrics::total() {
+    static queue_metrics instance(-1, nullptr);
+    return instance;
+}
+
+std::shared_ptr<scylla_blas::queue_metrics> scylla_blas::queue_metrics::of(int64_t queue_id) {
+    std::lock_guard lock(registry_mutex);
+    if (auto existing = registry[queue_id].lock()) {
+        return existing;
+    }
+
+    prune_registry();
+    /* Not make_shared – the weak pointer in the registry would keep the whole instance allocated */
+    std::shared_ptr<queue_metrics> created(new queue_metrics(queue_id, &total()));
+    registry[queue_id] = created;
+    return created;
+}
+
+std::vector<scylla_blas::queue_metrics_snapshot> scylla_blas::queue_metrics::snapshot_all() {
+    std::vector<queue_metrics_snapshot> ret = { total().get() };
+
+    std::lock_guard lock(registry_mutex);
+    prune_registry();
+    for (auto &[id, entry] : registry) {
+        if (auto metrics = entry.lock()) {
+            ret.push_back(metrics->get());
+        }
+    }
+    return ret;
+}
+
+void scylla_blas::queue_metrics::log_all() {
+    for (auto &snapshot : snapshot_all()) {
+        LogInfo("Queue metrics of {}", snapshot.to_string());
+    }
+}
+
+void scylla_blas::queue_metrics::reset_all() {
+    total().reset();
+
+    std::lock_guard lock(registry_mutex);
+    for (auto &[id, entry] : registry) {
+        if (auto metrics = entry.lock()) {
+            metrics->reset();
+        }
+    }
+}
+
+int64_t scylla_blas::queue_metrics::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void scylla_blas::queue_metrics::record_produce(int64_t count) {
+    _produce_calls.fetch_add(1, std::memory_order_relaxed);
+    _produced_tasks.fetch_add(count, std::memory_order_relaxed);
+    _produce_batch.record(count);
+
+    if (_total != nullptr) {
+        _total->record_produce(count);
+    }
+}
+
+void scylla_blas::queue_metrics::record_produce_conflict() {
+    _produce_conflicts.fetch_add(1, std::memory_order_relaxed);
+
+    if (_total != nullptr) {
+        _total->record_produce_conflict();
+    }
+}
+
+void scylla_blas::queue_metrics::record_claimed(int64_t id, int64_t time) {
+    // Ids are tracked per queue, the totals only aggregate the measurements.
+    if (_total == nullptr) {
+        return;
+    }
+
+    // Races between claims of ids that share a record only lose a measurement.
+    auto &record = _claims[id % QUEUE_METRICS_TRACKED_CLAIMS];
+    record.id.store(-1, std::memory_order_relaxed);
+    record.time.store(time, std::memory_order_relaxed);
+    record.id.store(id, std::memory_order_release);
+}
+
+void scylla_blas::queue_metrics::record_claim(const std::vector<std::pair<int64_t, proto::task>> &claimed, int64_t start_time) {
+    int64_t time = now();
+    for (auto &[id, task] : claimed) {
+        record_claimed(id, time);
+    }
+
+    for (auto metrics : { this, _total }) {
+        if (metrics == nullptr) {
+            continue;
+        }
+        metrics->_claim_calls.fetch_add(1, std::memory_order_relaxed);
+        if (claimed.empty()) {
+            metrics->_empty_claims.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            metrics->_claimed_tasks.fetch_add(claimed.size(), std::memory_order_relaxed);
+            metrics->_time_to_claim.record(time - start_time);
+        }
+    }
+}
+
+void scylla_blas::queue_metrics::record_claim_conflict() {
+    _claim_conflicts.fetch_add(1, std::memory_order_relaxed);
+
+    if (_total != nullptr) {
+        _total->record_claim_conflict();
+    }
+}
+
+void scylla_blas::queue_metrics::record_stale_claim(int64_t id) {
+    _stale_claims.fetch_add(1, std::memory_order_relaxed);
+    record_claimed(id, now());
+
+    if (_total != nullptr) {
+        _total->record_stale_claim(id);
+    }
+}
+
+void scylla_blas::queue_metrics::record_payload_miss() {
+    _payload_misses.fetch_add(1, std::memory_order_relaxed);
+
+    if (_total != nullptr) {
+        _total->record_payload_miss();
+    }
+}
+
+void scylla_blas::queue_metrics::record_finished(int64_t id) {
+    std::optional<int64_t> time_to_finish;
+    if (_total != nullptr) {
+        auto &record = _claims[id % QUEUE_METRICS_TRACKED_CLAIMS];
+        int64_t expected = id;
+        int64_t claim_time = record.time.load(std::memory_order_relaxed);
+        // Only the first report of a claim is measured.
+        if (record.id.compare_exchange_strong(expected, -1)) {
+            time_to_finish = now() - claim_time;
+        }
+    }
+
+    for (auto metrics : { this, _total }) {
+        if (metrics == nullptr) {
+            continue;
+        }
+        metrics->_finished_tasks.fetch_add(1, std::memory_order_relaxed);
+        if (time_to_finish.has_value()) {
+            metrics->_time_to_finish.record(*time_to_finish);
+        }
+    }
+}
+
+void scylla_blas::queue_metrics::record_depth(int64_t depth) {
+    _depth.store(depth, std::memory_order_relaxed);
+    store_max(_max_depth, depth);
+
+    if (_total != nullptr) {
+        _total->record_depth(depth);
+    }
+}
+
+scylla_blas::queue_metrics_snapshot scylla_blas::queue_metrics::get() const {
+    return {
+        .queue_id = _queue_id,
+        .produce_calls = _produce_calls.load(std::memory_order_relaxed),
+        .produced_tasks = _produced_tasks.load(std::memory_order_relaxed),
+        .produce_conflicts = _produce_conflicts.load(std::memory_order_relaxed),
+        .claim_calls = _claim_calls.load(std::memory_order_relaxed),
+        .claimed_tasks = _claimed_tasks.load(std::memory_order_relaxed),
+        .empty_claims = _empty_claims.load(std::memory_order_relaxed),
+        .claim_conflicts = _claim_conflicts.load(std::memory_order_relaxed),
+        .stale_claims = _stale_claims.load(std::memory_order_relaxed),
+        .payload_misses = _payload_misses.load(std::memory_order_relaxed),
+        .finished_tasks = _finished_tasks.load(std::memory_order_relaxed),
+        .depth = _depth.load(std::memory_order_relaxed),
+        .max_depth = _max_depth.load(std::memory_order_relaxed),
+        .produce_batch = _produce_batch.get(),
+        .time_to_claim = _time_to_claim.get(),
+        .time_to_finish = _time_to_finish.get()
+    };
+}
+
+void scylla_blas::queue_metrics::reset() {
+    for (auto counter : { &_produce_calls, &_produced_tasks, &_produce_conflicts, &_claim_calls, &_claimed_tasks,
+                          &_empty_claims, &_claim_conflicts, &_stale_claims, &_payload_misses, &_finished_tasks,
+                          &_depth, &_max_depth }) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+
+    _produce_batch.reset();
+    _time_to_claim.reset();
+    _time_to_finish.reset();
+
+    for (auto &record : _claims) {
+        record.id.store(-1, std::memory_order_relaxed);
+    }
+}
@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <random>
+#include <set>
+#include <tuple>
+
 #include <scylla_blas/logging/logging.hh>
+#include <scylla_blas/queue/codec.hh>
 #include <scylla_blas/queue/scylla_queue.hh>
 
 using task = scylla_blas::scylla_queue::task;
@@ -7,39 +13,164 @@ using scylla_queue = scylla_blas::scylla_queue;
 using session_map_t = std::unordered_map<scmd::session *, std::unordered_set<scylla_queue *>>;
 
 session_map_t scylla_queue::session_map = session_map_t{};
+std::mutex scylla_queue::session_map_mutex;
+
+namespace {
+
+using column_list = std::vector<std::pair<std::string, std::string>>;
+
+/* Regular columns of the queue tables, with their types. Those missing in tables created
+ * by earlier versions are added by init_meta.
+ */
+const column_list queue_meta_columns = {
+    {"multi_producer", "BOOLEAN"},
+    {"multi_consumer", "BOOLEAN"},
+    {"cnt_new", "BIGINT"},
+    {"cnt_used", "BIGINT"},
+    {"cnt_released", "BIGINT"},
+    {"bucket_count", "BIGINT"},
+    {"sibling_first_id", "BIGINT"},
+    {"sibling_count", "BIGINT"},
+    {"range_first", "BIGINT"},
+    {"range_end", "BIGINT"},
+    {"range_columns", "BIGINT"},
+    {"range_consumers", "BIGINT"},
+    {"track_finished", "BOOLEAN"},
+    {"upstream_count", "BIGINT"},
+    {"cancelled_below", "BIGINT"},
+    {"deadline", "BIGINT"}
+};
+
+const column_list queue_data_columns = {
+    {"is_finished", "BOOLEAN"},
+    {"value", "BLOB"},
+    {"response", "BLOB"},
+    {"lease", "BIGINT"}
+};
+
+std::string column_definitions(const column_list &columns) {
+    std::string definitions;
+    for (auto &[name, type] : columns) {
+        definitions += fmt::format("{} {}, ", name, type);
+    }
+    return definitions;
+}
+
+/* Names of the columns of blas.`table`, none if there is no such table */
+std::set<std::string> columns_of(const std::shared_ptr<scmd::session> &session, const std::string &table) {
+    std::set<std::string> columns;
+    auto result = session->execute(
+            "SELECT column_name FROM system_schema.columns WHERE keyspace_name = 'blas' AND table_name = ?;", table);
+    while (result.next_row()) {
+        const char *name;
+        size_t length;
+        scmd_internal::throw_on_cass_error(cass_value_get_string(result.get_column_raw("column_name"), &name, &length));
+        columns.emplace(name, length);
+    }
+    return columns;
+}
+
+void add_missing_columns(const std::shared_ptr<scmd::session> &session, const std::string &table, const column_list &columns) {
+    auto existing = columns_of(session, table);
+    for (auto &[name, type] : columns) {
+        if (!existing.contains(name)) {
+            LogInfo("Adding column {} to blas.{}", name, table);
+            scmd::statement add_column(fmt::format("ALTER TABLE blas.{} ADD {} {};", table, name, type));
+            session->execute(add_column.set_timeout(0));
+        }
+    }
+}
+
+}
 
 void scylla_blas::scylla_queue::init_meta(const std::shared_ptr<scmd::session> &session) {
-    scmd::statement create_meta_table(R"(CREATE TABLE IF NOT EXISTS blas.queue_meta (
-                                            queue_id bigint PRIMARY KEY,
-                                            multi_producer BOOLEAN,
-                                            multi_consumer BOOLEAN,
-                                            cnt_new BIGINT,
-                                            cnt_used BIGINT
-                                        ))");
+    /* Running --init again upgrades an existing keyspace. The partition key of queue_data, which got
+     * the bucket and page of a task, can't be altered. Queue tables hold nothing but tasks in flight,
+     * so tables from before are dropped and created anew – with no schedulers or workers running.
+     */
+    auto data_columns = columns_of(session, "queue_data");
+    if (!data_columns.empty() && !data_columns.contains("bucket")) {
+        LogWarn("Queue tables predate bucketed queues, recreating them. Tasks left in queues are dropped.");
+        deinit_meta(session);
+    }
+
+    scmd::statement create_meta_table(fmt::format(R"(CREATE TABLE IF NOT EXISTS blas.queue_meta (
+                                            queue_id bigint,
+                                            {}
+                                            PRIMARY KEY(queue_id)
+                                        ))", column_definitions(queue_meta_columns)));
     create_meta_table.set_timeout(0);
     auto future_1 = session->execute_async(create_meta_table);
 
-    scmd::statement create_table(R"(
-            CREATE TABLE blas.queue_data (
+    scmd::statement create_table(fmt::format(R"(
+            CREATE TABLE IF NOT EXISTS blas.queue_data (
                 queue_id bigint,
+                bucket bigint,
+                page bigint,
                 task_id bigint,
-                is_finished BOOLEAN,
-                value BLOB,
-                response BLOB,
-                PRIMARY KEY(queue_id, task_id)
-            ))");
+                {}
+                PRIMARY KEY((queue_id, bucket, page), task_id)
+            ))", column_definitions(queue_data_columns)));
     create_table.set_timeout(0);
     auto future_2 = session->execute_async(create_table);
 
+    scmd::statement create_bucket_table(R"(CREATE TABLE IF NOT EXISTS blas.queue_bucket (
+                                            queue_id bigint,
+                                            bucket bigint,
+                                            cnt_used BIGINT,
+                                            PRIMARY KEY((queue_id, bucket))
+                                        ))");
+    create_bucket_table.set_timeout(0);
+    auto future_3 = session->execute_async(create_bucket_table);
+
+    scmd::statement create_upstream_table(R"(CREATE TABLE IF NOT EXISTS blas.queue_upstream (
+                                            queue_id bigint,
+                                            upstream_id bigint,
+                                            kind BIGINT,
+                                            PRIMARY KEY(queue_id, upstream_id)
+                                        ))");
+    create_upstream_table.set_timeout(0);
+    auto future_4 = session->execute_async(create_upstream_table);
+
+    scmd::statement create_main_queue_table(R"(CREATE TABLE IF NOT EXISTS blas.main_queues (
+                                            priority bigint,
+                                            queue_id bigint,
+                                            PRIMARY KEY(priority, queue_id)
+                                        ))");
+    create_main_queue_table.set_timeout(0);
+    auto future_5 = session->execute_async(create_main_queue_table);
+
+    scmd::statement create_worker_table(R"(CREATE TABLE IF NOT EXISTS blas.workers (
+                                            worker_id bigint PRIMARY KEY,
+                                            heartbeat bigint
+                                        ))");
+    create_worker_table.set_timeout(0);
+    auto future_6 = session->execute_async(create_worker_table);
+
     future_1.wait();
     future_2.wait();
+    future_3.wait();
+    future_4.wait();
+    future_5.wait();
+    future_6.wait();
+
+    add_missing_columns(session, "queue_meta", queue_meta_columns);
+    add_missing_columns(session, "queue_data", queue_data_columns);
 }
 
 [[maybe_unused]] void scylla_blas::scylla_queue::deinit_meta(const std::shared_ptr<scmd::session> &session) {
     auto future_1 = session->execute_async("DROP TABLE IF EXISTS blas.queue_meta");
     auto future_2 = session->execute_async("DROP TABLE IF EXISTS blas.queue_data");
+    auto future_3 = session->execute_async("DROP TABLE IF EXISTS blas.queue_bucket");
+    auto future_4 = session->execute_async("DROP TABLE IF EXISTS blas.queue_upstream");
+    auto future_5 = session->execute_async("DROP TABLE IF EXISTS blas.main_queues");
+    auto future_6 = session->execute_async("DROP TABLE IF EXISTS blas.workers");
     future_1.wait();
     future_2.wait();
+    future_3.wait();
+    future_4.wait();
+    future_5.wait();
+    future_6.wait();
 }
 
 bool scylla_blas::scylla_queue::queue_exists(const std::shared_ptr<scmd::session> &session, int64_t id) {
@@ -48,32 +179,114 @@ bool scylla_blas::scylla_queue::queue_exists(const std::shared_ptr<scmd::session
 }
 
 void scylla_blas::scylla_queue::create_queue(const std::shared_ptr<scmd::session> &session,
-                                             int64_t id, bool multi_producer, bool multi_consumer) {
+                                             int64_t id, bool multi_producer, bool multi_consumer,
+                                             int64_t bucket_count) {
+    if (bucket_count < 1) {
+        throw std::runtime_error(fmt::format("Invalid bucket count for queue {}: {}", id, bucket_count));
+    }
+
+    if (bucket_count > 1) {
+        auto prepared = session->prepare("INSERT INTO blas.queue_bucket (queue_id, bucket, cnt_used) VALUES (?, ?, 0)");
+        scmd::batch_query batch(CASS_BATCH_TYPE_UNLOGGED);
+        for (int64_t bucket = 0; bucket < bucket_count; bucket++) {
+            auto stmt = prepared.get_statement();
+            stmt.bind(id, bucket);
+            batch.add_statement(stmt);
+        }
+        session->execute(batch);
+    }
+
+    /* Registering the queue last makes sure its buckets are ready before anyone connects */
     scmd::statement register_queue = scmd::statement(R"(
-            INSERT INTO blas.queue_meta (queue_id, multi_producer, multi_consumer, cnt_new, cnt_used)
-            VALUES (?, ?, ?, 0, 0))", 3);
-    session->execute(register_queue, id, multi_producer, multi_consumer);
+            INSERT INTO blas.queue_meta (queue_id, multi_producer, multi_consumer, cnt_new, cnt_used, cnt_released, bucket_count)
+            VALUES (?, ?, ?, 0, 0, 0, ?))", 4);
+    session->execute(register_queue, id, multi_producer, multi_consumer, bucket_count);
 }
 
 void scylla_blas::scylla_queue::delete_queue(const std::shared_ptr<scmd::session> &session, int64_t id) {
-    auto future_1 = session->execute_async("DELETE FROM blas.queue_data WHERE queue_id = ?", id);
-    auto future_2 = session->execute_async("DELETE FROM blas.queue_meta WHERE queue_id = ?", id);
-    future_1.wait();
-    future_2.wait();
+    auto result = session->execute("SELECT cnt_new, cnt_released, bucket_count FROM blas.queue_meta WHERE queue_id = ?", id);
+    if (!result.next_row()) {
+        return;
+    }
+    int64_t cnt_new = result.get_column<int64_t>("cnt_new");
+    int64_t cnt_released = result.is_column_null("cnt_released") ? 0 : result.get_column<int64_t>("cnt_released");
+    int64_t bucket_count = result.is_column_null("bucket_count") ? 1 : result.get_column<int64_t>("bucket_count");
+
+    auto futures = delete_pages(session, id, bucket_count, page_of(cnt_released), page_of(cnt_new) + 1);
+    for (int64_t bucket = 0; bucket < bucket_count; bucket++) {
+        futures.push_back(session->execute_async("DELETE FROM blas.queue_bucket WHERE queue_id = ? AND bucket = ?", id, bucket));
+    }
+    futures.push_back(session->execute_async("DELETE FROM blas.queue_upstream WHERE queue_id = ?", id));
+    futures.push_back(session->execute_async("DELETE FROM blas.queue_meta WHERE queue_id = ?", id));
+
+    for (auto &future : futures) {
+        future.wait();
+    }
+}
+
+void scylla_blas::scylla_queue::register_main_queue(const std::shared_ptr<scmd::session> &session, int64_t id,
+                                                    priority_class priority, int64_t ttl) {
+    if (ttl <= 0) {
+        session->execute("INSERT INTO blas.main_queues (priority, queue_id) VALUES (?, ?)", (int64_t)priority, id);
+        return;
+    }
+
+    /* TTLs are in whole seconds */
+    int64_t ttl_seconds = std::max((ttl + 999999) / 1000000, int64_t(1));
+    session->execute(fmt::format("INSERT INTO blas.main_queues (priority, queue_id) VALUES (?, ?) USING TTL {}", ttl_seconds),
+                     (int64_t)priority, id);
+}
+
+void scylla_blas::scylla_queue::unregister_main_queue(const std::shared_ptr<scmd::session> &session, int64_t id,
+                                                      priority_class priority) {
+    session->execute("DELETE FROM blas.main_queues WHERE priority = ? AND queue_id = ?", (int64_t)priority, id);
+}
+
+std::vector<std::pair<scylla_blas::priority_class, int64_t>>
+scylla_blas::scylla_queue::list_main_queues(const std::shared_ptr<scmd::session> &session) {
+    std::vector<std::pair<priority_class, int64_t>> queues;
+    auto result = session->execute("SELECT priority, queue_id FROM blas.main_queues");
+    while (result.next_row()) {
+        queues.emplace_back((priority_class)result.get_column<int64_t>("priority"), result.get_column<int64_t>("queue_id"));
+    }
+    std::sort(queues.begin(), queues.end());
+    return queues;
+}
+
+void scylla_blas::scylla_queue::heartbeat_worker(const std::shared_ptr<scmd::session> &session, int64_t worker_id,
+                                                 int64_t ttl) {
+    /* TTLs are in whole seconds */
+    int64_t ttl_seconds = std::max((ttl + 999999) / 1000000, int64_t(1));
+    session->execute(fmt::format("INSERT INTO blas.workers (worker_id, heartbeat) VALUES (?, ?) USING TTL {}", ttl_seconds),
+                     worker_id, get_wall_time_microseconds());
+}
+
+void scylla_blas::scylla_queue::unregister_worker(const std::shared_ptr<scmd::session> &session, int64_t worker_id) {
+    session->execute("DELETE FROM blas.workers WHERE worker_id = ?", worker_id);
+}
+
+int64_t scylla_blas::scylla_queue::count_live_workers(const std::shared_ptr<scmd::session> &session) {
+    auto result = session->execute("SELECT COUNT(*) FROM blas.workers");
+    result.next_row();
+    return result.get_column<int64_t>("count");
 }
 
 scylla_blas::scylla_queue::scylla_queue(const std::shared_ptr<scmd::session> &session, int64_t id) :
         queue_id(id),
-        _session(session)
+        _session(session),
+        _metrics(queue_metrics::of(id))
 {
-    auto iter = session_map.find(_session.get());
-    if (iter != session_map.end()) {
-        scylla_queue *other = *iter->second.begin();
-        copy_statements_from(other);
-        iter->second.insert(this);
-    } else {
-        prepare_statements();
-        session_map.insert({_session.get(), {this}});
+    {
+        std::lock_guard lock(session_map_mutex);
+        auto iter = session_map.find(_session.get());
+        if (iter != session_map.end()) {
+            scylla_queue *other = *iter->second.begin();
+            copy_statements_from(other);
+            iter->second.insert(this);
+        } else {
+            prepare_statements();
+            session_map.insert({_session.get(), {this}});
+        }
     }
 
     auto result = session->execute("SELECT * FROM blas.queue_meta WHERE queue_id = ?", queue_id);
@@ -85,15 +298,39 @@ scylla_blas::scylla_queue::scylla_queue(const std::shared_ptr<scmd::session> &se
     multi_consumer = result.get_column<bool>("multi_consumer");
     cnt_new = result.get_column<int64_t>("cnt_new");
     cnt_used = result.get_column<int64_t>("cnt_used");
+    cnt_released = result.is_column_null("cnt_released") ? 0 : result.get_column<int64_t>("cnt_released");
+    bucket_count = result.is_column_null("bucket_count") ? 1 : result.get_column<int64_t>("bucket_count");
+
+    /* Spread consumers over buckets, so that each of them has its own counter to claim from */
+    home_bucket = std::random_device{}() % bucket_count;
+    bucket_used.assign(bucket_count, 0);
+
+    sibling_first_id = result.is_column_null("sibling_first_id") ? 0 : result.get_column<int64_t>("sibling_first_id");
+    sibling_count = result.is_column_null("sibling_count") ? 0 : result.get_column<int64_t>("sibling_count");
+    range = range_from_row(result);
+    track_finished = !result.is_column_null("track_finished") && result.get_column<bool>("track_finished");
+    upstream_count = result.is_column_null("upstream_count") ? 0 : result.get_column<int64_t>("upstream_count");
+    deadline = result.is_column_null("deadline") ? 0 : result.get_column<int64_t>("deadline");
 }
 
 scylla_blas::scylla_queue::scylla_queue(scylla_queue &&other) noexcept :
     queue_id(std::exchange(other.queue_id, -1)),
     _session(std::move(other._session)),
+    _metrics(other._metrics),
     multi_producer(other.multi_producer),
     multi_consumer(other.multi_consumer),
     cnt_new(other.cnt_new),
-    cnt_used(other.cnt_used)
+    cnt_used(other.cnt_used),
+    cnt_released(other.cnt_released),
+    bucket_count(other.bucket_count),
+    home_bucket(other.home_bucket),
+    bucket_used(std::move(other.bucket_used)),
+    sibling_first_id(other.sibling_first_id),
+    sibling_count(other.sibling_count),
+    range(other.range),
+    track_finished(other.track_finished),
+    upstream_count(other.upstream_count),
+    deadline(other.deadline)
 {
     copy_statements_from(&other);
     auto session_ptr = _session.get();
@@ -101,12 +338,14 @@ scylla_blas::scylla_queue::scylla_queue(scylla_queue &&other) noexcept :
     /* If the queue has been moved from, there is nothing left to do. */
     if (session_ptr == nullptr) return;
 
+    std::lock_guard lock(session_map_mutex);
     auto iter = session_map.find(session_ptr);
     iter->second.erase(&other);
     iter->second.insert(this);
 }
 
 scylla_blas::scylla_queue& scylla_blas::scylla_queue::operator=(scylla_queue &&other) noexcept {
+    std::lock_guard lock(session_map_mutex);
     {
         auto session_ptr = _session.get();
         if (session_ptr != nullptr) {
@@ -120,10 +359,21 @@ scylla_blas::scylla_queue& scylla_blas::scylla_queue::operator=(scylla_queue &&o
     }
     queue_id = std::exchange(other.queue_id, -1);
     _session = std::move(other._session);
+    _metrics = other._metrics;
     multi_producer = other.multi_producer;
     multi_consumer = other.multi_consumer;
     cnt_new = other.cnt_new;
     cnt_used = other.cnt_used;
+    cnt_released = other.cnt_released;
+    bucket_count = other.bucket_count;
+    home_bucket = other.home_bucket;
+    bucket_used = std::move(other.bucket_used);
+    sibling_first_id = other.sibling_first_id;
+    sibling_count = other.sibling_count;
+    range = other.range;
+    track_finished = other.track_finished;
+    upstream_count = other.upstream_count;
+    deadline = other.deadline;
     copy_statements_from(&other);
     {
         auto session_ptr = _session.get();
@@ -141,6 +391,7 @@ scylla_blas::scylla_queue& scylla_blas::scylla_queue::operator=(scylla_queue &&o
 scylla_blas::scylla_queue::~scylla_queue() {
     auto session_ptr = _session.get();
     if (session_ptr == nullptr) return;
+    std::lock_guard lock(session_map_mutex);
     auto iter = session_map.find(session_ptr);
     if (iter->second.size() == 1) {
         session_map.erase(iter);
@@ -150,46 +401,134 @@ scylla_blas::scylla_queue::~scylla_queue() {
 }
 
 int64_t scylla_blas::scylla_queue::produce(const task &task) {
-    if (multi_producer) {
-        return produce_multi(task);
-    } else {
-        return produce_simple(task);
-    }
+    int64_t id = multi_producer ? produce_multi(task) : produce_simple(task);
+    _metrics->record_produce(1);
+    return id;
 }
 
 int64_t scylla_blas::scylla_queue::produce(const std::vector<task> &tasks) {
-    if (multi_producer) {
-        return produce_many_multi(tasks);
-    } else {
-        return produce_many_simple(tasks);
+    int64_t first_id = multi_producer ? produce_many_multi(tasks) : produce_many_simple(tasks);
+    _metrics->record_produce(tasks.size());
+    return first_id;
+}
+
+int64_t scylla_blas::scylla_queue::produce_range(int64_t count, int64_t columns, int64_t consumers) {
+    // Consumers have to see the counter and the descriptor change together, and tasks of a bucketed queue
+    // are not claimed in order of their ids.
+    if (multi_producer || bucket_count > 1) {
+        throw std::runtime_error(fmt::format("Queue {} can't hold task ranges: only unbucketed, single producer queues can", queue_id));
     }
+
+    task_range produced = { .first_id = cnt_new, .end_id = cnt_new + count,
+                            .columns = columns, .consumers = std::max(consumers, int64_t(1)) };
+    _session->execute(*produce_range_prepared, produced.end_id, produced.first_id, produced.end_id,
+                      produced.columns, produced.consumers, queue_id);
+    cnt_new = produced.end_id;
+    range = produced;
+
+    _metrics->record_produce(count);
+    return produced.first_id;
 }
 
 std::optional<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume() {
-    if (multi_consumer) {
-        return consume_multi();
+    int64_t start_time = queue_metrics::now();
+    std::vector<std::pair<int64_t, task>> claimed;
+
+    if (bucket_count > 1) {
+        claimed = consume_bucketed(1);
+    } else {
+        auto opt = multi_consumer ? consume_multi() : consume_simple();
+        if (opt.has_value()) {
+            claimed.push_back(std::move(*opt));
+        }
+    }
+
+    _metrics->record_claim(claimed, start_time);
+    if (claimed.empty()) {
+        return std::nullopt;
+    }
+    return claimed.front();
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume(int64_t n) {
+    if (n <= 0) {
+        return {};
+    }
+
+    int64_t start_time = queue_metrics::now();
+    std::vector<std::pair<int64_t, task>> claimed;
+
+    if (bucket_count > 1) {
+        claimed = consume_bucketed(n);
+    } else if (multi_consumer) {
+        claimed = consume_many_multi(n, false);
     } else {
-        return consume_simple();
+        claimed = consume_many_simple(n, false);
     }
+
+    _metrics->record_claim(claimed, start_time);
+    return claimed;
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_guided(int64_t min_chunk) {
+    if (min_chunk <= 0 || bucket_count > 1) {
+        return consume(min_chunk);
+    }
+
+    int64_t start_time = queue_metrics::now();
+    auto claimed = multi_consumer ? consume_many_multi(min_chunk, true) : consume_many_simple(min_chunk, true);
+
+    _metrics->record_claim(claimed, start_time);
+    return claimed;
 }
 
 void scylla_blas::scylla_queue::mark_as_finished(int64_t id) {
-    response r = { .type = proto::R_NONE };
+    response r = { .type = proto::R_NONE, .simple { .response = 0 } };
     mark_as_finished(id, r);
 }
 
 void scylla_blas::scylla_queue::mark_as_finished(int64_t id, const response &response) {
     scmd::statement stmt = mark_task_finished_prepared->get_statement();
-    scmd_internal::throw_on_cass_error(cass_statement_bind_bytes(stmt.get_statement(), 0, reinterpret_cast<const cass_byte_t *>(&response), sizeof response));
+    auto bytes = proto::encode(response);
+    scmd_internal::throw_on_cass_error(cass_statement_bind_bytes(stmt.get_statement(), 0, bytes.data(), bytes.size()));
     scmd_internal::throw_on_cass_error(cass_statement_bind_int64(stmt.get_statement(), 1, queue_id));
-    scmd_internal::throw_on_cass_error(cass_statement_bind_int64(stmt.get_statement(), 2, id));
+    scmd_internal::throw_on_cass_error(cass_statement_bind_int64(stmt.get_statement(), 2, bucket_of(id)));
+    scmd_internal::throw_on_cass_error(cass_statement_bind_int64(stmt.get_statement(), 3, page_of(id)));
+    scmd_internal::throw_on_cass_error(cass_statement_bind_int64(stmt.get_statement(), 4, id));
     _session->execute(stmt);
+    _metrics->record_finished(id);
+}
+
+void scylla_blas::scylla_queue::mark_as_finished(const std::vector<int64_t> &ids) {
+    // Ids of a single partition usually come together, each run of them makes one batch.
+    std::vector<scmd::future> futures;
+    for (size_t i = 0; i < ids.size();) {
+        int64_t bucket = bucket_of(ids[i]);
+        int64_t page = page_of(ids[i]);
+        scmd::batch_query batch(CASS_BATCH_TYPE_UNLOGGED);
+        for (; i < ids.size() && bucket_of(ids[i]) == bucket && page_of(ids[i]) == page; i++) {
+            scmd::statement stmt = mark_task_done_prepared->get_statement();
+            stmt.bind(queue_id, bucket, page, ids[i]);
+            batch.add_statement(stmt);
+        }
+        futures.push_back(_session->execute_async(batch));
+    }
+
+    for (auto &future : futures) {
+        future.wait();
+    }
+
+    for (int64_t id : ids) {
+        _metrics->record_finished(id);
+    }
 }
 
 bool scylla_blas::scylla_queue::is_finished(int64_t id) {
     try{
-        auto result = _session->execute(*check_task_finished_prepared, queue_id, id);
+        auto result = _session->execute(*check_task_finished_prepared, queue_id, bucket_of(id), page_of(id), id);
         if (!result.next_row()) {
+            // Tasks of the range have no rows until they are finished.
+            if (range.contains(id)) return false;
             throw std::runtime_error("No task with given id");
         }
         return result.get_column<bool>("is_finished");
@@ -200,7 +539,7 @@ bool scylla_blas::scylla_queue::is_finished(int64_t id) {
 }
 
 std::optional<response> scylla_blas::scylla_queue::get_response(int64_t id) {
-    auto result = _session->execute(*get_task_response, queue_id, id);
+    auto result = _session->execute(*get_task_response, queue_id, bucket_of(id), page_of(id), id);
     if (!result.next_row()) {
         throw std::runtime_error("No task with given id");
     }
@@ -211,14 +550,239 @@ std::optional<response> scylla_blas::scylla_queue::get_response(int64_t id) {
     return response_from_value(v);
 }
 
+std::vector<std::pair<int64_t, std::optional<response>>> scylla_blas::scylla_queue::get_finished(int64_t first_id, int64_t count) {
+    std::vector<std::pair<int64_t, std::optional<response>>> finished;
+    try {
+        // The range is spread over partitions of (at most) bucket_count buckets and a few pages,
+        // each of them is queried separately.
+        int64_t end_id = first_id + count;
+        for (int64_t page = page_of(first_id); count > 0 && page <= page_of(end_id - 1); page++) {
+            int64_t page_first = std::max(first_id, page * QUEUE_PAGE_SIZE);
+            int64_t page_end = std::min(end_id, (page + 1) * QUEUE_PAGE_SIZE);
+            for (int64_t i = 0; i < std::min(bucket_count, page_end - page_first); i++) {
+                auto result = _session->execute(*check_task_range_finished_prepared, queue_id, bucket_of(page_first + i),
+                                                page, page_first, page_end);
+                while (result.next_row()) {
+                    if (result.is_column_null("is_finished") || !result.get_column<bool>("is_finished")) {
+                        continue;
+                    }
+
+                    int64_t task_id = result.get_column<int64_t>("task_id");
+                    if (result.is_column_null("response")) {
+                        finished.emplace_back(task_id, std::nullopt);
+                    } else {
+                        finished.emplace_back(task_id, response_from_value(result.get_column_raw("response")));
+                    }
+                }
+            }
+        }
+    } catch (const scmd::exception &ex) {
+        LogWarn("Received exception while checking if tasks are finished: {}", ex.what());
+    }
+
+    if (bucket_count > 1) {
+        std::sort(finished.begin(), finished.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    }
+
+    return finished;
+}
+
+int64_t scylla_blas::scylla_queue::get_pending_count() {
+    update_counters();
+    if (bucket_count == 1) {
+        return std::max(cnt_new - cnt_used, int64_t(0));
+    }
+
+    for (int64_t bucket = 0; bucket < bucket_count; bucket++) {
+        update_bucket_counter(bucket);
+    }
+    int64_t pending = bucket_pending_count();
+    _metrics->record_depth(pending);
+    return pending;
+}
+
+void scylla_blas::scylla_queue::renew_lease(int64_t id) {
+    _session->execute(*renew_lease_prepared, get_wall_time_microseconds(), queue_id, bucket_of(id), page_of(id), id);
+}
+
+std::optional<std::pair<int64_t, task>> scylla_blas::scylla_queue::claim_stale(int64_t lease_time,
+                                                                               const std::function<bool(const task&)> &eligible) {
+    update_counters();
+    int64_t now = get_wall_time_microseconds();
+
+    std::vector<std::tuple<int64_t, int64_t, task>> candidates;
+    scan_unreleased([&](scmd::query_result &result) {
+        while (result.next_row()) {
+            if (result.is_column_null("lease") || result.is_column_null("value")) continue;
+            if (!result.is_column_null("is_finished") && result.get_column<bool>("is_finished")) continue;
+
+            int64_t lease = result.get_column<int64_t>("lease");
+            if (lease + lease_time > now) continue;
+
+            task t = task_from_value(result.get_column_raw("value"));
+            if (eligible(t)) {
+                candidates.emplace_back(result.get_column<int64_t>("task_id"), lease, t);
+            }
+        }
+    });
+
+    // Another idle client may be looking at the same tasks - the lease decides which one of them takes over.
+    for (auto &[id, lease, t] : candidates) {
+        auto result = _session->execute(*take_over_lease_prepared, now, queue_id, bucket_of(id), page_of(id), id, lease);
+        if (result.next_row() && result.get_column<bool>("[applied]")) {
+            _metrics->record_stale_claim(id);
+            return std::make_pair(id, t);
+        }
+        _metrics->record_claim_conflict();
+    }
+
+    return std::nullopt;
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::get_unfinished() {
+    update_counters();
+
+    std::vector<std::pair<int64_t, task>> unfinished;
+    // Tasks of the range have rows only once they are finished.
+    std::unordered_set<int64_t> finished_in_range;
+    scan_unreleased([&](scmd::query_result &result) {
+        while (result.next_row()) {
+            int64_t id = result.get_column<int64_t>("task_id");
+            bool is_finished = !result.is_column_null("is_finished") && result.get_column<bool>("is_finished");
+            if (range.contains(id)) {
+                if (is_finished) finished_in_range.insert(id);
+                continue;
+            }
+            if (result.is_column_null("value") || is_finished) continue;
+            unfinished.emplace_back(id, task_from_value(result.get_column_raw("value")));
+        }
+    });
+
+    for (int64_t id = std::max(range.first_id, cnt_released); id < range.end_id; id++) {
+        if (!finished_in_range.contains(id)) {
+            unfinished.emplace_back(id, range.task_of(id));
+        }
+    }
+
+    if (bucket_count > 1 || range.end_id > range.first_id) {
+        std::sort(unfinished.begin(), unfinished.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    }
+
+    return unfinished;
+}
+
+void scylla_blas::scylla_queue::cancel() {
+    update_counters();
+    _session->execute("UPDATE blas.queue_meta SET cancelled_below = ? WHERE queue_id = ?", cnt_new, queue_id);
+}
+
+void scylla_blas::scylla_queue::set_deadline(int64_t new_deadline) {
+    if (new_deadline == deadline) {
+        return;
+    }
+
+    _session->execute("UPDATE blas.queue_meta SET deadline = ? WHERE queue_id = ?", new_deadline, queue_id);
+    deadline = new_deadline;
+}
+
+bool scylla_blas::scylla_queue::is_cancelled(int64_t id) {
+    auto result = _session->execute(*fetch_cancellation_prepared, queue_id);
+    if (!result.next_row()) {
+        throw std::runtime_error("Queue deleted while working?");
+    }
+    int64_t cancelled_below = result.is_column_null("cancelled_below") ? 0 : result.get_column<int64_t>("cancelled_below");
+    int64_t current_deadline = result.is_column_null("deadline") ? 0 : result.get_column<int64_t>("deadline");
+    return id < cancelled_below || (current_deadline > 0 && get_wall_time_microseconds() >= current_deadline);
+}
+
+void scylla_blas::scylla_queue::set_siblings(int64_t first_id, int64_t count) {
+    _session->execute("UPDATE blas.queue_meta SET sibling_first_id = ?, sibling_count = ? WHERE queue_id = ?",
+                      first_id, count, queue_id);
+    sibling_first_id = first_id;
+    sibling_count = count;
+}
+
+void scylla_blas::scylla_queue::set_dependencies(const std::vector<queue_dependency> &upstream, bool track) {
+    _session->execute("DELETE FROM blas.queue_upstream WHERE queue_id = ?", queue_id);
+
+    if (!upstream.empty()) {
+        auto prepared = _session->prepare("INSERT INTO blas.queue_upstream (queue_id, upstream_id, kind) VALUES (?, ?, ?)");
+        scmd::batch_query batch(CASS_BATCH_TYPE_UNLOGGED);
+        for (auto &dependency : upstream) {
+            auto stmt = prepared.get_statement();
+            stmt.bind(queue_id, dependency.queue_id, (int64_t)dependency.kind);
+            batch.add_statement(stmt);
+        }
+        _session->execute(batch);
+    }
+
+    /* Updating the meta last makes sure the upstream queues are listed before anyone looks for them */
+    _session->execute("UPDATE blas.queue_meta SET track_finished = ?, upstream_count = ? WHERE queue_id = ?",
+                      track, (int64_t)upstream.size(), queue_id);
+    track_finished = track;
+    upstream_count = upstream.size();
+}
+
+std::vector<scylla_blas::queue_dependency> scylla_blas::scylla_queue::get_upstream() {
+    if (upstream_count == 0) {
+        return {};
+    }
+
+    std::vector<queue_dependency> upstream;
+    auto result = _session->execute("SELECT upstream_id, kind FROM blas.queue_upstream WHERE queue_id = ?", queue_id);
+    while (result.next_row()) {
+        upstream.push_back({ result.get_column<int64_t>("upstream_id"),
+                             (dependency_kind)result.get_column<int64_t>("kind") });
+    }
+    return upstream;
+}
+
+void scylla_blas::scylla_queue::release(int64_t watermark) {
+    // The default queue is shared by every client producing to it directly, and none of them
+    // knows whether the tasks of the others below the watermark were collected.
+    if (queue_id == DEFAULT_WORKER_QUEUE_ID) {
+        LogDebug("Not releasing tasks of the shared queue {}", queue_id);
+        return;
+    }
+
+    // Only whole pages are dropped, the rest of the range waits for a later call.
+    int64_t end_page = page_of(watermark);
+    if (end_page <= page_of(cnt_released)) {
+        return;
+    }
+
+    auto futures = delete_pages(_session, queue_id, bucket_count, page_of(cnt_released), end_page);
+    cnt_released = end_page * QUEUE_PAGE_SIZE;
+    futures.push_back(_session->execute_async(*update_released_counter_prepared, cnt_released, queue_id));
+
+    for (auto &future : futures) {
+        future.wait();
+    }
+}
+
 void scylla_blas::scylla_queue::reset() {
-    auto future1 = _session->execute_async(*update_new_counter_prepared, (int64_t)0, get_id());
-    auto future2 = _session->execute_async(*update_used_counter_prepared, (int64_t)0, get_id());
-    auto future3 = _session->execute_async("DELETE FROM blas.queue_data WHERE queue_id = ?", get_id());
+    // Pages below cnt_released were already dropped - only the rest has to be deleted.
+    update_counters();
+    auto futures = delete_pages(_session, queue_id, bucket_count, page_of(cnt_released), page_of(cnt_new) + 1);
+    cnt_released = 0;
+    range = task_range{};
+
+    // Ids of the old range will be given to new tasks.
+    // Same goes for the ids that were cancelled.
+    futures.push_back(_session->execute_async("UPDATE blas.queue_meta SET range_first = 0, range_end = 0, cancelled_below = 0 WHERE queue_id = ?", get_id()));
+
+    futures.push_back(_session->execute_async(*update_new_counter_prepared, (int64_t)0, get_id()));
+    futures.push_back(_session->execute_async(*update_used_counter_prepared, (int64_t)0, get_id()));
+    futures.push_back(_session->execute_async(*update_released_counter_prepared, (int64_t)0, get_id()));
+    if (bucket_count > 1) {
+        for (int64_t bucket = 0; bucket < bucket_count; bucket++) {
+            futures.push_back(_session->execute_async(*update_bucket_counter_prepared, (int64_t)0, get_id(), bucket));
+        }
+    }
 
-    future1.wait();
-    future2.wait();
-    future3.wait();
+    for (auto &future : futures) {
+        future.wait();
+    }
 }
 
 // =========== PRIVATE METHODS ===========
@@ -230,28 +794,52 @@ void init_prepared(scylla_queue::shared_prepared &stmt, const std::shared_ptr<sc
 void scylla_blas::scylla_queue::prepare_statements() {
     init_prepared(update_new_counter_prepared, _session, "UPDATE blas.queue_meta SET cnt_new = ? WHERE queue_id = ?");
     init_prepared(update_new_counter_trans_prepared, _session, "UPDATE blas.queue_meta SET cnt_new = ? WHERE queue_id = ? IF cnt_new = ?");
+    init_prepared(produce_range_prepared, _session, "UPDATE blas.queue_meta SET cnt_new = ?, range_first = ?, range_end = ?, range_columns = ?, range_consumers = ? WHERE queue_id = ?");
 
-    init_prepared(fetch_counters_stmt, _session, "SELECT cnt_new, cnt_used FROM blas.queue_meta WHERE queue_id = ?");
+    init_prepared(fetch_counters_stmt, _session, "SELECT cnt_new, cnt_used, cnt_released, range_first, range_end, range_columns, range_consumers FROM blas.queue_meta WHERE queue_id = ?");
     init_prepared(update_used_counter_prepared, _session, "UPDATE blas.queue_meta SET cnt_used = ? WHERE queue_id = ?");
     init_prepared(update_used_counter_trans_prepared, _session, "UPDATE blas.queue_meta SET cnt_used = ? WHERE queue_id = ? IF cnt_used = ? AND cnt_new >= ?");
-    init_prepared(fetch_task_by_id_prepared, _session, "SELECT value FROM blas.queue_data WHERE queue_id = ? AND task_id = ?");
-    init_prepared(insert_task_prepared, _session, "INSERT INTO blas.queue_data (queue_id, task_id, is_finished, value) VALUES (?, ?, False, ?)");
-    init_prepared(mark_task_finished_prepared, _session, "UPDATE blas.queue_data SET is_finished = True, response = ? WHERE queue_id = ? AND task_id = ?");
-    init_prepared(check_task_finished_prepared, _session, "SELECT is_finished FROM blas.queue_data WHERE queue_id = ? AND task_id = ?");
-    init_prepared(get_task_response, _session, "SELECT response FROM blas.queue_data WHERE queue_id = ? AND task_id = ?");
+    init_prepared(fetch_bucket_counter_prepared, _session, "SELECT cnt_used FROM blas.queue_bucket WHERE queue_id = ? AND bucket = ?");
+    init_prepared(update_bucket_counter_prepared, _session, "UPDATE blas.queue_bucket SET cnt_used = ? WHERE queue_id = ? AND bucket = ?");
+    init_prepared(update_bucket_counter_trans_prepared, _session, "UPDATE blas.queue_bucket SET cnt_used = ? WHERE queue_id = ? AND bucket = ? IF cnt_used = ?");
+    init_prepared(update_released_counter_prepared, _session, "UPDATE blas.queue_meta SET cnt_released = ? WHERE queue_id = ?");
+    init_prepared(fetch_task_by_id_prepared, _session, "SELECT value FROM blas.queue_data WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id = ?");
+    init_prepared(fetch_task_range_prepared, _session, "SELECT task_id, value FROM blas.queue_data WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id >= ? AND task_id < ?");
+    init_prepared(insert_task_prepared, _session, "INSERT INTO blas.queue_data (queue_id, bucket, page, task_id, is_finished, value) VALUES (?, ?, ?, ?, False, ?)");
+    init_prepared(mark_task_finished_prepared, _session, "UPDATE blas.queue_data SET is_finished = True, response = ? WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id = ?");
+    init_prepared(check_task_finished_prepared, _session, "SELECT is_finished FROM blas.queue_data WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id = ?");
+    init_prepared(check_task_range_finished_prepared, _session, "SELECT task_id, is_finished, response FROM blas.queue_data WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id >= ? AND task_id < ?");
+    init_prepared(get_task_response, _session, "SELECT response FROM blas.queue_data WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id = ?");
+    init_prepared(mark_task_done_prepared, _session, "UPDATE blas.queue_data SET is_finished = True WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id = ?");
+    init_prepared(renew_lease_prepared, _session, "UPDATE blas.queue_data SET lease = ? WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id = ?");
+    init_prepared(take_over_lease_prepared, _session, "UPDATE blas.queue_data SET lease = ? WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id = ? IF lease = ? AND is_finished = False");
+    init_prepared(fetch_task_range_state_prepared, _session, "SELECT task_id, is_finished, lease, value FROM blas.queue_data WHERE queue_id = ? AND bucket = ? AND page = ? AND task_id >= ? AND task_id < ?");
+    init_prepared(fetch_cancellation_prepared, _session, "SELECT cancelled_below, deadline FROM blas.queue_meta WHERE queue_id = ?");
 }
 
 void scylla_blas::scylla_queue::copy_statements_from(scylla_blas::scylla_queue *other) {
     this->update_new_counter_prepared           = other->update_new_counter_prepared;
     this->update_new_counter_trans_prepared     = other->update_new_counter_trans_prepared;
+    this->produce_range_prepared                = other->produce_range_prepared;
     this->fetch_counters_stmt                   = other->fetch_counters_stmt;
     this->update_used_counter_prepared          = other->update_used_counter_prepared;
     this->update_used_counter_trans_prepared    = other->update_used_counter_trans_prepared;
+    this->fetch_bucket_counter_prepared         = other->fetch_bucket_counter_prepared;
+    this->update_bucket_counter_prepared        = other->update_bucket_counter_prepared;
+    this->update_bucket_counter_trans_prepared  = other->update_bucket_counter_trans_prepared;
+    this->update_released_counter_prepared      = other->update_released_counter_prepared;
     this->fetch_task_by_id_prepared             = other->fetch_task_by_id_prepared;
+    this->fetch_task_range_prepared             = other->fetch_task_range_prepared;
     this->insert_task_prepared                  = other->insert_task_prepared;
     this->mark_task_finished_prepared           = other->mark_task_finished_prepared;
     this->check_task_finished_prepared          = other->check_task_finished_prepared;
+    this->check_task_range_finished_prepared    = other->check_task_range_finished_prepared;
     this->get_task_response                     = other->get_task_response;
+    this->mark_task_done_prepared               = other->mark_task_done_prepared;
+    this->renew_lease_prepared                  = other->renew_lease_prepared;
+    this->take_over_lease_prepared              = other->take_over_lease_prepared;
+    this->fetch_task_range_state_prepared       = other->fetch_task_range_state_prepared;
+    this->fetch_cancellation_prepared           = other->fetch_cancellation_prepared;
 }
 
 void scylla_blas::scylla_queue::update_counters() {
@@ -261,25 +849,91 @@ void scylla_blas::scylla_queue::update_counters() {
     }
     cnt_new = result.get_column<int64_t>("cnt_new");
     cnt_used = result.get_column<int64_t>("cnt_used");
+    cnt_released = result.is_column_null("cnt_released") ? 0 : result.get_column<int64_t>("cnt_released");
+    range = range_from_row(result);
+    if (bucket_count == 1) {
+        _metrics->record_depth(std::max(cnt_new - cnt_used, int64_t(0)));
+    }
+}
+
+scylla_blas::task_range scylla_blas::scylla_queue::range_from_row(scmd::query_result &result) {
+    if (result.is_column_null("range_first") || result.is_column_null("range_end")) {
+        return {};
+    }
+
+    return {
+        .first_id = result.get_column<int64_t>("range_first"),
+        .end_id = result.get_column<int64_t>("range_end"),
+        .columns = result.is_column_null("range_columns") ? 0 : result.get_column<int64_t>("range_columns"),
+        .consumers = result.is_column_null("range_consumers") ? 1 : result.get_column<int64_t>("range_consumers")
+    };
+}
+
+void scylla_blas::scylla_queue::update_bucket_counter(int64_t bucket) {
+    auto result = _session->execute(*fetch_bucket_counter_prepared, queue_id, bucket);
+    if (!result.next_row()) {
+        throw std::runtime_error("Queue deleted while working?");
+    }
+    bucket_used[bucket] = result.get_column<int64_t>("cnt_used");
+}
+
+void scylla_blas::scylla_queue::scan_unreleased(const std::function<void(scmd::query_result &)> &visit) {
+    if (cnt_new <= cnt_released) {
+        return;
+    }
+
+    for (int64_t page = page_of(cnt_released); page <= page_of(cnt_new - 1); page++) {
+        int64_t page_first = std::max(cnt_released, page * QUEUE_PAGE_SIZE);
+        int64_t page_end = std::min(cnt_new, (page + 1) * QUEUE_PAGE_SIZE);
+        for (int64_t i = 0; i < std::min(bucket_count, page_end - page_first); i++) {
+            auto result = _session->execute(*fetch_task_range_state_prepared, queue_id, bucket_of(page_first + i),
+                                            page, page_first, page_end);
+            visit(result);
+        }
+    }
+}
+
+std::vector<scmd::future> scylla_blas::scylla_queue::delete_pages(const std::shared_ptr<scmd::session> &session, int64_t id,
+                                                                  int64_t bucket_count, int64_t first_page, int64_t end_page) {
+    // Each page of each bucket is a separate partition, so it is dropped with a single partition tombstone.
+    std::vector<scmd::future> futures;
+    for (int64_t page = first_page; page < end_page; page++) {
+        for (int64_t bucket = 0; bucket < bucket_count; bucket++) {
+            futures.push_back(session->execute_async("DELETE FROM blas.queue_data WHERE queue_id = ? AND bucket = ? AND page = ?",
+                                                     id, bucket, page));
+        }
+    }
+
+    return futures;
 }
 
 scmd::statement scylla_blas::scylla_queue::prepare_insert_query(int64_t task_id, const task &task) {
     scmd::statement insert_task = insert_task_prepared->get_statement();
-    insert_task.bind(queue_id, task_id);
+    insert_task.bind(queue_id, bucket_of(task_id), page_of(task_id), task_id);
     // TODO: implement binding/retrieving bytes in driver and get rid of this ugliness.
-    scmd_internal::throw_on_cass_error(cass_statement_bind_bytes(insert_task.get_statement(), 2,
-                                                                 reinterpret_cast<const cass_byte_t *>(&task), sizeof task));
+    auto bytes = proto::encode(task);
+    scmd_internal::throw_on_cass_error(cass_statement_bind_bytes(insert_task.get_statement(), 4, bytes.data(), bytes.size()));
     return insert_task;
 }
 
-scmd::batch_query scylla_blas::scylla_queue::prepare_batch_insert_query(int64_t base_id, const std::vector<task> &tasks) {
-    scmd::batch_query batch(CASS_BATCH_TYPE_UNLOGGED);
-    for(int64_t i = 0; i < tasks.size(); i++) {
-        auto stmt = prepare_insert_query(base_id + i, tasks[i]);
-        batch.add_statement(stmt);
+std::vector<scmd::future> scylla_blas::scylla_queue::insert_tasks(int64_t base_id, const std::vector<task> &tasks) {
+    // Unlogged batches are only cheap if they stay within a single partition,
+    // so tasks are grouped by their bucket and page - one batch per partition.
+    std::vector<scmd::future> futures;
+    for (int64_t i = 0; i < std::min(bucket_count, (int64_t)tasks.size()); i++) {
+        int64_t j = i;
+        while (j < (int64_t)tasks.size()) {
+            int64_t page = page_of(base_id + j);
+            scmd::batch_query batch(CASS_BATCH_TYPE_UNLOGGED);
+            for (; j < (int64_t)tasks.size() && page_of(base_id + j) == page; j += bucket_count) {
+                auto stmt = prepare_insert_query(base_id + j, tasks[j]);
+                batch.add_statement(stmt);
+            }
+            futures.push_back(_session->execute_async(batch));
+        }
     }
 
-    return batch;
+    return futures;
 }
 
 scmd::future scylla_blas::scylla_queue::insert_task(int64_t task_id, const task &task) {
@@ -299,15 +953,15 @@ int64_t scylla_blas::scylla_queue::produce_simple(const task &task) {
 }
 
 int64_t scylla_blas::scylla_queue::produce_many_simple(const std::vector<task> &tasks) {
-    auto batch = prepare_batch_insert_query(cnt_new, tasks);
-    auto future_1 = _session->execute_async(batch);
-    auto future_2 = _session->execute_async(*update_new_counter_prepared, (int64_t)(cnt_new + tasks.size()), queue_id);
+    auto futures = insert_tasks(cnt_new, tasks);
+    futures.push_back(_session->execute_async(*update_new_counter_prepared, (int64_t)(cnt_new + tasks.size()), queue_id));
 
     int64_t first_id = cnt_new;
     cnt_new += tasks.size();
 
-    future_1.wait();
-    future_2.wait();
+    for (auto &future : futures) {
+        future.wait();
+    }
 
     return first_id;
 }
@@ -323,6 +977,7 @@ int64_t scylla_blas::scylla_queue::produce_multi(const task &task) {
             insert_task(cnt_new, task).wait();
             return cnt_new++;
         } else {
+            _metrics->record_produce_conflict();
             cnt_new = result.get_column<int64_t>("cnt_new");
         }
     }
@@ -336,50 +991,43 @@ int64_t scylla_blas::scylla_queue::produce_many_multi(const std::vector<task> &t
             throw std::runtime_error("Queue deleted while working?");
         }
         if (result.get_column<bool>("[applied]")) {
-            auto batch = prepare_batch_insert_query(cnt_new, tasks);
-            auto future = _session->execute_async(batch);
+            auto futures = insert_tasks(cnt_new, tasks);
             int64_t first_id = cnt_new;
             cnt_new += tasks.size();
-            future.wait();
+            for (auto &future : futures) {
+                future.wait();
+            }
             return first_id;
         } else {
+            _metrics->record_produce_conflict();
             cnt_new = result.get_column<int64_t>("cnt_new");
         }
     }
 }
 
 task scylla_blas::scylla_queue::task_from_value(const CassValue *v) {
-    task ret{};
     const cass_byte_t *out_data;
     size_t out_size;
-    cass_value_get_bytes(v, &out_data, &out_size);
-    if (out_size != sizeof(task)) {
-        throw std::runtime_error("Invalid data in queue");
-    }
-    memcpy(&ret, out_data, out_size);
-    return ret;
+    scmd_internal::throw_on_cass_error(cass_value_get_bytes(v, &out_data, &out_size));
+    return proto::decode_task(out_data, out_size);
 }
 
 response scylla_blas::scylla_queue::response_from_value(const CassValue *v) {
-    response ret{};
     const cass_byte_t *out_data;
     size_t out_size;
-    cass_value_get_bytes(v, &out_data, &out_size);
-    if (out_size != sizeof(response)) {
-        throw std::runtime_error("Invalid response data in queue");
-    }
-    memcpy(&ret, out_data, out_size);
-    return ret;
+    scmd_internal::throw_on_cass_error(cass_value_get_bytes(v, &out_data, &out_size));
+    return proto::decode_response(out_data, out_size);
 }
 
 task scylla_blas::scylla_queue::fetch_task_loop(int64_t task_id) {
     // Now we need to fetch task data - it may not be there yet, but it should be rare.
     while(true) {
-        auto task_result = _session->execute(*fetch_task_by_id_prepared, queue_id, task_id);
+        auto task_result = _session->execute(*fetch_task_by_id_prepared, queue_id, bucket_of(task_id), page_of(task_id), task_id);
         if (!task_result.next_row()) {
             // Task was not inserted yet, we need to wait.
             // It shouldn't happen too often, requires a race condition.
             // Maybe some sleep here?
+            _metrics->record_payload_miss();
             continue;
         }
         // TODO: bytes in driver
@@ -387,6 +1035,63 @@ task scylla_blas::scylla_queue::fetch_task_loop(int64_t task_id) {
     }
 }
 
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::fetch_task_range_loop(int64_t first_id, int64_t count) {
+    // Same as fetch_task_loop, but for count consecutive tasks of the bucket that first_id belongs to,
+    // i.e. { first_id, first_id + bucket_count, ... }. For an unbucketed queue it is [first_id, first_id + count).
+    // Rows that were already fetched are kept, only the missing suffix is queried again.
+    std::vector<std::pair<int64_t, task>> tasks;
+    tasks.reserve(count);
+    int64_t bucket = bucket_of(first_id);
+    int64_t end_id = first_id + count * bucket_count;
+    while((int64_t)tasks.size() < count) {
+        // A query covers the rest of the range, but doesn't cross the end of a page (partition).
+        int64_t next_id = first_id + tasks.size() * bucket_count;
+        int64_t page = page_of(next_id);
+        int64_t page_end = std::min(end_id, (page + 1) * QUEUE_PAGE_SIZE);
+        auto task_result = _session->execute(*fetch_task_range_prepared, queue_id, bucket, page, next_id, page_end);
+        while (task_result.next_row()) {
+            int64_t task_id = task_result.get_column<int64_t>("task_id");
+            if (task_id != next_id) {
+                // There is a gap - some producer did not insert its task yet.
+                break;
+            }
+            tasks.emplace_back(task_id, task_from_value(task_result.get_column_raw("value")));
+            next_id += bucket_count;
+        }
+        if (next_id < page_end) {
+            _metrics->record_payload_miss();
+        }
+    }
+
+    return tasks;
+}
+
+task scylla_blas::scylla_queue::task_at(int64_t task_id) {
+    return range.contains(task_id) ? range.task_of(task_id) : fetch_task_loop(task_id);
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::claimed_tasks(int64_t first_id, int64_t count) {
+    // Claims are contiguous, and so is the range - the part of the claim that falls into it is contiguous too.
+    int64_t end_id = first_id + count;
+    int64_t range_first = std::clamp(range.first_id, first_id, end_id);
+    int64_t range_end = std::clamp(range.end_id, range_first, end_id);
+
+    std::vector<std::pair<int64_t, task>> tasks;
+    tasks.reserve(count);
+    if (range_first > first_id) {
+        tasks = fetch_task_range_loop(first_id, range_first - first_id);
+    }
+    for (int64_t id = range_first; id < range_end; id++) {
+        tasks.emplace_back(id, range.task_of(id));
+    }
+    if (end_id > range_end) {
+        auto rest = fetch_task_range_loop(range_end, end_id - range_end);
+        tasks.insert(tasks.end(), rest.begin(), rest.end());
+    }
+
+    return tasks;
+}
+
 std::optional<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_simple() {
     // First we need to check if there is task to fetch
     // There is, if used counter is less than new counter
@@ -399,7 +1104,7 @@ std::optional<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_simpl
     auto future_2 = _session->execute_async(*update_used_counter_prepared, cnt_used, queue_id);
     future_2.wait();
 
-    return std::make_pair(cnt_used - 1, fetch_task_loop(cnt_used - 1));
+    return std::make_pair(cnt_used - 1, task_at(cnt_used - 1));
 }
 
 std::optional<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_multi() {
@@ -417,14 +1122,125 @@ std::optional<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_multi
         if (!result.next_row()) {
             throw std::runtime_error("Queue deleted while working?");
         }
-        cnt_new = result.get_column<int64_t>("cnt_new");
-        cnt_used = result.get_column<int64_t>("cnt_used");
         bool is_applied = result.get_column<bool>("[applied]");
 
         if (is_applied) {
             // We claimed a task
             cnt_used++;
-            return std::make_pair(cnt_used - 1, fetch_task_loop(cnt_used - 1));
+            return std::make_pair(cnt_used - 1, task_at(cnt_used - 1));
+        }
+        _metrics->record_claim_conflict();
+
+        if (result.get_column<int64_t>("cnt_new") != cnt_new) {
+            // New tasks were produced - possibly as a new range, whose descriptor we don't know yet.
+            update_counters();
+        } else {
+            cnt_used = result.get_column<int64_t>("cnt_used");
+        }
+    }
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_many_simple(int64_t n, bool guided) {
+    update_counters();
+    if (cnt_used >= cnt_new) {
+        return {};
+    }
+    // No other consumers - the whole range can be claimed without a transaction.
+    int64_t first_id = cnt_used;
+    int64_t count = claim_size(n, guided, cnt_new - cnt_used);
+    cnt_used += count;
+    auto future = _session->execute_async(*update_used_counter_prepared, cnt_used, queue_id);
+    future.wait();
+
+    return claimed_tasks(first_id, count);
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_many_multi(int64_t n, bool guided) {
+    update_counters();
+
+    while(true) {
+        if (cnt_used >= cnt_new) {
+            return {};
+        }
+
+        // Claim as much as is available, but no more than requested.
+        // The condition on cnt_new guarantees that the whole claimed range was produced.
+        int64_t count = claim_size(n, guided, cnt_new - cnt_used);
+        auto result = _session->execute(*update_used_counter_trans_prepared, cnt_used + count, queue_id, cnt_used, cnt_used + count);
+
+        if (!result.next_row()) {
+            throw std::runtime_error("Queue deleted while working?");
+        }
+        bool is_applied = result.get_column<bool>("[applied]");
+
+        if (is_applied) {
+            // We claimed tasks [cnt_used, cnt_used + count)
+            int64_t first_id = cnt_used;
+            cnt_used += count;
+            return claimed_tasks(first_id, count);
+        }
+        _metrics->record_claim_conflict();
+
+        if (result.get_column<int64_t>("cnt_new") != cnt_new) {
+            // New tasks were produced - possibly as a new range, whose descriptor we don't know yet.
+            update_counters();
+        } else {
+            cnt_used = result.get_column<int64_t>("cnt_used");
+        }
+    }
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_bucketed(int64_t n) {
+    update_counters();
+
+    // Start from our own bucket - the others are only visited when it is drained.
+    for (int64_t i = 0; i < bucket_count; i++) {
+        int64_t bucket = (home_bucket + i) % bucket_count;
+        // A counter that is behind only costs a failed transaction, but a single consumer
+        // claims without one, and a bucket that looks drained may have been reset since.
+        if (!multi_consumer || bucket_size(bucket) <= bucket_used[bucket]) {
+            update_bucket_counter(bucket);
+        }
+
+        auto claimed = consume_from_bucket(bucket, n);
+        if (!claimed.empty()) {
+            _metrics->record_depth(bucket_pending_count());
+            return claimed;
+        }
+    }
+
+    _metrics->record_depth(bucket_pending_count());
+    return {};
+}
+
+std::vector<std::pair<int64_t, task>> scylla_blas::scylla_queue::consume_from_bucket(int64_t bucket, int64_t n) {
+    while(true) {
+        // cnt_new only grows, so everything below the value we have read is already produced.
+        int64_t available = bucket_size(bucket) - bucket_used[bucket];
+        if (available <= 0) {
+            return {};
+        }
+
+        int64_t count = std::min(n, available);
+        int64_t first_used = bucket_used[bucket];
+
+        if (!multi_consumer) {
+            bucket_used[bucket] += count;
+            _session->execute(*update_bucket_counter_prepared, bucket_used[bucket], queue_id, bucket);
+            return fetch_task_range_loop(first_used * bucket_count + bucket, count);
+        }
+
+        auto result = _session->execute(*update_bucket_counter_trans_prepared, first_used + count, queue_id, bucket, first_used);
+        if (!result.next_row()) {
+            throw std::runtime_error("Queue deleted while working?");
+        }
+        bucket_used[bucket] = result.get_column<int64_t>("cnt_used");
+
+        if (result.get_column<bool>("[applied]")) {
+            // We claimed local positions [first_used, first_used + count) of this bucket
+            bucket_used[bucket] = first_used + count;
+            return fetch_task_range_loop(first_used * bucket_count + bucket, count);
         }
+        _metrics->record_claim_conflict();
     }
 }
@@ -1,4 +1,19 @@
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "scylla_blas/queue/codec.hh"
 #include "scylla_blas/queue/worker_proc.hh"
+#include "scylla_blas/utils/version_bumps.hh"
 
 #include "random_value_factory.hh"
 #include "sparse_matrix_value_generator.hh"
@@ -8,248 +23,1086 @@ namespace scylla_blas::worker {
     void set_worker_retries(int64_t retries) {
         max_worker_retries = retries;
     }
+
+    int64_t subtask_batch_size = DEFAULT_SUBTASK_BATCH_SIZE;
+    void set_subtask_batch_size(int64_t batch_size) {
+        subtask_batch_size = std::max(batch_size, int64_t(1));
+    }
+
+    bool speculative_execution = DEFAULT_SPECULATIVE_EXECUTION;
+    void set_speculative_execution(bool enabled) {
+        speculative_execution = enabled;
+    }
+
+    int64_t prefetch_depth = DEFAULT_SUBTASK_PREFETCH_DEPTH;
+    void set_prefetch_depth(int64_t depth) {
+        prefetch_depth = std::max(depth, int64_t(0));
+    }
+
+    std::atomic<int64_t> operand_cache_size = DEFAULT_OPERAND_CACHE_BYTES;
+    void set_operand_cache_size(int64_t bytes) {
+        operand_cache_size = std::max(bytes, int64_t(0));
+    }
+
+    int64_t read_window = DEFAULT_READ_WINDOW;
+    void set_read_window(int64_t window) {
+        read_window = std::max(window, int64_t(1));
+    }
+
+    int64_t task_lease_time = DEFAULT_TASK_LEASE_TIME_MICROSECONDS;
+    void set_task_lease_time(int64_t lease_time) {
+        task_lease_time = std::max(lease_time, int64_t(1));
+    }
+
+    int64_t metrics_interval = DEFAULT_QUEUE_METRICS_INTERVAL_MICROSECONDS;
+    void set_metrics_interval(int64_t interval) {
+        metrics_interval = std::max(interval, int64_t(0));
+    }
+
+    std::array<int64_t, PRIORITY_CLASS_COUNT> priority_weights = {
+        DEFAULT_INTERACTIVE_WEIGHT, DEFAULT_NORMAL_WEIGHT, DEFAULT_BATCH_WEIGHT
+    };
+    void set_priority_weights(const std::array<int64_t, PRIORITY_CLASS_COUNT> &weights) {
+        for (int64_t priority = 0; priority < PRIORITY_CLASS_COUNT; priority++) {
+            priority_weights[priority] = std::max(weights[priority], int64_t(0));
+        }
+    }
 }
 
 namespace {
 
-void consume_tasks(scylla_blas::scylla_queue &task_queue,
-                   std::function<void(scylla_blas::proto::task&)> consume) {
-    LogDebug("Consuming subtasks from queue {}", task_queue.get_id());
-    using namespace scylla_blas;
-    int64_t attempts;
-    while (true) {
-        std::optional<std::pair<int64_t, proto::task>> opt;
-        for(attempts = 0; attempts <= scylla_blas::worker::max_worker_retries; attempts++) {
+/* The leased main task run by this thread, see run_worker */
+struct leased_task {
+    scylla_blas::task_queue *queue = nullptr; /* The main queue, null if the task isn't leased */
+    int64_t id = 0;
+    int64_t last_renewal = 0;
+    bool is_backup = false; /* A re-execution of a task that went stale */
+};
+
+thread_local leased_task current_task;
+
+/* Shared by all worker threads of the process, so that the metrics are logged once per interval */
+std::atomic<int64_t> last_metrics_dump = 0;
+
+void maybe_log_metrics() {
+    if (scylla_blas::worker::metrics_interval <= 0) return;
+
+    int64_t now = scylla_blas::queue_metrics::now();
+    int64_t last = last_metrics_dump.load();
+    if (last == 0) {
+        last_metrics_dump.compare_exchange_strong(last, now);
+    } else if (now - last >= scylla_blas::worker::metrics_interval && last_metrics_dump.compare_exchange_strong(last, now)) {
+        scylla_blas::queue_metrics::log_all();
+    }
+}
+
+/* Shared by all worker threads of the process, so that one of them at a time looks for stale tasks.
+ * A scan reads every unreleased page of the main queues, and no task goes stale sooner than its lease
+ * expires – after a scan that found nothing, the next one waits for a lease time.
+ */
+std::atomic<int64_t> next_stale_scan = 0;
+
+void report_progress() {
+    if (current_task.queue == nullptr) return;
+
+    int64_t now = scylla_blas::get_wall_time_microseconds();
+    if (now - current_task.last_renewal < scylla_blas::worker::task_lease_time / 4) return;
+    try {
+        current_task.queue->renew_lease(current_task.id);
+        current_task.last_renewal = now;
+    } catch (const std::exception &e) {
+        LogWarn("Failed to renew lease of task {}: {}", current_task.id, e.what());
+    }
+}
+
+/* Picks the main queue to take the next main task from. Priority classes are picked with smooth weighted
+ * round robin: every pick adds its weight to the credit of each class, and the class with the most credit
+ * that has a task pending wins, paying back the total weight. Among the queues of a class (one per scheduler)
+ * tasks are taken in turn, so that no scheduler starves the others. The registry is refreshed periodically.
+ */
+class main_queue_selector {
+    using claimed_task = std::tuple<std::shared_ptr<scylla_blas::task_queue>, int64_t, scylla_blas::proto::task>;
+
+    scylla_blas::queue_backend &_backend;
+    std::array<std::vector<std::shared_ptr<scylla_blas::task_queue>>, scylla_blas::PRIORITY_CLASS_COUNT> _queues;
+    std::array<size_t, scylla_blas::PRIORITY_CLASS_COUNT> _next;
+    std::array<int64_t, scylla_blas::PRIORITY_CLASS_COUNT> _credit;
+    int64_t _last_refresh;
+
+    void refresh() {
+        std::map<int64_t, std::shared_ptr<scylla_blas::task_queue>> open;
+        for (auto &queues : _queues) {
+            for (auto &q : queues) {
+                open[q->get_id()] = q;
+            }
+            queues.clear();
+        }
+
+        for (auto [priority, id] : _backend.list_main_queues()) {
+            if (priority < 0 || priority >= scylla_blas::PRIORITY_CLASS_COUNT) continue;
             try {
-                opt = task_queue.consume();
-                if (!opt.has_value()) {
-                    LogDebug("No more subtasks in queue, finishing task");
-                    // The task queue is empty – nothing left to do.
-                    return;
-                }
-                break;
+                auto it = open.find(id);
+                _queues[priority].push_back(it != open.end() ? it->second : _backend.open_queue(id));
             } catch (const std::exception &e) {
-                LogWarn("Error while fetching subtask, retrying, {} / {}",
-                        attempts, scylla_blas::worker::max_worker_retries);
+                /* The scheduler may have just deleted it */
+                LogDebug("Could not open main queue {}: {}", id, e.what());
             }
         }
-        if (attempts > scylla_blas::worker::max_worker_retries) {
-            LogError("Too many failed attempts to fetch subtask, giving up");
-            throw scylla_blas::worker::subtask_failed_exception();
+        _last_refresh = scylla_blas::queue_metrics::now();
+    }
+
+    std::optional<claimed_task> consume_class(int64_t priority) {
+        auto &queues = _queues[priority];
+        for (size_t i = 0; i < queues.size(); i++) {
+            auto &q = queues[(_next[priority] + i) % queues.size()];
+            auto claimed = q->consume();
+            if (claimed.has_value()) {
+                _next[priority] = (_next[priority] + i + 1) % queues.size();
+                return claimed_task{ q, claimed->first, claimed->second };
+            }
+        }
+        return std::nullopt;
+    }
+
+public:
+    explicit main_queue_selector(scylla_blas::queue_backend &backend) :
+        _backend(backend), _queues(), _next(), _credit(), _last_refresh(0) {}
+
+    std::optional<claimed_task> consume() {
+        using scylla_blas::worker::priority_weights;
+        if (scylla_blas::queue_metrics::now() - _last_refresh >= MAIN_QUEUE_REFRESH_MICROSECONDS) {
+            refresh();
+        }
+
+        int64_t total = 0;
+        std::vector<int64_t> order;
+        for (int64_t priority = 0; priority < scylla_blas::PRIORITY_CLASS_COUNT; priority++) {
+            if (priority_weights[priority] == 0) continue;
+            _credit[priority] += priority_weights[priority];
+            total += priority_weights[priority];
+            order.push_back(priority);
+        }
+        std::stable_sort(order.begin(), order.end(), [this](int64_t a, int64_t b) { return _credit[a] > _credit[b]; });
+
+        for (int64_t priority : order) {
+            auto claimed = consume_class(priority);
+            if (claimed.has_value()) {
+                _credit[priority] -= total;
+                return claimed;
+            }
+            /* An idle class doesn't save up credit for later */
+            _credit[priority] = 0;
+        }
+        return std::nullopt;
+    }
+
+    /* Same as queue::claim_stale, over all main queues served by this worker, most important ones first.
+     * Finds nothing while another scan of the process is due later, see next_stale_scan.
+     */
+    std::optional<claimed_task> claim_stale(int64_t lease_time, const std::function<bool(const scylla_blas::proto::task&)> &eligible) {
+        int64_t now = scylla_blas::get_wall_time_microseconds();
+        int64_t due = next_stale_scan.load();
+        if (now < due || !next_stale_scan.compare_exchange_strong(due, now + lease_time)) {
+            return std::nullopt;
+        }
+
+        for (int64_t priority = 0; priority < scylla_blas::PRIORITY_CLASS_COUNT; priority++) {
+            if (scylla_blas::worker::priority_weights[priority] == 0) continue;
+            for (auto &q : _queues[priority]) {
+                auto claimed = q->claim_stale(lease_time, eligible);
+                if (claimed.has_value()) {
+                    /* There may be more of them */
+                    next_stale_scan.store(now);
+                    return claimed_task{ q, claimed->first, claimed->second };
+                }
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+/* Keeps the worker registered in the backend (see queue_backend::count_live_workers) while it exists.
+ * Heartbeats are sent by a thread of their own, so that a long main task doesn't make the worker look dead.
+ */
+class worker_heartbeat {
+    static int64_t random_worker_id() {
+        std::mt19937_64 generator(std::random_device{}());
+        return std::uniform_int_distribution<int64_t>(1)(generator);
+    }
+
+    scylla_blas::queue_backend &_backend;
+    int64_t _worker_id;
+    std::mutex _mutex;
+    std::condition_variable _stopped;
+    bool _stop;
+    std::thread _thread;
+
+    void beat() {
+        try {
+            _backend.heartbeat_worker(_worker_id, WORKER_HEARTBEAT_TTL_MICROSECONDS);
+        } catch (const std::exception &e) {
+            LogWarn("Failed to renew registration of worker {}: {}", _worker_id, e.what());
+        }
+    }
+
+public:
+    explicit worker_heartbeat(scylla_blas::queue_backend &backend) :
+        _backend(backend),
+        _worker_id(random_worker_id()),
+        _stop(false)
+    {
+        beat();
+        _thread = std::thread([this] {
+            std::unique_lock lock(_mutex);
+            while (!_stopped.wait_for(lock, std::chrono::microseconds(WORKER_HEARTBEAT_MICROSECONDS), [this] { return _stop; })) {
+                lock.unlock();
+                beat();
+                lock.lock();
+            }
+        });
+    }
+
+    worker_heartbeat(const worker_heartbeat &other) = delete;
+    worker_heartbeat& operator=(const worker_heartbeat &other) = delete;
+
+    ~worker_heartbeat() {
+        {
+            std::lock_guard lock(_mutex);
+            _stop = true;
+        }
+        _stopped.notify_all();
+        _thread.join();
+
+        try {
+            _backend.unregister_worker(_worker_id);
+        } catch (const std::exception &e) {
+            /* The registration expires anyway */
+            LogWarn("Failed to unregister worker {}: {}", _worker_id, e.what());
+        }
+    }
+
+    int64_t get_id() const { return _worker_id; }
+};
+
+/* A subtask procedure split in two phases. fetch only reads the operands of a subtask,
+ * so it may run ahead on another thread, while compute performs the subtask with them.
+ */
+template<class Operands>
+struct pipelined_procedure {
+    std::function<Operands(const scylla_blas::proto::task&)> fetch;
+    std::function<void(scylla_blas::proto::task&, Operands&)> compute;
+};
+
+struct no_operands {};
+
+/* Performs subtasks in order, with operands of up to `depth` next subtasks being fetched
+ * while the current one is computed. A failed subtask is retried from scratch, up to
+ * max_worker_retries times.
+ *
+ * Fetches run in order on a single thread of the pipeline, started with the first one –
+ * the reads of each fetch are already issued at once, see read_in_window.
+ */
+template<class Operands>
+class subtask_pipeline {
+    struct entry {
+        int64_t id;
+        scylla_blas::proto::task subtask;
+        std::optional<std::future<Operands>> operands;
+    };
+
+    scylla_blas::task_queue &_queue;
+    const pipelined_procedure<Operands> &_procedure;
+    int64_t _depth;
+    std::deque<entry> _window;
+    std::vector<int64_t> _done;
+    int64_t _cancellation_checked_at;
+
+    std::mutex _fetch_mutex;
+    std::condition_variable _fetch_wanted;
+    std::deque<std::pair<scylla_blas::proto::task, std::promise<Operands>>> _fetches;
+    bool _stopping = false;
+    std::thread _fetcher;
+
+    void fetch_loop() {
+        std::unique_lock lock(_fetch_mutex);
+        while (true) {
+            _fetch_wanted.wait(lock, [this] { return _stopping || !_fetches.empty(); });
+            if (_stopping) break;
+
+            auto [subtask, promise] = std::move(_fetches.front());
+            _fetches.pop_front();
+            lock.unlock();
+            try {
+                promise.set_value(_procedure.fetch(subtask));
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+            lock.lock();
+        }
+    }
+
+    void start_fetches() {
+        for (int64_t i = 0; i < std::min(_depth, (int64_t)_window.size()); i++) {
+            if (!_window[i].operands.has_value()) {
+                std::promise<Operands> promise;
+                _window[i].operands = promise.get_future();
+                {
+                    std::lock_guard lock(_fetch_mutex);
+                    _fetches.emplace_back(_window[i].subtask, std::move(promise));
+                }
+                if (!_fetcher.joinable()) {
+                    _fetcher = std::thread([this] { fetch_loop(); });
+                }
+                _fetch_wanted.notify_one();
+            }
+        }
+    }
+
+    void mark_done() {
+        if ((current_task.queue != nullptr || _queue.tracks_finished()) && !_done.empty()) {
+            // Leased tasks track their subtasks, so that a re-execution knows what is left to do.
+            // Queues that other queues depend on track them for the subtasks waiting downstream.
+            _queue.mark_as_finished(_done);
+            report_progress();
         }
+        _done.clear();
+    }
+
+    /* Subtasks claimed together belong to the same routine – once one is cancelled, all of them are */
+    void check_cancellation(int64_t id) {
+        int64_t now = scylla_blas::get_wall_time_microseconds();
+        if (now - _cancellation_checked_at < CANCELLATION_CHECK_MICROSECONDS) return;
+
+        _cancellation_checked_at = now;
+        if (_queue.is_cancelled(id)) {
+            LogInfo("Subtask {} of queue {} was cancelled, dropping {} more", id, _queue.get_id(), _window.size());
+            throw scylla_blas::worker::task_cancelled_exception();
+        }
+    }
+
+public:
+    subtask_pipeline(scylla_blas::task_queue &queue, const pipelined_procedure<Operands> &procedure, int64_t depth) :
+        _queue(queue), _procedure(procedure), _depth(depth), _window(), _done(), _cancellation_checked_at(0) {}
+
+    /* Waits for the fetch in progress, fetches not started yet are dropped */
+    ~subtask_pipeline() {
+        {
+            std::lock_guard lock(_fetch_mutex);
+            _stopping = true;
+        }
+        _fetch_wanted.notify_one();
+        if (_fetcher.joinable()) {
+            _fetcher.join();
+        }
+    }
+
+    bool empty() const { return _window.empty(); }
+
+    /* Whether more subtasks should be claimed to keep the pipeline busy */
+    bool wants_more() const { return (int64_t)_window.size() <= _depth; }
+
+    void push(const std::vector<std::pair<int64_t, scylla_blas::proto::task>> &subtasks) {
+        for (auto &[id, subtask] : subtasks) {
+            _window.push_back({ id, subtask, std::nullopt });
+        }
+        start_fetches();
+    }
+
+    /* Throws task_cancelled_exception if the routine of the subtasks was cancelled.
+     * Subtasks done so far are not reported as finished then.
+     */
+    void run_next() {
+        check_cancellation(_window.front().id);
+        entry e = std::move(_window.front());
+        _window.pop_front();
+        start_fetches();
 
-        LogInfo("New subtask task obtained; id = {}", opt.value().first);
+        int64_t attempts;
         for(attempts = 0; attempts <= scylla_blas::worker::max_worker_retries; attempts++) {
             try {
-                consume(opt.value().second);
+                // Only the first attempt uses the prefetched operands.
+                Operands operands = (attempts == 0 && e.operands.has_value()) ? e.operands->get() : _procedure.fetch(e.subtask);
+                _procedure.compute(e.subtask, operands);
                 break;
-            } catch (const std::exception &e) {
+            } catch (const std::exception &ex) {
                 LogWarn("Subtask {} failed. Reason: {}. Retrying, {} / {}",
-                        opt.value().first, e.what(), attempts, scylla_blas::worker::max_worker_retries);
+                        e.id, ex.what(), attempts, scylla_blas::worker::max_worker_retries);
             }
         }
         if (attempts > scylla_blas::worker::max_worker_retries) {
-            LogError("Too many ({}) failed attempts to perform subtask {}, giving up", attempts, opt.value().first);
+            LogError("Too many ({}) failed attempts to perform subtask {}, giving up", attempts, e.id);
             throw scylla_blas::worker::subtask_failed_exception();
         }
+
+        _done.push_back(e.id);
+        if ((int64_t)_done.size() >= scylla_blas::worker::subtask_batch_size) {
+            mark_done();
+        }
+    }
+
+    void finish() {
+        while (!empty()) {
+            run_next();
+        }
+        mark_done();
+    }
+};
+
+std::vector<std::pair<int64_t, scylla_blas::proto::task>> claim_subtasks(scylla_blas::task_queue &task_queue) {
+    int64_t attempts;
+    for(attempts = 0; attempts <= scylla_blas::worker::max_worker_retries; attempts++) {
+        try {
+            return task_queue.consume_guided(scylla_blas::worker::subtask_batch_size);
+        } catch (const std::exception &e) {
+            LogWarn("Error while fetching subtask, retrying, {} / {}",
+                    attempts, scylla_blas::worker::max_worker_retries);
+        }
+    }
+
+    LogError("Too many failed attempts to fetch subtask, giving up");
+    throw scylla_blas::worker::subtask_failed_exception();
+}
+
+/* Claims subtasks in batches, ahead of time if the pipeline is deep enough */
+template<class Operands>
+void consume_queue(scylla_blas::task_queue &task_queue, const pipelined_procedure<Operands> &procedure, int64_t depth) {
+    LogDebug("Consuming subtasks from queue {}", task_queue.get_id());
+    subtask_pipeline<Operands> pipeline(task_queue, procedure, depth);
+    bool exhausted = false;
+    while (true) {
+        while (!exhausted && pipeline.wants_more()) {
+            auto claimed = claim_subtasks(task_queue);
+            if (claimed.empty()) {
+                exhausted = true;
+            } else {
+                LogInfo("New subtasks obtained; ids = {}-{}", claimed.front().first, claimed.back().first);
+                pipeline.push(claimed);
+            }
+        }
+
+        if (pipeline.empty()) {
+            LogDebug("No more subtasks in queue, finishing task");
+            // The task queue is empty – nothing left to do.
+            break;
+        }
+        pipeline.run_next();
+    }
+    pipeline.finish();
+}
+
+/* A re-execution of a stale task also redoes the subtasks that were claimed, but never finished.
+ * Some of them may still be in progress elsewhere – it is fine for the tasks that are leased.
+ */
+template<class Operands>
+void redo_unfinished(scylla_blas::task_queue &task_queue, const pipelined_procedure<Operands> &procedure, int64_t depth) {
+    auto unfinished = task_queue.get_unfinished();
+    if (unfinished.empty()) {
+        return;
+    }
+
+    LogInfo("Redoing {} unfinished subtasks of queue {}", unfinished.size(), task_queue.get_id());
+    subtask_pipeline<Operands> pipeline(task_queue, procedure, depth);
+    pipeline.push(unfinished);
+    pipeline.finish();
+}
+
+/* Subtasks of a queue with upstream queues (see task_queue::set_dependencies) wait for the upstream
+ * subtasks they depend on. Waits are checked before the operands of a subtask are fetched,
+ * possibly by several prefetching threads at once.
+ */
+class upstream_tracker {
+    struct upstream {
+        std::shared_ptr<scylla_blas::task_queue> queue;
+        scylla_blas::dependency_kind kind;
+        scylla_blas::task_range range;
+        int64_t first_pending; /* ALL: subtasks of the range below it are all finished */
+        std::vector<bool> is_done;
+    };
+
+    std::vector<upstream> _upstream;
+    std::mutex _mutex;
+
+    /* Returns whether all subtasks of the upstream range are finished */
+    bool poll_all(upstream &u) {
+        std::lock_guard lock(_mutex);
+        if (u.first_pending < u.range.end_id) {
+            for (auto &[id, response] : u.queue->get_finished(u.first_pending, u.range.end_id - u.first_pending)) {
+                u.is_done[id - u.range.first_id] = true;
+            }
+            while (u.first_pending < u.range.end_id && u.is_done[u.first_pending - u.range.first_id]) {
+                u.first_pending++;
+            }
+        }
+        return u.first_pending >= u.range.end_id;
+    }
+
+public:
+    upstream_tracker(scylla_blas::queue_backend &backend, const std::vector<scylla_blas::queue_dependency> &dependencies) {
+        for (auto &dependency : dependencies) {
+            auto queue = backend.open_queue(dependency.queue_id);
+            auto range = queue->get_range();
+            _upstream.push_back({ queue, dependency.kind, range, range.first_id,
+                                  std::vector<bool>(range.end_id - range.first_id, false) });
+        }
+    }
+
+    bool empty() const { return _upstream.empty(); }
+
+    void wait_for(const scylla_blas::proto::task &subtask) {
+        for (auto &u : _upstream) {
+            scylla_blas::backoff wait(DEFAULT_SCHEDULER_MIN_SLEEP_TIME_MICROSECONDS, DEFAULT_WORKER_SLEEP_TIME_MICROSECONDS);
+            if (u.kind == scylla_blas::dependency_kind::SAME_SUBTASK) {
+                int64_t id = u.range.id_of(subtask);
+                while (u.range.contains(id) && !u.queue->is_finished(id) && !u.queue->is_cancelled(id)) {
+                    wait.wait();
+                }
+            } else {
+                while (!poll_all(u) && !u.queue->is_cancelled(u.range.first_id)) {
+                    wait.wait();
+                }
+            }
+        }
+    }
+};
+
+/* Consumes all subtasks from task_queue. If the queue belongs to a group of siblings,
+ * the worker then helps with the other queues of the group, always picking the one
+ * with the most subtasks left, until all of them are empty.
+ */
+template<class Operands>
+void consume_pipelined(scylla_blas::queue_backend &backend, scylla_blas::task_queue &queue,
+                       const pipelined_procedure<Operands> &procedure, int64_t depth) {
+    using namespace scylla_blas;
+    consume_queue(queue, procedure, depth);
+
+    auto [first_id, count] = queue.get_siblings();
+    if (count <= 1) {
+        if (current_task.is_backup) {
+            redo_unfinished(queue, procedure, depth);
+        }
+        return;
+    }
+
+    std::vector<std::shared_ptr<task_queue>> siblings;
+    for (int64_t id = first_id; id < first_id + count; id++) {
+        if (id == queue.get_id()) continue;
+        try {
+            siblings.push_back(backend.open_queue(id));
+        } catch (const std::exception &e) {
+            LogWarn("Could not connect to sibling queue {}: {}", id, e.what());
+        }
+    }
+
+    while (true) {
+        task_queue *fullest = nullptr;
+        int64_t max_pending = 0;
+        for (auto &q : siblings) {
+            try {
+                int64_t pending = q->get_pending_count();
+                if (pending > max_pending) {
+                    max_pending = pending;
+                    fullest = q.get();
+                }
+            } catch (const std::exception &e) {
+                LogWarn("Could not check sibling queue {}: {}", q->get_id(), e.what());
+            }
+        }
+
+        if (fullest == nullptr) {
+            LogDebug("All sibling queues are empty, finishing task");
+            break;
+        }
+
+        LogDebug("Stealing subtasks from queue {} ({} left)", fullest->get_id(), max_pending);
+        consume_queue(*fullest, procedure, depth);
+    }
+
+    if (current_task.is_backup) {
+        // With work stealing, the stale worker could have claimed subtasks of any queue of the group.
+        redo_unfinished(queue, procedure, depth);
+        for (auto &q : siblings) {
+            redo_unfinished(*q, procedure, depth);
+        }
+    }
+}
+
+/* Subtasks wait for their upstream ones, if the queue has any, right before their operands are fetched */
+template<class Operands>
+void consume_dataflow(scylla_blas::queue_backend &backend, scylla_blas::task_queue &queue,
+                      const pipelined_procedure<Operands> &procedure, int64_t depth) {
+    upstream_tracker tracker(backend, queue.get_upstream());
+    if (tracker.empty()) {
+        consume_pipelined(backend, queue, procedure, depth);
+        return;
     }
+
+    pipelined_procedure<Operands> waiting{
+        .fetch = [&tracker, &procedure] (const scylla_blas::proto::task &subtask) {
+            tracker.wait_for(subtask);
+            return procedure.fetch(subtask);
+        },
+        .compute = procedure.compute
+    };
+    consume_pipelined(backend, queue, waiting, depth);
+}
+
+/* Operands of the subtasks are prefetched, see set_prefetch_depth */
+template<class Operands>
+void consume_tasks(scylla_blas::queue_backend &backend, scylla_blas::task_queue &queue,
+                   const pipelined_procedure<Operands> &procedure) {
+    consume_dataflow(backend, queue, procedure, scylla_blas::worker::prefetch_depth);
+}
+
+/* Each subtask is performed by a single call, one after another */
+void consume_tasks(scylla_blas::queue_backend &backend, scylla_blas::task_queue &queue,
+                   const std::function<void(scylla_blas::proto::task&)> &consume) {
+    pipelined_procedure<no_operands> procedure{
+        .fetch = [] (const scylla_blas::proto::task &) { return no_operands{}; },
+        .compute = [&consume] (scylla_blas::proto::task &subtask, no_operands &) { consume(subtask); }
+    };
+    consume_dataflow(backend, queue, procedure, 0);
+}
+
+/* Memory taken by a cached block or segment, roughly */
+template<class T>
+int64_t footprint(const scylla_blas::matrix_block<T> &block) {
+    return sizeof(block) + block.get_values_raw().size() * sizeof(scylla_blas::matrix_value<T>);
+}
+
+template<class T>
+int64_t footprint(const scylla_blas::vector_segment<T> &segment) {
+    return sizeof(segment) + segment.size() * sizeof(scylla_blas::vector_value<T>);
+}
+
+/* Blocks and segments of read-only operands, shared by all threads of the process (see set_operand_cache_size).
+ * Entries are keyed by the version of their matrix or vector (see basic_matrix::get_version): once it is
+ * written to, they are never hit again, and are evicted as the least recently used ones.
+ */
+class operand_cache {
+public:
+    struct key {
+        bool is_matrix;
+        scylla_blas::id_t id;
+        int64_t version;
+        scylla_blas::index_t row; /* The segment index for vectors */
+        scylla_blas::index_t column;
+        int64_t trans;
+        size_t value_size; /* Matrices of different value types may share an id */
+
+        auto operator<=>(const key &other) const = default;
+    };
+
+private:
+    struct entry {
+        key k;
+        std::shared_ptr<const void> value;
+        int64_t bytes;
+    };
+
+    std::mutex _mutex;
+    std::list<entry> _entries; /* The most recently used first */
+    std::map<key, std::list<entry>::iterator> _index;
+    int64_t _bytes = 0;
+
+public:
+    /* The cached value, or null */
+    std::shared_ptr<const void> find(const key &k) {
+        if (scylla_blas::worker::operand_cache_size.load() == 0) return nullptr;
+
+        std::lock_guard lock(_mutex);
+        auto it = _index.find(k);
+        if (it == _index.end()) return nullptr;
+        _entries.splice(_entries.begin(), _entries, it->second);
+        return it->second->value;
+    }
+
+    void insert(const key &k, const std::shared_ptr<const void> &value, int64_t bytes) {
+        int64_t budget = scylla_blas::worker::operand_cache_size.load();
+        if (bytes > budget) return;
+
+        std::lock_guard lock(_mutex);
+        if (_index.contains(k)) return; /* Read concurrently by another thread */
+        _entries.push_front({k, value, bytes});
+        _index[k] = _entries.begin();
+        _bytes += bytes;
+        while (_bytes > budget) {
+            _bytes -= _entries.back().bytes;
+            _index.erase(_entries.back().k);
+            _entries.pop_back();
+        }
+    }
+};
+
+operand_cache operands_of_process;
+
+/* Reads `count` operands of a subtask (see read_blocks and read_segments) with at most read_window reads
+ * in flight, so that they take about one round trip instead of `count`. Operands found in the operand cache
+ * (if `cached`) are not read. consume is given the operands in order, each one as soon as it has arrived,
+ * so that compute overlaps the reads still in flight. on_read is given each operand read from Scylla.
+ */
+template<class V, class Pending>
+void read_in_window(size_t count, bool cached,
+                    const std::function<operand_cache::key(size_t)> &key_of,
+                    const std::function<Pending(size_t)> &issue,
+                    const std::function<void(size_t, const std::shared_ptr<const V>&)> &consume,
+                    const std::function<void(const V&)> &on_read) {
+    struct slot {
+        std::shared_ptr<const V> value; /* Null until the read arrives, unless found in the cache */
+        std::optional<Pending> pending;
+    };
+
+    std::deque<slot> slots;
+    size_t next = 0;
+    int64_t in_flight = 0;
+    for (size_t i = 0; i < count; i++) {
+        while (next < count && in_flight < scylla_blas::worker::read_window) {
+            slot s;
+            if (cached) s.value = std::static_pointer_cast<const V>(operands_of_process.find(key_of(next)));
+            if (s.value == nullptr) {
+                s.pending.emplace(issue(next));
+                in_flight++;
+            }
+            slots.push_back(std::move(s));
+            next++;
+        }
+
+        slot &s = slots.front();
+        if (s.value == nullptr) {
+            auto value = std::make_shared<const V>(s.pending->get());
+            in_flight--;
+            if (on_read) on_read(*value);
+            if (cached) operands_of_process.insert(key_of(i), value, footprint(*value));
+            s.value = value;
+        }
+        consume(i, s.value);
+        slots.pop_front();
+    }
+}
+
+/* Blocks of op(A) with given coordinates, see read_in_window */
+template<class T>
+void read_blocks(const scylla_blas::matrix<T> &A, const std::vector<std::pair<scylla_blas::index_t, scylla_blas::index_t>> &coords,
+                 scylla_blas::TRANSPOSE trans, bool cached,
+                 const std::function<void(size_t, const std::shared_ptr<const scylla_blas::matrix_block<T>>&)> &consume,
+                 const std::function<void(const scylla_blas::matrix_block<T>&)> &on_read = nullptr) {
+    using namespace scylla_blas;
+
+    read_in_window<matrix_block<T>, typename matrix<T>::pending_block>(
+        coords.size(), cached,
+        [&] (size_t i) {
+            return operand_cache::key { true, A.get_id(), A.get_version(), coords[i].first, coords[i].second, int64_t(trans), sizeof(T) };
+        },
+        [&] (size_t i) { return A.get_block_async(coords[i].first, coords[i].second, trans); },
+        consume, on_read);
+}
+
+/* Segments of X with given indexes, see read_in_window */
+template<class T>
+void read_segments(const scylla_blas::vector<T> &X, const std::vector<scylla_blas::index_t> &indexes, bool cached,
+                   const std::function<void(size_t, const std::shared_ptr<const scylla_blas::vector_segment<T>>&)> &consume) {
+    using namespace scylla_blas;
+
+    read_in_window<vector_segment<T>, typename vector<T>::pending_segment>(
+        indexes.size(), cached,
+        [&] (size_t i) { return operand_cache::key { false, X.get_id(), X.get_version(), indexes[i], 0, 0, sizeof(T) }; },
+        [&] (size_t i) { return X.get_segment_async(indexes[i]); },
+        consume, nullptr);
 }
 
 /* LEVEL 1 */
 template<class T>
-void swap(const std::shared_ptr<scmd::session> &session, const auto &task_details) {
-    scylla_blas::scylla_queue task_queue = scylla_blas::scylla_queue(session, task_details.task_queue_id);
+void swap(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, const auto &task_details) {
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
     scylla_blas::vector<T> X(session, task_details.X_id);
     scylla_blas::vector<T> Y(session, task_details.Y_id);
 
-    auto swap_segment = [&X, &Y] (scylla_blas::proto::task &subtask) {
-        scylla_blas::vector_segment<T> X_segm = X.get_segment(subtask.index);
-        scylla_blas::vector_segment<T> Y_segm = Y.get_segment(subtask.index);
-
-        X.update_segment(subtask.index, Y_segm);
-        Y.update_segment(subtask.index, X_segm);
+    using segments = std::pair<scylla_blas::vector_segment<T>, scylla_blas::vector_segment<T>>;
+    pipelined_procedure<segments> swap_segment {
+        .fetch = [&X, &Y] (const scylla_blas::proto::task &subtask) {
+            return segments(X.get_segment(subtask.index), Y.get_segment(subtask.index));
+        },
+        .compute = [&X, &Y] (scylla_blas::proto::task &subtask, segments &operands) {
+            auto &[X_segm, Y_segm] = operands;
+            X.update_segment(subtask.index, Y_segm);
+            Y.update_segment(subtask.index, X_segm);
+        }
     };
 
-    consume_tasks(task_queue, swap_segment);
+    consume_tasks(backend, *task_queue, swap_segment);
 }
 
 template<class T>
-void scal(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    scylla_blas::scylla_queue task_queue = scylla_blas::scylla_queue(session, task_details.task_queue_id);
+void scal(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
     scylla_blas::vector<T> X(session, task_details.X_id);
 
-    auto scal_segment = [&task_details, &X] (scylla_blas::proto::task &subtask) {
-        scylla_blas::vector_segment<T> X_segm = X.get_segment(subtask.index);
-        for (auto &entry : X_segm)
-            entry.value *= task_details.alpha;
+    pipelined_procedure<scylla_blas::vector_segment<T>> scal_segment {
+        .fetch = [&X] (const scylla_blas::proto::task &subtask) { return X.get_segment(subtask.index); },
+        .compute = [&task_details, &X] (scylla_blas::proto::task &subtask, scylla_blas::vector_segment<T> &X_segm) {
+            for (auto &entry : X_segm)
+                entry.value *= task_details.alpha;
 
-        X.update_segment(subtask.index, X_segm);
+            X.update_segment(subtask.index, X_segm);
+        }
     };
 
-    consume_tasks(task_queue, scal_segment);
+    consume_tasks(backend, *task_queue, scal_segment);
 }
 
 template<class T>
-void copy(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    scylla_blas::scylla_queue task_queue = scylla_blas::scylla_queue(session, task_details.task_queue_id);
+void copy(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
     scylla_blas::vector<T> X(session, task_details.X_id);
     scylla_blas::vector<T> Y(session, task_details.Y_id);
 
-    auto copy_segment = [&X, &Y] (scylla_blas::proto::task &subtask) {
-        Y.update_segment(subtask.index, X.get_segment(subtask.index));
+    pipelined_procedure<scylla_blas::vector_segment<T>> copy_segment {
+        .fetch = [&X] (const scylla_blas::proto::task &subtask) { return X.get_segment(subtask.index); },
+        .compute = [&Y] (scylla_blas::proto::task &subtask, scylla_blas::vector_segment<T> &X_segm) {
+            Y.update_segment(subtask.index, X_segm);
+        }
     };
 
-    consume_tasks(task_queue, copy_segment);
+    consume_tasks(backend, *task_queue, copy_segment);
 }
 
 template<class T>
-void axpy(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    scylla_blas::scylla_queue task_queue = scylla_blas::scylla_queue(session, task_details.task_queue_id);
+void axpy(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
     scylla_blas::vector<T> X(session, task_details.X_id);
     scylla_blas::vector<T> Y(session, task_details.Y_id);
 
-    auto axpy_segment = [&task_details, &X, &Y] (scylla_blas::proto::task &subtask) {
-        auto X_segm = X.get_segment(subtask.index);
-        auto Y_segm = Y.get_segment(subtask.index);
-
-        Y_segm = Y_segm + (X_segm * task_details.alpha);
+    using segments = std::pair<scylla_blas::vector_segment<T>, scylla_blas::vector_segment<T>>;
+    pipelined_procedure<segments> axpy_segment {
+        .fetch = [&X, &Y] (const scylla_blas::proto::task &subtask) {
+            return segments(X.get_segment(subtask.index), Y.get_segment(subtask.index));
+        },
+        .compute = [&task_details, &Y] (scylla_blas::proto::task &subtask, segments &operands) {
+            auto &[X_segm, Y_segm] = operands;
+            Y_segm = Y_segm + (X_segm * task_details.alpha);
 
-        Y.update_segment(subtask.index, Y_segm);
+            Y.update_segment(subtask.index, Y_segm);
+        }
     };
 
-    consume_tasks(task_queue, axpy_segment);
+    consume_tasks(backend, *task_queue, axpy_segment);
 }
 
 /* T -> source type;
  * U -> precision
  */
 template<class T, class U>
-U dot(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    scylla_blas::scylla_queue task_queue = scylla_blas::scylla_queue(session, task_details.task_queue_id);
+U dot(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
     scylla_blas::vector<T> X(session, task_details.X_id);
     scylla_blas::vector<T> Y(session, task_details.Y_id);
     U acc = 0;
 
-    auto dot_segment = [&X, &Y, &acc] (scylla_blas::proto::task &subtask) {
-        auto X_segm = X.get_segment(subtask.index);
-        auto Y_segm = Y.get_segment(subtask.index);
-
-        acc += X_segm.template dot_prod<U>(Y_segm);
+    using segments = std::pair<scylla_blas::vector_segment<T>, scylla_blas::vector_segment<T>>;
+    pipelined_procedure<segments> dot_segment {
+        .fetch = [&X, &Y] (const scylla_blas::proto::task &subtask) {
+            return segments(X.get_segment(subtask.index), Y.get_segment(subtask.index));
+        },
+        .compute = [&acc] (__attribute__((unused)) scylla_blas::proto::task &subtask, segments &operands) {
+            auto &[X_segm, Y_segm] = operands;
+            acc += X_segm.template dot_prod<U>(Y_segm);
+        }
     };
 
-    consume_tasks(task_queue, dot_segment);
+    consume_tasks(backend, *task_queue, dot_segment);
     return acc;
 }
 
 template<class T>
-T nrm2(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    scylla_blas::scylla_queue task_queue = scylla_blas::scylla_queue(session, task_details.task_queue_id);
+T nrm2(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
     scylla_blas::vector<T> X(session, task_details.X_id);
     T acc = 0;
 
-    auto nrm2_segment = [&X, &acc] (scylla_blas::proto::task &subtask) {
-        acc += X.get_segment(subtask.index).mod2();
+    pipelined_procedure<scylla_blas::vector_segment<T>> nrm2_segment {
+        .fetch = [&X] (const scylla_blas::proto::task &subtask) { return X.get_segment(subtask.index); },
+        .compute = [&acc] (__attribute__((unused)) scylla_blas::proto::task &subtask, scylla_blas::vector_segment<T> &X_segm) {
+            acc += X_segm.mod2();
+        }
     };
 
-    consume_tasks(task_queue, nrm2_segment);
+    consume_tasks(backend, *task_queue, nrm2_segment);
     return acc;
 }
 
 template<class T>
-T asum(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    scylla_blas::scylla_queue task_queue = scylla_blas::scylla_queue(session, task_details.task_queue_id);
+T asum(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
     scylla_blas::vector<T> X(session, task_details.X_id);
     T acc = 0;
 
-    auto nrm2_segment = [&X, &acc] (scylla_blas::proto::task &subtask) {
-        for (auto &val : X.get_segment(subtask.index)) {
-            acc += std::abs(val.value);
+    pipelined_procedure<scylla_blas::vector_segment<T>> asum_segment {
+        .fetch = [&X] (const scylla_blas::proto::task &subtask) { return X.get_segment(subtask.index); },
+        .compute = [&acc] (__attribute__((unused)) scylla_blas::proto::task &subtask, scylla_blas::vector_segment<T> &X_segm) {
+            for (auto &val : X_segm) {
+                acc += std::abs(val.value);
+            }
         }
     };
 
-    consume_tasks(task_queue, nrm2_segment);
+    consume_tasks(backend, *task_queue, asum_segment);
     return acc;
 }
 
 template<class T>
-std::pair<scylla_blas::index_t, T> iamax(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    scylla_blas::scylla_queue task_queue = scylla_blas::scylla_queue(session, task_details.task_queue_id);
+std::pair<scylla_blas::index_t, T> iamax(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
     scylla_blas::vector<T> X(session, task_details.X_id);
     T max_abs = 0;
     scylla_blas::index_t imax = 0;
 
-    auto iamax_segment = [&X, &max_abs, &imax] (scylla_blas::proto::task &subtask) {
-        scylla_blas::index_t offset = X.get_segment_offset(subtask.index);
-
-        for (auto &val : X.get_segment(subtask.index)) {
-            if (std::abs(val.value) > max_abs) {
-                max_abs = std::abs(val.value);
-                imax = val.index + offset;
-            } else if (std::abs(val.value) == max_abs) {
-                imax = std::min(imax, val.index + offset);
+    pipelined_procedure<scylla_blas::vector_segment<T>> iamax_segment {
+        .fetch = [&X] (const scylla_blas::proto::task &subtask) { return X.get_segment(subtask.index); },
+        .compute = [&X, &max_abs, &imax] (scylla_blas::proto::task &subtask, scylla_blas::vector_segment<T> &X_segm) {
+            scylla_blas::index_t offset = X.get_segment_offset(subtask.index);
+
+            for (auto &val : X_segm) {
+                if (std::abs(val.value) > max_abs) {
+                    max_abs = std::abs(val.value);
+                    imax = val.index + offset;
+                } else if (std::abs(val.value) == max_abs) {
+                    imax = std::min(imax, val.index + offset);
+                }
             }
         }
     };
 
-    consume_tasks(task_queue, iamax_segment);
+    consume_tasks(backend, *task_queue, iamax_segment);
     return { imax, max_abs };
 }
 
+/* A single pass over the segments of X, and of Y and Z if the steps (see proto::fused_op) use them.
+ * Operands are read once per segment: Z aliasing a vector written in the pass is taken from memory,
+ * and Y is not read at all when it is only overwritten (beta == 0).
+ */
+template<class T>
+T fused_vector(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    using namespace scylla_blas;
+
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
+    bool scales = task_details.ops & proto::FUSED_SCALE;
+    bool updates = task_details.ops & proto::FUSED_UPDATE;
+    bool dots = task_details.ops & proto::FUSED_DOT;
+    bool Z_is_X = task_details.Z_id == task_details.X_id;
+    bool Z_is_Y = updates && task_details.Z_id == task_details.Y_id;
+
+    vector<T> X(session, task_details.X_id);
+    std::optional<vector<T>> Y, Z;
+    if (updates) Y.emplace(session, task_details.Y_id);
+    if (dots && !Z_is_X && !Z_is_Y) Z.emplace(session, task_details.Z_id);
+    T acc = 0;
+
+    struct segments {
+        vector_segment<T> X, Y, Z;
+    };
+    pipelined_procedure<segments> fused_segment {
+        .fetch = [&X, &Y, &Z, &task_details] (const proto::task &subtask) {
+            segments ret;
+            ret.X = X.get_segment(subtask.index);
+            if (Y.has_value() && task_details.beta != 0) ret.Y = Y->get_segment(subtask.index);
+            if (Z.has_value()) ret.Z = Z->get_segment(subtask.index);
+            return ret;
+        },
+        .compute = [&, scales, updates, dots] (proto::task &subtask, segments &operands) {
+            if (scales) {
+                operands.X = operands.X * task_details.scale;
+                X.update_segment(subtask.index, operands.X);
+            }
+            if (updates) {
+                operands.Y = operands.Y * task_details.beta + operands.X * task_details.alpha;
+                Y->update_segment(subtask.index, operands.Y);
+            }
+            if (dots) {
+                const vector_segment<T> &last = updates ? operands.Y : operands.X;
+                const vector_segment<T> &other = Z_is_X ? operands.X : (Z_is_Y ? operands.Y : operands.Z);
+                acc += last.template dot_prod<T>(other);
+            }
+        }
+    };
+
+    consume_tasks(backend, *task_queue, fused_segment);
+    return acc;
+}
+
 /* LEVEL 2 */
+/* on_result, if set, is given each segment of Y once it is written */
 template<class T>
-void gemv(const std::shared_ptr<scmd::session> &session, auto &task_details) {
+void gemv(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details,
+          const std::function<void(scylla_blas::index_t, const scylla_blas::vector_segment<T>&)> &on_result = nullptr) {
     LogTrace("(gemv) Start");
     using namespace scylla_blas;
 
     matrix<T> A(session, task_details.A_id);
     vector<T> X(session, task_details.X_id);
     vector<T> Y(session, task_details.Y_id);
-    scylla_queue task_queue = scylla_queue(session, task_details.task_queue_id);
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
 
-    auto compute_result_segment = [&A, &X, &Y, &task_details] (proto::task &subtask) {
+    /* A and X (unless it is Y) are read-only, but within a dataflow plan upstream routines may write them
+     * after the versions were read, so they are cached only without upstream queues.
+     */
+    bool cached = task_queue->get_upstream().empty();
+    bool X_cached = cached && task_details.X_id != task_details.Y_id;
+
+    auto compute_result_segment = [&A, &X, &Y, &task_details, &on_result, cached, X_cached] (proto::task &subtask) {
         index_t prod_segments = A.get_blocks_width(task_details.TransA);
-        vector_segment result = Y.get_segment(subtask.index) * task_details.beta;
+        auto Y_read = Y.get_segment_async(subtask.index);
 
-        /* Prefetch the entire vector trying to minimize the number
-         * of read conflicts with the other workers.
-         *
-         * TODO: perhaps controlling the order of iteration like this:
-         *
-         * for(index_t i : iteration(subtask.index, segment_count))
-         *
-         * ...and interleaving it with vector reads would be
-         * preferable to trying to fetch the entire vector at once.
+        /* Prefetch the entire vector, starting from the segment of the subtask,
+         * trying to minimize the number of read conflicts with the other workers.
          */
-        scylla_blas::index_t segment_count = Y.get_segment_count();
-        std::vector<vector_segment<T>> segments(segment_count);
-        size_t segment_idx = subtask.index;
-        do {
-            segment_idx %= (segment_count);
-            segments[segment_idx] = X.get_segment(segment_idx + 1);
-            segment_idx = (segment_idx + 1);
-        } while(segment_idx != subtask.index );
+        std::vector<index_t> X_indexes;
+        for (index_t i = 0; i < prod_segments; i++) {
+            X_indexes.push_back((subtask.index - 1 + i) % prod_segments + 1);
+        }
+        std::vector<std::shared_ptr<const vector_segment<T>>> segments(prod_segments + 1);
+        read_segments<T>(X, X_indexes, X_cached, [&] (size_t i, const std::shared_ptr<const vector_segment<T>> &segment) {
+            segments[X_indexes[i]] = segment;
+        });
 
+        /* Blocks of A are multiplied as they arrive */
+        std::vector<std::pair<index_t, index_t>> A_coords;
         for (index_t i = 1; i <= prod_segments; i++) {
-            matrix_block<T> block_A = A.get_block(subtask.index, i, task_details.TransA);
-            vector_segment<T> &segment_X = segments[i - 1];
-
-            result += block_A.mult_vect(segment_X) * task_details.alpha;
+            A_coords.emplace_back(subtask.index, i);
         }
+        vector_segment result = Y_read.get() * task_details.beta;
+        read_blocks<T>(A, A_coords, task_details.TransA, cached, [&] (size_t i, const std::shared_ptr<const matrix_block<T>> &block_A) {
+            result += block_A->mult_vect(*segments[i + 1]) * task_details.alpha;
+        });
 
         Y.update_segment(subtask.index, result);
+        if (on_result) on_result(subtask.index, result);
     };
 
-    consume_tasks(task_queue, compute_result_segment);
+    consume_tasks(backend, *task_queue, compute_result_segment);
+}
+
+/* gemv, with the dot product of each computed segment of Y with the segment of Z. Z aliasing Y is not read. */
+template<class T>
+T gemv_dot(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    using namespace scylla_blas;
+
+    std::optional<vector<T>> Z;
+    if (task_details.Z_id != task_details.Y_id) Z.emplace(session, task_details.Z_id);
+    T acc = 0;
+
+    gemv<T>(session, backend, task_details, [&Z, &acc] (index_t index, const vector_segment<T> &Y_segm) {
+        acc += Y_segm.template dot_prod<T>(Z.has_value() ? Z->get_segment(index) : Y_segm);
+    });
+    return acc;
 }
 
 template<class T>
-void gbmv(const std::shared_ptr<scmd::session> &session, auto &task_details) {
+void gbmv(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
     using namespace scylla_blas;
 
     matrix<T> A(session, task_details.A_id);
     vector<T> X(session, task_details.X_id);
     vector<T> Y(session, task_details.Y_id);
-    scylla_queue task_queue = scylla_queue(session, task_details.task_queue_id);
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
 
     auto compute_result_segment = [&A, &X, &Y, &task_details] (proto::task &subtask) {
         auto [start, end] = A.get_banded_block_limits_for_row(subtask.index, task_details.KL, task_details.KU, task_details.TransA);
@@ -265,11 +1118,11 @@ void gbmv(const std::shared_ptr<scmd::session> &session, auto &task_details) {
         Y.update_segment(subtask.index, result);
     };
 
-    consume_tasks(task_queue, compute_result_segment);
+    consume_tasks(backend, *task_queue, compute_result_segment);
 }
 
 template<class T>
-std::pair<T, T> tsv_generic(const std::shared_ptr<scmd::session> &session,
+std::pair<T, T> tsv_generic(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend,
                             auto &task_details, auto get_right_limit_for_row) {
     /* Based on Jacobi method and Gauss-Seidel method – no difference between the two
      * as the matrix is triangular, i.e. L = 0 (or U = 0 if it is lower-triangular).
@@ -279,7 +1132,7 @@ std::pair<T, T> tsv_generic(const std::shared_ptr<scmd::session> &session,
     matrix<T> A(session, task_details.A_id);
     vector<T> b(session, task_details.X_id);
     vector<T> X(session, task_details.Y_id);
-    scylla_queue task_queue = scylla_queue(session, task_details.task_queue_id);
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
 
     T diff = 0, total = 0;
 
@@ -320,34 +1173,34 @@ std::pair<T, T> tsv_generic(const std::shared_ptr<scmd::session> &session,
         X.update_segment(subtask.index, result_segment);
     };
 
-    consume_tasks(task_queue, compute_result_segment);
+    consume_tasks(backend, *task_queue, compute_result_segment);
     return {diff, total};
 }
 
 template<class T>
-std::pair<T, T> trsv(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    return tsv_generic<T>(session, task_details,
+std::pair<T, T> trsv(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    return tsv_generic<T>(session, backend, task_details,
                           [&task_details](const scylla_blas::matrix<T> &A, scylla_blas::index_t row) {
                               return A.get_blocks_width(task_details.TransA);
                           });
 }
 
 template<class T>
-std::pair<T, T> tbsv(const std::shared_ptr<scmd::session> &session, auto &task_details) {
-    return tsv_generic<T>(session, task_details,
+std::pair<T, T> tbsv(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
+    return tsv_generic<T>(session, backend, task_details,
                           [&task_details](const scylla_blas::matrix<T> &A, scylla_blas::index_t row) {
                               return A.get_banded_block_limits_for_row(row, 0, task_details.KU, task_details.TransA).second;
                           });
 }
 
 template<class T>
-void ger(const std::shared_ptr<scmd::session> &session, auto &task_details) {
+void ger(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
     using namespace scylla_blas;
 
     vector<T> X(session, task_details.X_id);
     vector<T> Y(session, task_details.Y_id);
     matrix<T> A(session, task_details.A_id);
-    scylla_queue task_queue = scylla_queue(session, task_details.task_queue_id);
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
 
     auto compute_product_block = [&X, &Y, &A, &task_details] (proto::task &subtask) {
         auto [row, column] = subtask.coord;
@@ -358,43 +1211,142 @@ void ger(const std::shared_ptr<scmd::session> &session, auto &task_details) {
 
         matrix_block computed = matrix_block<T>::outer_prod(seg_X, seg_Y) * task_details.alpha + result_block;
 
-        A.insert_block(row, column, computed);
+        A.insert_whole_block(row, column, computed);
     };
 
-    consume_tasks(task_queue, compute_product_block);
+    consume_tasks(backend, *task_queue, compute_product_block);
 }
 
+/* Lines of blocks (e.g. block rows of a matrix) most recently read by a main task, at most `capacity` of them.
+ * Subtasks placed close to each other (see task_range::task_of) share lines, which are then read once,
+ * not once per subtask. A line is read by the first subtask that needs it, others wait for that read.
+ */
+template<class T>
+class block_line_cache {
+    using line = std::vector<scylla_blas::matrix_block<T>>;
+    using entry = std::pair<scylla_blas::index_t, std::shared_future<std::shared_ptr<const line>>>;
+
+    size_t _capacity;
+    std::mutex _mutex;
+    std::list<entry> _lines; /* The most recently used first */
+
+public:
+    explicit block_line_cache(size_t capacity) : _capacity(capacity) {}
+
+    std::shared_ptr<const line> get(scylla_blas::index_t key, const std::function<line()> &read) {
+        if (_capacity == 0) return std::make_shared<const line>(read());
+
+        std::shared_future<std::shared_ptr<const line>> result;
+        {
+            std::lock_guard lock(_mutex);
+            auto it = std::find_if(_lines.begin(), _lines.end(), [key](const entry &e) { return e.first == key; });
+            if (it != _lines.end()) {
+                _lines.splice(_lines.begin(), _lines, it);
+            } else {
+                _lines.emplace_front(key, std::async(std::launch::deferred, [read] {
+                    return std::make_shared<const line>(read());
+                }).share());
+                if (_lines.size() > _capacity) _lines.pop_back();
+            }
+            result = _lines.front().second;
+        }
+
+        try {
+            return result.get();
+        } catch (...) {
+            /* Don't keep a failed read, the retry of the subtask has to read the line again */
+            std::lock_guard lock(_mutex);
+            std::erase_if(_lines, [key](const entry &e) { return e.first == key; });
+            throw;
+        }
+    }
+};
+
 /* LEVEL 3 */
 template<class T>
-void gemm(const std::shared_ptr<scmd::session> &session, auto &task_details) {
+scylla_blas::proto::response gemm(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
     using namespace scylla_blas;
 
     matrix<T> A(session, task_details.A_id);
     matrix<T> B(session, task_details.B_id);
     matrix<T> C(session, task_details.C_id);
-    scylla_queue task_queue = scylla_queue(session, task_details.task_queue_id);
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
 
-    auto compute_result_block = [&A, &B, &C, &task_details] (proto::task &subtask) {
-        auto [row, column] = subtask.coord;
+    /* All blocks of a subtask are read ahead, so prefetch_depth bounds how many rows of A and columns of B are held
+     * on top of the cached ones. Rows and columns are cached only if C is neither of the operands, and their blocks
+     * are also kept in the operand cache of the process, unless upstream routines of a dataflow plan may write them.
+     */
+    using line = std::vector<matrix_block<T>>;
+    struct operands {
+        matrix_block<T> C_block;
+        std::shared_ptr<const line> A_row;
+        std::shared_ptr<const line> B_column;
+    };
 
-        index_t blocks_to_multiply = A.get_blocks_width(task_details.TransA);
-        matrix_block result_block = C.get_block(row, column) * task_details.beta;
+    bool in_place = task_details.C_id == task_details.A_id || task_details.C_id == task_details.B_id;
+    block_line_cache<T> A_rows(in_place ? 0 : GEMM_CACHED_LINES);
+    block_line_cache<T> B_columns(in_place ? 0 : GEMM_CACHED_LINES);
+    bool cached = !in_place && task_queue->get_upstream().empty();
+    std::atomic<int64_t> blocks_read = 0, bytes_read = 0;
 
-        for (index_t i = 1; i <= blocks_to_multiply; i++) {
-            matrix_block block_A = A.get_block(row, i, task_details.TransA);
-            matrix_block block_B = B.get_block(i, column, task_details.TransB);
+    /* Only blocks read from Scylla are counted, not the ones found in the operand cache */
+    std::function<void(const matrix_block<T>&)> count_read = [&blocks_read, &bytes_read] (const matrix_block<T> &block) {
+        blocks_read++;
+        bytes_read += block.get_values_raw().size() * sizeof(matrix_value<T>);
+    };
 
-            result_block += block_A * block_B * task_details.alpha;
-        }
+    /* All blocks of a line are read at once, see read_in_window */
+    auto read_line = [&cached, &count_read] (const matrix<T> &M, std::vector<std::pair<index_t, index_t>> &&coords,
+                                            TRANSPOSE trans) {
+        line ret;
+        ret.reserve(coords.size());
+        read_blocks<T>(M, coords, trans, cached, [&ret] (size_t, const std::shared_ptr<const matrix_block<T>> &block) {
+            ret.push_back(*block);
+        }, count_read);
+        return ret;
+    };
+
+    pipelined_procedure<operands> compute_result_block {
+        .fetch = [&] (const proto::task &subtask) {
+            auto [row, column] = subtask.coord;
+
+            index_t blocks_to_multiply = A.get_blocks_width(task_details.TransA);
+            auto C_read = C.get_block_async(row, column);
+
+            auto A_row = A_rows.get(row, [&, row, blocks_to_multiply] {
+                std::vector<std::pair<index_t, index_t>> coords;
+                for (index_t i = 1; i <= blocks_to_multiply; i++) coords.emplace_back(row, i);
+                return read_line(A, std::move(coords), task_details.TransA);
+            });
+            auto B_column = B_columns.get(column, [&, column, blocks_to_multiply] {
+                std::vector<std::pair<index_t, index_t>> coords;
+                for (index_t i = 1; i <= blocks_to_multiply; i++) coords.emplace_back(i, column);
+                return read_line(B, std::move(coords), task_details.TransB);
+            });
+
+            return operands { .C_block = C_read.get(), .A_row = A_row, .B_column = B_column };
+        },
+        .compute = [&C, &task_details] (proto::task &subtask, operands &blocks) {
+            auto [row, column] = subtask.coord;
+
+            matrix_block result_block = blocks.C_block * task_details.beta;
+
+            for (size_t i = 0; i < blocks.A_row->size(); i++) {
+                result_block += (*blocks.A_row)[i] * (*blocks.B_column)[i] * task_details.alpha;
+            }
 
-        C.insert_block(row, column, result_block);
+            C.insert_whole_block(row, column, result_block);
+        }
     };
 
-    consume_tasks(task_queue, compute_result_block);
+    consume_tasks(backend, *task_queue, compute_result_block);
+
+    LogDebug("gemm read {} blocks of A and B, {} bytes", blocks_read.load(), bytes_read.load());
+    return { .type = proto::R_READS, .result_reads { .blocks = blocks_read.load(), .bytes = bytes_read.load() } };
 }
 
 template<class T>
-void syrk_generic(const std::shared_ptr<scmd::session> &session,
+void syrk_generic(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend,
                   const scylla_blas::matrix<T> &A,
                   const scylla_blas::matrix<T> &B,
                   scylla_blas::matrix<T> &C,
@@ -402,7 +1354,7 @@ void syrk_generic(const std::shared_ptr<scmd::session> &session,
 
     using namespace scylla_blas;
 
-    scylla_queue task_queue = scylla_queue(session, task_details.task_queue_id);
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
 
     auto compute_result_block = [&A, &B, &C, scaling, &task_details] (proto::task &subtask) {
         auto [row, column] = subtask.coord;
@@ -419,37 +1371,37 @@ void syrk_generic(const std::shared_ptr<scmd::session> &session,
             result_block += (block_left_A * block_left_B + block_right_B * block_right_A) * (task_details.alpha * scaling);
         }
 
-        C.insert_block(row, column, result_block);
+        C.insert_whole_block(row, column, result_block);
     };
 
-    consume_tasks(task_queue, compute_result_block);
+    consume_tasks(backend, *task_queue, compute_result_block);
 }
 
 template<class T>
-void syrk(const std::shared_ptr<scmd::session> &session, auto &task_details) {
+void syrk(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
     scylla_blas::matrix<T> A(session, task_details.A_id);
     scylla_blas::matrix<T> C(session, task_details.C_id);
 
-    syrk_generic<T>(session, A, A, C, 0.5, task_details);
+    syrk_generic<T>(session, backend, A, A, C, 0.5, task_details);
 }
 
 template<class T>
-void syr2k(const std::shared_ptr<scmd::session> &session, auto &task_details) {
+void syr2k(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
     scylla_blas::matrix<T> A(session, task_details.A_id);
     scylla_blas::matrix<T> B(session, task_details.B_id);
     scylla_blas::matrix<T> C(session, task_details.C_id);
 
-    syrk_generic<T>(session, A, B, C, 1, task_details);
+    syrk_generic<T>(session, backend, A, B, C, 1, task_details);
 }
 
 /* MISC */
 template<class T>
-void rvgen(const std::shared_ptr<scmd::session> &session, auto &task_details) {
+void rvgen(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
     /* TOOD: unify with rmgen? */
     using namespace scylla_blas;
 
     vector<T> X(session, task_details.structure_id);
-    scylla_queue task_queue = scylla_queue(session, task_details.task_queue_id);
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
 
     auto generate_block = [&X, &task_details] (proto::task &subtask) {
         index_t segment_id = subtask.index;
@@ -472,15 +1424,15 @@ void rvgen(const std::shared_ptr<scmd::session> &session, auto &task_details) {
         X.insert_segment(segment_id, values);
     };
 
-    consume_tasks(task_queue, generate_block);
+    consume_tasks(backend, *task_queue, generate_block);
 }
 
 template<class T>
-void rmgen(const std::shared_ptr<scmd::session> &session, auto &task_details) {
+void rmgen(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, auto &task_details) {
     using namespace scylla_blas;
 
     matrix<T> A(session, task_details.structure_id);
-    scylla_queue task_queue = scylla_queue(session, task_details.task_queue_id);
+    auto task_queue = backend.open_queue(task_details.task_queue_id);
 
     auto generate_block = [&A, &task_details] (proto::task &subtask) {
         auto [row, column] = subtask.coord;
@@ -510,207 +1462,417 @@ void rmgen(const std::shared_ptr<scmd::session> &session, auto &task_details) {
         A.insert_block(row, column, block);
     };
 
-    consume_tasks(task_queue, generate_block);
+    consume_tasks(backend, *task_queue, generate_block);
 }
 
 }
 
 #define DEFINE_WORKER_FUNCTION(function_name, function_body) \
 std::optional<scylla_blas::proto::response> \
-scylla_blas::worker::function_name(const std::shared_ptr<scmd::session> &session, const scylla_blas::proto::task &task) function_body
+scylla_blas::worker::function_name(const std::shared_ptr<scmd::session> &session, scylla_blas::queue_backend &backend, const scylla_blas::proto::task &task) function_body
 
 DEFINE_WORKER_FUNCTION(sswap, {
-    swap<float>(session, task.vector_task_float);
+    swap<float>(session, backend, task.vector_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(sscal, {
-    scal<float>(session, task.vector_task_float);
+    scal<float>(session, backend, task.vector_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(scopy, {
-    copy<float>(session, task.vector_task_float);
+    copy<float>(session, backend, task.vector_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(saxpy, {
-    axpy<float>(session, task.vector_task_float);
+    axpy<float>(session, backend, task.vector_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(sdot, {
-    float result = (dot<float, float>(session, task.vector_task_float));
-    return proto::response{ .result_float = result };
+    float result = (dot<float, float>(session, backend, task.vector_task_float));
+    return (proto::response{ .type = proto::R_FLOAT, .result_float = result });
 })
 
 DEFINE_WORKER_FUNCTION(sdsdot, {
-    double result = (dot<float, double>(session, task.vector_task_float));
-    return proto::response{ .result_double = result };
+    double result = (dot<float, double>(session, backend, task.vector_task_float));
+    return (proto::response{ .type = proto::R_DOUBLE, .result_double = result });
 })
 
 DEFINE_WORKER_FUNCTION(snrm2, {
-    float result = nrm2<float>(session, task.vector_task_float);
-    return proto::response{ .result_float = result };
+    float result = nrm2<float>(session, backend, task.vector_task_float);
+    return (proto::response{ .type = proto::R_FLOAT, .result_float = result });
 })
 
 DEFINE_WORKER_FUNCTION(sasum, {
-    float result = asum<float>(session, task.vector_task_float);
-    return proto::response{ .result_float = result };
+    float result = asum<float>(session, backend, task.vector_task_float);
+    return (proto::response{ .type = proto::R_FLOAT, .result_float = result });
 })
 
 DEFINE_WORKER_FUNCTION(isamax, {
-    auto result = iamax<float>(session, task.vector_task_float);
-    return (proto::response{ .result_max_float_index { .index = result.first, .value = result.second }});
+    auto result = iamax<float>(session, backend, task.vector_task_float);
+    return (proto::response{ .type = proto::R_FLOAT_INDEX_VALUE, .result_max_float_index { .index = result.first, .value = result.second }});
 })
 
 DEFINE_WORKER_FUNCTION(dswap, {
-    swap<double>(session, task.vector_task_double);
+    swap<double>(session, backend, task.vector_task_double);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(dscal, {
-    scal<double>(session, task.vector_task_double);
+    scal<double>(session, backend, task.vector_task_double);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(dcopy, {
-    copy<double>(session, task.vector_task_double);
+    copy<double>(session, backend, task.vector_task_double);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(daxpy, {
-    axpy<double>(session, task.vector_task_double);
+    axpy<double>(session, backend, task.vector_task_double);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(ddot, {
-    double result = (dot<double, double>(session, task.vector_task_double));
-    return proto::response{ .result_double = result };
+    double result = (dot<double, double>(session, backend, task.vector_task_double));
+    return (proto::response{ .type = proto::R_DOUBLE, .result_double = result });
 })
 
 DEFINE_WORKER_FUNCTION(dsdot, {
-    double result = (dot<float, double>(session, task.vector_task_double));
-    return proto::response{ .result_double = result };
+    double result = (dot<float, double>(session, backend, task.vector_task_double));
+    return (proto::response{ .type = proto::R_DOUBLE, .result_double = result });
 })
 
 DEFINE_WORKER_FUNCTION(dnrm2, {
-    double result = (nrm2<double>(session, task.vector_task_double));
-    return proto::response{ .result_double = result };
+    double result = (nrm2<double>(session, backend, task.vector_task_double));
+    return (proto::response{ .type = proto::R_DOUBLE, .result_double = result });
 })
 
 DEFINE_WORKER_FUNCTION(dasum, {
-    double result = (asum<double>(session, task.vector_task_double));
-    return proto::response{ .result_double = result };
+    double result = (asum<double>(session, backend, task.vector_task_double));
+    return (proto::response{ .type = proto::R_DOUBLE, .result_double = result });
 })
 
 DEFINE_WORKER_FUNCTION(idamax, {
-    auto result = iamax<double>(session, task.vector_task_double);
-    return (proto::response{ .result_max_double_index { .index = result.first, .value = result.second }});
+    auto result = iamax<double>(session, backend, task.vector_task_double);
+    return (proto::response{ .type = proto::R_DOUBLE_INDEX_VALUE, .result_max_double_index { .index = result.first, .value = result.second }});
 })
 
 /* LEVEL 2 */
 DEFINE_WORKER_FUNCTION(sgemv, {
-    gemv<float>(session, task.mixed_task_float);
+    gemv<float>(session, backend, task.mixed_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(dgemv, {
-    gemv<double>(session, task.mixed_task_double);
+    gemv<double>(session, backend, task.mixed_task_double);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(sgbmv, {
-    gbmv<float>(session, task.mixed_task_float);
+    gbmv<float>(session, backend, task.mixed_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(dgbmv, {
-    gbmv<double>(session, task.mixed_task_double);
+    gbmv<double>(session, backend, task.mixed_task_double);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(strsv, {
-    auto result = trsv<float>(session, task.mixed_task_float);
-    return (proto::response{ .result_float_pair = { .first = result.first, .second = result.second } });
+    auto result = trsv<float>(session, backend, task.mixed_task_float);
+    return (proto::response{ .type = proto::R_FLOAT_PAIR, .result_float_pair = { .first = result.first, .second = result.second } });
 })
 
 DEFINE_WORKER_FUNCTION(dtrsv, {
-    auto result = trsv<double>(session, task.mixed_task_double);
-    return (proto::response{ .result_double_pair = { .first = result.first, .second = result.second } });
+    auto result = trsv<double>(session, backend, task.mixed_task_double);
+    return (proto::response{ .type = proto::R_DOUBLE_PAIR, .result_double_pair = { .first = result.first, .second = result.second } });
 })
 
 DEFINE_WORKER_FUNCTION(stbsv, {
-    auto result = tbsv<float>(session, task.mixed_task_float);
-    return (proto::response{ .result_float_pair = { .first = result.first, .second = result.second } });
+    auto result = tbsv<float>(session, backend, task.mixed_task_float);
+    return (proto::response{ .type = proto::R_FLOAT_PAIR, .result_float_pair = { .first = result.first, .second = result.second } });
 })
 
 DEFINE_WORKER_FUNCTION(dtbsv, {
-    auto result = tbsv<double>(session, task.mixed_task_double);
-    return (proto::response{ .result_double_pair = { .first = result.first, .second = result.second } });
+    auto result = tbsv<double>(session, backend, task.mixed_task_double);
+    return (proto::response{ .type = proto::R_DOUBLE_PAIR, .result_double_pair = { .first = result.first, .second = result.second } });
 })
 
 DEFINE_WORKER_FUNCTION(sger, {
-    ger<float>(session, task.mixed_task_float);
+    ger<float>(session, backend, task.mixed_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(dger, {
-    ger<double>(session, task.mixed_task_double);
+    ger<double>(session, backend, task.mixed_task_double);
     return std::nullopt;
 })
 /* LEVEL 3 */
 
 DEFINE_WORKER_FUNCTION(sgemm, {
-    gemm<float>(session, task.matrix_task_float);
-    return std::nullopt;
+    return gemm<float>(session, backend, task.matrix_task_float);
 })
 
 DEFINE_WORKER_FUNCTION(dgemm, {
-    gemm<double>(session, task.matrix_task_double);
-    return std::nullopt;
+    return gemm<double>(session, backend, task.matrix_task_double);
 })
 
 DEFINE_WORKER_FUNCTION(ssyrk, {
-    syrk<float>(session, task.matrix_task_float);
+    syrk<float>(session, backend, task.matrix_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(dsyrk, {
-    syrk<double>(session, task.matrix_task_double);
+    syrk<double>(session, backend, task.matrix_task_double);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(ssyr2k, {
-    syr2k<float>(session, task.matrix_task_float);
+    syr2k<float>(session, backend, task.matrix_task_float);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(dsyr2k, {
-    syr2k<double>(session, task.matrix_task_double);
+    syr2k<double>(session, backend, task.matrix_task_double);
     return std::nullopt;
 })
 
+/* FUSED */
+
+DEFINE_WORKER_FUNCTION(sfused_vector, {
+    auto result = fused_vector<float>(session, backend, task.fused_vector_task_float);
+    return (proto::response{ .type = proto::R_FLOAT, .result_float = result });
+})
+
+DEFINE_WORKER_FUNCTION(dfused_vector, {
+    auto result = fused_vector<double>(session, backend, task.fused_vector_task_double);
+    return (proto::response{ .type = proto::R_DOUBLE, .result_double = result });
+})
+
+DEFINE_WORKER_FUNCTION(sgemv_dot, {
+    auto result = gemv_dot<float>(session, backend, task.gemv_dot_task_float);
+    return (proto::response{ .type = proto::R_FLOAT, .result_float = result });
+})
+
+DEFINE_WORKER_FUNCTION(dgemv_dot, {
+    auto result = gemv_dot<double>(session, backend, task.gemv_dot_task_double);
+    return (proto::response{ .type = proto::R_DOUBLE, .result_double = result });
+})
+
 /* MISC */
 
 DEFINE_WORKER_FUNCTION(srvgen, {
-    rvgen<float>(session, task.generation_task);
+    rvgen<float>(session, backend, task.generation_task);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(drvgen, {
-    rvgen<double>(session, task.generation_task);
+    rvgen<double>(session, backend, task.generation_task);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(srmgen, {
-    rmgen<float>(session, task.generation_task);
+    rmgen<float>(session, backend, task.generation_task);
     return std::nullopt;
 })
 
 DEFINE_WORKER_FUNCTION(drmgen, {
-    rmgen<double>(session, task.generation_task);
+    rmgen<double>(session, backend, task.generation_task);
     return std::nullopt;
 })
 
-#undef DEFINE_WORKER_FUNCTION
\ No newline at end of file
+#undef DEFINE_WORKER_FUNCTION
+void scylla_blas::worker::run_worker(const std::shared_ptr<scmd::session> &session, queue_backend &backend,
+                                     int64_t sleep_time, const std::atomic<bool> &stop) {
+    LogInfo("Starting worker loop, priority weights: {}, {}, {}...",
+            priority_weights[INTERACTIVE], priority_weights[NORMAL], priority_weights[BATCH]);
+    main_queue_selector main_queues(backend);
+    worker_heartbeat heartbeat(backend);
+    LogInfo("Registered as worker {}", heartbeat.get_id());
+    while (!stop.load()) {
+        maybe_log_metrics();
+
+        std::optional<std::tuple<std::shared_ptr<task_queue>, int64_t, scylla_blas::proto::task>> opt;
+        try {
+            opt = main_queues.consume();
+        } catch (const std::exception &e) {
+            LogWarn("Exception while fetching main task: {}, retrying", e.what());
+            scylla_blas::wait_microseconds(sleep_time);
+            continue;
+        }
+        bool is_backup = false;
+        if (!opt.has_value() && speculative_execution) {
+            try {
+                opt = main_queues.claim_stale(task_lease_time, is_speculation_safe);
+                is_backup = opt.has_value();
+            } catch (const std::exception &e) {
+                LogWarn("Exception while looking for stale tasks: {}", e.what());
+            }
+        }
+        if (!opt.has_value()) {
+            scylla_blas::wait_microseconds(sleep_time);
+            continue;
+        }
+        auto [base_queue, task_id, task_data] = opt.value();
+        if (is_backup) {
+            LogInfo("Re-executing stale task {} of queue {}", task_id, base_queue->get_id());
+        } else {
+            LogInfo("A new task received! task_id: {}, queue: {}", task_id, base_queue->get_id());
+        }
+
+        current_task = leased_task{};
+        if (speculative_execution && is_speculation_safe(task_data)) {
+            current_task = leased_task{ base_queue.get(), task_id, 0, is_backup };
+            if (!is_backup) {
+                report_progress();
+            }
+        }
+
+        /* Versions of the structures written by the task are bumped once it is done, before it is reported */
+        version_bump_scope bumps;
+        int64_t attempts;
+        for (attempts = 0; attempts <= max_worker_retries; attempts++) {
+            /* Keep trying until the task is finished – otherwise it will be lost and never marked as finished */
+            /* TODO: scylla_queue.mark_as_failed()? */
+            try {
+                procedure_t& proc = get_procedure_for_task(task_data);
+                std::optional<scylla_blas::proto::response> result;
+                try {
+                    /* A partial result to be returned is tagged with its variant by the procedure */
+                    result = proc(session, backend, task_data);
+                } catch (const task_cancelled_exception &e) {
+                    /* The scheduler learns that the partial results of the routine are incomplete */
+                    LogInfo("Task {} was cancelled", task_id);
+                    result = scylla_blas::proto::response{ .type = scylla_blas::proto::R_CANCELLED, .simple { .response = 0 } };
+                }
+
+                bumps.flush();
+                if (result.has_value()) {
+                    base_queue->mark_as_finished(task_id, result.value());
+                } else {
+                    base_queue->mark_as_finished(task_id);
+                }
+
+                break;
+            } catch (const subtask_failed_exception &e) {
+                LogError("Subtask of task {} failed. Abandoning task", task_id);
+                attempts = max_worker_retries + 1;
+                break;
+            } catch (const std::exception &e) {
+                LogWarn("Task {} failed. Reason: {}. Retrying...", task_id, e.what());
+            }
+        }
+
+        current_task = leased_task{};
+        try {
+            /* Writes of an abandoned task were made all the same */
+            bumps.flush();
+        } catch (const std::exception &e) {
+            LogWarn("Failed to bump versions of the structures written by task {}: {}", task_id, e.what());
+        }
+
+        if (attempts <= max_worker_retries) {
+            LogInfo("Task {} completed succesfully.", task_id);
+        } else {
+            LogError("Abandoned task {} due to too many failures.", task_id);
+        }
+    }
+}
+
+scylla_blas::worker::local_worker_pool::local_worker_pool(const std::shared_ptr<scmd::session> &session,
+                                                          const std::shared_ptr<queue_backend> &backend,
+                                                          int64_t worker_count, int64_t sleep_time,
+                                                          bool pin_threads) :
+        _backend(backend),
+        _stop(false),
+        _threads()
+{
+    int64_t cpu_count = std::max((int64_t)std::thread::hardware_concurrency(), int64_t(1));
+    for (int64_t i = 0; i < worker_count; i++) {
+        _threads.emplace_back([this, session, sleep_time] {
+            run_worker(session, *_backend, sleep_time, _stop);
+        });
+
+        if (pin_threads) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cpu_count, &cpus);
+            int error = pthread_setaffinity_np(_threads.back().native_handle(), sizeof(cpus), &cpus);
+            if (error != 0) {
+                /* Not critical – the thread runs unpinned */
+                LogWarn("Failed to pin worker thread {} to CPU {}: error {}", i, i % cpu_count, error);
+            }
+        }
+    }
+}
+
+scylla_blas::worker::local_worker_pool::~local_worker_pool() {
+    _stop.store(true);
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+}
+
+scylla_blas::worker::queue_load scylla_blas::worker::queue_load_monitor::measure() {
+    queue_load load;
+    std::map<int64_t, std::shared_ptr<task_queue>> still_open;
+    std::set<int64_t> subtask_queues;
+    for (auto [priority, id] : _backend.list_main_queues()) {
+        try {
+            auto it = _main_queues.find(id);
+            auto queue = it != _main_queues.end() ? it->second : _backend.open_queue(id);
+            load.main_tasks += queue->get_pending_count();
+            for (auto &[task_id, main_task] : queue->get_unfinished()) {
+                if (auto subtask_queue = proto::subtask_queue_of(main_task)) {
+                    subtask_queues.insert(*subtask_queue);
+                }
+            }
+            still_open[id] = queue;
+        } catch (const std::exception &e) {
+            /* The scheduler may have just deleted it */
+            LogDebug("Could not read main queue {}: {}", id, e.what());
+        }
+    }
+    _main_queues = std::move(still_open);
+
+    for (int64_t id : subtask_queues) {
+        try {
+            load.subtasks += _backend.open_queue(id)->get_pending_count();
+        } catch (const std::exception &e) {
+            /* The routine may have just finished */
+            LogDebug("Could not read subtask queue {}: {}", id, e.what());
+        }
+    }
+    return load;
+}
+
+scylla_blas::worker::worker_scaler::worker_scaler(int64_t min_workers, int64_t max_workers, int64_t idle_intervals) :
+        _min_workers(min_workers),
+        _max_workers(max_workers),
+        _idle_intervals(idle_intervals),
+        _target(min_workers),
+        _idle_for(0)
+{
+    if (min_workers < 0 || max_workers < std::max(min_workers, int64_t(1))) {
+        throw std::runtime_error(fmt::format("Invalid worker limits: {} to {}", min_workers, max_workers));
+    }
+}
+
+int64_t scylla_blas::worker::worker_scaler::update(const queue_load &load, int64_t live_workers) {
+    bool backlog = load.main_tasks > 0 || load.subtasks > SUPERVISOR_SUBTASKS_PER_WORKER * std::max(live_workers, int64_t(1));
+    _idle_for = load.main_tasks == 0 && load.subtasks == 0 ? _idle_for + 1 : 0;
+    if (backlog && _target < _max_workers) {
+        _target++;
+        LogInfo("{} main tasks and {} subtasks waiting for {} workers, scaling up to {} workers",
+                load.main_tasks, load.subtasks, live_workers, _target);
+    } else if (_idle_for >= _idle_intervals && _target > _min_workers) {
+        _target--;
+        _idle_for = 0;
+        LogInfo("Queues idle, scaling down to {} workers", _target);
+    }
+    return _target;
+}
@@ -1,4 +1,5 @@
 #include "scylla_blas/vector.hh"
+#include "scylla_blas/utils/version_bumps.hh"
 
 void scylla_blas::basic_vector::get_meta_from_database() {
     scmd::query_result result = _session->execute(_get_meta_prepared);
@@ -9,11 +10,26 @@ void scylla_blas::basic_vector::get_meta_from_database() {
 
     this->length =  result.get_column<index_t>("length");
     this->block_size =  result.get_column<index_t>("block_size");
+
+    scmd::query_result version_result = _session->execute(_get_version_prepared, id);
+    this->version = version_result.next_row() ? version_result.get_column<int64_t>("version") : 0;
+}
+
+void scylla_blas::basic_vector::bump_version() {
+    if (version_bump_scope::defer(false, id, [session = _session, id = id] { bump_version(session, id); })) return;
+
+    _session->execute(_bump_version_prepared, id);
+}
+
+void scylla_blas::basic_vector::bump_version(const std::shared_ptr<scmd::session> &session, id_t id) {
+    session->execute("UPDATE blas.vector_version SET version = version + 1 WHERE id = ?;", id);
 }
 
 void scylla_blas::basic_vector::clear(const std::shared_ptr<scmd::session> &session, int64_t id) {
     scmd::statement drop_table(fmt::format("TRUNCATE blas.vector_{0};", id));
     session->execute(drop_table.set_timeout(0));
+
+    bump_version(session, id);
 }
 
 void scylla_blas::basic_vector::resize(const std::shared_ptr<scmd::session> &session,
@@ -23,6 +39,7 @@ void scylla_blas::basic_vector::resize(const std::shared_ptr<scmd::session> &ses
                 SET     length     = ?
                 WHERE   id         = ?;
         )", new_length, id);
+    bump_version(session, id);
 }
 
 void scylla_blas::basic_vector::set_block_size(const std::shared_ptr<scmd::session> &session, scylla_blas::id_t id,
@@ -32,6 +49,7 @@ void scylla_blas::basic_vector::set_block_size(const std::shared_ptr<scmd::sessi
                 SET     block_size  = ?
                 WHERE   id          = ?;
         )", new_block_size, id);
+    bump_version(session, id);
 }
 
 void scylla_blas::basic_vector::drop(const std::shared_ptr<scmd::session> &session, int64_t id) {
@@ -45,12 +63,18 @@ void scylla_blas::basic_vector::init_meta(const std::shared_ptr<scmd::session> &
                                                 length     BIGINT,
                                                 block_size BIGINT);)");
     session->execute(init_meta.set_timeout(0));
+
+    /* See basic_matrix::init_meta */
+    scmd::statement init_version(R"(CREATE TABLE IF NOT EXISTS blas.vector_version (
+                                                id         BIGINT PRIMARY KEY,
+                                                version    COUNTER);)");
+    session->execute(init_version.set_timeout(0));
 }
 
 scylla_blas::basic_vector::basic_vector(const std::shared_ptr<scmd::session> &session, int64_t id) :
         _session(session),
         id(id),
-        length(0), block_size(0), // Updated in constructor body in update_meta
+        length(0), block_size(0), version(0), // Updated in constructor body in update_meta
 #define PREPARE(x, args...) x(_session->prepare(fmt::format(args)))
         PREPARE(_get_meta_prepared,
                 "SELECT * FROM blas.vector_meta WHERE id = {};", id),
@@ -69,7 +93,11 @@ scylla_blas::basic_vector::basic_vector(const std::shared_ptr<scmd::session> &se
         PREPARE(_resize_prepared,
                 "UPDATE blas.vector_meta SET length = ? WHERE id = ?;"),
         PREPARE(_set_block_size_prepared,
-                "UPDATE blas.vector_meta SET block_size = ? WHERE id = ?;")
+                "UPDATE blas.vector_meta SET block_size = ? WHERE id = ?;"),
+        PREPARE(_get_version_prepared,
+                "SELECT version FROM blas.vector_version WHERE id = ?;"),
+        PREPARE(_bump_version_prepared,
+                "UPDATE blas.vector_version SET version = version + 1 WHERE id = ?;")
 #undef PREPARE
 {
     get_meta_from_database();
@@ -77,11 +105,13 @@ scylla_blas::basic_vector::basic_vector(const std::shared_ptr<scmd::session> &se
 
 void scylla_blas::basic_vector::resize(scylla_blas::index_t new_length) {
     _session->execute(_resize_prepared, new_length, id);
+    bump_version();
     this->length = new_length;
 }
 
 void scylla_blas::basic_vector::set_block_size(scylla_blas::index_t new_block_size) {
     _session->execute(_set_block_size_prepared, new_block_size, id);
+    bump_version();
     this->block_size = new_block_size;
 }
 
@@ -30,6 +30,79 @@ BOOST_FIXTURE_TEST_CASE(vector_dot_float, vector_fixture)
     BOOST_CHECK(std::abs(sum - res) < scylla_blas::epsilon);
 }
 
+BOOST_FIXTURE_TEST_CASE(vector_dot_float_work_stealing, vector_fixture)
+{
+    // Given two vector of five values, and workers allowed to steal subtasks.
+    std::vector<float> values1 = {4.234f, 3214.4243f, 290342.0f, 0.0f, -1.0f};
+    std::vector<float> values2 = {3.0f, 392.9001f, 0.005f, 5.0f, 29844.05325811f};
+    auto vector1 = getScyllaVectorOf(test_const::float_vector_1_id, values1);
+    auto vector2 = getScyllaVectorOf(test_const::float_vector_2_id, values2);
+    scheduler->set_work_stealing(true);
+
+    // When performing dot product of these two vectors.
+    float res = scheduler->sdot(*vector1, *vector2);
+
+    float sum = 0;
+    for (int i = 0; i < values1.size(); i++) {
+        sum += values1[i] * values2[i];
+    }
+
+    // Then every segment is counted exactly once, whichever worker took it.
+    BOOST_CHECK(std::abs(sum - res) < scylla_blas::epsilon);
+}
+
+BOOST_FIXTURE_TEST_CASE(vector_dot_float_async, vector_fixture)
+{
+    // Given two vector of five values.
+    std::vector<float> values1 = {4.234f, 3214.4243f, 290342.0f, 0.0f, -1.0f};
+    std::vector<float> values2 = {3.0f, 392.9001f, 0.005f, 5.0f, 29844.05325811f};
+    auto vector1 = getScyllaVectorOf(test_const::float_vector_1_id, values1);
+    auto vector2 = getScyllaVectorOf(test_const::float_vector_2_id, values2);
+
+    // When starting a dot product and a norm without waiting for the first one.
+    auto dot = scheduler->sdot_async(*vector1, *vector2);
+    auto nrm = scheduler->snrm2_async(*vector1);
+    BOOST_CHECK(scheduler->get_outstanding_count() <= 2);
+
+    float sum = 0, sum_squares = 0;
+    for (int i = 0; i < values1.size(); i++) {
+        sum += values1[i] * values2[i];
+        sum_squares += values1[i] * values1[i];
+    }
+
+    // Then both results are correct, whichever of them is collected first.
+    BOOST_CHECK(std::abs(std::sqrt(sum_squares) - nrm.get()) < scylla_blas::epsilon);
+    BOOST_CHECK(std::abs(sum - dot.get()) < scylla_blas::epsilon);
+    BOOST_CHECK(dot.ready());
+    BOOST_CHECK_EQUAL(scheduler->get_outstanding_count(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(vector_dot_float_local, vector_fixture)
+{
+    // Given two vector of five values, and a scheduler running small routines by itself.
+    std::vector<float> values1 = {4.234f, 3214.4243f, 290342.0f, 0.0f, -1.0f};
+    std::vector<float> values2 = {3.0f, 392.9001f, 0.005f, 5.0f, 29844.05325811f};
+    auto vector1 = getScyllaVectorOf(test_const::float_vector_1_id, values1);
+    auto vector2 = getScyllaVectorOf(test_const::float_vector_2_id, values2);
+    scheduler->set_local_execution_threshold(DEFAULT_LOCAL_EXECUTION_THRESHOLD);
+
+    // When starting a dot product and a norm.
+    auto dot = scheduler->sdot_async(*vector1, *vector2);
+    auto nrm = scheduler->snrm2_async(*vector1);
+
+    float sum = 0, sum_squares = 0;
+    for (int i = 0; i < values1.size(); i++) {
+        sum += values1[i] * values2[i];
+        sum_squares += values1[i] * values1[i];
+    }
+
+    // Then both are done before their futures are even polled, with the same results as workers give.
+    BOOST_CHECK_EQUAL(scheduler->get_outstanding_count(), 0);
+    BOOST_CHECK(dot.ready());
+    BOOST_CHECK(std::abs(std::sqrt(sum_squares) - nrm.get()) < scylla_blas::epsilon);
+    BOOST_CHECK(std::abs(sum - dot.get()) < scylla_blas::epsilon);
+}
+
 BOOST_FIXTURE_TEST_CASE(vector_dot_float_same_obj, vector_fixture)
 {
     // Given one vector of five values.
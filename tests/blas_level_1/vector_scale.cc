@@ -51,3 +51,66 @@ BOOST_FIXTURE_TEST_CASE(double_vector_scale_IT, vector_fixture)
                                 vals2[difference->index - 1]));
     }
 }
+
+BOOST_FIXTURE_TEST_CASE(float_vector_scale_plan_IT, vector_fixture)
+{
+    // Given vector of 4 floats and a plan of its scaling by 2
+    std::vector<float> vals = {1.6f, 2.9999f, 3.0f, 0.0f};
+    auto vector = getScyllaVectorOf(test_const::float_vector_1_id, vals);
+    auto plan = scheduler->record_plan([&] { scheduler->sscal_async(2, *vector); });
+
+    // Recording a plan doesn't perform it
+    BOOST_CHECK(!cmp_vector(*vector, vals).has_value());
+
+    // When running the plan 3 times
+    for (int i = 0; i < 3; i++) {
+        scheduler->run_plan(*plan).get();
+    }
+
+    // Then result vector is scaled by 8.
+    std::vector<float> vals2 = {1.6f * 8, 2.9999f * 8, 3.0f * 8, 0.0f * 8};
+    std::optional<scylla_blas::vector_value<float>> difference = cmp_vector(*vector, vals2);
+    BOOST_CHECK(!difference.has_value());
+    if (difference.has_value()) {
+        BOOST_ERROR(fmt::format("Difference at position {0}, {1} - {2}",
+                                difference->index,
+                                difference->value,
+                                vals2[difference->index - 1]));
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(float_vector_scale_graph_IT, vector_fixture)
+{
+    // Given vectors X and Y, and a graph copying X to Y, then scaling Y by 2 and by 3
+    std::vector<float> vals = {1.6f, 2.9999f, 3.0f, 0.0f};
+    auto X = getScyllaVectorOf(test_const::float_vector_1_id, vals);
+    auto Y = getScyllaVectorOf(test_const::float_vector_2_id, std::vector<float>(vals.size(), 0.0f));
+    auto graph = scheduler->record_graph([&] {
+        scheduler->scopy_async(*X, *Y);
+        scheduler->sscal_async(2, *Y);
+        scheduler->sscal_async(3, *Y);
+    });
+
+    // Each routine depends on the earlier ones segment by segment
+    BOOST_REQUIRE_EQUAL(graph->get_routine_count(), 3);
+    BOOST_REQUIRE_EQUAL(graph->get_dependency_count(), 3);
+
+    // When running the graph twice
+    for (int i = 0; i < 2; i++) {
+        for (auto &future : scheduler->run_graph(*graph)) {
+            future.wait();
+        }
+    }
+
+    // Then Y is X scaled by 6, and X is unchanged.
+    std::vector<float> vals2 = {1.6f * 6, 2.9999f * 6, 3.0f * 6, 0.0f * 6};
+    std::optional<scylla_blas::vector_value<float>> difference = cmp_vector(*Y, vals2);
+    BOOST_CHECK(!difference.has_value());
+    if (difference.has_value()) {
+        BOOST_ERROR(fmt::format("Difference at position {0}, {1} - {2}",
+                                difference->index,
+                                difference->value,
+                                vals2[difference->index - 1]));
+    }
+    BOOST_CHECK(!cmp_vector(*X, vals).has_value());
+}
@@ -1,5 +1,8 @@
 #include <boost/test/unit_test.hpp>
 
+#include "scylla_blas/queue/local_queue.hh"
+#include "scylla_blas/queue/worker_proc.hh"
+
 #include "../test_utils.hh"
 #include "../fixture.hh"
 #include "preset_matrix_value_generator.hh"
@@ -132,3 +135,69 @@ BOOST_FIXTURE_TEST_CASE(triangular_banded_solver, mixed_fixture)
     }
 }
 
+
+BOOST_FIXTURE_TEST_CASE(triangular_solver_check_interval, mixed_fixture)
+{
+    using namespace scylla_blas;
+
+    for (bool speculative : { true, false }) {
+        // Given a triangular system, and a solver that checks convergence every third sweep.
+        auto double_B = getScyllaDoubleVector(test_const::double_vector_3_id);
+        auto double_B2 = getScyllaDoubleVector(test_const::double_vector_4_id);
+        auto old_vec = double_B->get_whole();
+        scheduler->set_speculative_sweeps(speculative);
+        scheduler->set_convergence_check_interval(3);
+
+        // When solving it.
+        trim_to_triangular<double>(double_BxB);
+        scheduler->dtrsv(Upper, NoTrans, NonUnit, *double_BxB, *double_B);
+        scheduler->dgemv(NoTrans, 1,  *double_BxB, *double_B, 0, *double_B2);
+
+        // Then the result is as accurate as with a check after every sweep, with no sweep left running.
+        auto new_vec = double_B2->get_whole();
+        BOOST_REQUIRE_LE((old_vec + new_vec * (-1)).nrminf() / new_vec.nrminf(), EPSILON);
+        BOOST_CHECK_EQUAL(scheduler->get_outstanding_count(), 0);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(triangular_solver_speculative_workers, mixed_fixture)
+{
+    using namespace scylla_blas;
+
+    // Given a triangular system, and two workers running overlapping sweeps of the solver.
+    auto backend = std::make_shared<local_backend>();
+    worker::local_worker_pool pool(session, backend, 2);
+    routine_scheduler local_scheduler(session, backend);
+    local_scheduler.set_local_execution_threshold(0);
+    local_scheduler.set_speculative_sweeps(true);
+
+    auto double_B = getScyllaDoubleVector(test_const::double_vector_3_id);
+    auto old_vec = double_B->get_whole();
+    trim_to_triangular<double>(double_BxB);
+
+    // When solving it.
+    local_scheduler.dtrsv(Upper, NoTrans, NonUnit, *double_BxB, *double_B);
+
+    // Then the result matches back substitution.
+    index_t n = double_BxB->get_row_count();
+    std::vector<double> expected(n + 1, 0);
+    for (auto &val : old_vec) {
+        expected[val.index] = val.value;
+    }
+    for (index_t i = n; i >= 1; i--) {
+        double diagonal = 1;
+        for (auto &val : double_BxB->get_row(i)) {
+            if (val.index == i) diagonal = val.value;
+            else if (val.index > i) expected[i] -= val.value * expected[val.index];
+        }
+        expected[i] /= diagonal;
+    }
+    vector_segment<double> reference;
+    for (index_t i = 1; i <= n; i++) {
+        if (expected[i] != 0) reference.emplace_back(i, expected[i]);
+    }
+
+    auto new_vec = double_B->get_whole();
+    BOOST_REQUIRE_LE((new_vec + reference * (-1)).nrminf() / reference.nrminf(), EPSILON);
+    BOOST_CHECK_EQUAL(local_scheduler.get_outstanding_count(), 0);
+}
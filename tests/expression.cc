@@ -0,0 +1,67 @@
+#include <cmath>
+#include <boost/test/unit_test.hpp>
+
+#include "scylla_blas/expression.hh"
+
+#include "test_utils.hh"
+#include "fixture.hh"
+#include "vector_utils.hh"
+
+BOOST_FIXTURE_TEST_CASE(expression_fuses_vector_statements, vector_fixture)
+{
+    // Given two vectors, and a scaling, an update and a dot product of them recorded lazily.
+    std::vector<double> values1 = {4.25, -3.5, 0.0, 12.0, 1.0};
+    std::vector<double> values2 = {3.0, 2.0, 0.5, 0.0, -7.0};
+    auto X = getScyllaVectorOf(test_const::double_vector_1_id, values1);
+    auto Y = getScyllaVectorOf(test_const::double_vector_2_id, values2);
+
+    scylla_blas::expression<double> e(*scheduler);
+    e.scal(2, *X);
+    e.assign(*Y, 3.0 * *X + 1.0 * *Y);
+    auto r = e.dot(*Y, *Y);
+
+    // When the expression is evaluated.
+    BOOST_CHECK_EQUAL(e.get_pass_count(), 1);
+    BOOST_CHECK(!r.ready());
+    e.evaluate();
+
+    std::vector<double> expected_X, expected_Y;
+    double expected_r = 0;
+    for (size_t i = 0; i < values1.size(); i++) {
+        expected_X.push_back(2 * values1[i]);
+        expected_Y.push_back(6 * values1[i] + values2[i]);
+        expected_r += expected_Y.back() * expected_Y.back();
+    }
+
+    // Then the single pass gives the same results as the statements run one by one.
+    BOOST_CHECK(!cmp_vector(*X, expected_X).has_value());
+    BOOST_CHECK(!cmp_vector(*Y, expected_Y).has_value());
+    BOOST_CHECK(std::abs(expected_r - r.get()) < scylla_blas::epsilon);
+}
+
+BOOST_FIXTURE_TEST_CASE(expression_fuses_gemv_and_dot, mixed_fixture)
+{
+    // Given Y = A * X computed by gemv.
+    auto &A = *double_BxA;
+    auto &X = *double_vectors[test_const::double_vector_1_id];
+    auto &Y = *double_vectors[test_const::double_vector_3_id];
+    auto &Z = *double_vectors[test_const::double_vector_4_id];
+    scheduler->dgemv(scylla_blas::NoTrans, 1, A, X, 0, Y);
+    auto expected_Y = Y.get_whole();
+
+    // When the same product is recorded lazily, followed by its dot product with Z and evaluated.
+    Y.clear_all();
+    scylla_blas::expression<double> e(*scheduler);
+    e.assign(Y, 1.0 * A * X);
+    auto r = e.dot(Z, Y);
+    BOOST_CHECK_EQUAL(e.get_pass_count(), 1);
+    e.evaluate();
+
+    // Then it takes a single pass, with the same result as gemv and dot.
+    auto whole = Y.get_whole();
+    BOOST_REQUIRE_EQUAL(whole.size(), expected_Y.size());
+    for (size_t i = 0; i < whole.size(); i++) {
+        BOOST_CHECK(std::abs(whole[i].value - expected_Y[i].value) < scylla_blas::epsilon);
+    }
+    BOOST_CHECK(std::abs(scheduler->ddot(Y, Z) - r.get()) < scylla_blas::epsilon);
+}
@@ -23,6 +23,8 @@ public:
         global_config::init();
         connect();
         this->scheduler = std::make_shared<scylla_blas::routine_scheduler>(session);
+        /* Test structures are small – without this, the routines would never reach the workers */
+        this->scheduler->set_local_execution_threshold(0);
     }
 
     ~scylla_fixture() {
@@ -1,15 +1,22 @@
+#include <cstring>
 #include <queue>
+#include <set>
+#include <thread>
 
 #include <boost/test/unit_test.hpp>
 
+#include "scylla_blas/queue/codec.hh"
+#include "scylla_blas/queue/local_queue.hh"
+#include "scylla_blas/queue/queue_metrics.hh"
 #include "scylla_blas/queue/scylla_queue.hh"
+#include "scylla_blas/queue/worker_proc.hh"
 #include "fixture.hh"
 
 BOOST_FIXTURE_TEST_SUITE(queue_tests, scylla_fixture)
 
 static std::vector<int64_t> values = {0, 42, 1410, 1, 1999, 2021, 1000 * 1000 * 1000 + 7, 406};
 
-static void test_queue_simple(scylla_blas::scylla_queue& queue) {
+static void test_queue_simple(scylla_blas::task_queue& queue) {
     // Test tasks without results
     std::queue<int64_t> task_ids = {};
     for(auto val : values) {
@@ -40,7 +47,7 @@ static void test_queue_simple(scylla_blas::scylla_queue& queue) {
     }
 }
 
-static void test_queue_response(scylla_blas::scylla_queue& queue) {
+static void test_queue_response(scylla_blas::task_queue& queue) {
     std::queue<int64_t> task_ids = {};
     // Test tasks with basic results
     for(auto val : values) {
@@ -75,7 +82,7 @@ static void test_queue_response(scylla_blas::scylla_queue& queue) {
     }
 }
 
-static void test_queue_batch(scylla_blas::scylla_queue& queue) {
+static void test_queue_batch(scylla_blas::task_queue& queue) {
         // Test tasks without results
         int64_t tasks_id;
         std::vector<scylla_blas::proto::task> tasks;
@@ -109,6 +116,191 @@ static void test_queue_batch(scylla_blas::scylla_queue& queue) {
         }
     }
 
+static void test_queue_consume_many(scylla_blas::task_queue& queue) {
+    std::vector<scylla_blas::proto::task> tasks;
+    for (auto val : values) {
+        tasks.push_back({
+                .type = scylla_blas::proto::NONE,
+                .basic {
+                        .data = val
+                }
+        });
+    }
+
+    int64_t tasks_id = queue.produce(tasks);
+
+    // Claim in chunks of 3 - the last chunk should be truncated to what is left.
+    size_t consumed = 0;
+    while (consumed < values.size()) {
+        auto claimed = queue.consume(3);
+        BOOST_REQUIRE_EQUAL(claimed.size(), std::min(size_t(3), values.size() - consumed));
+        for (auto &[id, task] : claimed) {
+            BOOST_REQUIRE_EQUAL(id, tasks_id + consumed);
+            BOOST_REQUIRE_EQUAL(values[consumed], task.basic.data);
+            queue.mark_as_finished(id);
+            consumed++;
+        }
+    }
+
+    BOOST_REQUIRE(queue.consume(3).empty());
+    BOOST_REQUIRE(!queue.consume().has_value());
+}
+
+static void test_queue_get_finished(scylla_blas::task_queue& queue) {
+    std::vector<scylla_blas::proto::task> tasks;
+    for (auto val : values) {
+        tasks.push_back({
+                .type = scylla_blas::proto::NONE,
+                .basic {
+                        .data = val
+                }
+        });
+    }
+
+    int64_t tasks_id = queue.produce(tasks);
+    BOOST_REQUIRE(queue.get_finished(tasks_id, values.size()).empty());
+
+    // Finish every other task, with its value as a response.
+    auto claimed = queue.consume(values.size());
+    BOOST_REQUIRE_EQUAL(claimed.size(), values.size());
+    for (size_t i = 0; i < claimed.size(); i += 2) {
+        scylla_blas::proto::response r{};
+        r.type = scylla_blas::proto::R_INT64;
+        r.simple.response = claimed[i].second.basic.data;
+        queue.mark_as_finished(claimed[i].first, r);
+    }
+
+    auto finished = queue.get_finished(tasks_id, values.size());
+    BOOST_REQUIRE_EQUAL(finished.size(), (values.size() + 1) / 2);
+    for (size_t i = 0; i < finished.size(); i++) {
+        auto &[id, response] = finished[i];
+        BOOST_REQUIRE_EQUAL(id, tasks_id + 2 * i);
+        BOOST_REQUIRE(response.has_value());
+        BOOST_REQUIRE(response.value().type == scylla_blas::proto::R_INT64);
+        BOOST_REQUIRE_EQUAL(response.value().simple.response, values[2 * i]);
+    }
+}
+
+static void test_queue_bucketed(scylla_blas::task_queue& queue) {
+    // Tasks are spread over buckets, so only the set of consumed tasks is deterministic, not their order.
+    std::vector<scylla_blas::proto::task> tasks;
+    for (auto val : values) {
+        tasks.push_back({
+                .type = scylla_blas::proto::NONE,
+                .basic {
+                        .data = val
+                }
+        });
+    }
+
+    int64_t tasks_id = queue.produce(tasks);
+
+    std::multiset<int64_t> expected(values.begin(), values.end());
+    std::multiset<int64_t> consumed;
+    std::set<int64_t> ids;
+    while (consumed.size() < values.size()) {
+        auto claimed = queue.consume(3);
+        BOOST_REQUIRE(!claimed.empty());
+        for (auto &[id, task] : claimed) {
+            BOOST_REQUIRE(id >= tasks_id && id < tasks_id + (int64_t)values.size());
+            BOOST_REQUIRE_EQUAL(values[id - tasks_id], task.basic.data);
+            BOOST_REQUIRE(ids.insert(id).second);
+            consumed.insert(task.basic.data);
+            queue.mark_as_finished(id);
+        }
+    }
+
+    BOOST_REQUIRE(consumed == expected);
+    BOOST_REQUIRE(!queue.consume().has_value());
+
+    auto finished = queue.get_finished(tasks_id, values.size());
+    BOOST_REQUIRE_EQUAL(finished.size(), values.size());
+    for (size_t i = 0; i < finished.size(); i++) {
+        BOOST_REQUIRE_EQUAL(finished[i].first, tasks_id + i);
+    }
+}
+
+static void test_queue_leases(scylla_blas::task_queue& queue) {
+    auto any = [](const scylla_blas::proto::task &) { return true; };
+    std::vector<scylla_blas::proto::task> tasks(3, { .type = scylla_blas::proto::NONE });
+    int64_t tasks_id = queue.produce(tasks);
+
+    // Only leased tasks can go stale.
+    auto claimed = queue.consume(2);
+    BOOST_REQUIRE_EQUAL(claimed.size(), 2);
+    queue.renew_lease(tasks_id);
+    scylla_blas::wait_microseconds(20000);
+    BOOST_REQUIRE(!queue.claim_stale(1000 * 1000, any).has_value());
+    BOOST_REQUIRE(!queue.claim_stale(1000, [](const auto &) { return false; }).has_value());
+
+    auto stale = queue.claim_stale(1000, any);
+    BOOST_REQUIRE(stale.has_value());
+    BOOST_REQUIRE_EQUAL(stale->first, tasks_id);
+    // The lease was taken over, so it's fresh again.
+    BOOST_REQUIRE(!queue.claim_stale(1000 * 1000, any).has_value());
+
+    BOOST_REQUIRE_EQUAL(queue.get_unfinished().size(), 3);
+    queue.mark_as_finished(std::vector<int64_t>{tasks_id, tasks_id + 1});
+    BOOST_REQUIRE(queue.is_finished(tasks_id + 1));
+    auto unfinished = queue.get_unfinished();
+    BOOST_REQUIRE_EQUAL(unfinished.size(), 1);
+    BOOST_REQUIRE_EQUAL(unfinished.front().first, tasks_id + 2);
+
+    // Finished tasks are never stale.
+    scylla_blas::wait_microseconds(20000);
+    BOOST_REQUIRE(!queue.claim_stale(1000, any).has_value());
+}
+
+static void test_queue_range(scylla_blas::task_queue& queue) {
+    // A 3 x 5 grid of subtasks, shared by 2 consumers.
+    int64_t range_id = queue.produce_range(15, 5, 2);
+    BOOST_REQUIRE_EQUAL(queue.get_pending_count(), 15);
+
+    // Claims shrink as the range drains: ceil(15 / 4) = 4, then ceil(11 / 4) = 3, ...
+    std::vector<int64_t> chunk_sizes;
+    std::vector<std::pair<int64_t, scylla_blas::proto::task>> claimed;
+    while (true) {
+        auto chunk = queue.consume_guided(2);
+        if (chunk.empty()) break;
+        chunk_sizes.push_back(chunk.size());
+        claimed.insert(claimed.end(), chunk.begin(), chunk.end());
+    }
+    BOOST_REQUIRE(chunk_sizes == std::vector<int64_t>({4, 3, 2, 2, 2, 2}));
+
+    // The grid is enumerated in 2 x 2 tiles, the ones at the edges are cut: 4 tasks per tile is the first claim.
+    std::vector<std::pair<int64_t, int64_t>> expected = {
+        {1, 1}, {1, 2}, {2, 1}, {2, 2}, {1, 3}, {1, 4}, {2, 3}, {2, 4}, {1, 5}, {2, 5},
+        {3, 1}, {3, 2}, {3, 3}, {3, 4}, {3, 5}
+    };
+    BOOST_REQUIRE_EQUAL(claimed.size(), 15);
+    for (int64_t i = 0; i < 15; i++) {
+        BOOST_REQUIRE_EQUAL(claimed[i].first, range_id + i);
+        BOOST_REQUIRE_EQUAL(claimed[i].second.coord.block_row, expected[i].first);
+        BOOST_REQUIRE_EQUAL(claimed[i].second.coord.block_column, expected[i].second);
+        BOOST_REQUIRE_EQUAL(queue.get_range().id_of(claimed[i].second), claimed[i].first);
+    }
+
+    // Unfinished tasks of the range are derived from their ids too.
+    queue.mark_as_finished(std::vector<int64_t>{range_id, range_id + 1});
+    BOOST_REQUIRE(queue.is_finished(range_id + 1));
+    BOOST_REQUIRE(!queue.is_finished(range_id + 2));
+    auto unfinished = queue.get_unfinished();
+    BOOST_REQUIRE_EQUAL(unfinished.size(), 13);
+    BOOST_REQUIRE_EQUAL(unfinished.front().first, range_id + 2);
+
+    // Regular tasks may follow a drained range, and a one-dimensional range may follow them.
+    int64_t task_id = queue.produce({ .type = scylla_blas::proto::NONE, .basic { .data = 42 } });
+    int64_t vector_id = queue.produce_range(3, 0, 1);
+    auto rest = queue.consume(10);
+    BOOST_REQUIRE_EQUAL(rest.size(), 4);
+    BOOST_REQUIRE_EQUAL(rest[0].first, task_id);
+    BOOST_REQUIRE_EQUAL(rest[0].second.basic.data, 42);
+    for (int64_t i = 0; i < 3; i++) {
+        BOOST_REQUIRE_EQUAL(rest[i + 1].first, vector_id + i);
+        BOOST_REQUIRE_EQUAL(rest[i + 1].second.index, i + 1);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(scylla_queue_sp_mc)
 {
     scylla_blas::scylla_queue::delete_queue(session, 1337);
@@ -118,6 +310,8 @@ BOOST_AUTO_TEST_CASE(scylla_queue_sp_mc)
     test_queue_simple(queue);
     test_queue_response(queue);
     test_queue_batch(queue);
+    test_queue_consume_many(queue);
+    test_queue_get_finished(queue);
 }
 
 BOOST_AUTO_TEST_CASE(scylla_queue_mp_sc)
@@ -129,6 +323,8 @@ BOOST_AUTO_TEST_CASE(scylla_queue_mp_sc)
     test_queue_simple(queue);
     test_queue_response(queue);
     test_queue_batch(queue);
+    test_queue_consume_many(queue);
+    test_queue_get_finished(queue);
 }
 
 BOOST_AUTO_TEST_CASE(scylla_queue_sp_sc)
@@ -140,6 +336,8 @@ BOOST_AUTO_TEST_CASE(scylla_queue_sp_sc)
     test_queue_simple(queue);
     test_queue_response(queue);
     test_queue_batch(queue);
+    test_queue_consume_many(queue);
+    test_queue_get_finished(queue);
 }
 
 BOOST_AUTO_TEST_CASE(scylla_queue_mp_mc)
@@ -151,6 +349,710 @@ BOOST_AUTO_TEST_CASE(scylla_queue_mp_mc)
     test_queue_simple(queue);
     test_queue_response(queue);
     test_queue_batch(queue);
+    test_queue_consume_many(queue);
+    test_queue_get_finished(queue);
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_bucketed_mc)
+{
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, true, true, 3);
+    BOOST_REQUIRE(scylla_blas::scylla_queue::queue_exists(session, 1337));
+    auto queue = scylla_blas::scylla_queue(session, 1337);
+    BOOST_REQUIRE_EQUAL(queue.get_bucket_count(), 3);
+    test_queue_bucketed(queue);
+    queue.reset();
+    test_queue_bucketed(queue);
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_bucketed_sc)
+{
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, false, false, 3);
+    BOOST_REQUIRE(scylla_blas::scylla_queue::queue_exists(session, 1337));
+    auto queue = scylla_blas::scylla_queue(session, 1337);
+    test_queue_bucketed(queue);
+    test_queue_bucketed(queue);
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_release)
+{
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, false, false);
+    auto queue = scylla_blas::scylla_queue(session, 1337);
+
+    // Spans three pages, the last one only partially filled.
+    std::vector<scylla_blas::proto::task> tasks;
+    for (int64_t i = 0; i < 2 * QUEUE_PAGE_SIZE + 10; i++) {
+        tasks.push_back({
+                .type = scylla_blas::proto::NONE,
+                .basic {
+                        .data = i
+                }
+        });
+    }
+    int64_t tasks_id = queue.produce(tasks);
+
+    auto claimed = queue.consume(tasks.size());
+    BOOST_REQUIRE_EQUAL(claimed.size(), tasks.size());
+    for (auto &[id, task] : claimed) {
+        BOOST_REQUIRE_EQUAL(id - tasks_id, task.basic.data);
+        queue.mark_as_finished(id);
+    }
+
+    // Only the first page lies entirely below the watermark.
+    queue.release(tasks_id + QUEUE_PAGE_SIZE + 5);
+    BOOST_REQUIRE_THROW(queue.get_response(tasks_id), std::runtime_error);
+    BOOST_REQUIRE_THROW(queue.get_response(tasks_id + QUEUE_PAGE_SIZE - 1), std::runtime_error);
+    BOOST_REQUIRE(queue.is_finished(tasks_id + QUEUE_PAGE_SIZE));
+    BOOST_REQUIRE_EQUAL(queue.get_finished(tasks_id, tasks.size()).size(), tasks.size() - QUEUE_PAGE_SIZE);
+
+    // The queue keeps working after a release, and after a reset.
+    queue.release(tasks_id + tasks.size());
+    BOOST_REQUIRE_EQUAL(queue.get_finished(tasks_id, tasks.size()).size(), 10);
+    test_queue_simple(queue);
+    queue.reset();
+    test_queue_batch(queue);
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_release_shared)
+{
+    // Other clients may still wait for tasks of the default queue, it never drops them.
+    scylla_blas::scylla_queue::delete_queue(session, DEFAULT_WORKER_QUEUE_ID);
+    scylla_blas::scylla_queue::create_queue(session, DEFAULT_WORKER_QUEUE_ID, false, true);
+    auto queue = scylla_blas::scylla_queue(session, DEFAULT_WORKER_QUEUE_ID);
+
+    std::vector<scylla_blas::proto::task> tasks(QUEUE_PAGE_SIZE + 1, { .type = scylla_blas::proto::NONE });
+    int64_t tasks_id = queue.produce(tasks);
+    for (auto &[id, task] : queue.consume(tasks.size())) {
+        queue.mark_as_finished(id);
+    }
+
+    queue.release(tasks_id + tasks.size());
+    BOOST_REQUIRE_EQUAL(queue.get_finished(tasks_id, tasks.size()).size(), tasks.size());
+    queue.reset();
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_siblings)
+{
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, false, true);
+    auto queue = scylla_blas::scylla_queue(session, 1337);
+    BOOST_REQUIRE_EQUAL(queue.get_siblings().second, 0);
+    queue.set_siblings(1337, 2);
+
+    // A consumer connecting later sees the group, and how much work is left.
+    auto consumer = scylla_blas::scylla_queue(session, 1337);
+    BOOST_REQUIRE(consumer.get_siblings() == std::make_pair(int64_t(1337), int64_t(2)));
+    BOOST_REQUIRE_EQUAL(consumer.get_pending_count(), 0);
+
+    std::vector<scylla_blas::proto::task> tasks(values.size(), { .type = scylla_blas::proto::NONE });
+    queue.produce(tasks);
+    BOOST_REQUIRE_EQUAL(consumer.get_pending_count(), values.size());
+    consumer.consume(3);
+    BOOST_REQUIRE_EQUAL(consumer.get_pending_count(), values.size() - 3);
+}
+
+// `connect` opens another client of the queue.
+static void test_queue_dependencies(scylla_blas::task_queue &queue,
+                                    const std::function<std::shared_ptr<scylla_blas::task_queue>()> &connect) {
+    using scylla_blas::dependency_kind;
+    BOOST_REQUIRE(connect()->get_upstream().empty());
+    BOOST_REQUIRE(!connect()->tracks_finished());
+
+    // Clients that connect afterwards see the dependencies.
+    queue.set_dependencies({{ 7, dependency_kind::SAME_SUBTASK }, { 8, dependency_kind::ALL }}, true);
+    auto other_client = connect();
+    BOOST_REQUIRE(other_client->tracks_finished());
+    auto upstream = other_client->get_upstream();
+    BOOST_REQUIRE_EQUAL(upstream.size(), 2);
+    BOOST_REQUIRE_EQUAL(upstream[0].queue_id, 7);
+    BOOST_REQUIRE(upstream[0].kind == dependency_kind::SAME_SUBTASK);
+    BOOST_REQUIRE_EQUAL(upstream[1].queue_id, 8);
+    BOOST_REQUIRE(upstream[1].kind == dependency_kind::ALL);
+
+    queue.set_dependencies({}, false);
+    BOOST_REQUIRE(connect()->get_upstream().empty());
+    BOOST_REQUIRE(!connect()->tracks_finished());
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_dependencies)
+{
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, false, true);
+    auto queue = scylla_blas::scylla_queue(session, 1337);
+    test_queue_dependencies(queue, [this] { return std::make_shared<scylla_blas::scylla_queue>(session, 1337); });
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_leases)
+{
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, false, true);
+    auto queue = scylla_blas::scylla_queue(session, 1337);
+    test_queue_leases(queue);
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_range)
+{
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, false, true);
+    auto queue = scylla_blas::scylla_queue(session, 1337);
+    test_queue_range(queue);
+
+    // Task ranges need a single producer.
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, true, true);
+    auto multi_producer_queue = scylla_blas::scylla_queue(session, 1337);
+    BOOST_REQUIRE_THROW(multi_producer_queue.produce_range(10, 0, 1), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_basic)
+{
+    scylla_blas::local_backend backend;
+    BOOST_REQUIRE(!backend.queue_exists(1337));
+    BOOST_REQUIRE_THROW(backend.open_queue(1337), std::runtime_error);
+    backend.create_queue(1337);
+    BOOST_REQUIRE(backend.queue_exists(1337));
+
+    auto queue = backend.open_queue(1337);
+    test_queue_simple(*queue);
+    test_queue_response(*queue);
+    test_queue_batch(*queue);
+    test_queue_consume_many(*queue);
+    test_queue_get_finished(*queue);
+
+    // Queues opened with the same id are the same queue.
+    BOOST_REQUIRE_EQUAL(backend.open_queue(1337)->get_produced_count(), queue->get_produced_count());
+    backend.delete_queue(1337);
+    BOOST_REQUIRE(!backend.queue_exists(1337));
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_leases)
+{
+    scylla_blas::local_backend backend;
+    backend.create_queue(1337);
+    test_queue_leases(*backend.open_queue(1337));
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_range)
+{
+    scylla_blas::local_backend backend;
+    backend.create_queue(1337);
+    test_queue_range(*backend.open_queue(1337));
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_dependencies)
+{
+    scylla_blas::local_backend backend;
+    backend.create_queue(1337);
+    test_queue_dependencies(*backend.open_queue(1337), [&backend] { return backend.open_queue(1337); });
+}
+
+static void test_queue_cancellation(scylla_blas::task_queue &queue) {
+    std::vector<scylla_blas::proto::task> tasks(3, { .type = scylla_blas::proto::NONE });
+    int64_t first_id = queue.produce(tasks);
+    BOOST_REQUIRE_EQUAL(queue.consume(1).size(), 1);
+    BOOST_REQUIRE(!queue.is_cancelled(first_id));
+
+    // Cancelling covers all tasks produced so far, claimed or not...
+    queue.cancel();
+    for (int64_t id = first_id; id < first_id + 3; id++) {
+        BOOST_REQUIRE(queue.is_cancelled(id));
+    }
+
+    // ...but not the ones produced later.
+    int64_t next_id = queue.produce(tasks.front());
+    BOOST_REQUIRE(!queue.is_cancelled(next_id));
+
+    // A deadline that passed cancels everything, until it is cleared.
+    queue.set_deadline(scylla_blas::get_wall_time_microseconds() + 1000 * 1000 * 1000);
+    BOOST_REQUIRE(!queue.is_cancelled(next_id));
+    queue.set_deadline(scylla_blas::get_wall_time_microseconds() - 1);
+    BOOST_REQUIRE(queue.is_cancelled(next_id));
+    queue.set_deadline(0);
+    BOOST_REQUIRE(!queue.is_cancelled(next_id));
+
+    // Ids given out again after a reset are not cancelled.
+    queue.reset();
+    BOOST_REQUIRE(!queue.is_cancelled(queue.produce(tasks.front())));
+}
+
+BOOST_AUTO_TEST_CASE(scylla_queue_cancellation)
+{
+    scylla_blas::scylla_queue::delete_queue(session, 1337);
+    scylla_blas::scylla_queue::create_queue(session, 1337, false, true);
+    auto queue = scylla_blas::scylla_queue(session, 1337);
+    test_queue_cancellation(queue);
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_cancellation)
+{
+    scylla_blas::local_backend backend;
+    backend.create_queue(1337);
+    test_queue_cancellation(*backend.open_queue(1337));
+}
+
+BOOST_AUTO_TEST_CASE(local_worker_abandons_cancelled_subtasks)
+{
+    // Given a main task of a routine whose subtasks were cancelled before a worker got to them.
+    auto backend = std::make_shared<scylla_blas::local_backend>();
+    backend->create_queue(1337);
+    backend->create_queue(1338);
+    auto main_queue = backend->open_queue(1337);
+    auto subtask_queue = backend->open_queue(1338);
+    backend->register_main_queue(1337, scylla_blas::NORMAL);
+    scylla_blas::vector<double>::init(session, 1337, 100 * DEFAULT_BLOCK_SIZE);
+
+    subtask_queue->produce_range(100, 0, 1);
+    subtask_queue->cancel();
+    scylla_blas::proto::task main_task = { .type = scylla_blas::proto::DSCAL,
+                                           .vector_task_double { .task_queue_id = 1338, .alpha = 2, .X_id = 1337 } };
+    int64_t task_id = main_queue->produce(main_task);
+
+    // When a worker takes it.
+    scylla_blas::worker::local_worker_pool pool(session, backend, 1, DEFAULT_LOCAL_WORKER_SLEEP_TIME_MICROSECONDS);
+    while (!main_queue->is_finished(task_id)) {
+        scylla_blas::wait_microseconds(1000);
+    }
+
+    // Then it reports the cancellation, without performing the subtasks.
+    BOOST_REQUIRE_EQUAL(main_queue->get_response(task_id)->type, scylla_blas::proto::R_CANCELLED);
+    BOOST_REQUIRE_EQUAL(subtask_queue->get_finished(0, 100).size(), 0);
+}
+
+static void test_main_queue_registry(scylla_blas::queue_backend &backend) {
+    using scylla_blas::priority_class;
+    auto registered = [&backend] (priority_class priority, int64_t id) {
+        auto queues = backend.list_main_queues();
+        return std::find(queues.begin(), queues.end(), std::make_pair(priority, id)) != queues.end();
+    };
+
+    backend.register_main_queue(1338, scylla_blas::BATCH);
+    backend.register_main_queue(1337, scylla_blas::INTERACTIVE);
+    BOOST_REQUIRE(registered(scylla_blas::INTERACTIVE, 1337));
+    BOOST_REQUIRE(registered(scylla_blas::BATCH, 1338));
+    BOOST_REQUIRE(!registered(scylla_blas::NORMAL, 1337));
+
+    // Listed by priority class, the most important first.
+    auto queues = backend.list_main_queues();
+    BOOST_REQUIRE(std::is_sorted(queues.begin(), queues.end()));
+
+    backend.unregister_main_queue(1337, scylla_blas::INTERACTIVE);
+    backend.unregister_main_queue(1338, scylla_blas::BATCH);
+    BOOST_REQUIRE(!registered(scylla_blas::INTERACTIVE, 1337));
+    BOOST_REQUIRE(!registered(scylla_blas::BATCH, 1338));
+}
+
+BOOST_AUTO_TEST_CASE(scylla_main_queue_registry)
+{
+    scylla_blas::scylla_backend backend(session);
+    test_main_queue_registry(backend);
+}
+
+BOOST_AUTO_TEST_CASE(local_main_queue_registry)
+{
+    scylla_blas::local_backend backend;
+    test_main_queue_registry(backend);
+
+    /* Queues whose schedulers stop renewing their registration are forgotten */
+    backend.register_main_queue(1339, scylla_blas::NORMAL, 1000);
+    BOOST_REQUIRE_EQUAL(backend.list_main_queues().size(), 1);
+    scylla_blas::wait_microseconds(2000);
+    BOOST_REQUIRE(backend.list_main_queues().empty());
+}
+
+static void test_worker_registry(scylla_blas::queue_backend &backend) {
+    int64_t before = backend.count_live_workers();
+
+    backend.heartbeat_worker(1337, WORKER_HEARTBEAT_TTL_MICROSECONDS);
+    backend.heartbeat_worker(1338, WORKER_HEARTBEAT_TTL_MICROSECONDS);
+    backend.heartbeat_worker(1338, WORKER_HEARTBEAT_TTL_MICROSECONDS);
+    BOOST_REQUIRE_EQUAL(backend.count_live_workers(), before + 2);
+
+    backend.unregister_worker(1337);
+    BOOST_REQUIRE_EQUAL(backend.count_live_workers(), before + 1);
+    backend.unregister_worker(1338);
+    BOOST_REQUIRE_EQUAL(backend.count_live_workers(), before);
+}
+
+BOOST_AUTO_TEST_CASE(scylla_worker_registry)
+{
+    scylla_blas::scylla_backend backend(session);
+    test_worker_registry(backend);
+}
+
+BOOST_AUTO_TEST_CASE(local_worker_registry)
+{
+    scylla_blas::local_backend backend;
+    test_worker_registry(backend);
+
+    /* Workers that stop sending heartbeats expire */
+    backend.heartbeat_worker(1339, 1000);
+    scylla_blas::wait_microseconds(2000);
+    BOOST_REQUIRE_EQUAL(backend.count_live_workers(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(local_worker_pool_registers_workers)
+{
+    auto backend = std::make_shared<scylla_blas::local_backend>();
+    {
+        scylla_blas::worker::local_worker_pool pool(session, backend, 3);
+        /* The first heartbeat is sent before the worker loop starts */
+        while (backend->count_live_workers() < 3) {
+            scylla_blas::wait_microseconds(100);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(backend->count_live_workers(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_load_monitor)
+{
+    // Given a routine whose main task was claimed, with subtasks left in its subtask queue.
+    scylla_blas::local_backend backend;
+    backend.create_queue(1337);
+    backend.create_queue(1338);
+    auto main_queue = backend.open_queue(1337);
+    auto subtask_queue = backend.open_queue(1338);
+    backend.register_main_queue(1337, scylla_blas::NORMAL);
+    scylla_blas::worker::queue_load_monitor monitor(backend);
+    BOOST_REQUIRE_EQUAL(monitor.measure().subtasks, 0);
+
+    scylla_blas::proto::task main_task = { .type = scylla_blas::proto::DSCAL,
+                                           .vector_task_double { .task_queue_id = 1338, .alpha = 2, .X_id = 1337 } };
+    main_queue->produce(main_task);
+    main_queue->produce(main_task);
+    subtask_queue->produce_range(100, 0, 1);
+    auto claimed = main_queue->consume();
+    subtask_queue->consume(30);
+
+    // Then the load counts the main task not claimed yet, and the subtasks left.
+    auto load = monitor.measure();
+    BOOST_REQUIRE_EQUAL(load.main_tasks, 1);
+    BOOST_REQUIRE_EQUAL(load.subtasks, 70);
+
+    // And finished routines are not counted.
+    main_queue->consume();
+    main_queue->mark_as_finished(claimed->first);
+    main_queue->mark_as_finished(claimed->first + 1);
+    load = monitor.measure();
+    BOOST_REQUIRE_EQUAL(load.main_tasks, 0);
+    BOOST_REQUIRE_EQUAL(load.subtasks, 0);
+}
+
+BOOST_AUTO_TEST_CASE(worker_scaler_decisions)
+{
+    scylla_blas::worker::worker_scaler scaler(1, 3, 2);
+    BOOST_REQUIRE_EQUAL(scaler.get_target(), 1);
+
+    /* Each routine in progress has one main task per live worker claimed, so only its subtasks wait */
+    scylla_blas::worker::queue_load backlog = { .main_tasks = 0, .subtasks = 2 * SUPERVISOR_SUBTASKS_PER_WORKER };
+    BOOST_REQUIRE_EQUAL(scaler.update(backlog, 1), 2);
+    BOOST_REQUIRE_EQUAL(scaler.update(backlog, 2), 2);
+    BOOST_REQUIRE_EQUAL(scaler.update({ .main_tasks = 1, .subtasks = 0 }, 2), 3);
+    BOOST_REQUIRE_EQUAL(scaler.update({ .main_tasks = 1, .subtasks = 0 }, 3), 3);
+
+    /* Scales down only after idle_intervals checks in a row without waiting tasks */
+    BOOST_REQUIRE_EQUAL(scaler.update({}, 3), 3);
+    BOOST_REQUIRE_EQUAL(scaler.update({ .main_tasks = 0, .subtasks = 1 }, 3), 3);
+    BOOST_REQUIRE_EQUAL(scaler.update({}, 3), 3);
+    BOOST_REQUIRE_EQUAL(scaler.update({}, 3), 2);
+    BOOST_REQUIRE_EQUAL(scaler.update({}, 2), 2);
+    BOOST_REQUIRE_EQUAL(scaler.update({}, 2), 1);
+    BOOST_REQUIRE_EQUAL(scaler.update({}, 1), 1);
+    BOOST_REQUIRE_EQUAL(scaler.update({}, 1), 1);
+
+    BOOST_REQUIRE_THROW(scylla_blas::worker::worker_scaler(2, 1, 2), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_metrics)
+{
+    scylla_blas::local_backend backend;
+    backend.create_queue(1338);
+    auto queue = backend.open_queue(1338);
+    auto metrics = scylla_blas::queue_metrics::of(1338);
+    metrics->reset();
+
+    std::vector<scylla_blas::proto::task> tasks(10, { .type = scylla_blas::proto::NONE });
+    queue->produce(tasks);
+    queue->produce(tasks.front());
+    auto claimed = queue->consume(4);
+    BOOST_REQUIRE_EQUAL(claimed.size(), 4);
+    for (auto &[id, task] : claimed) {
+        queue->mark_as_finished(id);
+    }
+    BOOST_REQUIRE(queue->consume(100).size() == 7);
+    BOOST_REQUIRE(queue->consume(100).empty());
+
+    auto snapshot = metrics->get();
+    BOOST_REQUIRE_EQUAL(snapshot.queue_id, 1338);
+    BOOST_REQUIRE_EQUAL(snapshot.produce_calls, 2);
+    BOOST_REQUIRE_EQUAL(snapshot.produced_tasks, 11);
+    BOOST_REQUIRE_EQUAL(snapshot.produce_batch.max, 10);
+    BOOST_REQUIRE_EQUAL(snapshot.claim_calls, 3);
+    BOOST_REQUIRE_EQUAL(snapshot.claimed_tasks, 11);
+    BOOST_REQUIRE_EQUAL(snapshot.empty_claims, 1);
+    BOOST_REQUIRE_EQUAL(snapshot.time_to_claim.count, 2);
+    BOOST_REQUIRE_EQUAL(snapshot.finished_tasks, 4);
+    BOOST_REQUIRE_EQUAL(snapshot.time_to_finish.count, 4);
+    BOOST_REQUIRE_EQUAL(snapshot.depth, 0);
+    BOOST_REQUIRE_EQUAL(snapshot.max_depth, 7);
+
+    // A repeated report of the same task is not measured again.
+    queue->mark_as_finished(claimed.front().first);
+    BOOST_REQUIRE_EQUAL(metrics->get().time_to_finish.count, 4);
+
+    auto all = scylla_blas::queue_metrics::snapshot_all();
+    BOOST_REQUIRE_EQUAL(all.front().queue_id, -1);
+    BOOST_REQUIRE(all.front().produced_tasks >= 11);
+
+    // Once the queue is gone, so are its metrics – only the totals keep them.
+    auto listed = [] {
+        auto all = scylla_blas::queue_metrics::snapshot_all();
+        return std::any_of(all.begin(), all.end(), [] (auto &s) { return s.queue_id == 1338; });
+    };
+    BOOST_REQUIRE(listed());
+    backend.delete_queue(1338);
+    queue = nullptr;
+    metrics = nullptr;
+    BOOST_REQUIRE(!listed());
+    BOOST_REQUIRE_EQUAL(scylla_blas::queue_metrics::of(1338)->get().produced_tasks, 0);
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_release)
+{
+    scylla_blas::local_backend backend;
+    backend.create_queue(1337);
+    auto queue = backend.open_queue(1337);
+
+    std::vector<scylla_blas::proto::task> tasks(2 * QUEUE_PAGE_SIZE + 10, { .type = scylla_blas::proto::NONE });
+    int64_t tasks_id = queue->produce(tasks);
+    for (auto &[id, task] : queue->consume(tasks.size())) {
+        queue->mark_as_finished(id);
+    }
+
+    queue->release(tasks_id + QUEUE_PAGE_SIZE + 5);
+    BOOST_REQUIRE_THROW(queue->get_response(tasks_id), std::runtime_error);
+    BOOST_REQUIRE(queue->is_finished(tasks_id + QUEUE_PAGE_SIZE));
+    BOOST_REQUIRE_EQUAL(queue->get_finished(tasks_id, tasks.size()).size(), tasks.size() - QUEUE_PAGE_SIZE);
+
+    queue->reset();
+    test_queue_batch(*queue);
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_release_concurrent)
+{
+    constexpr int64_t page_count = 8;
+
+    scylla_blas::local_backend backend;
+    backend.create_queue(1337);
+    auto queue = backend.open_queue(1337);
+
+    std::vector<scylla_blas::proto::task> tasks(page_count * QUEUE_PAGE_SIZE, { .type = scylla_blas::proto::NONE });
+    int64_t tasks_id = queue->produce(tasks);
+    for (auto &[id, task] : queue->consume(tasks.size())) {
+        queue->mark_as_finished(id);
+    }
+
+    // Readers keep scanning the pages while they are released under them.
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> readers;
+    for (int64_t t = 0; t < 3; t++) {
+        readers.emplace_back([&] {
+            while (!stop.load()) {
+                queue->get_finished(tasks_id, tasks.size());
+                queue->get_unfinished();
+                queue->claim_stale(0, [] (const scylla_blas::proto::task &) { return true; });
+            }
+        });
+    }
+    for (int64_t page = 1; page <= page_count; page++) {
+        queue->release(tasks_id + page * QUEUE_PAGE_SIZE);
+    }
+    stop.store(true);
+    for (auto &reader : readers) {
+        reader.join();
+    }
+
+    BOOST_REQUIRE(queue->get_finished(tasks_id, tasks.size()).empty());
+    // A late report of a released task is ignored.
+    queue->mark_as_finished(tasks_id);
+    BOOST_REQUIRE(queue->get_finished(tasks_id, tasks.size()).empty());
+}
+
+BOOST_AUTO_TEST_CASE(local_queue_concurrent)
+{
+    constexpr int64_t thread_count = 4;
+    constexpr int64_t tasks_per_thread = 3 * QUEUE_PAGE_SIZE;
+
+    scylla_blas::local_backend backend;
+    backend.create_queue(1337, true, true);
+    auto queue = backend.open_queue(1337);
+
+    std::vector<std::thread> producers;
+    for (int64_t t = 0; t < thread_count; t++) {
+        producers.emplace_back([&queue, t] {
+            for (int64_t i = 0; i < tasks_per_thread; i++) {
+                queue->produce({ .type = scylla_blas::proto::NONE, .basic { .data = t * tasks_per_thread + i } });
+            }
+        });
+    }
+
+    // Every task is claimed by exactly one consumer.
+    std::vector<std::vector<int64_t>> seen(thread_count);
+    std::atomic<int64_t> consumed_count(0);
+    std::vector<std::thread> consumers;
+    for (int64_t t = 0; t < thread_count; t++) {
+        consumers.emplace_back([&, t] {
+            while (consumed_count.load() < thread_count * tasks_per_thread) {
+                for (auto &[id, task] : queue->consume(5)) {
+                    seen[t].push_back(task.basic.data);
+                    queue->mark_as_finished(id);
+                    consumed_count++;
+                }
+            }
+        });
+    }
+
+    for (auto &thread : producers) thread.join();
+    for (auto &thread : consumers) thread.join();
+
+    std::set<int64_t> all;
+    for (auto &values_seen : seen) {
+        for (auto val : values_seen) {
+            BOOST_REQUIRE(all.insert(val).second);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(all.size(), thread_count * tasks_per_thread);
+    BOOST_REQUIRE_EQUAL(queue->get_finished(0, thread_count * tasks_per_thread).size(), all.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+BOOST_AUTO_TEST_SUITE(codec_tests)
+
+static scylla_blas::proto::task roundtrip(const scylla_blas::proto::task &t) {
+    auto bytes = scylla_blas::proto::encode(t);
+    return scylla_blas::proto::decode_task(bytes.data(), bytes.size());
+}
+
+BOOST_AUTO_TEST_CASE(codec_task_roundtrip)
+{
+    scylla_blas::proto::task subtask = { .type = scylla_blas::proto::NONE, .coord { .block_row = 3, .block_column = -7 } };
+    auto decoded = roundtrip(subtask);
+    BOOST_REQUIRE_EQUAL(decoded.coord.block_row, 3);
+    BOOST_REQUIRE_EQUAL(decoded.coord.block_column, -7);
+    BOOST_REQUIRE_LT(scylla_blas::proto::encode(subtask).size(), sizeof(scylla_blas::proto::task));
+
+    scylla_blas::proto::task mixed = {
+            .type = scylla_blas::proto::DTBSV,
+            .mixed_task_double = {
+                    .task_queue_id = 1634000000000000,
+                    .KL = 2, .KU = 2,
+                    .A_id = 5, .TransA = scylla_blas::Trans,
+                    .Uplo = scylla_blas::Lower, .Diag = scylla_blas::Unit, .alpha = 0.1,
+                    .X_id = 1, .beta = -2.5, .Y_id = 6
+            }
+    };
+    decoded = roundtrip(mixed);
+    BOOST_REQUIRE(decoded.type == scylla_blas::proto::DTBSV);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.task_queue_id, 1634000000000000);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.KU, 2);
+    BOOST_REQUIRE(decoded.mixed_task_double.Uplo == scylla_blas::Lower);
+    BOOST_REQUIRE(decoded.mixed_task_double.Diag == scylla_blas::Unit);
+    BOOST_REQUIRE(decoded.mixed_task_double.TransA == scylla_blas::Trans);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.alpha, 0.1);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.beta, -2.5);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.Y_id, 6);
+
+    scylla_blas::proto::task matrix = {
+            .type = scylla_blas::proto::SGEMM,
+            .matrix_task_float = {
+                    .task_queue_id = 11, .A_id = 1, .TransA = scylla_blas::NoTrans, .alpha = 1.5f,
+                    .B_id = 2, .TransB = scylla_blas::Trans, .beta = 0.25f, .C_id = 3
+            }
+    };
+    decoded = roundtrip(matrix);
+    BOOST_REQUIRE_EQUAL(decoded.matrix_task_float.alpha, 1.5f);
+    BOOST_REQUIRE(decoded.matrix_task_float.TransB == scylla_blas::Trans);
+    BOOST_REQUIRE_EQUAL(decoded.matrix_task_float.C_id, 3);
+}
+
+BOOST_AUTO_TEST_CASE(codec_response_roundtrip)
+{
+    scylla_blas::proto::response r{};
+    r.type = scylla_blas::proto::R_DOUBLE_INDEX_VALUE;
+    r.result_max_double_index = { .index = 42, .value = -3.75 };
+    auto bytes = scylla_blas::proto::encode(r);
+    auto decoded = scylla_blas::proto::decode_response(bytes.data(), bytes.size());
+    BOOST_REQUIRE(decoded.type == scylla_blas::proto::R_DOUBLE_INDEX_VALUE);
+    BOOST_REQUIRE_EQUAL(decoded.result_max_double_index.index, 42);
+    BOOST_REQUIRE_EQUAL(decoded.result_max_double_index.value, -3.75);
+
+    // Only the fields of the variant are sent, whatever the rest of the union (or its padding) holds.
+    scylla_blas::proto::response dirty;
+    memset(&dirty, 0xAB, sizeof dirty);
+    dirty.type = scylla_blas::proto::R_FLOAT_INDEX_VALUE;
+    dirty.result_max_float_index = { .index = 7, .value = 0.5f };
+    scylla_blas::proto::response clean{};
+    clean.type = scylla_blas::proto::R_FLOAT_INDEX_VALUE;
+    clean.result_max_float_index = { .index = 7, .value = 0.5f };
+    bytes = scylla_blas::proto::encode(dirty);
+    BOOST_REQUIRE(bytes == scylla_blas::proto::encode(clean));
+    decoded = scylla_blas::proto::decode_response(bytes.data(), bytes.size());
+    BOOST_REQUIRE_EQUAL(decoded.result_max_float_index.index, 7);
+    BOOST_REQUIRE_EQUAL(decoded.result_max_float_index.value, 0.5f);
+
+    scylla_blas::proto::response none = { .type = scylla_blas::proto::R_NONE };
+    bytes = scylla_blas::proto::encode(none);
+    BOOST_REQUIRE(scylla_blas::proto::decode_response(bytes.data(), bytes.size()).type == scylla_blas::proto::R_NONE);
+}
+
+BOOST_AUTO_TEST_CASE(codec_legacy)
+{
+    scylla_blas::proto::task t = { .type = scylla_blas::proto::SSCAL, .vector_task_float = { .task_queue_id = 9, .alpha = 2.0f, .X_id = 4 } };
+
+    // Records written by older schedulers are still read, and can still be written for older workers.
+    scylla_blas::proto::set_wire_version(scylla_blas::proto::WIRE_VERSION_LEGACY);
+    auto bytes = scylla_blas::proto::encode(t);
+    scylla_blas::proto::set_wire_version(scylla_blas::proto::WIRE_VERSION_LATEST);
+    BOOST_REQUIRE_EQUAL(bytes.size(), sizeof(scylla_blas::proto::task));
+
+    auto decoded = scylla_blas::proto::decode_task(bytes.data(), bytes.size());
+    BOOST_REQUIRE_EQUAL(decoded.vector_task_float.task_queue_id, 9);
+    BOOST_REQUIRE_EQUAL(decoded.vector_task_float.alpha, 2.0f);
+    BOOST_REQUIRE_EQUAL(decoded.vector_task_float.X_id, 4);
+
+    bytes.pop_back();
+    BOOST_REQUIRE_THROW(scylla_blas::proto::decode_task(bytes.data(), bytes.size()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(codec_legacy_image)
+{
+    // A DGBMV task as written by schedulers that predate the compact codec (x86-64, little endian).
+    const std::vector<uint8_t> image = {
+            0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // type, padding
+            0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // task_queue_id
+            0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // KL
+            0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // KU
+            0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // A_id
+            0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // TransA, padding
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF8, 0x3F, // alpha
+            0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // X_id
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, // beta
+            0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00  // Y_id
+    };
+    BOOST_REQUIRE_EQUAL(image.size(), sizeof(scylla_blas::proto::task));
+
+    auto decoded = scylla_blas::proto::decode_task(image.data(), image.size());
+    BOOST_REQUIRE(decoded.type == scylla_blas::proto::DGBMV);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.task_queue_id, 7);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.KL, 1);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.KU, 2);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.A_id, 3);
+    BOOST_REQUIRE(decoded.mixed_task_double.TransA == scylla_blas::Trans);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.alpha, 1.5);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.X_id, 4);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.beta, -2.0);
+    BOOST_REQUIRE_EQUAL(decoded.mixed_task_double.Y_id, 5);
 }
 
-BOOST_AUTO_TEST_SUITE_END();
\ No newline at end of file
+BOOST_AUTO_TEST_SUITE_END();
@@ -1,9 +1,11 @@
 #include <boost/test/unit_test.hpp>
 
 #include "scylla_blas/queue/scylla_queue.hh"
+#include "scylla_blas/cost_model.hh"
 #include "scylla_blas/matrix.hh"
 #include "scylla_blas/vector.hh"
 #include "scylla_blas/config.hh"
+#include "scylla_blas/utils/version_bumps.hh"
 #include "fixture.hh"
 
 BOOST_FIXTURE_TEST_SUITE(structure_tests, scylla_fixture)
@@ -34,6 +36,102 @@ BOOST_AUTO_TEST_CASE(matrices)
     BOOST_REQUIRE_EQUAL(matrix.get_column_count(), matrix_2.get_column_count());
 }
 
+BOOST_AUTO_TEST_CASE(matrix_nnz)
+{
+    auto matrix = scylla_blas::matrix<float>::init_and_return(session, 0, 10, 6, true, 4);
+
+    /* Block rows: 1-4, 5-8, 9-10, block columns: 1-4, 5-6 */
+    matrix.insert_value(1, 1, 1);
+    matrix.insert_value(2, 5, 2);
+    matrix.insert_value(9, 6, 3);
+    matrix.insert_value(10, 2, 0); // not inserted
+
+    BOOST_REQUIRE(matrix.get_block_row_nnz() == std::vector<int64_t>({2, 0, 1}));
+    BOOST_REQUIRE(matrix.get_block_column_nnz() == std::vector<int64_t>({1, 2}));
+    BOOST_REQUIRE(matrix.get_block_row_nnz(scylla_blas::Trans) == std::vector<int64_t>({1, 2}));
+
+    auto costs = scylla_blas::product_block_costs(matrix, scylla_blas::NoTrans, matrix, scylla_blas::Trans);
+    BOOST_REQUIRE_EQUAL(costs.size(), 9);
+    BOOST_REQUIRE_EQUAL(costs[0], 2 + 2 + 4);
+    BOOST_REQUIRE_EQUAL(costs[4], 0 + 0 + 4);
+
+    matrix.clear_all();
+    BOOST_REQUIRE(matrix.get_block_row_nnz() == std::vector<int64_t>({0, 0, 0}));
+
+    /* Rewritten values are counted once */
+    scylla_blas::vector_segment<float> rewrites;
+    for (int i = 0; i < 30; i++) {
+        rewrites.emplace_back(1, 1);
+    }
+    matrix.insert_row(5, rewrites);
+    BOOST_REQUIRE(matrix.get_block_row_nnz() == std::vector<int64_t>({0, 1, 0}));
+    BOOST_REQUIRE(matrix.get_block_column_nnz() == std::vector<int64_t>({1, 0}));
+
+    /* The count of a block written whole is kept, until a partial write or a cleared row drops it */
+    std::vector<scylla_blas::matrix_value<float>> values = {{1, 1, 1}, {2, 2, 2}};
+    matrix.insert_whole_block(3, 2, scylla_blas::matrix_block<float>(values));
+    BOOST_REQUIRE(matrix.get_block_nnz() == std::vector<int64_t>({0, 0, 1, 0, 0, 2}));
+    matrix.insert_value(10, 5, 3);
+    BOOST_REQUIRE(matrix.get_block_nnz() == std::vector<int64_t>({0, 0, 1, 0, 0, 3}));
+    matrix.clear_row(9);
+    BOOST_REQUIRE(matrix.get_block_nnz() == std::vector<int64_t>({0, 0, 1, 0, 0, 2}));
+    BOOST_REQUIRE(scylla_blas::update_block_costs(matrix) == std::vector<int64_t>({4, 4, 5, 4, 4, 6}));
+    matrix.clear_all();
+
+    /* Matrices initialized before the counts were kept can still be opened and written, without estimates */
+    session->execute("DROP TABLE blas.matrix_0_block_nnz;");
+    auto old_matrix = scylla_blas::matrix<float>(session, 0);
+    old_matrix.insert_value(1, 1, 1);
+    BOOST_REQUIRE(old_matrix.get_block_nnz().empty());
+    BOOST_REQUIRE(scylla_blas::product_block_costs(old_matrix, scylla_blas::NoTrans, old_matrix, scylla_blas::Trans).empty());
+    BOOST_REQUIRE_EQUAL(old_matrix.get_value(1, 1), 1);
+    scylla_blas::basic_matrix::clear(session, 0);
+    BOOST_REQUIRE(scylla_blas::matrix<float>(session, 0).get_block_row_nnz() == std::vector<int64_t>({0, 0, 0}));
+}
+
+BOOST_AUTO_TEST_CASE(structure_versions)
+{
+    auto matrix = scylla_blas::matrix<float>::init_and_return(session, 0, 8, 8, true);
+    auto vector = scylla_blas::vector<float>::init_and_return(session, 0, 8);
+    int64_t matrix_version = matrix.get_version();
+    int64_t vector_version = vector.get_version();
+
+    /* A new handle sees the same version until the structure is written to */
+    BOOST_REQUIRE_EQUAL(scylla_blas::matrix<float>(session, 0).get_version(), matrix_version);
+    BOOST_REQUIRE_EQUAL(scylla_blas::vector<float>(session, 0).get_version(), vector_version);
+
+    matrix.insert_value(1, 1, 1);
+    vector.update_value(1, 1);
+    BOOST_REQUIRE_GT(scylla_blas::matrix<float>(session, 0).get_version(), matrix_version);
+    BOOST_REQUIRE_GT(scylla_blas::vector<float>(session, 0).get_version(), vector_version);
+
+    /* Within a scope, the bumps of all writes are made once, when it is flushed */
+    vector_version = scylla_blas::vector<float>(session, 0).get_version();
+    {
+        scylla_blas::version_bump_scope bumps;
+        vector.update_value(2, 2);
+        vector.update_value(3, 3);
+        BOOST_REQUIRE_EQUAL(scylla_blas::vector<float>(session, 0).get_version(), vector_version);
+        bumps.flush();
+    }
+    BOOST_REQUIRE_EQUAL(scylla_blas::vector<float>(session, 0).get_version(), vector_version + 1);
+
+    matrix_version = scylla_blas::matrix<float>(session, 0).get_version();
+    scylla_blas::basic_matrix::clear(session, 0);
+    BOOST_REQUIRE_GT(scylla_blas::matrix<float>(session, 0).get_version(), matrix_version);
+}
+
+BOOST_AUTO_TEST_CASE(longest_first_assignment)
+{
+    std::vector<int64_t> costs = {1, 7, 2, 5, 3, 4};
+    BOOST_REQUIRE(scylla_blas::is_skewed({1, 1, 10}));
+    BOOST_REQUIRE(!scylla_blas::is_skewed(costs));
+
+    /* 7 -> 0, 5 -> 1, 4 -> 1, 3 -> 0, 2 -> 1, 1 -> 0: loads 11 and 11 */
+    auto assignment = scylla_blas::assign_longest_first(costs, 2);
+    BOOST_REQUIRE(assignment == std::vector<size_t>({0, 0, 1, 1, 0, 1}));
+}
+
 BOOST_AUTO_TEST_CASE(vector_segments)
 {
     auto vector_1 = scylla_blas::vector_segment<float>();